@@ -0,0 +1,282 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "Benchmark.h"
+#include <chrono>
+#include <ctime>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <iomanip>
+#include <map>
+#include <cmath>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+vector<pair<string,string> > Benchmark::options;
+
+
+static double RealClock()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double CPUClock()
+{
+    // all threads of the process, as cpu_time of Google Benchmark
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID,&ts);
+    return ts.tv_sec + ts.tv_nsec * 1.E-9;
+}
+
+
+BenchmarkState::BenchmarkState(const vector<long> &args, long maxIterations)
+    : args(args), maxIterations(maxIterations)
+{
+}
+
+void BenchmarkState::Start()
+{
+    running   = true;
+    realStart = RealClock();
+    cpuStart  = CPUClock();
+}
+
+void BenchmarkState::Stop()
+{
+    if(!running) return;
+    realSeconds += RealClock() - realStart;
+    cpuSeconds  += CPUClock()  - cpuStart;
+    running = false;
+}
+
+bool BenchmarkState::KeepRunning()
+{
+    if(count==0) Start();
+    if(count<maxIterations)
+    {
+        count++;
+        return true;
+    }
+    Stop();
+    return false;
+}
+
+void BenchmarkState::PauseTiming()
+{
+    Stop();
+}
+
+void BenchmarkState::ResumeTiming()
+{
+    Start();
+}
+
+
+vector<Benchmark*> &Benchmark::Registry()
+{
+    static vector<Benchmark*> registry;
+    return registry;
+}
+
+Benchmark *Benchmark::Register(const string &name, BenchmarkFunc func)
+{
+    Benchmark *bench = new Benchmark;
+    bench->name = name;
+    bench->func = func;
+    Registry().push_back(bench);
+    return bench;
+}
+
+Benchmark *Benchmark::Args(const vector<long> &args)
+{
+    argsList.push_back(args);
+    return this;
+}
+
+Benchmark *Benchmark::Iterations(long n)
+{
+    fixedIterations = n;
+    return this;
+}
+
+string Benchmark::GetOption(const string &key, const string &defaultValue)
+{
+    for(size_t i=0;i<options.size();i++)
+    {
+        if(options[i].first==key) return options[i].second;
+    }
+    return defaultValue;
+}
+
+Benchmark::Result Benchmark::Run(const Benchmark &bench, const vector<long> &args, double minTime)
+{
+    Result result;
+    result.name = bench.name;
+    for(size_t i=0;i<args.size();i++) result.name += "/" + to_string(args[i]);
+
+    // grow the iteration number until the loop is long enough to time
+    long n = bench.fixedIterations ? bench.fixedIterations : 1;
+    while(true)
+    {
+        BenchmarkState state(args,n);
+        bench.func(state);
+
+        if(bench.fixedIterations || state.realSeconds>=minTime || n>=1000000000)
+        {
+            result.iterations     = n;
+            result.realTime       = state.realSeconds / n * 1.E9;
+            result.cpuTime        = state.cpuSeconds  / n * 1.E9;
+            result.itemsPerSecond = state.realSeconds>0 ? state.itemsProcessed / state.realSeconds : 0.E0;
+            result.label          = state.label;
+            return result;
+        }
+        double multiplier = state.realSeconds>0 ? 1.4 * minTime / state.realSeconds : 100;
+        n = max(n + 1, min(n * 100, long(n * multiplier)));
+    }
+}
+
+void Benchmark::WriteJSON(const string &fileName, const vector<Result> &results)
+{
+    ofstream fout(fileName);
+    time_t now = time(NULL);
+    char date[64];
+    strftime(date,sizeof(date),"%Y-%m-%dT%H:%M:%S",localtime(&now));
+    int threads = 1;
+#ifdef _OPENMP
+    threads = omp_get_max_threads();
+#endif
+
+    fout<<"{"<<endl;
+    fout<<"  \"context\": {"<<endl;
+    fout<<"    \"date\": \""<<date<<"\","<<endl;
+    fout<<"    \"num_cpus\": "<<thread::hardware_concurrency()<<","<<endl;
+    fout<<"    \"omp_threads\": "<<threads<<endl;
+    fout<<"  },"<<endl;
+    fout<<"  \"benchmarks\": ["<<endl;
+    fout<<setprecision(10);
+    for(size_t i=0;i<results.size();i++)
+    {
+        fout<<"    {"<<endl;
+        fout<<"      \"name\": \""<<results[i].name<<"\","<<endl;
+        fout<<"      \"iterations\": "<<results[i].iterations<<","<<endl;
+        fout<<"      \"real_time\": "<<results[i].realTime<<","<<endl;
+        fout<<"      \"cpu_time\": "<<results[i].cpuTime<<","<<endl;
+        fout<<"      \"time_unit\": \"ns\"";
+        if(results[i].itemsPerSecond>0) fout<<","<<endl<<"      \"items_per_second\": "<<results[i].itemsPerSecond;
+        if(!results[i].label.empty())    fout<<","<<endl<<"      \"label\": \""<<results[i].label<<"\"";
+        fout<<endl<<"    }"<<(i+1<results.size() ? "," : "")<<endl;
+    }
+    fout<<"  ]"<<endl;
+    fout<<"}"<<endl;
+}
+
+int Benchmark::Compare(const string &fileName, const vector<Result> &results, double tolerance)
+{
+    // the baseline is a file of WriteJSON (or of Google Benchmark), only name and real_time are read
+    ifstream fin(fileName);
+    if(!fin.is_open())
+    {
+        cerr<<"baseline "<<fileName<<" can not be opened"<<endl;
+        return 1;
+    }
+    stringstream buffer;
+    buffer<<fin.rdbuf();
+    string text = buffer.str();
+
+    map<string,double> baseline;
+    size_t pos = 0;
+    while((pos = text.find("\"name\": \"",pos))!=string::npos)
+    {
+        pos += 9;
+        string name = text.substr(pos,text.find('"',pos)-pos);
+        size_t next = text.find("\"name\": \"",pos);
+        size_t time = text.find("\"real_time\":",pos);
+        if(time==string::npos || time>next) continue;
+        baseline[name] = stod(text.substr(time+12));
+    }
+
+    int regressions = 0;
+    cout<<endl<<"against "<<fileName<<", tolerance "<<tolerance * 100<<" %"<<endl;
+    for(size_t i=0;i<results.size();i++)
+    {
+        if(baseline.count(results[i].name)==0) continue;
+        double ratio = results[i].realTime / baseline[results[i].name];
+        bool slower  = ratio > 1 + tolerance;
+        regressions += slower;
+        cout<<setw(48)<<left<<results[i].name<<setw(12)<<left<<setprecision(4)<<ratio<<(slower ? "SLOWER" : "")<<endl;
+    }
+    cout<<regressions<<" regressions"<<endl;
+    return regressions>0;
+}
+
+int Benchmark::Main(int argc, char *argv[])
+{
+    for(int i=1;i<argc;i++)
+    {
+        string arg = argv[i];
+        size_t eq  = arg.find('=');
+        if(arg.compare(0,2,"--")!=0 || eq==string::npos)
+        {
+            cerr<<"usage: run_bench [--filter=text] [--min_time=s] [--out=file.json] [--baseline=file.json] [--tolerance=0.1] "
+                <<"[--cases=input_examples] [--turns=n]"<<endl;
+            return 1;
+        }
+        options.push_back(make_pair(arg.substr(2,eq-2),arg.substr(eq+1)));
+    }
+    string filter   = GetOption("filter","");
+    double minTime  = stod(GetOption("min_time","0.5"));
+    string out      = GetOption("out","");
+    string baseline = GetOption("baseline","");
+    double tolerance= stod(GetOption("tolerance","0.1"));
+
+    // the kernels and the tracking report to cout, only the benchmark table is printed
+    ostream report(cout.rdbuf());
+    cout.setstate(ios_base::failbit);
+
+    report<<setw(48)<<left<<"benchmark"<<setw(16)<<left<<"time [ns]"<<setw(16)<<left<<"cpu [ns]"
+          <<setw(14)<<left<<"iterations"<<setw(16)<<left<<"items/s"<<endl;
+
+    vector<Result> results;
+    vector<Benchmark*> &registry = Registry();
+    for(size_t b=0;b<registry.size();b++)
+    {
+        vector<vector<long> > argsList = registry[b]->argsList;
+        if(argsList.empty()) argsList.push_back(vector<long>());
+        for(size_t a=0;a<argsList.size();a++)
+        {
+            string name = registry[b]->name;
+            for(size_t i=0;i<argsList[a].size();i++) name += "/" + to_string(argsList[a][i]);
+            if(name.find(filter)==string::npos) continue;
+
+            Result result = Run(*registry[b],argsList[a],minTime);
+            results.push_back(result);
+            report<<setw(48)<<left<<result.name
+                  <<setw(16)<<left<<setprecision(6)<<result.realTime
+                  <<setw(16)<<left<<result.cpuTime
+                  <<setw(14)<<left<<result.iterations
+                  <<setw(16)<<left<<result.itemsPerSecond
+                  <<result.label<<endl;
+        }
+    }
+    cout.clear();
+
+    if(!out.empty()) WriteJSON(out,results);
+    if(!baseline.empty()) return Compare(baseline,results,tolerance);
+    return 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+    return Benchmark::Main(argc,argv);
+}
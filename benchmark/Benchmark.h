@@ -0,0 +1,99 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef Benchmark_H
+#define Benchmark_H
+
+#include <vector>
+#include <string>
+#include <functional>
+
+using namespace std;
+
+// Minimal benchmark harness in the style of Google Benchmark, for the run_bench target (make bench).
+// A benchmark is a function of a BenchmarkState, registered with BENCHMARK(name) and one Args() per parameter set:
+//
+//     static void BM_Kernel(BenchmarkState &state)
+//     {
+//         ... setup with state.range(0) particles ...
+//         while(state.KeepRunning()) Kernel();
+//         state.SetItemsProcessed(state.iterations() * state.range(0));
+//     }
+//     BENCHMARK(BM_Kernel)->Args({10000})->Args({100000});
+//
+// The iteration number grows until the timed loop takes --min_time seconds, or it is fixed by Iterations().
+class BenchmarkState
+{
+
+public:
+    BenchmarkState(const vector<long> &args, long maxIterations);
+
+    bool   KeepRunning();                       // true maxIterations times, the clock runs from the first call
+    void   PauseTiming();                       // setup inside the loop that is not to be timed
+    void   ResumeTiming();
+    long   range(int i) const {return args[i];}
+    long   iterations() const {return maxIterations;}
+    void   SetItemsProcessed(double items) {itemsProcessed = items;}
+    void   SetLabel(const string &text) {label = text;}
+
+    double realSeconds = 0.E0;
+    double cpuSeconds  = 0.E0;
+    double itemsProcessed = 0.E0;
+    string label;
+
+private:
+    vector<long> args;
+    long maxIterations;
+    long count   = 0;
+    bool running = false;
+    double realStart = 0.E0;
+    double cpuStart  = 0.E0;
+
+    void Start();
+    void Stop();
+};
+
+class Benchmark
+{
+
+public:
+    typedef function<void(BenchmarkState&)> BenchmarkFunc;
+
+    static Benchmark *Register(const string &name, BenchmarkFunc func);
+    static int Main(int argc, char *argv[]);    // --filter= --min_time= --out= --baseline= --tolerance=
+    static string GetOption(const string &key, const string &defaultValue);     // --key=value of the command line
+
+    Benchmark *Args(const vector<long> &args);
+    Benchmark *Iterations(long n);              // fixed iteration number, e.g. the tracking runs
+
+private:
+    string name;
+    BenchmarkFunc func;
+    vector<vector<long> > argsList;
+    long fixedIterations = 0;
+
+    struct Result
+    {
+        string name;
+        long   iterations;
+        double realTime;                        // ns per iteration
+        double cpuTime;
+        double itemsPerSecond;
+        string label;
+    };
+    static vector<Benchmark*> &Registry();
+    static vector<pair<string,string> > options;
+    static Result Run(const Benchmark &bench, const vector<long> &args, double minTime);
+    static void   WriteJSON(const string &fileName, const vector<Result> &results);
+    static int    Compare(const string &fileName, const vector<Result> &results, double tolerance);
+};
+
+#define BENCHMARK(func) static Benchmark *benchmark_##func = Benchmark::Register(#func, func)
+
+
+#endif
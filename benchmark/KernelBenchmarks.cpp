@@ -0,0 +1,380 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "Benchmark.h"
+#include "Global.h"
+#include "ReadInputSettings.h"
+#include "LatticeInterActionPoint.h"
+#include "Train.h"
+#include "CavityResonator.h"
+#include "MPBeam.h"
+#include "WakeFunction.h"
+#include "BoardBandImp.h"
+#include "PIC2D.h"
+#include "PIC3D.h"
+#include "Faddeeva.h"
+#include "FFTWPlanCache.h"
+#include "BassettiErskineField.h"
+#include "RandomStream.h"
+#include <random>
+#include <unistd.h>
+
+using namespace std;
+
+// Micro benchmarks of the tracking kernels. The machine is the MP setup of --input (default the PETRA IV example)
+// with the particle, bunch and bin numbers of the benchmark arguments.
+
+
+// relative file names of an input (twiss, wakes) are resolved in its directory
+class InputDirectory
+{
+public:
+    InputDirectory(const string &inputFile)
+    {
+        char buffer[4096];
+        cwd = getcwd(buffer,sizeof(buffer)) ? buffer : ".";
+        size_t slash = inputFile.rfind('/');
+        fileName = inputFile.substr(slash==string::npos ? 0 : slash+1);
+        if(slash!=string::npos && chdir(inputFile.substr(0,slash).c_str())!=0)
+        {
+            cerr<<"directory of "<<inputFile<<" can not be entered"<<endl;
+            exit(0);
+        }
+    }
+    ~InputDirectory()
+    {
+        if(chdir(cwd.c_str())!=0) cerr<<"can not return to "<<cwd<<endl;
+    }
+    string fileName;
+private:
+    string cwd;
+};
+
+struct BenchMachine
+{
+    ReadInputSettings       inputParameter;
+    LatticeInterActionPoint latticeInterActionPoint;
+    Train                   train;
+    CavityResonator         cavityResonator;
+    MPBeam                  beam;
+    WakeFunction            sRWakeFunction;
+
+    BenchMachine(long particles, long bunches=1, long bins=100)
+    {
+        InputDirectory dir(Benchmark::GetOption("input","input_examples/Petra4_LS/input.dat"));
+        char *argv[2] = {(char*)"run_bench", (char*)dir.fileName.c_str()};
+        inputParameter.ParamRead(2,argv);
+
+        // MP tracking, an even fill of the given bunches, the bins of the RF and short range wake kernels
+        int harmonics = inputParameter.ringParBasic->harmonics;
+        int bunchGap  = harmonics / bunches - 1;
+        ReadInputSettings::RingFillPatt *fill = inputParameter.ringFillPatt;
+        fill->trainNumber         = 1;
+        fill->totBunchNumber      = bunches;
+        fill->bunchNumberPerTrain = vector<int>(1,bunches);
+        fill->bunchGaps           = vector<int>(1,bunchGap);
+        fill->trainGaps           = vector<int>(1,harmonics - bunches * (bunchGap + 1));
+        fill->bunchChargeNum      = 0;
+        inputParameter.ringRun->calSetting              = 2;
+        inputParameter.ringRun->TBTBunchPrintNum        = 0;
+        inputParameter.ringBunchPara->macroEleNumPerBunch = particles;
+        inputParameter.ringParRf->rfBunchBinNum         = bins;
+        inputParameter.ringSRWake->SRWBunchBinNum       = bins;
+
+        FFTWPlanCache::Initial(inputParameter);
+        BassettiErskineField::Initial(inputParameter);
+        RandomStream::Initial(inputParameter);
+
+        latticeInterActionPoint.Initial(inputParameter);
+        latticeInterActionPoint.SetLatticeParaForOneTurnMap(inputParameter);
+        latticeInterActionPoint.GetTransLinearCouplingCoef(inputParameter);
+        latticeInterActionPoint.SetLatticeBRHForSynRad(inputParameter);
+        train.Initial(inputParameter);
+        cavityResonator.Initial(inputParameter);
+        beam.Initial(train,latticeInterActionPoint,inputParameter);
+        beam.InitialcavityResonator(inputParameter,cavityResonator);
+        sRWakeFunction.InitialSRWake(inputParameter,latticeInterActionPoint);
+        beam.MPBeamRMSCal(latticeInterActionPoint,0);
+    }
+};
+
+// normal distributed test data
+static vector<double> Gaussian(long n, double sigma, unsigned seed)
+{
+    mt19937 gen(seed);
+    normal_distribution<double> normal(0.E0,sigma);
+    vector<double> data(n);
+    for(long i=0;i<n;i++) data[i] = normal(gen);
+    return data;
+}
+
+
+static void BM_LatticeMap(BenchmarkState &state)
+{
+    BenchMachine machine(state.range(0));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    while(state.KeepRunning())
+    {
+        bunch.BunchTransferDueToLatticeTSymplectic(machine.inputParameter,machine.latticeInterActionPoint,0);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_LatticeMap)->Args({10000})->Args({100000})->Args({1000000});
+
+static void BM_BeamLatticeMap(BenchmarkState &state)
+{
+    // all bunches, bunch-parallel with runThreads
+    BenchMachine machine(state.range(0),state.range(1));
+    while(state.KeepRunning())
+    {
+        machine.beam.BeamTransferPerInteractionPointDueToLatticeT(machine.inputParameter,machine.latticeInterActionPoint,0);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0) * state.range(1));
+}
+BENCHMARK(BM_BeamLatticeMap)->Args({10000,10})->Args({10000,100});
+
+static void BM_SynRadDamping(BenchmarkState &state)
+{
+    BenchMachine machine(state.range(0));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    while(state.KeepRunning())
+    {
+        bunch.BunchSynRadDamping(machine.inputParameter,machine.latticeInterActionPoint);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SynRadDamping)->Args({10000})->Args({100000})->Args({1000000});
+
+static void BM_BunchMoments(BenchmarkState &state)
+{
+    BenchMachine machine(state.range(0));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    while(state.KeepRunning())
+    {
+        bunch.momentsDirty = true;
+        bunch.GetMPBunchRMS(machine.latticeInterActionPoint,0);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_BunchMoments)->Args({10000})->Args({100000})->Args({1000000});
+
+static void BM_LongitudinalBinning(BenchmarkState &state)
+{
+    // range(1) bins; range(2) = 0: sort of moved particles every time, 1: the same particles on two grids in turn
+    BenchMachine machine(state.range(0));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    int nBins = state.range(1);
+    bunch.GetZMinMax();
+    double dz = (bunch.zMaxCurrentTurn - bunch.zMinCurrentTurn) / nBins;
+    int n = 0;
+    while(state.KeepRunning())
+    {
+        if(state.range(2)==0) bunch.longBinning.Invalidate();
+        double dzGrid = (n++ % 2) ? dz : dz * 1.25;
+        bunch.longBinning.Bin(bunch.ePositionZ.data(),bunch.macroEleNumActive,bunch.zMinCurrentTurn,dzGrid,nBins);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_LongitudinalBinning)->Args({100000,100,0})->Args({100000,100,1})->Args({1000000,1000,0})->Args({1000000,1000,1});
+
+static void BM_SRWake(BenchmarkState &state)
+{
+    BenchMachine machine(state.range(0),1,state.range(1));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    while(state.KeepRunning())
+    {
+        bunch.BunchTransferDueToSRWake(machine.inputParameter,machine.sRWakeFunction,machine.latticeInterActionPoint,0);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_SRWake)->Args({100000,100})->Args({100000,1000})->Args({1000000,1000});
+
+static void BM_BBImpedance(BenchmarkState &state)
+{
+    // broadband resonator impedance on range(1) frequency points, as BoardBandImp::ReadInImp sets it up from a file
+    BenchMachine machine(state.range(0));
+    ReadInputSettings &inputParameter = machine.inputParameter;
+    inputParameter.ringBBImp->timeDomain = 0;
+
+    BoardBandImp boardBandImp;
+    int nFreq = state.range(1);
+    double fR = 20.E9, rs = 5.E3, rsT = 1.E6, q = 1.E0;
+    for(int i=0;i<nFreq;i++)
+    {
+        double f = 100.E9 * i / (nFreq - 1);
+        complex<double> res = (i==0) ? complex<double>(0.E0,0.E0) : 1.E0 / (1.E0 + li * q * (fR / f - f / fR));
+        boardBandImp.freq.push_back(f);
+        boardBandImp.zZImp.push_back (rs  * res);
+        boardBandImp.zDxImp.push_back(rsT * res * fR / max(f,1.E0));
+        boardBandImp.zDyImp.push_back(rsT * res * fR / max(f,1.E0));
+        boardBandImp.zQxImp.push_back(0.E0);
+        boardBandImp.zQyImp.push_back(0.E0);
+    }
+    double rBeta         = inputParameter.ringParBasic->rBeta;
+    boardBandImp.nBins   = nFreq;
+    boardBandImp.freqMax = boardBandImp.freq.back();
+    boardBandImp.dt      = 1.0 / (2 * boardBandImp.freqMax);
+    boardBandImp.tMax    = boardBandImp.dt * (nFreq - 1);
+    boardBandImp.dz      = boardBandImp.dt * CLight * rBeta;
+    boardBandImp.zMax    = boardBandImp.dz * (nFreq - 1);
+    boardBandImp.binPosZ.resize(2*nFreq-1);
+    for(size_t i=0;i<boardBandImp.binPosZ.size();i++) boardBandImp.binPosZ[i] = (- boardBandImp.tMax + i * boardBandImp.dt) * CLight * rBeta;
+    boardBandImp.InitialFFTWBuffer(inputParameter);
+
+    MPBunch &bunch = machine.beam.beamVec[0];
+    bunch.profileForBunchBBImp.resize(2*nFreq-1,0.E0);
+    bunch.wakePotenFromBBI->wakePotenZ.resize(2*nFreq-1,0.E0);
+    bunch.wakePotenFromBBI->wakePotenDx.resize(2*nFreq-1,0.E0);
+    bunch.wakePotenFromBBI->wakePotenDy.resize(2*nFreq-1,0.E0);
+    bunch.wakePotenFromBBI->wakePotenQx.resize(2*nFreq-1,0.E0);
+    bunch.wakePotenFromBBI->wakePotenQy.resize(2*nFreq-1,0.E0);
+
+    while(state.KeepRunning())
+    {
+        bunch.BBImpBunchInteraction(inputParameter,boardBandImp,machine.latticeInterActionPoint);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_BBImpedance)->Args({100000,1024})->Args({100000,8192});
+
+static void BM_RFBinByBin(BenchmarkState &state)
+{
+    BenchMachine machine(state.range(0),1,state.range(1));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    double tRF = machine.inputParameter.ringParBasic->t0 / machine.inputParameter.ringParRf->ringHarm;
+    while(state.KeepRunning())
+    {
+        bunch.GetZMinMax();
+        bunch.timeFromCurrnetBunchToNextBunch = (bunch.bunchGap + 1) * tRF;
+        bunch.BunchMomentumUpdateDuetoRFBinByBin(machine.inputParameter,machine.cavityResonator);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_RFBinByBin)->Args({100000,100})->Args({100000,1000})->Args({1000000,1000});
+
+static void BM_IonBunchInteraction(BenchmarkState &state)
+{
+    // the ion cloud of the ions left by range(1) bunch passages
+    BenchMachine machine(state.range(0));
+    MPBunch &bunch = machine.beam.beamVec[0];
+    LatticeInterActionPoint &lattice = machine.latticeInterActionPoint;
+    for(int j=0;j<state.range(1);j++)
+    {
+        lattice.GetIonNumberPerInterAction(bunch.electronNumPerBunch,0);
+        lattice.IonGenerator(bunch.rmsRx,bunch.rmsRy,bunch.xAver,bunch.yAver,0);
+        lattice.IonsUpdate(0);
+    }
+    lattice.IonRMSCal(0);
+
+    while(state.KeepRunning())
+    {
+        bunch.SSIonBunchInteraction(lattice,0);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+    int ions = 0;
+    for(int p=0;p<lattice.gasSpec;p++) ions += lattice.ionAccumuNumber[0][p];
+    state.SetLabel(to_string(ions) + " macro ions");
+}
+BENCHMARK(BM_IonBunchInteraction)->Args({10000,100})->Args({100000,100})->Args({100000,1000});
+
+static vector<vector<double> > PIC2DParticles(long n)
+{
+    vector<vector<double> > particles(2);
+    particles[0] = Gaussian(n,1.E-5,1);
+    particles[1] = Gaussian(n,5.E-6,2);
+    return particles;
+}
+
+static void BM_PIC2DRho(BenchmarkState &state)
+{
+    PIC2D pic;
+    pic.InitialPIC2D(vector<int>(2,state.range(1)));
+    vector<vector<double> > particles = PIC2DParticles(state.range(0));
+    vector<double> charge(state.range(0),1.E0);
+    pic.Set2DMesh(particles);
+    while(state.KeepRunning())
+    {
+        pic.Set2DRho(particles,charge);
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_PIC2DRho)->Args({100000,64})->Args({100000,256});
+
+static void BM_PIC2DPhi(BenchmarkState &state)
+{
+    PIC2D pic;
+    pic.InitialPIC2D(vector<int>(2,state.range(0)));
+    vector<vector<double> > particles = PIC2DParticles(100000);
+    pic.Set2DMesh(particles);
+    pic.Set2DRho(particles,vector<double>(100000,1.E0));
+    while(state.KeepRunning())
+    {
+        pic.Set2DPhi();
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0) * state.range(0));
+}
+BENCHMARK(BM_PIC2DPhi)->Args({64})->Args({128})->Args({256});
+
+static void BM_PIC2DEField(BenchmarkState &state)
+{
+    PIC2D pic;
+    pic.InitialPIC2D(vector<int>(2,state.range(0)));
+    vector<vector<double> > particles = PIC2DParticles(100000);
+    pic.Set2DMesh(particles);
+    pic.Set2DRho(particles,vector<double>(100000,1.E0));
+    pic.Set2DPhi();
+    while(state.KeepRunning())
+    {
+        pic.Set2DEField();
+    }
+    state.SetItemsProcessed(double(state.iterations()) * state.range(0) * state.range(0));
+}
+BENCHMARK(BM_PIC2DEField)->Args({64})->Args({128})->Args({256});
+
+static void BM_PIC3DPhi1(BenchmarkState &state)
+{
+    // grid range(0) x range(0) x range(1), a gaussian charge density
+    ReadInputSettings inputParameter;
+    inputParameter.ringParBasic->electronBeamEnergy = 6.E9;
+    inputParameter.ringRun->scMeshNum[0] = state.range(0);
+    inputParameter.ringRun->scMeshNum[1] = state.range(0);
+    inputParameter.ringRun->scMeshNum[2] = state.range(1);
+    PIC3D pic;
+    pic.InitialSC3D(inputParameter);
+    vector<double> density = Gaussian(state.range(0) * state.range(0) * state.range(1),1.E0,3);
+    long index = 0;
+    for(int i=0;i<state.range(0);i++)
+        for(int j=0;j<state.range(0);j++)
+            for(int k=0;k<state.range(1);k++) pic.rho(i,j,k) = density[index++];
+
+    while(state.KeepRunning())
+    {
+        pic.Set3DPhi1();
+    }
+    state.SetItemsProcessed(double(state.iterations()) * index);
+}
+BENCHMARK(BM_PIC3DPhi1)->Args({32,33})->Args({64,65});
+
+static void BM_FaddeevaW(BenchmarkState &state)
+{
+    // the argument range of the Bassetti-Erskine kicks
+    long n = state.range(0);
+    vector<double> re = Gaussian(n,3.E0,4);
+    vector<double> im = Gaussian(n,3.E0,5);
+    for(long i=0;i<n;i++) im[i] = fabs(im[i]);
+    volatile double sink = 0.E0;
+    while(state.KeepRunning())
+    {
+        double sum = 0.E0;
+        for(long i=0;i<n;i++) sum += Faddeeva::w(complex<double>(re[i],im[i])).real();
+        sink = sum;
+    }
+    (void)sink;
+    state.SetItemsProcessed(double(state.iterations()) * n);
+}
+BENCHMARK(BM_FaddeevaW)->Args({1000})->Args({100000});
@@ -0,0 +1,92 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "Benchmark.h"
+#include "Global.h"
+#include "ReadInputSettings.h"
+#include "LatticeInterActionPoint.h"
+#include "Train.h"
+#include "CavityResonator.h"
+#include "SPBeam.h"
+#include "MPBeam.h"
+#include "FFTWPlanCache.h"
+#include "BassettiErskineField.h"
+#include "RandomStream.h"
+#include <unistd.h>
+
+using namespace std;
+
+// Macro benchmarks: the example cases of input_examples (--cases) tracked for range(0) turns, as main() runs them.
+// The outputs of the runs are written in the directory of the case.
+
+static void TrackCase(const string &caseDir, const string &inputFile, int turns)
+{
+    char buffer[4096];
+    string cwd = getcwd(buffer,sizeof(buffer)) ? buffer : ".";
+    string dir = Benchmark::GetOption("cases","input_examples") + "/" + caseDir;
+    if(chdir(dir.c_str())!=0)
+    {
+        cerr<<"case directory "<<dir<<" can not be entered"<<endl;
+        exit(0);
+    }
+
+    ReadInputSettings inputParameter;
+    char *argv[2] = {(char*)"run_bench", (char*)inputFile.c_str()};
+    inputParameter.ParamRead(2,argv);
+    inputParameter.ringRun->nTurns = turns;
+
+    FFTWPlanCache::Initial(inputParameter);
+    BassettiErskineField::Initial(inputParameter);
+    RandomStream::Initial(inputParameter);
+
+    LatticeInterActionPoint latticeInterActionPoint;
+    latticeInterActionPoint.Initial(inputParameter);
+    latticeInterActionPoint.SetLatticeParaForOneTurnMap(inputParameter);
+    latticeInterActionPoint.GetTransLinearCouplingCoef(inputParameter);
+    latticeInterActionPoint.SetLatticeBRHForSynRad(inputParameter);
+
+    Train train;
+    train.Initial(inputParameter);
+
+    CavityResonator cavityResonator;
+    cavityResonator.Initial(inputParameter);
+
+    if(inputParameter.ringRun->calSetting==1)
+    {
+        SPBeam spbeam;
+        spbeam.Initial(train,latticeInterActionPoint,inputParameter);
+        spbeam.InitialcavityResonator(inputParameter,cavityResonator);
+        spbeam.Run(train,latticeInterActionPoint,inputParameter,cavityResonator);
+    }
+    else
+    {
+        MPBeam mpbeam;
+        mpbeam.Initial(train,latticeInterActionPoint,inputParameter);
+        mpbeam.InitialcavityResonator(inputParameter,cavityResonator);
+        mpbeam.Run(train,latticeInterActionPoint,inputParameter,cavityResonator);
+    }
+    FFTWPlanCache::Clear();
+
+    if(chdir(cwd.c_str())!=0) cerr<<"can not return to "<<cwd<<endl;
+}
+
+static void BM_Tracking_Petra4_LS(BenchmarkState &state)
+{
+    int turns = stoi(Benchmark::GetOption("turns",to_string(state.range(0))));
+    while(state.KeepRunning()) TrackCase("Petra4_LS","input.dat",turns);
+    state.SetItemsProcessed(double(state.iterations()) * turns);
+}
+BENCHMARK(BM_Tracking_Petra4_LS)->Args({200})->Iterations(1);
+
+static void BM_Tracking_KEK_LS(BenchmarkState &state)
+{
+    int turns = stoi(Benchmark::GetOption("turns",to_string(state.range(0))));
+    while(state.KeepRunning()) TrackCase("KEK_LS","KEK_LS_input.dat",turns);
+    state.SetItemsProcessed(double(state.iterations()) * turns);
+}
+BENCHMARK(BM_Tracking_KEK_LS)->Args({200})->Iterations(1);
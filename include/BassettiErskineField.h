@@ -0,0 +1,50 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+
+#ifndef BassettiErskineField_H
+#define BassettiErskineField_H
+
+#include <vector>
+#include "ReadInputSettings.h"
+
+using namespace std;
+
+// Normalized transverse field of a 2D Gaussian charge (rms rx, ry) at n points, the batched form of Bunch::BassettiErskine1
+// and Bunch::GaussianField used for the beam-ion kicks. The Faddeeva function w(z) is evaluated by the method set with
+// ionCalBEMethod: 0 Faddeeva.cpp (reference, default), 1 Humlicek W4 rational form, 2 Weideman N=32 series,
+// 3 table in units of sigma with Taylor steps from the nearest node. Initial() prints the error against Faddeeva.cpp and the speed.
+class BassettiErskineField
+{
+
+public:
+    enum WMethod {FADDEEVA=0, HUMLICEK=1, WEIDEMAN=2, TABLE=3};
+
+    static void Initial(const ReadInputSettings &inputParameter);
+    static void Report();                   // max relative error of w(z) and time per call of all methods
+    // fx, fy in [1/m], the same convention and round beam / beam centre cases as Bunch::BassettiErskine1 and GaussianField
+    static void Field(int n, const double *posx, const double *posy, double rmsRx, double rmsRy, double *fx, double *fy);
+    // w(x + i y) for x, y >= 0
+    static void W(int n, const double *x, const double *y, double *wRe, double *wIm, int wMethod);
+
+private:
+    static int            method;
+    static double         weidemanL;
+    static vector<double> weidemanCoeff;    // p(Z) = sum_n weidemanCoeff[n] Z^n
+    static vector<double> tableRe;          // w at the nodes (i * tableStep, j * tableStep), i, j = 0...tableNum-1
+    static vector<double> tableIm;
+    static const int      tableNum;
+    static const double   tableStep;
+
+    static void InitialWeideman();
+    static void InitialTable();
+    static void FieldElliptic(int n, const double *posx, const double *posy, double rmsRx, double rmsRy, double *fx, double *fy);
+};
+
+
+#endif
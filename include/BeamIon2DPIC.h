@@ -38,7 +38,7 @@ public:
     PIC2D pic2DBeam;
     PIC2D pic2DIon; 
 
-    void InitialPIC2D();
+    void InitialPIC2D(const ReadInputSettings &inputParameter);
 
 };
 
@@ -15,6 +15,7 @@
 #include "LatticeInterActionPoint.h"
 #include "ReadInputSettings.h"
 #include "Spline.h"
+#include <fftw3.h>
 
 using namespace std;
 using std::vector;
@@ -44,7 +45,18 @@ public:
     double dz;     
     vector<double> binPosZ;
 
+    // work buffers of MPBunch::BBImpBunchInteraction, allocated once and one set per OpenMP thread (bunch-parallel loop).
+    // Only the pointed-to data change during tracking, so they are usable through the const BoardBandImp & of the callers.
+    struct FFTWBuffer
+    {
+        double       *r2cin;          // [2*nBins-1]
+        fftw_complex *r2cout;         // [nBins]
+        fftw_complex *c2rin;          // [nBins]
+    };
+    vector<FFTWBuffer> fftwBuffer;
+
     void ReadInImp(const ReadInputSettings &inputParameter);
+    void InitialFFTWBuffer(const ReadInputSettings &inputParameter);
 private:
 
 };
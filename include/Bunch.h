@@ -19,6 +19,9 @@
 #include "WakeFunction.h"
 #include "Resonator.h"
 #include "Spline.h"
+#include "Checkpoint.h"
+#include "RandomStream.h"
+#include "LongitudinalBinning.h"
 
 
 using std::vector;
@@ -37,19 +40,39 @@ public:
     ~Bunch();
 
     int currentTurnNum = 0;    
+    // seconds in the per-bunch kernels, accumulated with runProfile = 2
+    enum BunchTimer {TIMER_ION=0, TIMER_SPACECHARGE=1, TIMER_LATTICE=2, TIMER_NUM=3};
+    double timer[TIMER_NUM] = {0.E0,0.E0,0.E0};
     int    bunchGap;                // the number of rf period needed for the coming bunch
     int    bunchHarmNum;    
 
-    vector<double> ePositionX;      // m
-    vector<double> ePositionY;
-    vector<double> ePositionZ;    
-    vector<double> eMomentumX;      // rad
-    vector<double> eMomentumY;
-    vector<double> eMomentumZ;
+    // particle coordinates, SoA storage. Particles [0,macroEleNumActive) are alive, lost particles are
+    // compacted to the tail by CompactLostParticle, so the hot loops run over the active range without eSurive checks.
+    v1dAligned ePositionX;      // m
+    v1dAligned ePositionY;
+    v1dAligned ePositionZ;    
+    v1dAligned eMomentumX;      // rad
+    v1dAligned eMomentumY;
+    v1dAligned eMomentumZ;
+    int macroEleNumActive=1;
     vector<double> eFxDueToIon;     // rad  
     vector<double> eFyDueToIon;
     vector<double> eFzDueToIon;
     vector<int> eSurive;         // if not Surive--throw out loss infomation
+
+    // coordinates of lost particles when they are lost, kept for the loss diagnostics
+    struct LostParticle
+    {
+        vector<double> x;
+        vector<double> px;
+        vector<double> y;
+        vector<double> py;
+        vector<double> z;
+        vector<double> pz;
+        vector<int> lossType;        // eSurive value, 1: transverse, 2: longitudinal
+        vector<int> lossTurn;
+    };
+    LostParticle *lostParticle = new LostParticle;
     vector<vector<double> > accPhaseAdvX;    // phaseAdvX[np][3], 0 1
     vector<vector<double> > accPhaseAdvY;    // accumulated phase advance of each particle for tune-spread simulation
     vector<vector<double> > accPhaseAdvZ;    // accumulated phase advance of each particle for tune-spread simulation       
@@ -63,6 +86,7 @@ public:
     double zAverLastTurn=0.E0;
     double pzAverLastTurn=0.E0;
     double transmission=1.E0;
+    bool   beamLost=false;                  // transmission below 0.5 in MarkLostParticle, Run stops at the end of the turn
 
     // for beam loading to get the time distance between bunches
     double zMinCurrentTurn =0.E0;
@@ -103,6 +127,13 @@ public:
     double eigenEmitX,eigenEmitY;
     double emitXY4D=0;
     double xyCouplingAlpha=0;  //rms value in x-y space
+
+    // set by every kernel that moves the particles, MPBunch::GetMPBunchRMS recomputes the moments only when it is set
+    // or when a caller asks for more than the cached momentsLevel
+    bool momentsDirty = true;
+    int  momentsLevel = 0;
+    // z slicing shared by the longitudinal kernels of MPBunch, invalidated by every kernel that changes ePositionZ
+    LongitudinalBinning longBinning;
     int latticeSetionPassedCount = 0;
 
 
@@ -151,6 +182,8 @@ public:
     
     vector<vector<double>> xyzHistoryDataToFit;   
 
+    RandomStream rndGen;                        // stream (BUNCH, bunch index): initial distribution and quantum excitation
+
     
     void Initial(const ReadInputSettings &inputParameter);
     void BassettiErskine1(double posx,double posy,double rmsRxTemp, double rmsRyTemp,double &tempFx,double &tempFy);
@@ -158,6 +191,10 @@ public:
     void BunchTransferDueToIon(const LatticeInterActionPoint &latticeInterActionPoint, int k);
     void BunchTransferDueToLatticeT(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k);
     void BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k);
+    template<bool CHROM, bool ADTS>     // chromaticity / amplitude dependent tune shift terms present, instantiated in Bunch.cpp
+    void BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k);
+    static void LatticeMapOptions(const ReadInputSettings &inputParameter, bool &chrom, bool &adts);
+    void BunchTransferDueToLatticeTSymplecticGSL(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k);   // reference gsl_blas version
     void BunchTransferDueToLatticeOneTurnT66(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint);
 	void BunchTransferDuetoSkewQuad(const ReadInputSettings &inputParameter);
     void InitialAccumPhaseAdV(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter );
@@ -166,6 +203,10 @@ public:
     void BunchLongPosTransferOneTurn(const ReadInputSettings &inputParameter);
     void SetBunchPosHistoryDataWithinWindow();
     void MarkLostParticle(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint);
+    void CompactLostParticle();
+    void ReleaseParticles();                 // MPI: bunch owned by another rank keeps only its moments
+    void SaveState(Checkpoint &checkpoint) const;
+    void LoadState(Checkpoint &checkpoint);
     void BunchSynRadDamping(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint);
     void BunchTransferDueToWake();
     void BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter, const int n);
@@ -191,6 +232,8 @@ public:
     void GetAccumuPhaseAdv(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter);
 
 private:
+    static const int SympMapBlock = 64;      // particles per block in BunchTransferDueToLatticeTSymplectic
+    static void SymplecticMapMatVec(const double (&mat)[6][6], const double (&vecIn)[6][SympMapBlock], double (&vecOut)[6][SympMapBlock], int n);
 
 };
 
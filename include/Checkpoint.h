@@ -0,0 +1,88 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+
+#ifndef Checkpoint_H
+#define Checkpoint_H
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <complex>
+#include <type_traits>
+
+using namespace std;
+
+// Tracking state of MPBeam::Run, one binary file per MPI rank (runCheckpointInterval, runCheckpointFile, runRestartFrom).
+// The classes Put() their members into the buffer and Get() them back in the same order. Commit() writes a temporary
+// file, syncs it and renames it over the previous checkpoint, so a crash during the write keeps the last good one.
+class Checkpoint
+{
+
+public:
+    Checkpoint();
+    ~Checkpoint();
+
+    bool Commit(const string &fileName);
+    bool Load(const string &fileName);          // false: missing file, wrong magic or truncated
+    bool Good() const {return !bad;}            // false after a Get() past the end of the loaded data
+
+    template<class T> void Put(const T &value)                                    // int, double, complex<double>, RandomStream
+    {
+        Append(&value, sizeof(T));
+    }
+    template<class T, class A> void Put(const vector<T,A> &value)
+    {
+        Put(int64_t(value.size()));
+        PutElements(value, is_trivially_copyable<T>());
+    }
+    void Put(const string &value);
+
+    template<class T> void Get(T &value)
+    {
+        Extract(&value, sizeof(T));
+    }
+    template<class T, class A> void Get(vector<T,A> &value)
+    {
+        int64_t n = 0;
+        Get(n);
+        if(n<0 || bad) n = 0;
+        value.resize(n);
+        GetElements(value, is_trivially_copyable<T>());
+    }
+    void Get(string &value);
+
+private:
+    vector<char> data;
+    size_t readPos = 0;
+    bool   bad = false;
+
+    void Append(const void *p, size_t n);
+    void Extract(void *p, size_t n);
+
+    template<class T, class A> void PutElements(const vector<T,A> &value, true_type)
+    {
+        if(!value.empty()) Append(value.data(), value.size() * sizeof(T));
+    }
+    template<class T, class A> void PutElements(const vector<T,A> &value, false_type)
+    {
+        for(size_t i=0;i<value.size();i++) Put(value[i]);
+    }
+    template<class T, class A> void GetElements(vector<T,A> &value, true_type)
+    {
+        if(!value.empty()) Extract(&value[0], value.size() * sizeof(T));
+    }
+    template<class T, class A> void GetElements(vector<T,A> &value, false_type)
+    {
+        for(size_t i=0;i<value.size();i++) Get(value[i]);
+    }
+};
+
+
+#endif
@@ -0,0 +1,43 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef FFTWPlanCache_H
+#define FFTWPlanCache_H
+
+#include <map>
+#include <utility>
+#include <string>
+#include <fftw3.h>
+#include "ReadInputSettings.h"
+
+using namespace std;
+
+// 1D real transforms planned once per size and shared by the whole run. The plans are made on scratch arrays,
+// callers execute them with fftw_execute_dft_r2c/c2r on their own fftw_malloc buffers (same alignment), which is thread safe.
+// Planner rigour (ESTIMATE/MEASURE/PATIENT) and the wisdom file are set in &Run (runFFTWPlanner, runFFTWWisdom).
+class FFTWPlanCache
+{
+
+public:
+    static void      Initial(const ReadInputSettings &inputParameter);  // planner flag and wisdom import
+    static void      ExportWisdom();
+    static void      Clear();
+    static fftw_plan GetPlanR2C(int n);                                  // double[n]         -> fftw_complex[n/2+1]
+    static fftw_plan GetPlanC2R(int n);                                  // fftw_complex[n/2+1] -> double[n], not normalized
+    static fftw_plan GetPlanDFTMany(int n, int howMany);                 // howMany contiguous fftw_complex[n], forward, in place, not normalized
+
+private:
+    static unsigned             plannerFlag;
+    static string               wisdomFile;
+    static map<int, fftw_plan>  planR2C;
+    static map<int, fftw_plan>  planC2R;
+    static map<pair<int,int>, fftw_plan> planDFTMany;
+};
+
+
+#endif
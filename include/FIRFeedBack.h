@@ -12,6 +12,7 @@
 #include <complex>
 #include "Global.h"
 #include "ReadInputSettings.h"
+#include "Checkpoint.h"
 
 
 using namespace std;
@@ -50,6 +51,8 @@ public:
     double fIRBunchByBunchFeedbackKickLimit;// =0.E0;
     
     void Initial(ReadInputSettings &inputParameter);
+    void SaveState(Checkpoint &checkpoint) const;     // bunch position history of the filter
+    void LoadState(Checkpoint &checkpoint);
     
       
 private:
@@ -16,6 +16,8 @@
 #include <string>
 #include <algorithm>
 #include <sys/time.h>
+#include <stdlib.h>
+#include <new>
 
 
 using std::complex;
@@ -40,6 +42,31 @@ const double FactorGaussSI        = VaccumZ0 * CLight / (4 * PI); //[ohm] [m/s]
 const  complex<double> li(0,1);
 
 
+// 64 byte aligned allocator, used by the particle coordinate arrays so that the hot loops vectorize on aligned data
+template <class T>
+struct AlignedAllocator
+{
+    typedef T value_type;
+    static const size_t alignment = 64;
+
+    AlignedAllocator() {}
+    template <class U> AlignedAllocator(const AlignedAllocator<U> &) {}
+    template <class U> struct rebind { typedef AlignedAllocator<U> other; };
+
+    T* allocate(size_t n)
+    {
+        void *p = NULL;
+        if(posix_memalign(&p, alignment, n * sizeof(T)) != 0) throw std::bad_alloc();
+        return static_cast<T*>(p);
+    }
+    void deallocate(T *p, size_t) { free(p); }
+};
+template <class T, class U> bool operator==(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {return true; }
+template <class T, class U> bool operator!=(const AlignedAllocator<T> &, const AlignedAllocator<U> &) {return false;}
+
+using v1dAligned = vector<double, AlignedAllocator<double> >;
+
+
 
 extern double TrackingTime;
 extern int      numProcess;
@@ -47,7 +74,6 @@ extern int      myRank;
 
 
 double cpuSecond();
-double Gaussrand(double rms, double aver,double randomIndex);
 
 void gsl_matrix_mul(gsl_matrix *a,gsl_matrix *b,gsl_matrix *c);
 void gsl_matrix_inv(gsl_matrix *a);
@@ -0,0 +1,51 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP
+//Copyright (c) 2021 DESY
+//This program is free software; you can redistribute it and/or modify
+//it under the terms of the GNU General Public License
+//Author: chao li, li.chao@desy.de
+//*************************************************************************
+
+#ifndef GrowthRateEstimator_H
+#define GrowthRateEstimator_H
+
+#include <vector>
+#include "Checkpoint.h"
+
+using namespace std;
+using std::vector;
+
+// Growth rates of nMode amplitudes while tracking: log(amp) = c0 + c1 * turn is fitted by least squares over the samples
+// with turnStart <= turn < turnEnd, the same fit as FittingGSL::FitALinear on the stored history. Only the running sums
+// of the normal equations are kept, O(nMode) memory whatever the number of turns. Samples with amp <= 0 are skipped.
+class GrowthRateEstimator
+{
+
+public:
+    GrowthRateEstimator() {}
+    ~GrowthRateEstimator() {}
+
+    void   Initial(int nMode, int turnStart, int turnEnd);
+    void   Add(int turn, const vector<double> &amp);
+    double GetRate(int mode) const;          // [1/turn], 0 with less than two samples
+    int    GetMaxRateMode() const;
+    int    GetSampleNum(int mode) const {return sumN[mode];}
+    int    GetModeNum() const {return sumN.size();}
+    void   SaveState(Checkpoint &checkpoint) const;    // running sums, a restart continues the fit
+    void   LoadState(Checkpoint &checkpoint);
+
+    // fastest mode and its rate [1/s] of the three planes to stdout, nothing before two samples
+    static void Report(const GrowthRateEstimator &grX, const GrowthRateEstimator &grY, const GrowthRateEstimator &grZ, double t0);
+
+private:
+    int turnStart = 0;
+    int turnEnd   = 0;
+    vector<int>    sumN;                     // per mode: samples, sum x, x^2, y, x y with x = turn - turnStart, y = log(amp)
+    vector<double> sumX;
+    vector<double> sumXX;
+    vector<double> sumY;
+    vector<double> sumXY;
+};
+
+
+#endif
@@ -14,6 +14,8 @@
 #include <vector>
 #include "ReadInputSettings.h"
 #include <gsl/gsl_matrix.h>
+#include "RandomStream.h"
+#include "Checkpoint.h"
 
 //using namespace std;
 using std::vector;
@@ -81,11 +83,22 @@ public:
     vector<vector<vector<double> > >ionVelocityY;            // m/s
     
 
+    // accumulated macro-ions of one species at one interaction point, one array per coordinate. The arrays reserve
+    // ionMaxNumberOneInterPoint once, IonsUpdate appends and IonTransferDueToBunch compacts in place without reallocation.
+    struct IonStore
+    {
+        v1dAligned x;                                        // m
+        v1dAligned y;                                        // m
+        v1dAligned vx;                                       // m/s
+        v1dAligned vy;                                       // m/s
+        v1dAligned fx;                                       // m/s, velocity kick of the last bunch passage
+        v1dAligned fy;
+        void Reserve(int capacity);
+        void Resize(int n);                                  // within the reserved capacity
+    };
+
     vector<vector<int> >ionAccumuNumber;
-    vector<vector<vector<double> > >ionAccumuPositionX;      // m --  pth type accumulated ions info at ith interction point
-    vector<vector<vector<double> > >ionAccumuPositionY;      // m
-    vector<vector<vector<double> > >ionAccumuVelocityX;      // m/s
-    vector<vector<vector<double> > >ionAccumuVelocityY;      // m/s
+    vector<vector<IonStore> > ionAccumu;                     // pth type accumulated ions info at kth interction point, ionAccumu[k][p]
     
     vector<vector<double> >ionAccumuAverX;
     vector<vector<double> >ionAccumuAverY;
@@ -108,8 +121,7 @@ public:
 	vector<double> phaseAdvY12;
 	vector<double> phaseAdvZ12;
 			
-    vector<vector<vector<double> > >ionAccumuFx;             
-    vector<vector<vector<double> > >ionAccumuFy;             
+    vector<RandomStream> ionRndStream;                      // ion generation, stream (IONSITE, k) at the kth interaction point
       
     int ionMaxNumberOneInterPoint;                          // pth type ions at ith interaction point.  Maxiuimum allowed macro ions number
           
@@ -143,6 +155,8 @@ public:
     void InitialLatticeIonInfo(const ReadInputSettings &inputParameter);
     void InitialLatticeSympMat(const ReadInputSettings &inputParameter);
     void IonGenerator(double rmsRx, double rmsRy, double xAver,double yAver, int k);
+    void SaveIonState(Checkpoint &checkpoint) const;        // accumulated ions and the generator state
+    void LoadIonState(Checkpoint &checkpoint);
     void IonsUpdate(int k);
     void IonRMSCal(int k);
     void IonRMSCal(int k,int p);
@@ -0,0 +1,72 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef LongitudinalBinning_H
+#define LongitudinalBinning_H
+
+#include <vector>
+#include <cmath>
+
+using namespace std;
+
+// Longitudinal slicing of one bunch, shared by the MPBunch kernels that bin the bunch along z (rfmode and bin-by-bin
+// beam loading, short range wake, broadband impedance, 2.5D space charge slices).
+// Bin() puts the particles into nBins bins of length dz from zMin (index floor((z-zMin)/dz), clamped to the grid) with a
+// counting sort: Particles(k) are the Count(k) indices of bin k, contiguous, GetBinIndex()[i] is the bin of particle i.
+// The sort is kept until the grid changes or Invalidate() is called by a kernel that moves the particles in z, so the
+// kernels between two z updates sort the bunch once. A new grid on the same particles is filled in the order of the
+// previous one, i.e. from nearly sorted z.
+// DepositCIC/GatherCIC use cloud-in-cell (linear) weights between the bin centres zMin + (k+1/2) dz.
+class LongitudinalBinning
+{
+
+public:
+    void   Invalidate() {valid = false;}
+    void   Bin(const double *z, int n, double zMin, double dz, int nBins);
+
+    int        GetBinNum()  const {return nBins;}
+    int        Count(int k) const {return binStart[k+1] - binStart[k];}
+    const int *Particles(int k) const {return order.data() + binStart[k];}
+    const int *GetBinIndex() const {return binIndex.data();}
+
+    void   DepositNGP(const double *weight, double scale, double *profile) const;                  // profile[k] += scale * weight[i] over bin k, weight = nullptr: 1
+    void   DepositCIC(const double *z, const double *weight, double scale, double *profile) const;
+
+    inline double GatherCIC(const double *profile, double z) const
+    {
+        int k; double f;
+        CICWeight(z, k, f);
+        if(nBins==1) return profile[0];
+        return (1 - f) * profile[k] + f * profile[k+1];
+    }
+
+private:
+    // the left bin k and the weight f of bin k+1; out of the centres the particle is on the first/last bin only.
+    // nBins = 1 gives k = -1, the callers put everything on bin 0
+    inline void CICWeight(double z, int &k, double &f) const
+    {
+        double u = (z - zMin) / dz - 0.5;
+        k = int(floor(u));
+        f = u - k;
+        if(k<0)            {k = 0;         f = 0.E0;}
+        if(k>nBins-2)      {k = nBins - 2; f = 1.E0;}
+    }
+
+    vector<int> binStart;           // [nBins+1], bin k is order[binStart[k] .. binStart[k+1]-1]
+    vector<int> order;              // particle indices sorted by bin
+    vector<int> binIndex;           // bin of particle i
+    vector<int> previous;           // order of the previous grid while remapping
+    double zMin = 0.E0;
+    double dz   = 1.E0;
+    int    nBins = 0;
+    int    particleNum = 0;
+    bool   valid = false;
+};
+
+
+#endif
@@ -22,6 +22,10 @@
 #include <complex>
 #include "CavityResonator.h" 
 #include "PIC3D.h"
+#include "SDDSWriter.h"
+#include "Ramping.h"
+#include "TrackingPipeline.h"
+#include "GrowthRateEstimator.h"
 
 using namespace std;
 using std::vector;
@@ -36,6 +40,7 @@ public:
     ~MPBeam();
     
     int currentTurnNum = 0;
+    int profileBunch   = 0;         // runProfile = 2: Bunch::timer of the bunch kernels is accumulated
     struct StrongStrongBunchInfo{
 
         double emitYMax;
@@ -70,6 +75,10 @@ public:
     };
     StrongStrongBunchInfo *strongStrongBunchInfo = new StrongStrongBunchInfo;      
     vector<MPBunch> beamVec;
+    // beamVec[bunchStart,bunchEnd) is tracked by this MPI rank (all bunches without MPIMODE). The other bunches keep
+    // only their moments, refreshed each MPBeamRMSCal, which is all the coupled-bunch stages need.
+    int bunchStart = 0;
+    int bunchEnd   = 0;
     vector<vector<double> > bunchZMinZMax; // bunchTMaxTMinTAver[i][0,1] -> [mic,max]
 
     struct QuasiWakePoten{
@@ -83,6 +92,13 @@ public:
     };
     QuasiWakePoten *quasiWakePoten = new QuasiWakePoten;
 
+    // turn-by-turn SDDS files of MPBeamDataPrintPerTurn and SRWakeBeamIntaction, open for the whole run
+    SDDSWriter *tbtBunchAverOut = new SDDSWriter;
+    vector<SDDSWriter*> tbtBunchDisOut;
+    vector<SDDSWriter*> tbtBunchProOut;
+    SDDSWriter *srWakePotenOut = new SDDSWriter;
+    bool tbtFilesOpened = false;                // MPBeamDataPrintPerTurn files opened at its first call
+
     // for GPU, all particle cord 
     // double  *partCord; 
     //
@@ -122,6 +138,10 @@ public:
     vector<double > freXIQDecompScan;
     vector<double > freYIQDecompScan;
     vector<double > freZIQDecompScan;
+    vector<complex<double> > iqTwiddle;     // exp(-li 2 PI Q h_i / H) of bunch i, planes x y z one after the other, GetIQDecomp
+    // mode growth rates fitted while tracking in GetCBMGR, from the ideal and the IQ mode amplitudes
+    GrowthRateEstimator cbmIdealGRX, cbmIdealGRY, cbmIdealGRZ;
+    GrowthRateEstimator cbmIQGRX,    cbmIQGRY,    cbmIQGRZ;
     //--------------------------------------------------------------------------------
 
 
@@ -129,7 +149,7 @@ public:
     vector<double> phaseIQ;
 
     void Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter, CavityResonator &cavityResonator);
-    void MPBeamRMSCal(LatticeInterActionPoint &latticeInterActionPoint, int k);
+    void MPBeamRMSCal(LatticeInterActionPoint &latticeInterActionPoint, int k, int level=MPBunch::MOMENTS_FULL);  // cached per bunch, see MPBunch::GetMPBunchRMS
     void MPGetBeamInfo();
     void MPBeamDataPrintPerTurn(int turns, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter);
     void SSBeamIonEffectOneInteractionPoint(ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint, int nTurns, int k, BeamIon2DPIC &beamIon2DPIC);
@@ -144,6 +164,12 @@ public:
     void Initial(Train &train, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter);
     void InitialcavityResonator(ReadInputSettings &inputParameter,CavityResonator &cavityResonator);    
     void BeamTransferPerInteractionPointDueToLatticeT(const ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint, int k);
+    template<bool CHROM, bool ADTS>
+    void BeamTransferPerInteractionPointDueToLatticeT(const ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint, int k);
+    void BunchTimingReport(const ReadInputSettings &inputParameter);
+    void BuildPipeline(TrackingPipeline &pipeline, ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                       CavityResonator &cavityResonator, Ramping &ramping, FIRFeedBack &firFeedBack, BoardBandImp &boardBandImp,
+                       WakeFunction &lRWakeFunction, WakeFunction &sRWakeFunction, PIC3D &picBeam3D, BeamIon2DPIC &beamIon2DPIC);
     void BeamMomtumUpdateDueToRF(ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint,CavityResonator &cavityResonator);
     void BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint,CavityResonator &cavityResonator);
     void BeamLongiPosTransferOneTurn(const ReadInputSettings &inputParameter);
@@ -159,8 +185,10 @@ public:
     void GetHaissinski(ReadInputSettings &inputParameter,CavityResonator &cavityResonator,WakeFunction &sRWakeFunction);
     void BeamTransferDuetoDriveMode(const ReadInputSettings &inputParameter, const int n);
     void MarkParticleLostInBunch(const ReadInputSettings &inputParameter, const LatticeInterActionPoint &latticeInterActionPoint);
+    bool BeamLost() const;                      // a bunch on any rank below 50% transmission
     void GetDriveModeGrowthRate(const int turns, const ReadInputSettings &inputParameter);
     void GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter);
+    void GetIQDecomp(const vector<double> &x, const vector<double> &y, const vector<double> &z, int harmonics, fftw_complex *iq);
     void GetAnalyticalWithFilter(const ReadInputSettings &inputParameter); 
     vector<complex<double> > GetHilbertAnalytical(vector<double> signal, const double filterBandWithdNu, double workQ);  
     //void SetBeamPosHistoryDataWithinWindow();
@@ -175,6 +203,12 @@ public:
     void BBImpBeamInteraction(const ReadInputSettings &inputParameter, const BoardBandImp &boardBandImp,const LatticeInterActionPoint &latticeInterActionPoint );
     void CopyPartCordToGPU(double *partCord, int totalPartiNum);
     void CopyPartCordFromGPU(double *partCord);
+    void MPISyncBunchMoments();
+    void MPISyncBunchZMinMax();
+    void SaveCheckpoint(int nextTurn, const ReadInputSettings &inputParameter, const LatticeInterActionPoint &latticeInterActionPoint,
+                        const CavityResonator &cavityResonator, const WakeFunction &lRWakeFunction, const FIRFeedBack &firFeedBack);
+    int  LoadCheckpoint(ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                        CavityResonator &cavityResonator, WakeFunction &lRWakeFunction, FIRFeedBack &firFeedBack);   // returns the turn to continue from
 
       		
 private:
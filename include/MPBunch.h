@@ -21,6 +21,7 @@
 #include "Spline.h"
 #include "BoardBandImp.h"
 #include "BeamIon2DPIC.h"
+#include "SDDSWriter.h"
 
 
 using namespace std;
@@ -55,6 +56,9 @@ public:
     double zAverAnalytical;
     double bunchLengthAnalytical;
     vector<vector<double>> srWakePoten;
+    vector<int> srWakeBinPartNum;      // particle number per bin of the last BunchTransferDueToSRWake call
+    double srWakeBinZMin;
+    double srWakeBinDz;
     
 
     // the wakepoten here decleared for solver in frequecy domain
@@ -79,10 +83,18 @@ public:
     void InitialMPBunch(const ReadInputSettings &inputParameter);        
     void DistriGenerator(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter, int i);
     double GSSlover(const double if0);
-    void GetMPBunchRMS(const LatticeInterActionPoint &latticeInterActionPoint, int k);    
+    // CENTROID: xAver...pzAver only. FULL: also the rms sizes, emittances, eigen emittances and z min/max.
+    enum MomentsLevel {MOMENTS_CENTROID=1, MOMENTS_FULL=2};
+    double momentMean[6] = {0};              // (x, px, y, py, z, pz), cached by GetMPBunchRMS
+    double momentCov[6][6] = {{0}};          // central second moments
+    void GetMPBunchRMS(const LatticeInterActionPoint &latticeInterActionPoint, int k, int level=MOMENTS_FULL);
+    void AccumulateMoments(int level);
     void SSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionPoint, int k);
     void SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC,LatticeInterActionPoint &latticeInterActionPoint, int k);
     void BunchTransferDueToSRWake(const  ReadInputSettings &inputParameter, WakeFunction &wakefunction, const LatticeInterActionPoint &latticeInterActionPoint, int turns);
+    void SRWakePotenPrint(SDDSWriter &fout);
+    void SaveState(Checkpoint &checkpoint) const;
+    void LoadState(Checkpoint &checkpoint);
     void GetZMinMax();
     void BBImpBunchInteraction(const ReadInputSettings &inputParameter, const BoardBandImp &boardBandImp, const LatticeInterActionPoint &latticeInterActionPoint);
     void BBImpBunchInteractionTD(const ReadInputSettings &inputParameter,const BoardBandImp &boardBandImp,const LatticeInterActionPoint &latticeInterActionPoint,vector<vector<double>> wakePoten);
@@ -13,6 +13,7 @@
 #include <complex>
 #include <fftw3.h>
 #include "ReadInputSettings.h"
+#include "PICMesh.h"
 using namespace std;
 using std::complex;
 
@@ -35,7 +36,13 @@ public:
     v1i numberOfGrid;          // nx; ny;
     double meshWidth[2] = {0.E0,0E0};           //
     double meshCen[2]   = {0.E0,0E0};
-    void InitialPIC2D(vector<int> meshNum);
+    void InitialPIC2D(vector<int> meshNum, int solver = 0);
+
+    // 0: Dirichlet boundary on the mesh edge, sine transform (FFTW_RODFT00); the mesh is square
+    // 1: open boundary, Hockney doubled grid convolution with the integrated Green function; the mesh length
+    //    follows the rms size in each plane, so flat beams are solved on a flat mesh. The y length is rounded up so that
+    //    the cell aspect ratio hy/hx sits on a geometric ladder (meshAspect) and the Green function is reused
+    int poissonSolver = 0;
 
     double beamrmssize[2];
 
@@ -47,27 +54,45 @@ public:
     v2d partExEyField;
 
 
+    // particle scratch, sized to the largest partNum seen and reused
     v1i partMeshIndX;  // countx[partNum] 
     v1i partMeshIndY;  // county[partNum]
     v1i isPartOutMesh;
-    v2d weigh;
+    v1d weigh;         // [4*partNum], weights of particle i on its 4 mesh points are weigh[4*i+j]
 
-    v2d rho;    // nx*ny
-    v2d phi;
-    v2d ex;
-    v2d ey;
+    PICMesh rho;    // nx*ny
+    PICMesh phi;
+    PICMesh ex;
+    PICMesh ey;
     double range = 10.E0;
 
 
-    double              *in_xy,   *out_xy;
-    fftw_plan           rho_X_Y_To_Rho_Kx_Ky, phi_Kx_Ky_To_Phi_X_Y;
+    // OpenMP: loops over fewer particles (grid points) than parallelMinSize run serially; inside a parallel region
+    // (2.5D slices solved concurrently, one PIC2D per thread) all loops are serial. The charge is deposited on one
+    // private grid per thread (rhoThread), summed afterwards.
+    int parallelMinSize = 8192;
+    v1d rhoThread;
+
+    // sine transform rho -> phi, then in place in phi
+    fftw_plan           rho_X_Y_To_Rho_Kx_Ky = nullptr, phi_Kx_Ky_To_Phi_X_Y = nullptr;
     fftw_r2r_kind       kind_xy_forward[2]  = { FFTW_RODFT00,FFTW_RODFT00 };
     fftw_r2r_kind       kind_xy_backward[2] = { FFTW_RODFT00,FFTW_RODFT00 };
 
+    // open boundary solver: (2nx)*(2ny) real grid and its r2c transform, the transformed Green function of the cell
+    // hx = 1, hy = meshAspect is kept until the aspect ratio changes (greenAspect) and scaled to hx in Set2DPhiIGF
+    double              *rhoIGF = nullptr;
+    fftw_complex        *rhoIGFk = nullptr, *greenIGFk = nullptr;
+    fftw_plan           rhoIGF_X_Y_To_Kx_Ky = nullptr, phiIGF_Kx_Ky_To_X_Y = nullptr;
+    double meshAspect  = 0.E0;                  // hy/hx of the mesh, Set2DMesh
+    double greenAspect = 0.E0;
+
     void Set2DMesh(vector<vector<double>>  &particles);
     void Set2DMesh(double rmsXY[2], double averXY[2]);  // mesh is generated accoring to the rms beam size from the whole bunch
-    void Set2DRho (vector<vector<double>>  &particles, vector<double> charge);    
+    void Set2DRho (vector<vector<double>>  &particles, const vector<double> &charge);    
     void Set2DPhi();
+    void Set2DPhiIGF();
+    void SetIGFGreen();
+    void SetMeshAspect(vector<double> &meshLength, bool squareMesh);
     void Set2DEField();
     void SetPartSCField ();
     void UpdateTransverseMomentum  (vector<vector<double>>  &particles, const double ds);
@@ -14,6 +14,7 @@
 #include <complex>
 #include <fftw3.h>
 #include "PIC2D.h"
+#include "PICMesh.h"
 #include "ReadInputSettings.h"
 using namespace std;
 using std::complex;
@@ -48,28 +49,35 @@ public:
     v2d partEField;
 
 
+    // particle scratch, sized to the largest partNum seen and reused
     v1i partMeshIndX;  // countx[partNum] 
     v1i partMeshIndY;  // county[partNum]
     v1i partMeshIndZ;  // countz[partNum]
     v1i isPartOutMesh;
-    v2d weigh;
+    v1d weigh;         // [8*partNum], weigh[8*i+j]
 
-    v3d rho;    // nx*ny*nz
-    v3d phi;
-    v3d ex;
-    v3d ey;
-    v3d ez;
+    PICMesh rho;    // nx*ny*nz
+    PICMesh phi;
+    PICMesh ex;
+    PICMesh ey;
+    PICMesh ez;
     double range = 10.E0;
 
-    // 3D FFT
-    double              *in_xy,   *out_xy;
-    double              *in,      *out,      *outf;  
-    fftw_complex        *in_z,    *out_z,    *outf_z;
-    fftw_plan           rho_X_Y_Z_To_Rho_KX_KY_Z,  phi_KX_KY_Z_To_Phi_X_Y_Z;
+    // OpenMP as in PIC2D: private charge grids per thread (rhoThread), serial loops below parallelMinSize.
+    // The 3D FFTW plans use all threads (FFTW_THREADS builds) from fftThreadMinGrid = nx*ny*nz grid points on.
+    int parallelMinSize = 8192;
+    int fftThreadMinGrid = 262144;
+    v1d rhoThread;
+
+    // 3D FFT: sine transform in (x,y) from rho to out_xy, complex FFT in z (in_z -> out_z -> outf_z), sine
+    // transform from out_xy to phi
+    double              *out_xy = nullptr;
+    fftw_complex        *in_z = nullptr,    *out_z = nullptr,    *outf_z = nullptr;
+    fftw_plan           rho_X_Y_Z_To_Rho_KX_KY_Z = nullptr,  phi_KX_KY_Z_To_Phi_X_Y_Z = nullptr;
     fftw_r2r_kind       kind_xy_forward[2]  = { FFTW_RODFT00,FFTW_RODFT00 };
     fftw_r2r_kind       kind_xy_backward[2] = { FFTW_RODFT00,FFTW_RODFT00 };
 
-    fftw_plan           rho_KX_KY_Z_To_Rho_KX_KY_KZ,     phi_KX_KY_KZ_To_Phi_KX_KY_Z;
+    fftw_plan           rho_KX_KY_Z_To_Rho_KX_KY_KZ = nullptr,     phi_KX_KY_KZ_To_Phi_KX_KY_Z = nullptr;
   
     void Set3DMesh      (vector<vector<double>>  &particles);        // particles[3 , np], 2d array particle distribution in real space  
     void Set3DRho       (vector<vector<double>>  &particles, double macroCharge);     
@@ -78,14 +86,16 @@ public:
     void SetPartSCField (vector<vector<double>>  &particles);
     void UpdatMomentum  (vector<vector<double>>  &particles, const double ds);
 
-    void Set3DPhi1();
-    double           *in_xyz,   *out_xyz;
-    fftw_plan        rho_X_Y_Z_To_Rho_KX_KY_KZ,  phi_KX_KY_KZ_To_Phi_X_Y_Z;
+    void Set3DPhi1();       // 3D sine transform rho -> phi, then in place in phi
+    fftw_plan        rho_X_Y_Z_To_Rho_KX_KY_KZ = nullptr,  phi_KX_KY_KZ_To_Phi_X_Y_Z = nullptr;
     fftw_r2r_kind    kind_xyz_forward[3]  = { FFTW_RODFT00,FFTW_RODFT00, FFTW_RODFT00 };
     fftw_r2r_kind    kind_xyz_backward[3] = { FFTW_RODFT00,FFTW_RODFT00, FFTW_RODFT00 };
 
     // applied for 2.5D model, sliced in longitudinnal, each longitudianl slice track partilce with a 2D PIC   
+    // one solver per OpenMP thread so that the slices are solved concurrently, slicedBunchPIC2D = slicePIC2D[0]
     PIC2D *slicedBunchPIC2D; 
+    vector<PIC2D*> slicePIC2D;
+    void Set2DMesh(double rmsXY[2], double averXY[2]);   // same transverse mesh in all slicePIC2D
     // set the 1d space charge solver for SC Ez
 
 
@@ -0,0 +1,47 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef PICMesh_H
+#define PICMesh_H
+
+using namespace std;
+
+// One field (rho, phi, ex, ...) on the PIC mesh in a single fftw_malloc'ed (SIMD aligned) array, row-major:
+// (i,j) of a 2D mesh is Data()[i*ny+j], (i,j,k) of a 3D mesh is Data()[(i*ny+j)*nz+k]. This is the layout of the
+// FFTW plans of PIC2D/PIC3D, which transform Data() directly (in place or from one field into another).
+class PICMesh
+{
+
+public:
+    PICMesh() {}
+    ~PICMesh();
+    PICMesh(const PICMesh &) = delete;
+    PICMesh &operator=(const PICMesh &) = delete;
+
+    void Resize(int nx, int ny, int nz = 1);     // zero filled
+    void Zero();
+
+    double       *Data()       {return data;}
+    const double *Data() const {return data;}
+    int           Size() const {return size;}
+
+    inline double &operator()(int i, int j)                    {return data[i * ny + j];}
+    inline double  operator()(int i, int j) const              {return data[i * ny + j];}
+    inline double &operator()(int i, int j, int k)             {return data[(i * ny + j) * nz + k];}
+    inline double  operator()(int i, int j, int k) const       {return data[(i * ny + j) * nz + k];}
+
+private:
+    double *data = nullptr;
+    int nx = 0;
+    int ny = 0;
+    int nz = 1;
+    int size = 0;
+};
+
+
+#endif
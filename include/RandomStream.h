@@ -0,0 +1,48 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef RandomStream_H
+#define RandomStream_H
+
+#include <stdint.h>
+#include "ReadInputSettings.h"
+
+using namespace std;
+
+// Counter based random numbers, Philox4x32-10 (Salmon et al., SC11). The run seed (runRandomSeed) is the key, the
+// counter holds the stream number and the position in the stream, so every bunch and every ion interaction point
+// draws its own sequence: the results do not depend on the thread count or on the MPI bunch distribution.
+// A stream is a plain value (24 bytes + the spare normal), saved as is in the checkpoint.
+class RandomStream
+{
+
+public:
+    enum StreamType {BUNCH=0, IONSITE=1};
+
+    static void     Initial(const ReadInputSettings &inputParameter);   // run seed, 0: from std::random_device
+    static uint64_t GetSeed() {return seed;}
+
+    void   Seed(int type, int index);           // stream (type, index) of the run seed, from its start
+    double Uniform();                           // (0,1)
+    double Normal();                            // N(0,1)
+    void   Normal(int n, double *out);          // n values of N(0,1), the same sequence as n calls of Normal()
+
+private:
+    static uint64_t seed;
+
+    uint64_t key      = 0;
+    uint64_t stream   = 0;
+    uint64_t position = 0;                      // next Philox block
+    double   spare    = 0;                      // second value of the last Box-Muller pair
+    int      hasSpare = 0;
+
+    void NormalPairs(int nPair, double *out);   // 2 * nPair values from nPair blocks
+};
+
+
+#endif
@@ -97,6 +97,7 @@ public:
         vector <double> resDirFBDelay;
         string transResonParWriteTo;
         string methodForVb="soft";
+        int resInitTransient = 0;           // beam induced voltage in InitialcavityResonator, 0: closed form steady state, 1: turn by turn tracking
 
         
     };     
@@ -153,6 +154,8 @@ public:
         int macroIonNumberGeneratedPerIP;
         int   ionInfoPrintInterval;
         int ionCalSCMethod; 
+        int ionCalBEMethod = 0;             // w(z) of the Bassetti-Erskine kicks (BassettiErskineField), 0: Faddeeva 1: Humlicek 2: Weideman 3: table
+        int ionCalPICSolver = 0;            // Poisson solver of the beam-ion PIC (ionCalSCMethod=2), 0: sine transform 1: open boundary IGF
         string ionDisWriteTo;
         string twissInput="twiss.dat"; 
     };
@@ -187,6 +190,7 @@ public:
         string pipeGeoInput;
         string bbrInput;
         int nTurnswakeTrunction = 10;
+        int recursion = 0;                  // 1: BBR modes propagated as phasors bunch to bunch (no truncation), RW table keeps the turn sum
         string lrwOutput;
     };    
     RingLRWake * ringLRWake =  new RingLRWake;    
@@ -246,6 +250,20 @@ public:
         int rampFlag;
         int spaceChargeFlag = 0;
         int scMeshNum[3] = {32,32,33};
+        int scPICSolver = 0;                // Poisson solver of the 2.5D space charge slices, 0: sine transform 1: open boundary IGF
+        int threads = 1;                    // OpenMP threads for the bunch-parallel stages in MPBeam::Run; 0: OpenMP default
+        int symplecticMapGSL = 0;           // 1: gsl_blas reference one-section map in Bunch::BunchTransferDueToLatticeTSymplectic
+        int fftwPlanner = 0;                // FFTWPlanCache planner rigour, 0: ESTIMATE, 1: MEASURE, 2: PATIENT
+        string fftwWisdom;                  // FFTW wisdom file, imported at start and exported at the end of the run
+        int sddsBinary = 1;                 // turn-by-turn SDDS outputs (SDDSWriter), 1: binary pages, 0: ascii for debugging
+        unsigned long long randomSeed = 0;  // RandomStream key of the run, 0: drawn from std::random_device and printed
+        int checkpointInterval = 0;         // MP tracking state is written every checkpointInterval turns, 0: off
+        string checkpointFile = "checkpoint.bin";   // with MPI one file per rank, checkpointFile.<rank>
+        string restartFrom;                 // checkpoint file (prefix with MPI) the tracking continues from
+        int profileFlag = 0;                // timing of the turn stages, 0: off, 1: per stage, 2: also per bunch
+        string profileFile = "Timing";      // profileFile.sdds per turn and stage, profileFile_Bunch.sdds per bunch
+        int binningCIC = 0;                 // profiles of the short range wake and broadband impedance, 0: nearest bin, 1: cloud-in-cell
+        int cbmHistory = 1;                 // runCBMGR keeps the turn by turn histories (columns, Hilbert and bunch growth rates), 0: streaming mode growth rates only
         vector<int> TBTBunchDisDataBunchIndex;
         string TBTBunchAverData;
         string TBTBunchDisData;
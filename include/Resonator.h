@@ -12,6 +12,7 @@
 #include "ReadInputSettings.h"
 #include <vector>
 #include <complex>
+#include <map>
 
 // resonator is used as cavities
 
@@ -49,20 +50,20 @@ public:
     double robinsonDCStable = 1;
     
     // to get the initial status of generator
-    complex<double> resGenVgr = (0.0,0.0);      // generator voltage on resonance
-    complex<double> resGenIg  = (0.0,0);        // generator current
+    complex<double> resGenVgr = 0.E0;           // generator voltage on resonance
+    complex<double> resGenIg  = 0.E0;           // generator current
     double resBeamPower  = 0.0;
     double resCavPower  = 0.0;
     double resGenPower   = 0.0;
     double resGenPowerReflect   = 0.0;
 
  
-    complex<double> resCavVolReq=(0,0);     // it is the target value -- take into the self-beam loading voltage into account.   
-    complex<double> resGenVol=(0,0);        // in the cos  convention used in the code, the real part represents the momentum change
-    complex<double> vbAccum=(0,0);          // used in the tracking, record transient  cavity voltage
-    complex<double> vbAccum0=(0,0);          // used in the tracking,record transient cavity voltage in omegarf frame 
-    complex<double> vbAccumRFFrame=(0,0);          // used in the tracking,record transient cavity voltage in omegarf frame    
-    complex<double> resGenVolFB=(0.0,0);    // ref. PRAB 24, 104401 2021 Eq. (9). 
+    complex<double> resCavVolReq=0.E0;      // it is the target value -- take into the self-beam loading voltage into account.   
+    complex<double> resGenVol=0.E0;         // in the cos  convention used in the code, the real part represents the momentum change
+    complex<double> vbAccum=0.E0;           // used in the tracking, record transient  cavity voltage
+    complex<double> vbAccum0=0.E0;           // used in the tracking,record transient cavity voltage in omegarf frame 
+    complex<double> vbAccumRFFrame=0.E0;           // used in the tracking,record transient cavity voltage in omegarf frame    
+    complex<double> resGenVolFB=0.E0;       // ref. PRAB 24, 104401 2021 Eq. (9). 
 
 
     int resDirFB = 0;
@@ -84,7 +85,10 @@ public:
     };     
     FilterCavFB *filterCavFB = new FilterCavFB;
 
-    complex<double> vBSampleTemp=(0,0);
+    // samples at n*tRF (GetResonatorInfoAtNTrf) are taken only with sampleAtNTrf = 1: direct feedback (resDirFB) and the
+    // SPBeam cavity output read them at the bunch buckets
+    int sampleAtNTrf = 1;
+    complex<double> vBSampleTemp=0.E0;
     vector<complex<double> > vBSample;
     vector<complex<double> > vCavSample;
     vector<complex<double> > deltaVCavSample;
@@ -111,9 +115,33 @@ public:
     void GetBeamInducedVol(double timeToNextBunch);
     void ResonatorDynamics(double time);
     void GetResonatorInfoAtNTrf(int harmIndex,double dt);
+    // bunch at harmonic harmIndex to the next one nBuckets later: sample (if sampleAtNTrf) at the bunch bucket, then
+    // resGenVol advanced over the whole gap in one step, the same as nBuckets calls of ResonatorDynamics(tRF)
+    void AdvanceBuckets(int harmIndex, int nBuckets, double tRF, double dt);
+
+    // transient state changed by the bunch passages (vbAccum, resGenVol, samples at n*tRF), flattened to doubles
+    // so that it can be handed from MPI rank to rank in MPBeam::BeamMomtumUpdateDueToRFTest
+    void PackDynamicState(vector<double> &buf) const;
+    void UnpackDynamicState(const vector<double> &buf);
+
+    // beam induced voltage of a periodic fill after nTurns turns from an empty cavity, in closed form (geometric series
+    // over the turns and over the steps of a gap) instead of tracking: in each turn step k adds vb0[k], then the voltage
+    // decays and rotates stepNum[k] times by exp(stepExp[k]). Returns the voltage after each decay and rotation
+    // averaged over the steps of the last turn, as the transient tracking of InitialcavityResonator does. O(steps)
+    static complex<double> GetPeriodicBeamInducedVol(const vector<complex<double> > &vb0, const vector<complex<double> > &stepExp,
+                                                     const vector<int> &stepNum, int nTurns);
+    // the same fill, voltage at the start of turn nTurn (after nTurn whole turns)
+    static complex<double> GetPeriodicTurnStartVol(const vector<complex<double> > &vb0, const vector<complex<double> > &stepExp,
+                                                   const vector<int> &stepNum, int nTurn);
 
 private:
+    // resGenVol(t0+time) = decay * resGenVol(t0) + drive for a constant generator current, Ref. ResonatorDynamics
+    void GetGenPropagator(double time, complex<double> &decay, complex<double> &drive) const;
 
+    // (decay, drive) per number of buckets, rebuilt when tRF or a resonator parameter changes
+    map<int, pair<complex<double>, complex<double> > > genPropagator;
+    double propagatorKey[6] = {0};
+    complex<double> propagatorIg = 0.E0;
 };
 
 
@@ -0,0 +1,87 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef SDDSWriter_H
+#define SDDSWriter_H
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <set>
+
+using namespace std;
+
+// SDDS file written page by page. Parameters and columns are declared once before Open(), the values are encoded
+// on the calling thread into a buffer (binary, or text for runSDDSBinary = 0) and a background thread writes the full
+// buffers to the file. Calls on a writer that is not open do nothing, e.g. on the MPI ranks that do not own the file.
+// A last page with fewer rows than declared in StartPage (tracking stopped early) gets its row count corrected on Close().
+// Writers still open when the program calls exit() (an error in the middle of the tracking) are closed by CloseAll(),
+// the rows buffered so far are not lost.
+class SDDSWriter
+{
+
+public:
+    enum DataType {LONG, FLOAT, DOUBLE};
+
+    SDDSWriter();
+    ~SDDSWriter();
+
+    void DefineParameter(const string &name, const string &units, DataType type);
+    void DefineColumn(const string &name, const string &units, DataType type);
+    void Open(const string &fileName, int binaryMode, bool writeHeader=true);    // writeHeader=false: append pages to the file
+    void StartPage(int rowNum, const vector<double> &parameter=vector<double>());
+    void Put(double value);                                                    // next column of the current row
+    void Flush();                                                              // everything is in the file on return
+    void Close();
+    bool IsOpen() const {return file!=NULL;}
+
+private:
+    struct Field
+    {
+        string name;
+        string units;
+        DataType type;
+    };
+    vector<Field> parameterDef;
+    vector<Field> columnDef;
+
+    FILE *file = NULL;
+    int binary = 1;
+    int columnIndex = 0;
+    bool append = false;
+    long fileBytes   = 0;               // appended since Open()
+    long pageRowsPos = -1;              // file offset of the row count of the current page
+    int  pageRows    = 0;               // declared in StartPage
+    int  pageRowsPut = 0;
+
+    vector<char> buffer;                // filled by the caller
+    vector<char> writeBuffer;           // written by the writer thread
+    bool writePending = false;
+    bool stop = false;
+    thread writer;
+    mutex mtx;
+    condition_variable cv;
+    static const size_t bufferSize = 1 << 22;
+
+    void WriteHeader();
+    void Append(const void *data, size_t n);
+    void PutValue(double value, DataType type, char sep);
+    void HandOver();
+    void WriterLoop();
+    void PutRowCount(int rowNum);
+
+    static set<SDDSWriter*> openWriters;
+    static mutex openMtx;
+    static void CloseAll();             // atexit
+};
+
+
+#endif
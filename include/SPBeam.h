@@ -18,7 +18,11 @@
 #include <fstream>
 #include <vector>
 #include <complex>
+#include <fftw3.h>
 #include "CavityResonator.h" 
+#include "Ramping.h"
+#include "TrackingPipeline.h"
+#include "GrowthRateEstimator.h"
 #include <iostream>
 #include <iomanip>
 
@@ -73,9 +77,9 @@ public:
     vector<vector<double> > coupledBunchModeArgX;
     vector<vector<double> > coupledBunchModeArgY;
     vector<vector<double> > coupledBunchModeArgZ;
-    vector<double>CBMIdealGRX;
-    vector<double>CBMIdealGRY;
-    vector<double>CBMIdealGRZ;
+    GrowthRateEstimator CBMIdealGRX;        // mode growth rates fitted while tracking, SetIdealCoupledBunchModeData
+    GrowthRateEstimator CBMIdealGRY;
+    GrowthRateEstimator CBMIdealGRZ;
     vector<double>CBMHTGRX;
     vector<double>CBMHTGRY;
     vector<double>CBMHTGRZ;
@@ -121,12 +125,15 @@ public:
     vector<double > freXIQDecompScan;
     vector<double > freYIQDecompScan;
     vector<double > freZIQDecompScan;
+    vector<complex<double> > iqTwiddle;     // exp(-li 2 PI Q h_i / H) of bunch i, planes x y z one after the other, GetIQDecomp
     vector<double> ampIQ;
     vector<double> phaseIQ;
 
 
 
     void Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter, CavityResonator &cavityResonator);
+    void BuildPipeline(TrackingPipeline &pipeline, ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                       CavityResonator &cavityResonator, Ramping &ramping, FIRFeedBack &firFeedBack, WakeFunction &lRWakeFunction);
     void SPBeamRMSCal(LatticeInterActionPoint &latticeInterActionPoint, int k);
     void SPGetBeamInfo();
     void SPBeamDataPrintPerTurn(int turns, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter,CavityResonator &cavityResonator);
@@ -138,9 +145,10 @@ public:
     void GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter);
     
     void GetCBMGR1(const int turns, const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter);
-    void SetIdealCoupledBunchModeData(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter);
+    void SetIdealCoupledBunchModeData(const int turns, const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter);
     void SetHilbertCoupledBunchModeData(const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter);
     void SetIQCoupledBunchModeData(const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter);
+    void GetIQDecomp(const vector<double> &x, const vector<double> &y, const vector<double> &z, int harmonics, fftw_complex *iq);
 
     // shared funcitons by MP and SP cases.         
     void TuneRamping(ReadInputSettings &inputParameter,double n);
@@ -166,6 +174,7 @@ public:
     void GetHilbertAnalyticalInOneTurn(const ReadInputSettings &inputParameter);
     void BeamTransferDuetoDriveMode(const ReadInputSettings &inputParameter,const int n);                 
     void MarkParticleLostInBunch(const ReadInputSettings &inputParameter, const LatticeInterActionPoint &latticeInterActionPoint);
+    bool BeamLost() const;                      // a bunch below 50% transmission
 
     void BeamSynRadDamping(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint);
     void FIRBunchByBunchFeedback(const ReadInputSettings &inputParameter,FIRFeedBack &firFeedBack,int nTurns);
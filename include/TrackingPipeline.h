@@ -0,0 +1,58 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#ifndef TrackingPipeline_H
+#define TrackingPipeline_H
+
+#include <vector>
+#include <string>
+#include <functional>
+#include "ReadInputSettings.h"
+#include "SDDSWriter.h"
+
+using namespace std;
+
+// One turn of MPBeam::Run/SPBeam::Run as the list of stages selected once from the &Run flags (BuildPipeline),
+// executed in order for every turn. The argument of a stage is the turn number.
+// With runProfile > 0 every stage is timed: stages added under the same name (e.g. one per interaction point) are
+// summed, the times of each turn go to the timing file (runProfileFile.sdds, one row per turn) and TimingReport()
+// prints the summary. With runProfile = 0 Run() only calls the stages.
+class TrackingPipeline
+{
+
+public:
+    typedef function<void(int)> StageFunc;
+
+    void   Add(const string &name, StageFunc func);
+    void   Profile(const ReadInputSettings &inputParameter, int turnNum);    // after the last Add(), turnNum rows in the timing file
+    int    GetProfileLevel() const {return level;}
+    void   Run(int turn);
+    void   TimingReport();                              // seconds and share of the turn time per stage name, peak memory
+    double GetStageTime(const string &name) const;      // summed seconds of the stages called name
+    int    GetStageNum() const {return stages.size();}
+
+    static double PeakMemory();                         // MB, peak resident set size of the process
+
+private:
+    struct Stage
+    {
+        string    name;
+        StageFunc func;
+        double    seconds;
+        int       column;                               // index of name in names
+    };
+    vector<Stage>  stages;
+    vector<string> names;                               // distinct stage names in the order of the turn
+    vector<double> turnSeconds;                         // per name, of the current turn
+    int turns = 0;
+    int level = 0;
+    SDDSWriter fout;
+};
+
+
+#endif
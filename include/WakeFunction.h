@@ -17,19 +17,52 @@
 #include <vector>
 #include <string>
 #include <algorithm>
+#include <map>
+#include <fftw3.h>
 #include "Global.h"
 #include "ReadInputSettings.h"
 #include "LatticeInterActionPoint.h"
+#include "Checkpoint.h"
 class WakeFunction
 {
 
 public:
     WakeFunction();
     ~WakeFunction();
+
+    // pseudo-Green function of the short range wake tabulated on a bin grid, G(m*dtBin) with m = -(nBin-1)...(nBin-1),
+    // stored as its FFT on a zero-padded grid of nFFT >= 2*nBin-1 points, so that the bin-to-bin sum becomes a product in frequency domain.
+    struct SRWakeGreenTable
+    {
+        int    nBin;
+        int    nFFT;
+        double dtBin;                               // [s], quantized bin length the table is valid for
+        vector<complex<double> > kernelFFT[3];      // x, y, z; 1/nFFT of the backward transform is folded in
+    };
+    map<pair<int,int>, SRWakeGreenTable*> srWakeGreenTable;   // cached across turns and bunches, key (nBin, bin length ladder index)
+
+    const SRWakeGreenTable *GetSRWakeGreenTable(int nBin, double dtBin);
+    void SRWakeConvolution(const SRWakeGreenTable *table, const vector<double> &lineDensity, const vector<double> &dipoleX, const vector<double> &dipoleY, vector<vector<double> > &wakePoten);
     
-    vector<vector<double> > posxData;
+    vector<vector<double> > posxData;       // ring buffer over turns, posxData[LRWakeHistIndex(n)] is the bunch centre n turns ago
     vector<vector<double> > posyData;
     vector<vector<double> > poszData;
+    int lrwHistHead = 0;
+    int  LRWakeHistIndex(int n) const { return (lrwHistHead - n + posxData.size()) % posxData.size(); }
+    void LRWakeHistPush();                  // advance the head, the caller fills pos?Data[lrwHistHead]
+
+    // BBR long range wake as decaying rotating phasors (&LongRangeWake lrwRecursion = 1), no turn truncation.
+    // For tau<0: W(tau) = Re( lrwCoeff * exp(lrwRate * tau) ), lrwRate = alpha + i omegab, per mode and plane x y z.
+    // lrwPhasor = sum_k N_k d_k exp(lrwRate * (t_k - lrwTime)) over all bunch passages k so far, d = x, y, 1.
+    int lrwRecursion = 0;
+    vector<complex<double> > lrwRate[3];
+    vector<complex<double> > lrwCoeff[3];
+    vector<complex<double> > lrwPhasor[3];
+    double lrwTime = 0;                     // [s] time of the last passage, relative to the start of the current turn
+    void InitialLRWakeRecursion();
+    void LRWakeRecursion(double t, double electronNum, double posx, double posy, double *wakeSum);
+    void SaveLRWakeState(Checkpoint &checkpoint) const;   // bunch centre history and resonator phasors
+    void LoadLRWakeState(Checkpoint &checkpoint);
     
 
 	double betaFunIntPoint[2];       // x y
@@ -71,6 +104,7 @@ public:
     vector<double> txOmega;
     
 	vector<double> GetTotLRWakeLinearFit( double tau);
+	void GetTotLRWakeLinearFit(double tau, double *lwake);
 	vector<double> GetBBRWakeFun(double tau); // works for both long and short range wakefunction
     vector<double> GetBBRWakeFun1(double tau) ; // works for both long and short range wakefunction--1mm bunch pusedo-wake potential as wake function
 
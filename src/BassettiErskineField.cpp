@@ -0,0 +1,323 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "BassettiErskineField.h"
+#include "Global.h"
+#include "Faddeeva.h"
+#include <cmath>
+#include <complex>
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+
+using namespace std;
+
+int            BassettiErskineField::method = BassettiErskineField::FADDEEVA;
+double         BassettiErskineField::weidemanL = 0;
+vector<double> BassettiErskineField::weidemanCoeff;
+vector<double> BassettiErskineField::tableRe;
+vector<double> BassettiErskineField::tableIm;
+const int      BassettiErskineField::tableNum  = 121;
+const double   BassettiErskineField::tableStep = 0.05;
+
+
+void BassettiErskineField::Initial(const ReadInputSettings &inputParameter)
+{
+    method = inputParameter.ringIonEffPara->ionCalBEMethod;
+    InitialWeideman();
+    InitialTable();
+
+    if(method!=FADDEEVA && inputParameter.ringRun->beamIonFlag) Report();
+}
+
+void BassettiErskineField::InitialWeideman()
+{
+    // J.A.C. Weideman, SIAM J. Numer. Anal. 31 (1994) 1497: w(z) = 2 p(Z) / (L - iz)^2 + 1/sqrt(pi) / (L - iz),
+    // Z = (L + iz) / (L - iz). The coefficients are the cosine transform of exp(-t^2)(L^2+t^2) at t = L tan(theta/2).
+    const int N = 32;
+    const int M = 2 * N;
+    weidemanL = sqrt(N / sqrt(2.E0));
+    weidemanCoeff.assign(N, 0.E0);
+
+    for(int n=1;n<=N;n++)
+    {
+        double sum = 0.E0;
+        for(int k=-M+1;k<M;k++)
+        {
+            double t = weidemanL * tan(k * PI / M / 2);
+            sum += exp(-t * t) * (weidemanL * weidemanL + t * t) * cos(PI * n * k / M);
+        }
+        weidemanCoeff[n-1] = sum / (2 * M);
+    }
+}
+
+void BassettiErskineField::InitialTable()
+{
+    tableRe.resize(tableNum * tableNum);
+    tableIm.resize(tableNum * tableNum);
+    for(int i=0;i<tableNum;i++)
+    {
+        for(int j=0;j<tableNum;j++)
+        {
+            complex<double> w = Faddeeva::w(complex<double>(i * tableStep, j * tableStep));
+            tableRe[i * tableNum + j] = w.real();
+            tableIm[i * tableNum + j] = w.imag();
+        }
+    }
+}
+
+void BassettiErskineField::W(int n, const double *x, const double *y, double *wRe, double *wIm, int wMethod)
+{
+    const double invSqrtPI = 1.E0 / sqrt(PI);
+
+    if(wMethod==FADDEEVA)
+    {
+        for(int i=0;i<n;i++)
+        {
+            complex<double> w = Faddeeva::w(complex<double>(x[i], y[i]));
+            wRe[i] = w.real();
+            wIm[i] = w.imag();
+        }
+    }
+    else if(wMethod==HUMLICEK)
+    {
+        // J. Humlicek, JQSRT 27 (1982) 437, W4 with t = y - ix, relative error ~1e-4
+        for(int i=0;i<n;i++)
+        {
+            complex<double> t(y[i], -x[i]);
+            double s = abs(x[i]) + y[i];
+            complex<double> w, u;
+            if(s>=15)
+            {
+                w = t * 0.5641896 / (0.5 + t * t);
+            }
+            else if(s>=5.5)
+            {
+                u = t * t;
+                w = t * (1.410474 + u * 0.5641896) / (0.75 + u * (3.0 + u));
+            }
+            else if(y[i]>=0.195 * abs(x[i]) - 0.176)
+            {
+                w = (16.4955 + t * (20.20933 + t * (11.96482 + t * (3.778987 + t * 0.5642236))))
+                  / (16.4955 + t * (38.82363 + t * (39.27121 + t * (21.69274 + t * (6.699398 + t)))));
+            }
+            else
+            {
+                u = t * t;
+                w = exp(u) - t * (36183.31 - u * (3321.9905 - u * (1540.787 - u * (219.0313 - u * (35.76683 - u * (1.320522 - u * 0.56419))))))
+                           / (32066.6 - u * (24322.84 - u * (9022.228 - u * (2186.181 - u * (364.2191 - u * (61.57037 - u * (1.841439 - u)))))));
+            }
+            wRe[i] = w.real();
+            wIm[i] = w.imag();
+        }
+    }
+    else if(wMethod==WEIDEMAN)
+    {
+        // branch free, real arithmetic so that the loop vectorizes
+        const double L   = weidemanL;
+        const double *c  = weidemanCoeff.data();
+        const int nCoeff = weidemanCoeff.size();
+
+        #pragma omp simd
+        for(int i=0;i<n;i++)
+        {
+            // 1/(L - iz) = (L + y + ix) / ((L + y)^2 + x^2)
+            double dRe   = L + y[i];
+            double dNorm = 1.E0 / (dRe * dRe + x[i] * x[i]);
+            double invRe = dRe  * dNorm;
+            double invIm = x[i] * dNorm;
+            // Z = (L - y + ix) / (L - iz)
+            double nRe = L - y[i];
+            double zRe = nRe * invRe - x[i] * invIm;
+            double zIm = nRe * invIm + x[i] * invRe;
+
+            double pRe = c[nCoeff-1];
+            double pIm = 0.E0;
+            for(int k=nCoeff-2;k>=0;k--)
+            {
+                double tRe = pRe * zRe - pIm * zIm + c[k];
+                pIm        = pRe * zIm + pIm * zRe;
+                pRe        = tRe;
+            }
+
+            double inv2Re = invRe * invRe - invIm * invIm;
+            double inv2Im = 2 * invRe * invIm;
+            wRe[i] = 2 * (pRe * inv2Re - pIm * inv2Im) + invSqrtPI * invRe;
+            wIm[i] = 2 * (pRe * inv2Im + pIm * inv2Re) + invSqrtPI * invIm;
+        }
+    }
+    else
+    {
+        // nearest node within [0,(tableNum-1)*tableStep)^2 and 6 Taylor terms, w' = -2zw + 2i/sqrt(pi),
+        // w^(k+1) = -2z w^(k) - 2k w^(k-1). Outside the table the Laplace continued fraction.
+        const double tableMax = (tableNum - 1) * tableStep;
+        const double invStep  = 1.E0 / tableStep;
+
+        for(int i=0;i<n;i++)
+        {
+            if(x[i]<tableMax && y[i]<tableMax)
+            {
+                int ix = int(x[i] * invStep + 0.5);
+                int iy = int(y[i] * invStep + 0.5);
+                double z0Re = ix * tableStep;
+                double z0Im = iy * tableStep;
+                double dRe  = x[i] - z0Re;
+                double dIm  = y[i] - z0Im;
+
+                double dkRe = tableRe[ix * tableNum + iy];          // w^(k)
+                double dkIm = tableIm[ix * tableNum + iy];
+                double dmRe = 0.E0;                                 // w^(k-1)
+                double dmIm = 0.E0;
+                double pwRe = 1.E0;                                 // delta^k / k!
+                double pwIm = 0.E0;
+                double sumRe = dkRe;
+                double sumIm = dkIm;
+
+                for(int k=0;k<6;k++)
+                {
+                    double nextRe = -2 * (z0Re * dkRe - z0Im * dkIm) - 2 * k * dmRe;
+                    double nextIm = -2 * (z0Re * dkIm + z0Im * dkRe) - 2 * k * dmIm;
+                    if(k==0) nextIm += 2 * invSqrtPI;
+                    dmRe = dkRe;
+                    dmIm = dkIm;
+                    dkRe = nextRe;
+                    dkIm = nextIm;
+
+                    double tRe = (pwRe * dRe - pwIm * dIm) / (k + 1);
+                    pwIm       = (pwRe * dIm + pwIm * dRe) / (k + 1);
+                    pwRe       = tRe;
+
+                    sumRe += dkRe * pwRe - dkIm * pwIm;
+                    sumIm += dkRe * pwIm + dkIm * pwRe;
+                }
+                wRe[i] = sumRe;
+                wIm[i] = sumIm;
+            }
+            else
+            {
+                // w = i/sqrt(pi) / (z - (1/2) / (z - (2/2) / (z - ...)))
+                complex<double> z(x[i], y[i]);
+                complex<double> r(0.E0, 0.E0);
+                for(int k=12;k>=1;k--) r = (k / 2.E0) / (z - r);
+                complex<double> w = complex<double>(0.E0, invSqrtPI) / (z - r);
+                wRe[i] = w.real();
+                wIm[i] = w.imag();
+            }
+        }
+    }
+}
+
+void BassettiErskineField::Field(int n, const double *posx, const double *posy, double rmsRx, double rmsRy, double *fx, double *fy)
+{
+    // same branches as the per particle calls in MPBunch::SSIonBunchInteraction
+    if( (rmsRx - rmsRy)/rmsRy > 1.e-4 )
+    {
+        FieldElliptic(n, posx, posy, rmsRx, rmsRy, fx, fy);
+    }
+    else if( (rmsRx - rmsRy)/rmsRy < -1.e-4 )
+    {
+        FieldElliptic(n, posy, posx, rmsRy, rmsRx, fy, fx);
+    }
+    else
+    {
+        double sigma2 = rmsRx * rmsRx;
+        for(int i=0;i<n;i++)
+        {
+            double r2 = pow(posx[i],2) + pow(posy[i],2);
+            fx[i] = - posx[i] / r2 * (1 - exp(- r2 /2/sigma2 ) );
+            fy[i] = - posy[i] / r2 * (1 - exp(- r2 /2/sigma2 ) );
+        }
+    }
+
+    for(int i=0;i<n;i++)
+    {
+        if(abs(posx[i]/rmsRx) + abs(posy[i]/rmsRy)<1.0E-5)
+        {
+            fx[i] = 0;
+            fy[i] = 0;
+        }
+    }
+}
+
+void BassettiErskineField::FieldElliptic(int n, const double *posx, const double *posy, double rmsRx, double rmsRy, double *fx, double *fy)
+{
+    // Bunch::BassettiErskine1 for rmsRx > rmsRy: both w(z) of a point in one batch, z1 in [0,n), z2 in [n,2n)
+    double sigma    = sqrt(2*pow(rmsRx,2)-2*pow(rmsRy,2));
+    double ryOverRx = rmsRy/rmsRx;
+    double coeffBE  = -1 * sqrt(PI)/sigma;
+
+    vector<double> zRe(2*n), zIm(2*n), wRe(2*n), wIm(2*n);
+    for(int i=0;i<n;i++)
+    {
+        double tempPosix = abs(posx[i]);
+        double tempPosiy = abs(posy[i]);
+        zRe[i]   = tempPosix/sigma;
+        zIm[i]   = tempPosiy/sigma;
+        zRe[n+i] = ryOverRx*tempPosix/sigma;
+        zIm[n+i] = tempPosiy/sigma/ryOverRx;
+    }
+
+    W(2*n, zRe.data(), zIm.data(), wRe.data(), wIm.data(), method);
+
+    for(int i=0;i<n;i++)
+    {
+        double tempPosix = abs(posx[i]);
+        double tempPosiy = abs(posy[i]);
+        double z3 = - pow(tempPosix/rmsRx,2)/2 - pow(tempPosiy/rmsRy,2)/2;
+        double w3 = - exp(z3);
+
+        fx[i] = coeffBE * (wIm[i] + w3 * wIm[n+i]);
+        fy[i] = coeffBE * (wRe[i] + w3 * wRe[n+i]);
+
+        if(posx[i]<=0) fx[i] = -fx[i];
+        if(posy[i]<=0) fy[i] = -fy[i];
+    }
+}
+
+void BassettiErskineField::Report()
+{
+    // grid over [0,8]^2 in units of sigma, the range of the beam-ion kicks; relative error against Faddeeva.cpp
+    const int    nGrid = 401;
+    const double step  = 8.E0 / (nGrid - 1);
+    const int    n     = nGrid * nGrid;
+    vector<double> x(n), y(n), refRe(n), refIm(n), wRe(n), wIm(n);
+    for(int i=0;i<nGrid;i++)
+    {
+        for(int j=0;j<nGrid;j++)
+        {
+            x[i*nGrid+j] = i * step;
+            y[i*nGrid+j] = j * step;
+        }
+    }
+    W(n, x.data(), y.data(), refRe.data(), refIm.data(), FADDEEVA);
+
+    const char *name[4] = {"Faddeeva", "Humlicek W4", "Weideman N=32", "table+Taylor"};
+    cout<<"Bassetti-Erskine w(z), ionCalBEMethod = "<<method<<" ("<<name[method]<<")"<<endl;
+    cout<<setw(8)<<left<<"method"<<setw(16)<<left<<"name"<<setw(16)<<left<<"maxRelErr"<<setw(16)<<left<<"ns/w(z)"<<endl;
+    for(int m=FADDEEVA;m<=TABLE;m++)
+    {
+        int repeat = 0;
+        auto start = chrono::steady_clock::now();
+        double elapsed;
+        do
+        {
+            W(n, x.data(), y.data(), wRe.data(), wIm.data(), m);
+            repeat++;
+            elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        }
+        while(elapsed<0.05);
+
+        double maxErr = 0.E0;
+        for(int i=0;i<n;i++)
+        {
+            double err = sqrt(pow(wRe[i]-refRe[i],2) + pow(wIm[i]-refIm[i],2)) / sqrt(pow(refRe[i],2) + pow(refIm[i],2));
+            if(err>maxErr) maxErr = err;
+        }
+        cout<<setw(8)<<left<<m<<setw(16)<<left<<name[m]<<setw(16)<<left<<maxErr<<setw(16)<<left<<elapsed/repeat/n*1.E9<<endl;
+    }
+}
@@ -39,8 +39,9 @@ BeamIon2DPIC::~BeamIon2DPIC()
 
 }
 
-void BeamIon2DPIC::InitialPIC2D()
+void BeamIon2DPIC::InitialPIC2D(const ReadInputSettings &inputParameter)
 {
-    pic2DBeam.InitialPIC2D(meshNumBeam);
-    pic2DIon.InitialPIC2D(meshNumIon);
+    int solver = inputParameter.ringIonEffPara->ionCalPICSolver;
+    pic2DBeam.InitialPIC2D(meshNumBeam,solver);
+    pic2DIon.InitialPIC2D(meshNumIon,solver);
 }
@@ -25,6 +25,8 @@
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_histogram.h>
 #include <fftw3.h>
+#include <omp.h>
+#include "FFTWPlanCache.h"
 
 using namespace std;
 using std::vector;
@@ -36,7 +38,34 @@ BoardBandImp::BoardBandImp()
 
 BoardBandImp::~BoardBandImp()
 {
+    for(int i=0;i<fftwBuffer.size();i++)
+    {
+        fftw_free(fftwBuffer[i].r2cin);
+        fftw_free(fftwBuffer[i].r2cout);
+        fftw_free(fftwBuffer[i].c2rin);
+    }
+}
+
+void BoardBandImp::InitialFFTWBuffer(const ReadInputSettings &inputParameter)
+{
+    // called after ReadInImp; the profile grid has 2*nBins-1 points and its spectrum nBins points.
+    int nProfile = 2 * nBins - 1;
+    int nThreads = 1;
+#ifdef _OPENMP
+    nThreads = omp_get_max_threads();
+#endif
+
+    fftwBuffer.resize(nThreads);
+    for(int i=0;i<nThreads;i++)
+    {
+        fftwBuffer[i].r2cin        = (double*)       fftw_malloc(sizeof(double)       * nProfile);
+        fftwBuffer[i].r2cout       = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nProfile/2+1));
+        fftwBuffer[i].c2rin        = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nProfile/2+1));
+    }
 
+    // plan here, out of the bunch loop, so that MEASURE/PATIENT planning is not charged to the first turn
+    FFTWPlanCache::GetPlanR2C(nProfile);
+    FFTWPlanCache::GetPlanC2R(nProfile);
 }
 
 void BoardBandImp::ReadInImp(const  ReadInputSettings &inputParameter)
@@ -49,6 +49,7 @@ Bunch::~Bunch()
 {
     delete bunchRFModeInfo; 
     delete haissinski;  
+    delete lostParticle;
 }
 
 
@@ -80,6 +81,7 @@ void Bunch::Initial(const  ReadInputSettings &inputParameter)
     eFxDueToIon.resize(macroEleNumPerBunch,0E0);
     eFyDueToIon.resize(macroEleNumPerBunch,0E0);
     eFzDueToIon.resize(macroEleNumPerBunch,0E0);
+    macroEleNumActive = macroEleNumPerBunch;
     
     lRWakeForceAver.resize(3,0E0);
     accPhaseAdvX = v2d(macroEleNumPerBunch,v1d(3,0.E0));
@@ -173,32 +175,173 @@ void Bunch::MarkLostParticle(const ReadInputSettings &inputParameter,const Latti
 {
     int ringHarm        = inputParameter.ringParRf->ringHarm;
     double t0           = inputParameter.ringParBasic->t0;
+    double zLimit       = t0 * CLight / ringHarm / 2;
+    double invApX       = 1.0 / latticeInterActionPoint.pipeAperatureX[0];
+    double invApY       = 1.0 / latticeInterActionPoint.pipeAperatureY[0];
     int count           = 0;
-    int k = 0;
-    for(int i=0;i<macroEleNumPerBunch;i++)
+
+    for(int i=0;i<macroEleNumActive;i++)
     {    
-        if( abs(ePositionZ[i]) > t0 * CLight / ringHarm / 2 ) 
-        {
-            eSurive[i] = 2;   // loss in longitudianl
-            count++;
-        }
-        
-        double lossTemp =pow(ePositionX[i]/latticeInterActionPoint.pipeAperatureX[k],2) + pow(ePositionY[i]/latticeInterActionPoint.pipeAperatureY[k],2) ; 
-        if(lossTemp >1) 
-        {   
-            eSurive[i] = 1;                                     // loss in transverse
-            count++;
-        }
+        double lossTemp = pow(ePositionX[i] * invApX,2) + pow(ePositionY[i] * invApY,2);
+        int lossFlag    = 0;
+        if( abs(ePositionZ[i]) > zLimit ) lossFlag = 2;   // loss in longitudianl
+        if( lossTemp > 1 )                lossFlag = 1;   // loss in transverse
+        eSurive[i] = lossFlag;
+        count     += (lossFlag!=0);
     }
-    transmission = (macroEleNumPerBunch - count) / double(macroEleNumPerBunch);
-    if(transmission<0.5)
+
+    if(count>0) CompactLostParticle();
+
+    transmission = macroEleNumActive / double(macroEleNumPerBunch);
+    if(transmission<0.5 && !beamLost)
     {
         cout<<"bunch at harmoinc "<<bunchHarmNum<<", more than 50% particles are lost"<<endl;
-        exit(0);
+        beamLost = true;
     }
 
 }
 
+void Bunch::CompactLostParticle()
+{
+    momentsDirty = true;
+    longBinning.Invalidate();
+    // stable partition of the active range: surviving particles keep their order at the front,
+    // newly lost particles are archived in lostParticle and moved to the tail (before the earlier lost ones).
+    vector<int> order;
+    order.reserve(macroEleNumActive);
+    for(int i=0;i<macroEleNumActive;i++)
+    {
+        if(eSurive[i]==0) order.push_back(i);
+    }
+    int numAlive = order.size();
+
+    for(int i=0;i<macroEleNumActive;i++)
+    {
+        if(eSurive[i]==0) continue;
+        order.push_back(i);
+        lostParticle->x.push_back(ePositionX[i]);
+        lostParticle->px.push_back(eMomentumX[i]);
+        lostParticle->y.push_back(ePositionY[i]);
+        lostParticle->py.push_back(eMomentumY[i]);
+        lostParticle->z.push_back(ePositionZ[i]);
+        lostParticle->pz.push_back(eMomentumZ[i]);
+        lostParticle->lossType.push_back(eSurive[i]);
+        lostParticle->lossTurn.push_back(currentTurnNum);
+    }
+
+    v1dAligned tmp(macroEleNumActive);
+    v1dAligned *coord[6] = {&ePositionX,&eMomentumX,&ePositionY,&eMomentumY,&ePositionZ,&eMomentumZ};
+    for(int c=0;c<6;c++)
+    {
+        v1dAligned &vec = *coord[c];
+        for(int i=0;i<macroEleNumActive;i++) tmp[i] = vec[order[i]];
+        copy(tmp.begin(),tmp.end(),vec.begin());
+    }
+
+    vector<int> survTmp(macroEleNumActive);
+    for(int i=0;i<macroEleNumActive;i++) survTmp[i] = eSurive[order[i]];
+    copy(survTmp.begin(),survTmp.end(),eSurive.begin());
+
+    v2d phaseTmp(macroEleNumActive);
+    v2d *phase[3] = {&accPhaseAdvX,&accPhaseAdvY,&accPhaseAdvZ};
+    for(int c=0;c<3;c++)
+    {
+        v2d &vec = *phase[c];
+        for(int i=0;i<macroEleNumActive;i++) phaseTmp[i].swap(vec[order[i]]);
+        for(int i=0;i<macroEleNumActive;i++) vec[i].swap(phaseTmp[i]);
+    }
+
+    macroEleNumActive = numAlive;
+}
+
+void Bunch::ReleaseParticles()
+{
+    momentsDirty = true;
+    longBinning.Invalidate();
+    // bunch tracked by another MPI rank: bunch parameters and moments stay, the macro-particles are dropped
+    v1dAligned *coord[6] = {&ePositionX,&eMomentumX,&ePositionY,&eMomentumY,&ePositionZ,&eMomentumZ};
+    for(int c=0;c<6;c++) v1dAligned().swap(*coord[c]);
+    vector<double>().swap(eFxDueToIon);
+    vector<double>().swap(eFyDueToIon);
+    vector<double>().swap(eFzDueToIon);
+    vector<int>().swap(eSurive);
+    v2d().swap(accPhaseAdvX);
+    v2d().swap(accPhaseAdvY);
+    v2d().swap(accPhaseAdvZ);
+    macroEleNumActive = 0;
+}
+
+void Bunch::SaveState(Checkpoint &checkpoint) const
+{
+    // everything carried from turn to turn, the moments are recomputed at the start of the next turn
+    checkpoint.Put(currentTurnNum);
+    checkpoint.Put(macroEleNumActive);
+    checkpoint.Put(ePositionX);
+    checkpoint.Put(ePositionY);
+    checkpoint.Put(ePositionZ);
+    checkpoint.Put(eMomentumX);
+    checkpoint.Put(eMomentumY);
+    checkpoint.Put(eMomentumZ);
+    checkpoint.Put(eSurive);
+    checkpoint.Put(accPhaseAdvX);
+    checkpoint.Put(accPhaseAdvY);
+    checkpoint.Put(accPhaseAdvZ);
+    checkpoint.Put(lostParticle->x);
+    checkpoint.Put(lostParticle->px);
+    checkpoint.Put(lostParticle->y);
+    checkpoint.Put(lostParticle->py);
+    checkpoint.Put(lostParticle->z);
+    checkpoint.Put(lostParticle->pz);
+    checkpoint.Put(lostParticle->lossType);
+    checkpoint.Put(lostParticle->lossTurn);
+    checkpoint.Put(transmission);
+    checkpoint.Put(electronNumPerBunch);
+    checkpoint.Put(zAverLastTurn);
+    checkpoint.Put(pzAverLastTurn);
+    checkpoint.Put(rmsBunchLengthLastTurn);
+    checkpoint.Put(lRWakeForceAver);
+    checkpoint.Put(xyzHistoryDataToFit);
+    checkpoint.Put(rndGen);
+}
+
+void Bunch::LoadState(Checkpoint &checkpoint)
+{
+    momentsDirty = true;
+    longBinning.Invalidate();
+    checkpoint.Get(currentTurnNum);
+    checkpoint.Get(macroEleNumActive);
+    checkpoint.Get(ePositionX);
+    checkpoint.Get(ePositionY);
+    checkpoint.Get(ePositionZ);
+    checkpoint.Get(eMomentumX);
+    checkpoint.Get(eMomentumY);
+    checkpoint.Get(eMomentumZ);
+    checkpoint.Get(eSurive);
+    checkpoint.Get(accPhaseAdvX);
+    checkpoint.Get(accPhaseAdvY);
+    checkpoint.Get(accPhaseAdvZ);
+    checkpoint.Get(lostParticle->x);
+    checkpoint.Get(lostParticle->px);
+    checkpoint.Get(lostParticle->y);
+    checkpoint.Get(lostParticle->py);
+    checkpoint.Get(lostParticle->z);
+    checkpoint.Get(lostParticle->pz);
+    checkpoint.Get(lostParticle->lossType);
+    checkpoint.Get(lostParticle->lossTurn);
+    checkpoint.Get(transmission);
+    checkpoint.Get(electronNumPerBunch);
+    checkpoint.Get(zAverLastTurn);
+    checkpoint.Get(pzAverLastTurn);
+    checkpoint.Get(rmsBunchLengthLastTurn);
+    checkpoint.Get(lRWakeForceAver);
+    checkpoint.Get(xyzHistoryDataToFit);
+    checkpoint.Get(rndGen);
+
+    eFxDueToIon.assign(ePositionX.size(),0.E0);
+    eFyDueToIon.assign(ePositionX.size(),0.E0);
+    eFzDueToIon.assign(ePositionX.size(),0.E0);
+}
+
 void Bunch::GaussianField(double posx,double posy,double rmsRxTemp, double rmsRyTemp,double &tempFx,double &tempFy)
 {
 
@@ -212,7 +355,8 @@ void Bunch::GaussianField(double posx,double posy,double rmsRxTemp, double rmsRy
 
 void Bunch::BunchTransferDueToIon(const LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    momentsDirty = true;
+    for(int i=0;i<macroEleNumActive;i++)
     {
         eMomentumX[i] +=  eFxDueToIon[i]  ;    // rad
         eMomentumY[i] +=  eFyDueToIon[i]  ;    // rad
@@ -227,7 +371,7 @@ void Bunch::BunchTransferDueToIon(const LatticeInterActionPoint &latticeInterAct
 //     // prepare the data to munted to GPU 
 //     int dimPart6 = macroEleNumPerBunch * 6;   
 //     double partCord[dimPart6];
-//     for(int i=0;i<macroEleNumPerBunch;i++)
+//     for(int i=0;i<macroEleNumActive;i++)
 //     {
 //         partCord[6*i  ] =  ePositionX[i];
 //         partCord[6*i+1] =  eMomentumX[i];
@@ -240,7 +384,7 @@ void Bunch::BunchTransferDueToIon(const LatticeInterActionPoint &latticeInterAct
 //     int  paraNum = sizeof(latticeInterActionPoint.latticeParaForOneTurnMap)/sizeof(latticeInterActionPoint.latticeParaForOneTurnMap[0]);
 //     GPU_PartiOneTurnTransfer(macroEleNumPerBunch,partCord,paraNum,latticeInterActionPoint.latticeParaForOneTurnMap);
     
-//     for(int i=0;i<macroEleNumPerBunch;i++)
+//     for(int i=0;i<macroEleNumActive;i++)
 //     {
 //         ePositionX[i]   = partCord[6*i  ];
 //         eMomentumX[i]   = partCord[6*i+1]  ;
@@ -258,6 +402,8 @@ void Bunch::BunchTransferDueToIon(const LatticeInterActionPoint &latticeInterAct
 
 void Bunch::BunchTransferDueToLatticeOneTurnT66(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
     // get the twiss parameters of from lattice
     double alphax,betax,alphay,betay,gammax,gammay,etax,etaxp,etay,etayp;
     alphax = latticeInterActionPoint.twissAlphaX[0];
@@ -319,9 +465,8 @@ void Bunch::BunchTransferDueToLatticeOneTurnT66(const ReadInputSettings &inputPa
     double phix,phiy;
 
     // generate the transfer matrix for each particle in bunch 
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;
         // elegant ILMATRIX Eq(56), only keeo the first order here. -- notice the unit of \frac{d eta}/{d delta}
         ePositionX[i]  -=  etax  * eMomentumZ[i];   // [m] 
         ePositionY[i]  -=  etay  * eMomentumZ[i];   // [m]
@@ -430,6 +575,7 @@ void Bunch::BunchTransferDueToLatticeOneTurnT66(const ReadInputSettings &inputPa
 
 void Bunch::GetLongiKickDueToCavFB(const ReadInputSettings &inputParameter,Resonator &resonator)
 {
+    momentsDirty = true;
     double rBeta      = inputParameter.ringParBasic->rBeta;
     double electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
    
@@ -443,7 +589,7 @@ void Bunch::GetLongiKickDueToCavFB(const ReadInputSettings &inputParameter,Reson
     
     cavFB    = absCavFB * exp(li * argCavFB);
 
-    for(int i=0;i<ePositionX.size();i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
         eMomentumZ[i] += cavFB.real() /electronBeamEnergy / pow(rBeta,2);
     }
@@ -452,6 +598,7 @@ void Bunch::GetLongiKickDueToCavFB(const ReadInputSettings &inputParameter,Reson
 
 void Bunch::BunchMomentumUpdateDueToRFCA(const ReadInputSettings &inputParameter,Resonator &resonator,int resIndex)
 {
+    momentsDirty = true;
     int ringHarmH     = inputParameter.ringParRf->ringHarm;
     double f0         = inputParameter.ringParBasic->f0;
     double rBeta      = inputParameter.ringParBasic->rBeta;
@@ -464,7 +611,7 @@ void Bunch::BunchMomentumUpdateDueToRFCA(const ReadInputSettings &inputParameter
     complex<double> cavVoltage =(0.E0,0.E0);
     complex<double> genVoltage =(0.E0,0.E0);
 
-    for (int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
         genVoltage = resonator.resCavVolReq * exp( - li * ePositionZ[i] / CLight / rBeta * 2. * PI * double(resHarm) * fRF );
         cavVoltage = genVoltage;
@@ -482,21 +629,24 @@ void Bunch::BunchMomentumUpdateDueToRFCA(const ReadInputSettings &inputParameter
 
 void Bunch::BunchEnergyLossOneTurn(const ReadInputSettings &inputParameter)
 {
+    momentsDirty = true;
     double rBeta      = inputParameter.ringParBasic->rBeta;
     double u0         = inputParameter.ringParBasic->u0;
     double electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
 
-    for (int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
         eMomentumZ[i] -= u0 / electronBeamEnergy / pow(rBeta,2);   
 }
 
 
 void Bunch::BunchLongPosTransferOneTurn(const ReadInputSettings &inputParameter)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
     double circRing = inputParameter.ringParBasic->circRing;
     double *alphac = inputParameter.ringParBasic->alphac;
     
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
         ePositionZ[i] -= circRing * (alphac[0] * eMomentumZ[i]  + alphac[1] * pow( eMomentumZ[i] ,2) + alphac[2] * pow( eMomentumZ[i], 3) ) ;
 }
 
@@ -622,8 +772,221 @@ void Bunch::GetAccumuPhaseAdv(const LatticeInterActionPoint &latticeInterActionP
 
 
 
+void Bunch::LatticeMapOptions(const ReadInputSettings &inputParameter, bool &chrom, bool &adts)
+{
+    chrom = inputParameter.ringParBasic->chrom[0]!=0 || inputParameter.ringParBasic->chrom[1]!=0;
+    adts  = false;
+    for(int i=0;i<5;i++)
+    {
+        if(inputParameter.ringParBasic->aDTX[i]!=0 || inputParameter.ringParBasic->aDTY[i]!=0) adts = true;
+    }
+}
+
 void Bunch::BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
+    // specialization from the ring parameters, MPBeam picks it once when it builds the tracking pipeline
+    bool chrom, adts;
+    LatticeMapOptions(inputParameter,chrom,adts);
+    if(chrom && adts)   BunchTransferDueToLatticeTSymplectic<true, true >(inputParameter,latticeInterActionPoint,k);
+    else if(chrom)      BunchTransferDueToLatticeTSymplectic<true, false>(inputParameter,latticeInterActionPoint,k);
+    else if(adts)       BunchTransferDueToLatticeTSymplectic<false,true >(inputParameter,latticeInterActionPoint,k);
+    else                BunchTransferDueToLatticeTSymplectic<false,false>(inputParameter,latticeInterActionPoint,k);
+}
+
+template<bool CHROM, bool ADTS>
+void Bunch::BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k)
+{
+    momentsDirty = true;
+    longBinning.Invalidate();
+    // runSymplecticMapGSL = 1 keeps the gsl_blas reference map for regression checks
+    if(inputParameter.ringRun->symplecticMapGSL==1)
+    {
+        BunchTransferDueToLatticeTSymplecticGSL(inputParameter,latticeInterActionPoint,k);
+        return;
+    }
+
+    // same map as BunchTransferDueToLatticeTSymplecticGSL: X1 = (H2B2) * R(phi) * (B1H1) * X
+    // R(phi) is block diagonal, (x,px) and (y,py) rotate with amplitude dependent phase, (z,pz) is the identity.
+    // particles are processed in blocks of SympMapBlock in SoA layout, no heap allocation in the loop.
+    // CHROM = false drops the delta term of the phase, ADTS = false the amplitude terms; with neither the
+    // rotation is the same for all particles and cos/sin are taken once.
+	latticeSetionPassedCount = currentTurnNum * inputParameter.ringParBasic->ringSectNum + k;
+    const double etax   = latticeInterActionPoint.twissDispX[k];
+    const double etaxp  = latticeInterActionPoint.twissDispPX[k];
+    const double etay   = latticeInterActionPoint.twissDispY[k];
+    const double etayp  = latticeInterActionPoint.twissDispPY[k];
+	const double alphax = latticeInterActionPoint.twissAlphaX[k];
+    const double alphay = latticeInterActionPoint.twissAlphaY[k];
+    const double betax  = latticeInterActionPoint.twissBetaX[k];
+    const double betay  = latticeInterActionPoint.twissBetaY[k];
+
+    const double *aDTX  = inputParameter.ringParBasic->aDTX;
+    const double *aDTY  = inputParameter.ringParBasic->aDTY;
+    const double nux    = inputParameter.ringParBasic->workQx;
+    const double nuy    = inputParameter.ringParBasic->workQy;
+    const double chromx = inputParameter.ringParBasic->chrom[0];
+    const double chromy = inputParameter.ringParBasic->chrom[1];
+
+	const double phaseAdvX = latticeInterActionPoint.phaseAdvX12[k];
+	const double phaseAdvY = latticeInterActionPoint.phaseAdvY12[k];
+	const double weighX = phaseAdvX / (2 * PI * nux);
+	const double weighY = phaseAdvY / (2 * PI * nuy);
+
+    // ADTS coefficients already multiplied by 2*pi*weigh, deltaPhi = sum c_i * term_i
+    const double cX[6] = {2*PI*weighX*chromx, 2*PI*weighX*aDTX[0], 2*PI*weighX*aDTX[1], PI*weighX*aDTX[2], PI*weighX*aDTX[3], 2*PI*weighX*aDTX[4]};
+    const double cY[6] = {2*PI*weighY*chromy, 2*PI*weighY*aDTY[0], 2*PI*weighY*aDTY[1], PI*weighY*aDTY[2], PI*weighY*aDTY[3], 2*PI*weighY*aDTY[4]};
+
+    double B1H1[6][6], H2B2[6][6];
+    for(int i=0;i<6;i++)
+    {
+        for(int j=0;j<6;j++)
+        {
+            B1H1[i][j] = gsl_matrix_get(latticeInterActionPoint.symplecticMapB1H1[k].mat2D,i,j);
+            H2B2[i][j] = gsl_matrix_get(latticeInterActionPoint.symplecticMapInvH2InvB2[k].mat2D,i,j);
+        }
+    }
+
+    const bool getPhaseAdv = (k==inputParameter.ringParBasic->ringSectNum-1);
+
+    double vec[6][SympMapBlock];
+    double vecN[6][SympMapBlock];
+    double cosX[SympMapBlock], sinX[SympMapBlock], cosY[SympMapBlock], sinY[SympMapBlock];
+
+    if(!CHROM && !ADTS)
+    {
+        for(int p=0;p<SympMapBlock;p++)
+        {
+            cosX[p] = cos(phaseAdvX);
+            sinX[p] = sin(phaseAdvX);
+            cosY[p] = cos(phaseAdvY);
+            sinY[p] = sin(phaseAdvY);
+        }
+    }
+
+    // particles [0,macroEleNumActive) are alive, blocks are contiguous
+    for(int i0=0;i0<macroEleNumActive;i0+=SympMapBlock)
+    {
+        // (1) load the block
+        int n = (macroEleNumActive - i0 < SympMapBlock) ? macroEleNumActive - i0 : SympMapBlock;
+        for(int p=0;p<n;p++)
+        {
+            vec[0][p] = ePositionX[i0+p];
+            vec[1][p] = eMomentumX[i0+p];
+            vec[2][p] = ePositionY[i0+p];
+            vec[3][p] = eMomentumY[i0+p];
+            vec[4][p] = ePositionZ[i0+p];
+            vec[5][p] = eMomentumZ[i0+p];
+        }
+
+        // (2) amplitude dependent phase advance, elegant ILMATRIX Eq(56) first order dispersion
+        for(int p=0;p<n && (CHROM || ADTS);p++)
+        {
+            double delta = vec[5][p];
+            double phiX  = phaseAdvX;
+            double phiY  = phaseAdvY;
+            if(CHROM)
+            {
+                phiX += cX[0] * delta;
+                phiY += cY[0] * delta;
+            }
+            if(ADTS)
+            {
+                double x  = vec[0][p] - etax  * delta;
+                double px = vec[1][p] - etaxp * delta;
+                double y  = vec[2][p] - etay  * delta;
+                double py = vec[3][p] - etayp * delta;
+                double tx = alphax * x + betax * px;
+                double ty = alphay * y + betay * py;
+                double ampX = (x * x + tx * tx) / betax;
+                double ampY = (y * y + ty * ty) / betay;
+
+                phiX = phiX + cX[1] * ampX + cX[2] * ampY + cX[3] * ampX * ampX + cX[4] * ampY * ampY + cX[5] * ampX * ampY;
+                phiY = phiY + cY[1] * ampX + cY[2] * ampY + cY[3] * ampX * ampX + cY[4] * ampY * ampY + cY[5] * ampX * ampY;
+            }
+            cosX[p] = cos(phiX);
+            sinX[p] = sin(phiX);
+            cosY[p] = cos(phiY);
+            sinY[p] = sin(phiY);
+        }
+
+        // (3) vecN = B1H1 * vec
+        SymplecticMapMatVec(B1H1,vec,vecN,n);
+
+        // (4) block diagonal rotation, result back into vec
+        for(int p=0;p<n;p++)
+        {
+            vec[0][p] =  cosX[p] * vecN[0][p] + sinX[p] * vecN[1][p];
+            vec[1][p] = -sinX[p] * vecN[0][p] + cosX[p] * vecN[1][p];
+            vec[2][p] =  cosY[p] * vecN[2][p] + sinY[p] * vecN[3][p];
+            vec[3][p] = -sinY[p] * vecN[2][p] + cosY[p] * vecN[3][p];
+            vec[4][p] =  vecN[4][p];
+            vec[5][p] =  vecN[5][p];
+        }
+
+        // here to get the phase advances based on turn-by-trun data
+        if(getPhaseAdv)
+        {
+            double tmpx,tmpy,tmpz;
+            for(int p=0;p<n;p++)
+            {
+                int id = i0 + p;
+                accPhaseAdvX[id][1] = atan2(vec[1][p],vec[0][p]);
+                accPhaseAdvY[id][1] = atan2(vec[3][p],vec[2][p]);
+                accPhaseAdvZ[id][1] = atan2(vec[5][p],vec[4][p]);
+
+                tmpx = accPhaseAdvX[id][0] - accPhaseAdvX[id][1];
+                tmpy = accPhaseAdvY[id][0] - accPhaseAdvY[id][1];
+                tmpz = accPhaseAdvZ[id][0] - accPhaseAdvZ[id][1];
+
+                accPhaseAdvX[id][2] += tmpx >= 0? tmpx : tmpx + 2 * PI;
+                accPhaseAdvY[id][2] += tmpy >= 0? tmpy : tmpy + 2 * PI;
+                accPhaseAdvZ[id][2] += tmpz >= 0? tmpz : tmpz + 2 * PI;
+
+                accPhaseAdvX[id][0] = accPhaseAdvX[id][1];
+                accPhaseAdvY[id][0] = accPhaseAdvY[id][1];
+                accPhaseAdvZ[id][0] = accPhaseAdvZ[id][1];
+            }
+        }
+
+        // (5) vecN = H2B2 * vec, scatter back
+        SymplecticMapMatVec(H2B2,vec,vecN,n);
+
+        for(int p=0;p<n;p++)
+        {
+            int id = i0 + p;
+            ePositionX[id] = vecN[0][p];
+            eMomentumX[id] = vecN[1][p];
+            ePositionY[id] = vecN[2][p];
+            eMomentumY[id] = vecN[3][p];
+            ePositionZ[id] = vecN[4][p];
+            eMomentumZ[id] = vecN[5][p];
+        }
+    }
+}
+
+template void Bunch::BunchTransferDueToLatticeTSymplectic<false,false>(const ReadInputSettings&,const LatticeInterActionPoint&,int);
+template void Bunch::BunchTransferDueToLatticeTSymplectic<true, false>(const ReadInputSettings&,const LatticeInterActionPoint&,int);
+template void Bunch::BunchTransferDueToLatticeTSymplectic<false,true >(const ReadInputSettings&,const LatticeInterActionPoint&,int);
+template void Bunch::BunchTransferDueToLatticeTSymplectic<true, true >(const ReadInputSettings&,const LatticeInterActionPoint&,int);
+
+void Bunch::SymplecticMapMatVec(const double (&mat)[6][6], const double (&vecIn)[6][SympMapBlock], double (&vecOut)[6][SympMapBlock], int n)
+{
+    for(int r=0;r<6;r++)
+    {
+        const double m0 = mat[r][0], m1 = mat[r][1], m2 = mat[r][2];
+        const double m3 = mat[r][3], m4 = mat[r][4], m5 = mat[r][5];
+        for(int p=0;p<n;p++)
+        {
+            vecOut[r][p] = m0 * vecIn[0][p] + m1 * vecIn[1][p] + m2 * vecIn[2][p]
+                         + m3 * vecIn[3][p] + m4 * vecIn[4][p] + m5 * vecIn[5][p];
+        }
+    }
+}
+
+void Bunch::BunchTransferDueToLatticeTSymplecticGSL(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k)
+{
+    momentsDirty = true;
+    longBinning.Invalidate();
 	latticeSetionPassedCount = currentTurnNum * inputParameter.ringParBasic->ringSectNum + k;
     double etax   = latticeInterActionPoint.twissDispX[k];
     double etaxp  = latticeInterActionPoint.twissDispPX[k];  // \frac{disP}{ds} 
@@ -671,9 +1034,8 @@ void Bunch::BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputP
     double vec0[2],vec1[2];
     double deltaNux,deltaNuy;
 
-	for(int i=0;i<macroEleNumPerBunch;i++)
+	for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;
         // elegant ILMATRIX Eq(56), only keeo the first order here. -- notice the unit of \frac{d eta}/{d delta}
    	
 		x  = ePositionX[i] - etax  * eMomentumZ[i]; // [m] 
@@ -746,9 +1108,9 @@ void Bunch::BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputP
 	
 	gsl_matrix_free (vecX);
 	gsl_matrix_free (vecX1);
+	gsl_matrix_free (matRotat);
 	B1H1 = NULL;
 	H2B2 = NULL;
-    matRotat = NULL;	
 
     // getchar();
     
@@ -756,6 +1118,8 @@ void Bunch::BunchTransferDueToLatticeTSymplectic(const ReadInputSettings &inputP
 
 void Bunch::BunchTransferDuetoSkewQuad(const ReadInputSettings &inputParameter)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
 	gsl_matrix *skewQuad  = gsl_matrix_alloc (6, 6);
 	gsl_matrix_set_identity(skewQuad);
     gsl_matrix_set(skewQuad,1,2,inputParameter.ringParBasic->skewQuadK);
@@ -766,9 +1130,8 @@ void Bunch::BunchTransferDuetoSkewQuad(const ReadInputSettings &inputParameter)
     gsl_matrix_set_zero(vecX);
     gsl_matrix_set_zero(vecX1);
     
-	for(int i=0;i<macroEleNumPerBunch;i++)
+	for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;
 		
         vecX->data[0 * vecX->tda] = ePositionX[i];
         vecX->data[1 * vecX->tda] = eMomentumX[i];
@@ -799,6 +1162,7 @@ void Bunch::BunchTransferDuetoSkewQuad(const ReadInputSettings &inputParameter)
 
 void Bunch::BunchTransferDueToLatticeT(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
+    momentsDirty = true;
 
     double circRing = inputParameter.ringParBasic->circRing;
     double *alphac = inputParameter.ringParBasic->alphac;
@@ -847,9 +1211,8 @@ void Bunch::BunchTransferDueToLatticeT(const ReadInputSettings &inputParameter,c
     
     double tmp, phiX,phiY;
 
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;
 
         phiX = phiX0 + chromX * eMomentumZ[i];
         // transformation in the x direction:
@@ -939,6 +1302,8 @@ void Bunch::BunchTransferDueToLatticeT(const ReadInputSettings &inputParameter,c
 
 void Bunch::BunchSynRadDamping(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
     //Note: the SynRadDamping and excitation is follow Yuan ZHang's PRAB paper. 
 
     // in the unit of number of truns for synchRadDampTime setting.
@@ -984,15 +1349,16 @@ void Bunch::BunchSynRadDamping(const ReadInputSettings &inputParameter,const Lat
     gsl_matrix * vecNX  = gsl_matrix_alloc (6, 1);
 
     double tempX,tempPX,tempY,tempPY,tempZ,tempPZ;
-    double randR[6];
-
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    std::normal_distribution<> dx{0,1};
+    // all normals of the turn in one call, 6 per particle
+    vector<double> randR;
+    if(macroEleNumPerBunch!=1)
+    {
+        randR.resize(6 * macroEleNumActive);
+        rndGen.Normal(6 * macroEleNumActive, randR.data());
+    }
 
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;
         
         vecX->data[0 * vecX->tda] = ePositionX[i];
         vecX->data[1 * vecX->tda] = eMomentumX[i];
@@ -1011,16 +1377,11 @@ void Bunch::BunchSynRadDamping(const ReadInputSettings &inputParameter,const Lat
     
         if(macroEleNumPerBunch!=1)
         {
-            for(int j=0;j<6;j++)
-            {
-                randR[j]=dx(gen);
-            }
-
-            vecNX->data[0 * vecNX->tda] +=  coeff[0] * randR[0];
-            vecNX->data[1 * vecNX->tda] +=  coeff[0] * randR[1];
-            vecNX->data[2 * vecNX->tda] +=  coeff[1] * randR[2];
-            vecNX->data[3 * vecNX->tda] +=  coeff[1] * randR[3];
-            vecNX->data[5 * vecNX->tda] +=  coeff[2] * randR[5];           
+            vecNX->data[0 * vecNX->tda] +=  coeff[0] * randR[6*i+0];
+            vecNX->data[1 * vecNX->tda] +=  coeff[0] * randR[6*i+1];
+            vecNX->data[2 * vecNX->tda] +=  coeff[1] * randR[6*i+2];
+            vecNX->data[3 * vecNX->tda] +=  coeff[1] * randR[6*i+3];
+            vecNX->data[5 * vecNX->tda] +=  coeff[2] * randR[6*i+5];           
         }
 
 		//(2) transfer X to x,  Eq(11)
@@ -1045,6 +1406,7 @@ void Bunch::BunchSynRadDamping(const ReadInputSettings &inputParameter,const Lat
 
 void Bunch::BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter, const int n)
 {
+    momentsDirty = true;
     // Ref to Alex Chao Eq.(2.90) in transverse and Eq.(2.86) in longitudinal
     // Can be translated to BBR model as well
     double time = 0.E0;
@@ -1059,7 +1421,7 @@ void Bunch::BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter,
 
     if(inputParameter.driveMode->drivePlane == 0) // mode is exicted in z direction
     {
-        for(int i=0;i<ePositionX.size();i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
             time = n * t0 + bunchHarmNum * tRF - ePositionZ[i] /  CLight / rBeta;            
             eMomentumZ[i] += driveAmp * cos( 2 * PI * driveFre * time) / electronBeamEnergy / pow(rBeta,2);
@@ -1067,7 +1429,7 @@ void Bunch::BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter,
     }
     else if (inputParameter.driveMode->drivePlane == 1) // mode is exicted in x direction
     {
-        for(int i=0;i<ePositionX.size();i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
             time = n * t0 + bunchHarmNum * tRF - ePositionZ[i] /  CLight / rBeta;
             eMomentumX[i] += driveAmp * sin( 2 * PI * driveFre * time);
@@ -1075,7 +1437,7 @@ void Bunch::BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter,
     }
     else if (inputParameter.driveMode->drivePlane == 2) // // mode is exicted in y direction
     {
-        for(int i=0;i<ePositionX.size();i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
             time = n * t0 + bunchHarmNum * tRF - ePositionZ[i] /  CLight / rBeta;
             eMomentumY[i] += driveAmp * sin( 2 * PI * driveFre * time);
@@ -1090,7 +1452,8 @@ void Bunch::BunchTransferDueToDriveMode(const ReadInputSettings &inputParameter,
 
 void Bunch::BunchTransferDueToWake()
 {
-    for(int i=0;i<ePositionX.size();i++)
+    momentsDirty = true;
+    for(int i=0;i<macroEleNumActive;i++)
     {
         eMomentumX[i] += lRWakeForceAver[0];      //rad
         eMomentumY[i] += lRWakeForceAver[1];    
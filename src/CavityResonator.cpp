@@ -79,6 +79,7 @@ void CavityResonator::Initial(ReadInputSettings &inputParameter)
 
         
         resonatorVec[i].resDirFB             = inputParameter.ringParRf-> resDirFB[i];
+        resonatorVec[i].sampleAtNTrf         = resonatorVec[i].resDirFB!=0;
         // set the dirFB parameter
         if(resonatorVec[i].resDirFB!=0)
         {
@@ -0,0 +1,128 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "Checkpoint.h"
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <iostream>
+
+using namespace std;
+
+static const char checkpointMagic[8] = {'C','E','T','A','C','K','P','1'};
+
+
+Checkpoint::Checkpoint()
+{
+
+}
+
+Checkpoint::~Checkpoint()
+{
+
+}
+
+void Checkpoint::Put(const string &value)
+{
+    Put(int64_t(value.size()));
+    Append(value.data(), value.size());
+}
+
+void Checkpoint::Get(string &value)
+{
+    int64_t n = 0;
+    Get(n);
+    if(n<0 || bad || readPos + n > data.size())
+    {
+        bad = true;
+        value.clear();
+        return;
+    }
+    value.assign(&data[readPos], n);
+    readPos += n;
+}
+
+void Checkpoint::Append(const void *p, size_t n)
+{
+    const char *c = (const char*)p;
+    data.insert(data.end(), c, c + n);
+}
+
+void Checkpoint::Extract(void *p, size_t n)
+{
+    if(bad || readPos + n > data.size())
+    {
+        bad = true;
+        memset(p, 0, n);
+        return;
+    }
+    memcpy(p, &data[readPos], n);
+    readPos += n;
+}
+
+bool Checkpoint::Commit(const string &fileName)
+{
+    // magic, payload length, payload -> fileName.tmp, fsync, rename over fileName, fsync of the directory
+    string tmpName = fileName + ".tmp";
+    FILE *file = fopen(tmpName.c_str(), "wb");
+    if(file==NULL)
+    {
+        cerr<<"checkpoint "<<tmpName<<" can not be opened"<<endl;
+        return false;
+    }
+
+    uint64_t length = data.size();
+    bool ok = fwrite(checkpointMagic, 1, sizeof(checkpointMagic), file) == sizeof(checkpointMagic)
+           && fwrite(&length, sizeof(length), 1, file) == 1
+           && fwrite(data.data(), 1, data.size(), file) == data.size()
+           && fflush(file) == 0
+           && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    if(!ok || rename(tmpName.c_str(), fileName.c_str()) != 0)
+    {
+        cerr<<"checkpoint "<<fileName<<" is not written, the previous one is kept"<<endl;
+        remove(tmpName.c_str());
+        return false;
+    }
+
+    size_t slash = fileName.find_last_of('/');
+    string dirName = (slash==string::npos) ? string(".") : fileName.substr(0, slash + 1);
+    int dir = open(dirName.c_str(), O_RDONLY);
+    if(dir>=0)
+    {
+        fsync(dir);
+        close(dir);
+    }
+    return true;
+}
+
+bool Checkpoint::Load(const string &fileName)
+{
+    data.clear();
+    readPos = 0;
+    bad     = false;
+
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if(file==NULL) return false;
+
+    char magic[sizeof(checkpointMagic)];
+    uint64_t length = 0;
+    bool ok = fread(magic, 1, sizeof(magic), file) == sizeof(magic)
+           && memcmp(magic, checkpointMagic, sizeof(magic)) == 0
+           && fread(&length, sizeof(length), 1, file) == 1;
+    if(ok)
+    {
+        data.resize(length);
+        ok = fread(data.data(), 1, length, file) == length;
+    }
+    fclose(file);
+
+    if(!ok) data.clear();
+    return ok;
+}
@@ -0,0 +1,142 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "FFTWPlanCache.h"
+#include <iostream>
+#include <stdio.h>
+#include <fftw3.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+using namespace std;
+
+unsigned            FFTWPlanCache::plannerFlag = FFTW_ESTIMATE;
+string              FFTWPlanCache::wisdomFile;
+map<int, fftw_plan> FFTWPlanCache::planR2C;
+map<int, fftw_plan> FFTWPlanCache::planC2R;
+map<pair<int,int>, fftw_plan> FFTWPlanCache::planDFTMany;
+
+
+void FFTWPlanCache::Initial(const ReadInputSettings &inputParameter)
+{
+    int planner = inputParameter.ringRun->fftwPlanner;
+    if     (planner==0) plannerFlag = FFTW_ESTIMATE;
+    else if(planner==1) plannerFlag = FFTW_MEASURE;
+    else if(planner==2) plannerFlag = FFTW_PATIENT;
+
+#ifdef FFTW_THREADS
+    // linked with fftw3_omp (see Makefile): the plans made from here on use the OpenMP threads
+    static int threadsInitial = fftw_init_threads();
+#ifdef _OPENMP
+    if(threadsInitial) fftw_plan_with_nthreads(omp_get_max_threads());
+#endif
+#endif
+
+    wisdomFile = inputParameter.ringRun->fftwWisdom;
+    if(wisdomFile.empty()) return;
+
+    // a missing file is not an error, it is written at the end of the first run
+    if(fftw_import_wisdom_from_filename(wisdomFile.c_str()))
+    {
+        cout<<"FFTW wisdom is imported from "<<wisdomFile<<endl;
+    }
+}
+
+void FFTWPlanCache::ExportWisdom()
+{
+    if(wisdomFile.empty()) return;
+
+    if(!fftw_export_wisdom_to_filename(wisdomFile.c_str()))
+    {
+        cerr<<"FFTW wisdom can not be written to "<<wisdomFile<<endl;
+    }
+}
+
+void FFTWPlanCache::Clear()
+{
+    for(auto &it : planR2C) fftw_destroy_plan(it.second);
+    for(auto &it : planC2R) fftw_destroy_plan(it.second);
+    for(auto &it : planDFTMany) fftw_destroy_plan(it.second);
+    planR2C.clear();
+    planC2R.clear();
+    planDFTMany.clear();
+}
+
+fftw_plan FFTWPlanCache::GetPlanR2C(int n)
+{
+    fftw_plan p;
+
+    // the fftw planner is not thread safe and the map is shared, bunch-parallel callers go through here one by one
+    #pragma omp critical(fftwPlanner)
+    {
+        auto it = planR2C.find(n);
+        if(it != planR2C.end())
+        {
+            p = it->second;
+        }
+        else
+        {
+            // MEASURE/PATIENT overwrite the arrays while planning, so plan on scratch buffers
+            double       *in  = (double*)       fftw_malloc(sizeof(double)       * n);
+            fftw_complex *out = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (n/2+1));
+            p = fftw_plan_dft_r2c_1d(n, in, out, plannerFlag);
+            fftw_free(in);
+            fftw_free(out);
+            planR2C[n] = p;
+        }
+    }
+    return p;
+}
+
+fftw_plan FFTWPlanCache::GetPlanC2R(int n)
+{
+    fftw_plan p;
+
+    #pragma omp critical(fftwPlanner)
+    {
+        auto it = planC2R.find(n);
+        if(it != planC2R.end())
+        {
+            p = it->second;
+        }
+        else
+        {
+            fftw_complex *in  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (n/2+1));
+            double       *out = (double*)       fftw_malloc(sizeof(double)       * n);
+            p = fftw_plan_dft_c2r_1d(n, in, out, plannerFlag);
+            fftw_free(in);
+            fftw_free(out);
+            planC2R[n] = p;
+        }
+    }
+    return p;
+}
+
+fftw_plan FFTWPlanCache::GetPlanDFTMany(int n, int howMany)
+{
+    fftw_plan p;
+
+    #pragma omp critical(fftwPlanner)
+    {
+        auto it = planDFTMany.find(make_pair(n,howMany));
+        if(it != planDFTMany.end())
+        {
+            p = it->second;
+        }
+        else
+        {
+            // in place: callers execute it with fftw_execute_dft(p, buf, buf)
+            fftw_complex *buf = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * n * howMany);
+            p = fftw_plan_many_dft(1, &n, howMany, buf, NULL, 1, n, buf, NULL, 1, n, FFTW_FORWARD, plannerFlag);
+            fftw_free(buf);
+            planDFTMany[make_pair(n,howMany)] = p;
+        }
+    }
+    return p;
+}
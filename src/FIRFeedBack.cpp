@@ -33,6 +33,20 @@ FIRFeedBack::~FIRFeedBack()
 
 }
 
+void FIRFeedBack::SaveState(Checkpoint &checkpoint) const
+{
+    checkpoint.Put(posxData);
+    checkpoint.Put(posyData);
+    checkpoint.Put(poszData);
+}
+
+void FIRFeedBack::LoadState(Checkpoint &checkpoint)
+{
+    checkpoint.Get(posxData);
+    checkpoint.Get(posyData);
+    checkpoint.Get(poszData);
+}
+
 void FIRFeedBack::Initial(ReadInputSettings &inputParameter)
 {
     double beamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
@@ -23,8 +23,8 @@ using std::vector;
 
 
 
-int         numProcess;
-int         myRank;
+int         numProcess = 1;     // MPI ranks, set in main when built with -DMPIMODE (make mpi)
+int         myRank     = 0;
 double TrackingTime=0.E0;
 
 
@@ -68,36 +68,6 @@ double vectorDisNorm2(vector<double> a,vector<double> b)
 }
 
 
-double Gaussrand(double rms, double aver,double randomIndex)
-{
-    static double V1, V2, S;
-    static int phase = 0;
-    double X;
-     
-     srand(time(0)+randomIndex*10);
-     
-    if ( phase == 0 ) {
-        do {
-            double U1 = (double)rand() / RAND_MAX;
-            double U2 = (double)rand() / RAND_MAX;
-             
-            V1 = 2 * U1 - 1;
-            V2 = 2 * U2 - 1;
-            S = V1 * V1 + V2 * V2;
-        } while(S >= 1 || S == 0);
-         
-        X = V1 * sqrt(-2 * log(S) / S);
-    } else
-        X = V2 * sqrt(-2 * log(S) / S);
-         
-    phase = 1 - phase;
- 
- 
-    X =  X * rms + aver;
-    return X;
-}
-
-
 void gsl_matrix_mul(gsl_matrix *a,gsl_matrix *b,gsl_matrix *c)
 {
     int dimAx = a->size1;
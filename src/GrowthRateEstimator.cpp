@@ -0,0 +1,93 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP
+//Copyright (c) 2021 DESY
+//This program is free software; you can redistribute it and/or modify
+//it under the terms of the GNU General Public License
+//Author: chao li, li.chao@desy.de
+//*************************************************************************
+
+#include "GrowthRateEstimator.h"
+#include <cmath>
+#include <iostream>
+
+void GrowthRateEstimator::Initial(int nMode, int turnStart, int turnEnd)
+{
+    this->turnStart = turnStart;
+    this->turnEnd   = turnEnd;
+    sumN .assign(nMode,0);
+    sumX .assign(nMode,0.E0);
+    sumXX.assign(nMode,0.E0);
+    sumY .assign(nMode,0.E0);
+    sumXY.assign(nMode,0.E0);
+}
+
+void GrowthRateEstimator::Add(int turn, const vector<double> &amp)
+{
+    if(turn < turnStart || turn >= turnEnd) return;
+
+    // x is counted from turnStart, which keeps the sums small and the slope free of cancellation
+    double x = turn - turnStart;
+    for(size_t i=0;i<sumN.size();i++)
+    {
+        if(!(amp[i] > 0.E0)) continue;
+        double y  = log(amp[i]);
+        sumN [i] += 1;
+        sumX [i] += x;
+        sumXX[i] += x * x;
+        sumY [i] += y;
+        sumXY[i] += x * y;
+    }
+}
+
+double GrowthRateEstimator::GetRate(int mode) const
+{
+    double n   = sumN[mode];
+    double det = n * sumXX[mode] - sumX[mode] * sumX[mode];
+    if(sumN[mode] < 2 || det <= 0.E0) return 0.E0;
+
+    return (n * sumXY[mode] - sumX[mode] * sumY[mode]) / det;
+}
+
+int GrowthRateEstimator::GetMaxRateMode() const
+{
+    int index = 0;
+    for(size_t i=1;i<sumN.size();i++)
+    {
+        if(GetRate(i) > GetRate(index)) index = i;
+    }
+    return index;
+}
+
+void GrowthRateEstimator::SaveState(Checkpoint &checkpoint) const
+{
+    checkpoint.Put(turnStart);
+    checkpoint.Put(turnEnd);
+    checkpoint.Put(sumN);
+    checkpoint.Put(sumX);
+    checkpoint.Put(sumXX);
+    checkpoint.Put(sumY);
+    checkpoint.Put(sumXY);
+}
+
+void GrowthRateEstimator::LoadState(Checkpoint &checkpoint)
+{
+    checkpoint.Get(turnStart);
+    checkpoint.Get(turnEnd);
+    checkpoint.Get(sumN);
+    checkpoint.Get(sumX);
+    checkpoint.Get(sumXX);
+    checkpoint.Get(sumY);
+    checkpoint.Get(sumXY);
+}
+
+void GrowthRateEstimator::Report(const GrowthRateEstimator &grX, const GrowthRateEstimator &grY, const GrowthRateEstimator &grZ, double t0)
+{
+    if(grX.GetModeNum()==0 || grX.GetSampleNum(0) < 2) return;
+
+    int modeX = grX.GetMaxRateMode();
+    int modeY = grY.GetMaxRateMode();
+    int modeZ = grZ.GetMaxRateMode();
+    cout<<"    CBM growth rate (mode, 1/s)  x: "<<modeX<<" "<<grX.GetRate(modeX) / t0
+        <<"  y: "<<modeY<<" "<<grY.GetRate(modeY) / t0
+        <<"  z: "<<modeZ<<" "<<grZ.GetRate(modeZ) / t0<<endl;
+}
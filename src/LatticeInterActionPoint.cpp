@@ -45,6 +45,12 @@ void LatticeInterActionPoint::Initial(const ReadInputSettings &inputParameter)
     ionMaxNumberOneInterPoint = inputParameter.ringIonEffPara->ionMaxNumber;
     ionLossBoundary           = inputParameter.ringIonEffPara->ionLossBoundary;
 
+    ionRndStream.resize(numberOfInteraction);
+    for(int k=0;k<numberOfInteraction;k++)
+    {
+        ionRndStream[k].Seed(RandomStream::IONSITE, k);
+    }
+
     gasSpec                   = inputParameter.ringIonEffPara->gasSpec;
     ionMassNumber             = inputParameter.ringIonEffPara->ionMassNumber; 
     corssSectionEI            = inputParameter.ringIonEffPara->corssSectionEI;
@@ -140,12 +146,11 @@ void LatticeInterActionPoint::Initial(const ReadInputSettings &inputParameter)
     ionPositionY       = v3d(numberOfInteraction, v2d(gasSpec) );
     ionVelocityX       = v3d(numberOfInteraction, v2d(gasSpec) );
     ionVelocityY       = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuFx        = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuFy        = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuPositionX = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuPositionY = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuVelocityX = v3d(numberOfInteraction, v2d(gasSpec) );
-    ionAccumuVelocityY = v3d(numberOfInteraction, v2d(gasSpec) );
+    ionAccumu          = vector<vector<IonStore> >(numberOfInteraction, vector<IonStore>(gasSpec) );
+    for(int k=0;k<numberOfInteraction;k++)
+    {
+        for(int p=0;p<gasSpec;p++) ionAccumu[k][p].Reserve(ionMaxNumberOneInterPoint);
+    }
 
     // ionPositionX.resize(numberOfInteraction);
     // ionPositionY.resize(numberOfInteraction);
@@ -982,16 +987,53 @@ void LatticeInterActionPoint::GetIonNumberPerInterAction(double electronNumPerBu
 
 
 
+void LatticeInterActionPoint::SaveIonState(Checkpoint &checkpoint) const
+{
+    checkpoint.Put(macroIonCharge);
+    checkpoint.Put(ionAccumuNumber);
+    for(size_t k=0;k<ionAccumu.size();k++)
+    {
+        for(size_t p=0;p<ionAccumu[k].size();p++)
+        {
+            const IonStore &ions = ionAccumu[k][p];
+            checkpoint.Put(ions.x);
+            checkpoint.Put(ions.y);
+            checkpoint.Put(ions.vx);
+            checkpoint.Put(ions.vy);
+            checkpoint.Put(ions.fx);
+            checkpoint.Put(ions.fy);
+        }
+    }
+    checkpoint.Put(ionRndStream);
+}
+
+void LatticeInterActionPoint::LoadIonState(Checkpoint &checkpoint)
+{
+    checkpoint.Get(macroIonCharge);
+    checkpoint.Get(ionAccumuNumber);
+    for(size_t k=0;k<ionAccumu.size();k++)
+    {
+        for(size_t p=0;p<ionAccumu[k].size();p++)
+        {
+            IonStore &ions = ionAccumu[k][p];
+            checkpoint.Get(ions.x);
+            checkpoint.Get(ions.y);
+            checkpoint.Get(ions.vx);
+            checkpoint.Get(ions.vy);
+            checkpoint.Get(ions.fx);
+            checkpoint.Get(ions.fy);
+            ions.Reserve(ionMaxNumberOneInterPoint);
+        }
+    }
+    checkpoint.Get(ionRndStream);
+}
+
 void LatticeInterActionPoint::IonGenerator(double rmsRx, double rmsRy, double xAver,double yAver, int k)
 {
     double tempx;
     double tempy;
 
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    
-    std::normal_distribution<> dx{xAver,rmsRx};
-    std::normal_distribution<> dy{yAver,rmsRy};
+    RandomStream &rnd = ionRndStream[k];
 
     for(int p=0;p<gasSpec;p++)
     {
@@ -1000,8 +1042,8 @@ void LatticeInterActionPoint::IonGenerator(double rmsRx, double rmsRy, double xA
         int i=0;
         while(i<macroIonNumber[k][p])
         {
-            tempx = dx(gen);
-            tempy = dy(gen);
+            tempx = xAver + rmsRx * rnd.Normal();
+            tempy = yAver + rmsRy * rnd.Normal();
 
             if( pow( (tempx-xAver)/rmsRx, 2)  + pow( (tempy-yAver)/rmsRy, 2) > 4.E0  ) // ions generated within 3 rms beam size.
             {
@@ -1018,34 +1060,47 @@ void LatticeInterActionPoint::IonGenerator(double rmsRx, double rmsRy, double xA
    }     
 }
 
+void LatticeInterActionPoint::IonStore::Reserve(int capacity)
+{
+    v1dAligned *col[6] = {&x,&y,&vx,&vy,&fx,&fy};
+    for(int c=0;c<6;c++) col[c]->reserve(capacity);
+}
+
+void LatticeInterActionPoint::IonStore::Resize(int n)
+{
+    v1dAligned *col[6] = {&x,&y,&vx,&vy,&fx,&fy};
+    for(int c=0;c<6;c++) col[c]->resize(n);
+}
+
 void LatticeInterActionPoint::IonsUpdate(int k)
 {
-    // add the macroIonNumber[k][p] new generated ions to accumulated ions
+    // add the macroIonNumber[k][p] new generated ions to accumulated ions, within the reserved ionMaxNumberOneInterPoint
     
     for(int p=0;p<gasSpec;p++)
     {
-        for(int i=0;i<macroIonNumber[k][p];i++)
-        {               
-            ionAccumuPositionX[k][p].push_back(ionPositionX[k][p][i]);
-            ionAccumuPositionY[k][p].push_back(ionPositionY[k][p][i]);
-            ionAccumuVelocityX[k][p].push_back(ionVelocityX[k][p][i]);
-            ionAccumuVelocityY[k][p].push_back(ionVelocityY[k][p][i]);
-            ionAccumuFx[k][p].push_back(0.E0);
-            ionAccumuFy[k][p].push_back(0.E0);  
-        }
-    
-        ionAccumuNumber[k][p]  =  ionAccumuPositionX[k][p].size(); 
-    }
+        IonStore &ions = ionAccumu[k][p];
+        int numOld = ions.x.size();
+        int numNew = numOld + macroIonNumber[k][p];
 
-    
-    for(int p=0;p<gasSpec;p++)
-    {
-        if(ionAccumuNumber[k][p]>ionMaxNumberOneInterPoint)
+        if(numNew>ionMaxNumberOneInterPoint)
         {
             cerr<<"the accumulated ions at "<<p<<"th interaction point is larger than limit "<<ionMaxNumberOneInterPoint<<endl;
             cerr<<"try reduce ions generate per interaction or enlarge the ionCalIonMaxNumber "<<endl;
             exit(0);
         }
+
+        ions.Resize(numNew);
+        for(int i=0;i<macroIonNumber[k][p];i++)
+        {               
+            ions.x [numOld+i] = ionPositionX[k][p][i];
+            ions.y [numOld+i] = ionPositionY[k][p][i];
+            ions.vx[numOld+i] = ionVelocityX[k][p][i];
+            ions.vy[numOld+i] = ionVelocityY[k][p][i];
+            ions.fx[numOld+i] = 0.E0;
+            ions.fy[numOld+i] = 0.E0;  
+        }
+    
+        ionAccumuNumber[k][p]  =  numNew; 
     }
 }
 
@@ -1068,8 +1123,8 @@ void LatticeInterActionPoint::IonRMSCal(int k)
         
         for(int i=0;i<ionAccumuNumber[k][p];i++)
         {
-            xSum += ionAccumuPositionX[k][p][i];
-            ySum += ionAccumuPositionY[k][p][i];
+            xSum += ionAccumu[k][p].x[i];
+            ySum += ionAccumu[k][p].y[i];
         }
     }
 
@@ -1093,8 +1148,8 @@ void LatticeInterActionPoint::IonRMSCal(int k)
         
         for(int i=0;i<ionAccumuNumber[k][p];i++)
         {
-            x2Sum += pow(ionAccumuPositionX[k][p][i] - allIonAccumuAverX[k],2) ;
-            y2Sum += pow(ionAccumuPositionY[k][p][i] - allIonAccumuAverY[k],2) ;
+            x2Sum += pow(ionAccumu[k][p].x[i] - allIonAccumuAverX[k],2) ;
+            y2Sum += pow(ionAccumu[k][p].y[i] - allIonAccumuAverY[k],2) ;
         }
     }
 
@@ -1115,7 +1170,7 @@ void LatticeInterActionPoint::IonRMSCal(int k, int p)
     double x2Aver=0;
     double y2Aver=0;
 
-    ionAccumuNumber[k][p]=ionAccumuPositionX[k][p].size();
+    ionAccumuNumber[k][p]=ionAccumu[k][p].x.size();
             
     if(ionAccumuNumber[k][p]==0)
     {
@@ -1124,18 +1179,18 @@ void LatticeInterActionPoint::IonRMSCal(int k, int p)
     }
     else if(ionAccumuNumber[k][p]==1)
     {
-        x2Aver  =  pow(ionAccumuPositionX[k][p][0],2);
-        y2Aver  =  pow(ionAccumuPositionY[k][p][0],2);
+        x2Aver  =  pow(ionAccumu[k][p].x[0],2);
+        y2Aver  =  pow(ionAccumu[k][p].y[0],2);
     }
     else
     {
-        ionAccumuAverX[k][p]   = accumulate(begin(ionAccumuPositionX[k][p]), end(ionAccumuPositionX[k][p]), 0.0) / ionAccumuNumber[k][p];
-        ionAccumuAverY[k][p]   = accumulate(begin(ionAccumuPositionY[k][p]), end(ionAccumuPositionY[k][p]), 0.0) / ionAccumuNumber[k][p]; 
+        ionAccumuAverX[k][p]   = accumulate(begin(ionAccumu[k][p].x), end(ionAccumu[k][p].x), 0.0) / ionAccumuNumber[k][p];
+        ionAccumuAverY[k][p]   = accumulate(begin(ionAccumu[k][p].y), end(ionAccumu[k][p].y), 0.0) / ionAccumuNumber[k][p]; 
 
         for(int i=0;i<ionAccumuNumber[k][p];i++)
         {
-            x2Aver  +=  pow(ionAccumuPositionX[k][p][i]-ionAccumuAverX[k][p] ,2);
-            y2Aver  +=  pow(ionAccumuPositionY[k][p][i]-ionAccumuAverY[k][p] ,2);
+            x2Aver  +=  pow(ionAccumu[k][p].x[i]-ionAccumuAverX[k][p] ,2);
+            y2Aver  +=  pow(ionAccumu[k][p].y[i]-ionAccumuAverY[k][p] ,2);
         }
     }
     
@@ -1157,48 +1212,52 @@ void LatticeInterActionPoint::IonRMSCal(int k, int p)
                                                  
 void LatticeInterActionPoint::IonTransferDueToBunch(int bunchGap,int k, double bunchEffectiveSizeXMax, double bunchEffectiveSizeYMax)
 {
-
-    for(int p=0;p<gasSpec;p++)
-    {
-        for(int i=0;i<ionAccumuNumber[k][p];i++)
-        {
-            // kick----drift model to update ion velocity and position, time step is the bunchGap
-            ionAccumuVelocityX[k][p][i] +=  ionAccumuFx[k][p][i];             // [m/s]
-            ionAccumuVelocityY[k][p][i] +=  ionAccumuFy[k][p][i];
-
-            ionAccumuPositionX[k][p][i] +=  ionAccumuVelocityX[k][p][i] * circRing/harmonics*bunchGap/CLight;
-            ionAccumuPositionY[k][p][i] +=  ionAccumuVelocityY[k][p][i] * circRing/harmonics*bunchGap/CLight;
-        }
-    }
-
-    // after tracking -- remove the lost ions here. 
+    // kick----drift model to update ion velocity and position, time step is the bunchGap. The lost ions are removed
+    // in the same pass: surviving ions are moved down in their order, O(N) per species.
     double ionLossXBoundary;
     double ionLossYBoundary;
     
     pipeAperatureX[k]>ionLossBoundary*bunchEffectiveSizeXMax ? (ionLossXBoundary = ionLossBoundary*bunchEffectiveSizeXMax) : (ionLossXBoundary = pipeAperatureX[k]);
     pipeAperatureY[k]>ionLossBoundary*bunchEffectiveSizeYMax ? (ionLossYBoundary = ionLossBoundary*bunchEffectiveSizeYMax) : (ionLossYBoundary = pipeAperatureY[k]);     
-    
+
+
     totIonChargeAtInterPoint[k]=0;
     totMacroIonsAtInterPoint[k]=0;
 
     for(int p=0;p<gasSpec;p++)
     {    
-        int i=0;
-        while(i<ionAccumuPositionX[k][p].size())       
+        IonStore &ions = ionAccumu[k][p];
+        double *x  = ions.x.data();
+        double *y  = ions.y.data();
+        double *vx = ions.vx.data();
+        double *vy = ions.vy.data();
+        double *fx = ions.fx.data();
+        double *fy = ions.fy.data();
+
+        int numIon   = ions.x.size();
+        int numAlive = 0;
+        for(int i=0;i<numIon;i++)
         {
-            if(abs(ionAccumuPositionX[k][p][i])>ionLossXBoundary ||  abs(ionAccumuPositionY[k][p][i])>ionLossYBoundary )  //ion loss ceriteria
+            double vxNew = vx[i] + fx[i];             // [m/s]
+            double vyNew = vy[i] + fy[i];
+            double xNew  = x[i]  + vxNew * circRing/harmonics*bunchGap/CLight;
+            double yNew  = y[i]  + vyNew * circRing/harmonics*bunchGap/CLight;
+
+            if(abs(xNew)>ionLossXBoundary ||  abs(yNew)>ionLossYBoundary )  //ion loss ceriteria
             {
-                ionAccumuPositionX[k][p].erase(ionAccumuPositionX[k][p].begin()+i);
-                ionAccumuPositionY[k][p].erase(ionAccumuPositionY[k][p].begin()+i);
-                ionAccumuVelocityX[k][p].erase(ionAccumuVelocityX[k][p].begin()+i);
-                ionAccumuVelocityY[k][p].erase(ionAccumuVelocityY[k][p].begin()+i);
-                ionAccumuFx[k][p].erase(ionAccumuFx[k][p].begin()+i);
-                ionAccumuFy[k][p].erase(ionAccumuFy[k][p].begin()+i);
-                i--;
+                continue;
             }
-            i++;
+
+            x [numAlive] = xNew;
+            y [numAlive] = yNew;
+            vx[numAlive] = vxNew;
+            vy[numAlive] = vyNew;
+            fx[numAlive] = fx[i];
+            fy[numAlive] = fy[i];
+            numAlive++;
         }
-        ionAccumuNumber[k][p]  =  ionAccumuPositionX[k][p].size();         
+        ions.Resize(numAlive);
+        ionAccumuNumber[k][p]  =  numAlive;         
 
         totMacroIonsAtInterPoint[k] +=  ionAccumuNumber[k][p];
         totIonChargeAtInterPoint[k] +=  ionAccumuNumber[k][p] * macroIonCharge[k][p]; 
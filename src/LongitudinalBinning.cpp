@@ -0,0 +1,89 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "LongitudinalBinning.h"
+
+using namespace std;
+
+
+void LongitudinalBinning::Bin(const double *z, int n, double zMinIn, double dzIn, int nBinsIn)
+{
+    if(valid && n==particleNum && zMinIn==zMin && dzIn==dz && nBinsIn==nBins) return;
+
+    // same particles on another grid: visit them in the old sorted order
+    bool remap = valid && n==particleNum;
+    if(remap) previous.swap(order);
+
+    zMin        = zMinIn;
+    dz          = dzIn;
+    nBins       = nBinsIn;
+    particleNum = n;
+
+    binStart.assign(nBins+1,0);
+    binIndex.resize(n);
+    order.resize(n);
+
+    // histogram, counts shifted by one for the prefix sum
+    for(int j=0;j<n;j++)
+    {
+        int i = remap ? previous[j] : j;
+        int k = int(floor((z[i] - zMin) / dz));
+        k = k < 0      ? 0       : k;
+        k = k > nBins-1 ? nBins-1 : k;
+        binIndex[i] = k;
+        binStart[k+1]++;
+    }
+    for(int k=0;k<nBins;k++) binStart[k+1] += binStart[k];
+
+    // stable scatter, binStart[k] is the write position of bin k while filling and restored afterwards
+    for(int j=0;j<n;j++)
+    {
+        int i = remap ? previous[j] : j;
+        order[binStart[binIndex[i]]++] = i;
+    }
+    for(int k=nBins;k>0;k--) binStart[k] = binStart[k-1];
+    binStart[0] = 0;
+
+    valid = true;
+}
+
+void LongitudinalBinning::DepositNGP(const double *weight, double scale, double *profile) const
+{
+    for(int k=0;k<nBins;k++)
+    {
+        const int *index = Particles(k);
+        int count = Count(k);
+        if(weight==nullptr)
+        {
+            profile[k] += scale * count;
+            continue;
+        }
+        double sum = 0.E0;
+        for(int j=0;j<count;j++) sum += weight[index[j]];
+        profile[k] += scale * sum;
+    }
+}
+
+void LongitudinalBinning::DepositCIC(const double *z, const double *weight, double scale, double *profile) const
+{
+    if(nBins==1)
+    {
+        DepositNGP(weight,scale,profile);
+        return;
+    }
+    // in bin order, the two touched bins stay in cache
+    for(int j=0;j<particleNum;j++)
+    {
+        int i = order[j];
+        int k; double f;
+        CICWeight(z[i],k,f);
+        double w = weight==nullptr ? scale : scale * weight[i];
+        profile[k]   += (1 - f) * w;
+        profile[k+1] += f       * w;
+    }
+}
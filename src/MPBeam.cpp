@@ -36,6 +36,12 @@
 #include <iomanip>
 #include <cstring>
 #include <fftw3.h>
+#include "FFTWPlanCache.h"
+#include "SDDSWriter.h"
+#include "Checkpoint.h"
+#ifdef MPIMODE
+#include <mpi.h>
+#endif
 #include <complex.h>
 #include <vector>
 #include <numeric>
@@ -57,6 +63,10 @@ MPBeam::~MPBeam()
 {
       delete strongStrongBunchInfo;
       delete quasiWakePoten;
+      delete tbtBunchAverOut;
+      delete srWakePotenOut;
+      for(int i=0;i<tbtBunchDisOut.size();i++) delete tbtBunchDisOut[i];
+      for(int i=0;i<tbtBunchProOut.size();i++) delete tbtBunchProOut[i];
     //   delete partCord;
 }
 
@@ -106,11 +116,31 @@ void MPBeam::Initial(Train &train, LatticeInterActionPoint &latticeInterActionPo
     }
     //---------------------------------------------------------------------------------------
 
+    // bunches are split over the MPI ranks in contiguous bucket ranges, evenly by count. The coupled-bunch stages
+    // (beam loading, long range wake, FIR feedback) only need the bunch moments, synchronized in MPBeamRMSCal.
+    if(totBunchNum<numProcess)
+    {
+        cerr<<"MPI ranks "<<numProcess<<" are more than the bunches "<<totBunchNum<<endl;
+        exit(0);
+    }
+    if(numProcess>1 && inputParameter.ringRun->beamIonFlag)
+    {
+        cerr<<"beam-ion interaction passes the ion cloud from bunch to bunch, it runs on a single MPI rank"<<endl;
+        exit(0);
+    }
+    bunchStart = totBunchNum *  myRank      / numProcess;
+    bunchEnd   = totBunchNum * (myRank + 1) / numProcess;
+
     // set the bunch initial distribution and prepare partCord for GPU
     int totMacroPartNum = 0;
     for(int i=0;i<totBunchNum;i++)
     {
         beamVec[i].InitialMPBunch(inputParameter);
+        if(i<bunchStart || i>=bunchEnd)
+        {
+            beamVec[i].ReleaseParticles();
+            continue;
+        }
         beamVec[i].DistriGenerator(latticeInterActionPoint,inputParameter,i);
         beamVec[i].InitialAccumPhaseAdV(latticeInterActionPoint,inputParameter);
         
@@ -149,19 +179,42 @@ void MPBeam::Initial(Train &train, LatticeInterActionPoint &latticeInterActionPo
     // workQy = workQy - floor(workQy);
     // workQz = workQz - floor(workQz);
 
-    // only works for unifrom filling patterns setings.
+    // scan frequency j is evaluated as bin j of a bucket FFT (GetIQDecomp), which also holds for non-uniform filling patterns.
+    iqTwiddle.resize(3*totBunchNum);
     for(int i=0;i<totBunchNum;i++)
     {
         freXIQDecompScan[i] = (i + workQx) * f0;
         freYIQDecompScan[i] = (i + workQy) * f0;
         freZIQDecompScan[i] = (i + workQz) * f0;
+
+        iqTwiddle[i                ] = exp(- li * 2.0 * PI * workQx * double(beamVec[i].bunchHarmNum) / double(harmonics));
+        iqTwiddle[i +   totBunchNum] = exp(- li * 2.0 * PI * workQy * double(beamVec[i].bunchHarmNum) / double(harmonics));
+        iqTwiddle[i + 2*totBunchNum] = exp(- li * 2.0 * PI * workQz * double(beamVec[i].bunchHarmNum) / double(harmonics));
     }    
 
+    // GetCBMGR growth rate window, the samples the fit on the histories takes
+    int printInterval = inputParameter.ringRun->bunchInfoPrintInterval;
+    if(printInterval)
+    {
+        int fitStart = inputParameter.ringRun->growthRateFittingStart / printInterval * printInterval;
+        int fitEnd   = inputParameter.ringRun->growthRateFittingEnd   / printInterval * printInterval;
+        cbmIdealGRX.Initial(totBunchNum,fitStart,fitEnd);
+        cbmIdealGRY.Initial(totBunchNum,fitStart,fitEnd);
+        cbmIdealGRZ.Initial(totBunchNum,fitStart,fitEnd);
+        cbmIQGRX.Initial(totBunchNum,fitStart,fitEnd);
+        cbmIQGRY.Initial(totBunchNum,fitStart,fitEnd);
+        cbmIQGRZ.Initial(totBunchNum,fitStart,fitEnd);
+    }
+
     
-    RMOutPutFiles();
+    if(myRank==0) RMOutPutFiles();
+#ifdef MPIMODE
+    MPI_Barrier(MPI_COMM_WORLD);        // old output files are gone before any rank appends
+#endif
 
    // set section is used to generate the beam filling pattern data for elegant .
-    ofstream fout1 ("elegant_filling_train_para.sdds",ios::out);
+    ofstream fout1;
+    if(myRank==0) fout1.open("elegant_filling_train_para.sdds",ios::out);
 
     fout1<<"SDDS1"<<endl;
     fout1<<"&parameter name=BucketNumber, type=long, &end"<<endl;
@@ -237,6 +290,7 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
 {
     // According the beam filling pattern, tracking from transient to get steady state Vb. Ref. Bill Chapter 7.4.2
     // The notatoion of Bill's book is the same in P.B.Wilson's Section 3. Slac Pub 6062  except li -> - li, the phase rotation oppsiste.
+    // rfResInitTransient=0: the same steady state in closed form, Resonator::GetPeriodicBeamInducedVol, O(bunches) per cavity.
 
     int resNum      = inputParameter.ringParRf->resNum;
     int ringHarmH   = inputParameter.ringParBasic->harmonics;
@@ -274,7 +328,29 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
         vbKickAccum  =   complex<double>(0,0);  // get the accumme of  vb0/2
         vbKickAver[i] =   complex<double>(0,0);
 
-        for(int n=0;n<nTurns;n++)
+        if(!inputParameter.ringParRf->resInitTransient)
+        {
+            // one turn as steps: the empty buckets before the first bunch, then each bunch with the buckets up to the next one
+            deltaL = 1.0 / f0 / ringHarmH / tF;
+            cPsi   = deltaL * tan(cavityResonator.resonatorVec[i].resDeTunePsi);
+
+            vector<complex<double> > stepVb0(1,complex<double>(0.E0,0.E0));
+            vector<complex<double> > stepExp(beamVec.size()+1,complex<double>(-deltaL,cPsi));
+            vector<int> stepNum(1,beamVec.empty() ? ringHarmH : beamVec[0].bunchHarmNum);
+
+            for(int k=0;k<beamVec.size();k++)
+            {
+                vb0  = complex<double>(-1 * cavityResonator.resonatorVec[i].resFre * 2 * PI * cavityResonator.resonatorVec[i].resShuntImpRs
+                                          /  cavityResonator.resonatorVec[i].resQualityQ0, 0.E0) *  beamVec[k].electronNumPerBunch * ElectronCharge;
+                stepVb0.push_back(vb0);
+                stepNum.push_back((k+1<beamVec.size() ? beamVec[k+1].bunchHarmNum : ringHarmH) - beamVec[k].bunchHarmNum);
+                vbKickAccum += vb0/2.0;
+            }
+
+            vbAccumAver2 = Resonator::GetPeriodicBeamInducedVol(stepVb0,stepExp,stepNum,nTurns) * double(ringHarmH);   // sum over the buckets
+        }
+
+        for(int n=0;n<nTurns && inputParameter.ringParRf->resInitTransient;n++)
         {
             int k=0;    
             for(int j=0;j<ringHarmH;j++)
@@ -338,7 +414,8 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
     vb0=(0,0);
     vbAccum=(0,0);
 
-    ofstream fout(inputParameter.ringParRf->transResonParWriteTo+".sdds");
+    ofstream fout;
+    if(myRank==0) fout.open(inputParameter.ringParRf->transResonParWriteTo+".sdds");
 	fout<<"SDDS1"<<endl;
     fout<<"&parameter name=CavAmpIdeal,      units=V,   type=float,  &end"<<endl;
 	fout<<"&parameter name=CavPhaseIdeal,    units=rad, type=float,  &end"<<endl;
@@ -368,6 +445,9 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
 	fout<<"&data mode=ascii, &end"<<endl;
 
 
+    // with the closed form, at most maxPrintTurns turns are written, each one started from its closed form voltage
+    const int maxPrintTurns = 1000;
+    int printStride;
     double time=0;
     for(int i=0; i<resNum;i++)
     {
@@ -375,6 +455,20 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
         tF     = cavityResonator.resonatorVec[i].tF  ;      // [s]
         nTurns = ceil(100 * tF * f0);
         vbAccum     =   complex<double>(0,0);
+        printStride = inputParameter.ringParRf->resInitTransient ? 1 : (nTurns + maxPrintTurns - 1) / maxPrintTurns;
+
+        double turnTime = 0.E0;
+        vector<complex<double> > printVb0(beamVec.size()), printExp(beamVec.size());
+        vector<int> printNum(beamVec.size(),1);
+        for(int j=0;j<beamVec.size();j++)
+        {
+            printVb0[j] = complex<double>(-1 * cavityResonator.resonatorVec[i].resFre * 2 * PI * cavityResonator.resonatorVec[i].resShuntImpRs /
+                                             cavityResonator.resonatorVec[i].resQualityQ0,0.E0) * beamVec[j].electronNumPerBunch * ElectronCharge;
+            tB = beamVec[j].bunchGap * 1 / f0 / ringHarmH ;
+            deltaL = tB / tF ;
+            printExp[j] = complex<double>(-deltaL, deltaL * tan(cavityResonator.resonatorVec[i].resDeTunePsi));
+            turnTime += tB;
+        }
          
         fout<<abs(cavityResonator.resonatorVec[i].resCavVolReq)           <<endl;
         fout<<arg(cavityResonator.resonatorVec[i].resCavVolReq)           <<endl;
@@ -393,15 +487,20 @@ void MPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
         fout<<    cavityResonator.resonatorVec[i].resGenPowerReflect      <<endl; 
 
         fout<<"! page number "<<i+1<<endl;
-        fout<<nTurns*beamVec.size()<<endl;
+        fout<<(nTurns + printStride - 1) / printStride * beamVec.size()<<endl;
         cavityResonator.resonatorVec[i].resGenVol = complex<double>(0.E0,0.E0);
 
-        for(int n=0;n<nTurns;n++)
+        for(int n=0;n<nTurns;n+=printStride)
         {
+            if(printStride>1)
+            {
+                vbAccum = Resonator::GetPeriodicTurnStartVol(printVb0,printExp,printNum,n);
+                time    = n * turnTime;
+            }
+
             for(int j=0;j<beamVec.size();j++)
             {
-                vb0  = complex<double>(-1 * cavityResonator.resonatorVec[i].resFre * 2 * PI * cavityResonator.resonatorVec[i].resShuntImpRs /
-                                            cavityResonator.resonatorVec[i].resQualityQ0,0.E0) * beamVec[j].electronNumPerBunch * ElectronCharge;
+                vb0  = printVb0[j];
                 vbAccum += vb0;                                       //[V]
 
                 tB = beamVec[j].bunchGap * 1 / f0 / ringHarmH ;  //[s]
@@ -478,11 +577,11 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
     int indexStart =  int ( ( -rfLen / 2. - zMinBin + dzBin / 2 ) / dzBin);
     int indexEnd   =  int ( (  rfLen / 2. - zMinBin + dzBin / 2 ) / dzBin);
     int N = indexEnd - indexStart;
-    double wz[N],wDx[N],wDy[N],wQx[N],wQy[N];
-
+    vector<double> wz(N),wDx(N),wDy(N),wQx(N),wQy(N);
 
-    double temp[nBins];
-    double wakePoten[nBins];
+    // heap buffers (nBins can be large) and plans from FFTWPlanCache
+    double *temp          = (double*) fftw_malloc(sizeof(double) * nBins);
+    double *wakePoten     = (double*) fftw_malloc(sizeof(double) * nBins);
     
     for(int i=0;i<nBins;i++)
     {
@@ -492,8 +591,8 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
     fftw_complex *r2cout  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nBins /2 +1) );  // the same size as boardBandImp.zZImp.size() // bunch specturm
     fftw_complex *c2rin   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nBins /2 +1) );  // the same size as boardBandImp.zZImp.size()
     
-    fftw_plan p = fftw_plan_dft_r2c_1d(nBins, temp, r2cout, FFTW_ESTIMATE);    // ffw, according to g++/nvcc complile flag is FFTW_MEASURE/FFTW_ESTIMATE
-    fftw_execute(p);
+    fftw_plan planC2R = FFTWPlanCache::GetPlanC2R(nBins);
+    fftw_execute_dft_r2c(FFTWPlanCache::GetPlanR2C(nBins), temp, r2cout);
 
 
     // (0) - get longitudianl quasi-wake-poten r2cout stores the pspectrum info         
@@ -505,8 +604,7 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
         c2rin[i][1] = indVF.imag();                                    // [C/s] * [Ohm] = [V]   
     }
     
-    p = fftw_plan_dft_c2r_1d(nBins, c2rin, wakePoten, FFTW_ESTIMATE);
-    fftw_execute(p);
+    fftw_execute_dft_c2r(planC2R, c2rin, wakePoten);
     for(int i=0;i<N;i++)   wz[i] = wakePoten[i+indexStart] / nBins;
 
     //(1) transverse dipole x 
@@ -516,8 +614,7 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
         c2rin[i][0] = indVF.real();
         c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
     }
-    p = fftw_plan_dft_c2r_1d(nBins, c2rin, wakePoten, FFTW_ESTIMATE);
-    fftw_execute(p); 
+    fftw_execute_dft_c2r(planC2R, c2rin, wakePoten);
     for(int i=0;i<N;i++)  wDx[i] = wakePoten[i+indexStart] / nBins;
 
 
@@ -528,8 +625,7 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
         c2rin[i][0] = indVF.real();
         c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
     }
-    p = fftw_plan_dft_c2r_1d(nBins, c2rin, wakePoten, FFTW_ESTIMATE);
-    fftw_execute(p); 
+    fftw_execute_dft_c2r(planC2R, c2rin, wakePoten);
     for(int i=0;i<N;i++)  wDy[i] = wakePoten[i+indexStart] / nBins;
 
     //(3) transverse quad x 
@@ -539,8 +635,7 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
         c2rin[i][0] = indVF.real();
         c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
     }
-    p = fftw_plan_dft_c2r_1d(nBins, c2rin, wakePoten, FFTW_ESTIMATE);
-    fftw_execute(p); 
+    fftw_execute_dft_c2r(planC2R, c2rin, wakePoten);
     for(int i=0;i<N;i++)  wQx[i] = wakePoten[i+indexStart] / nBins;
 
     //(4) transverse quad y 
@@ -550,14 +645,14 @@ void MPBeam::GetQuasiWakePoten(const ReadInputSettings &inputParameter,const Boa
         c2rin[i][0] = indVF.real();
         c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
     }
-    p = fftw_plan_dft_c2r_1d(nBins, c2rin, wakePoten, FFTW_ESTIMATE);
-    fftw_execute(p); 
+    fftw_execute_dft_c2r(planC2R, c2rin, wakePoten);
     for(int i=0;i<N;i++)  wQy[i] = wakePoten[i+indexStart] / nBins;
 
 
-    fftw_destroy_plan(p);
     fftw_free(r2cout);
     fftw_free(c2rin);
+    fftw_free(temp);
+    fftw_free(wakePoten);
 
 
     // re-generate a quasi-wake from impedance here
@@ -858,7 +953,8 @@ void MPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
         if(inputParameter.ringBBImp->timeDomain==0)  // allocate the vector used to store the impedance data
         {
             boardBandImp.ReadInImp(inputParameter);
-            for(int i=0;i<beamVec.size();i++)
+            boardBandImp.InitialFFTWBuffer(inputParameter);
+            for(int i=bunchStart;i<bunchEnd;i++)
             {
                 beamVec[i].profileForBunchBBImp.resize(boardBandImp.nBins*2-1,0E0);
                 beamVec[i].wakePotenFromBBI->wakePotenZ.resize(boardBandImp.nBins*2-1,0E0);
@@ -894,286 +990,182 @@ void MPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
     if(scFlag==2)           picBeam3D.InitialSC3D(inputParameter); 
     // 2d beam-ion effect
     BeamIon2DPIC beamIon2DPIC;
-    if(ionCalSCMethod==2)   beamIon2DPIC.InitialPIC2D(); 
-    
-
-    //-----------------------------------------------------------              
-    // turn by turn data-- average of bunches 
-    ofstream fout ("result.sdds",ios::out);
-    fout<<"SDDS1"<<endl;
-    fout<<"&parameter name=beamCurr,    units=mA,   type=float,  &end"<<endl;
-    fout<<"&parameter name=I1,          units=m,   type=float,  &end"<<endl;
-    fout<<"&parameter name=I2,          units=1/m, type=float,  &end"<<endl;
-    fout<<"&parameter name=I3,          units=1/m^2,   type=float,  &end"<<endl;
-    fout<<"&parameter name=I4,          units=1/m, type=float,  &end"<<endl;
-    fout<<"&parameter name=I5,          units=1/m, type=float,  &end"<<endl;
-    fout<<"&parameter name=Jx,                     type=float,  &end"<<endl;
-    fout<<"&parameter name=Jy,                     type=float,  &end"<<endl;
-    fout<<"&parameter name=Jz,                     type=float,  &end"<<endl;
-    fout<<"&parameter name=f1001Abs,               type=float,  &end"<<endl;
-    fout<<"&parameter name=f1010Abs,               type=float,  &end"<<endl;
-    fout<<"&parameter name=f0110Abs,               type=float,  &end"<<endl;
-    fout<<"&parameter name=f0101Abs,               type=float,  &end"<<endl;
-    fout<<"&parameter name=f1001Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&parameter name=f1010Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&parameter name=f0110Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&parameter name=f0101Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&parameter name=LCFactor,               type=float,  &end"<<endl;
-    fout<<"&column name=Turns,                     type=long,   &end"<<endl;    
-    fout<<"&column name=IonCharge,      units=e,   type=float,  &end"<<endl;
-    fout<<"&column name=maxAverX,       units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=maxAverY,       units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchX,  units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchY,  units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchZ,  units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchPX, units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchPY, units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=averAllBunchPZ, units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchX,   units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchY,   units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchZ,   units=m,   type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchPX,  units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchPY,  units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=rmsAllBunchPZ,  units=rad, type=float,  &end"<<endl;
-    fout<<"&column name=Nux,                       type=float,  &end"<<endl;
-    fout<<"&column name=Nuy,                       type=float,  &end"<<endl;
-    fout<<"&column name=deltaNu,                   type=float,  &end"<<endl;
-    fout<<"&column name=f1001Abs,               type=float,  &end"<<endl;
-    fout<<"&column name=f1010Abs,               type=float,  &end"<<endl;
-    fout<<"&column name=f1001Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&column name=f1010Arg,  units=rad,   type=float,  &end"<<endl;
-    fout<<"&column name=LCFactor,               type=float,  &end"<<endl;
-    fout<<"&column name=xyAlpha,   units=rad,   type=float,  &end"<<endl;
-    fout<<"&column name=traceA,                 type=float,  &end"<<endl;
-    fout<<"&column name=traceB,                 type=float,  &end"<<endl;
-    fout<<"&column name=traceMSubN,             type=float,  &end"<<endl;
-    fout<<"&column name=gamma0,                 type=float,  &end"<<endl;
-    fout<<"&column name=gamma1,                 type=float,  &end"<<endl;
-    fout<<"&column name=detH,                   type=float,  &end"<<endl;
+    if(ionCalSCMethod==2)   beamIon2DPIC.InitialPIC2D(inputParameter); 
 
-    for(int j=0;j<inputParameter.ringRun->TBTBunchPrintNum;j++)
+    // continue from a checkpoint (runRestartFrom). The turn-by-turn files are written anew from the restart turn.
+    int startTurn = 0;
+    if(!inputParameter.ringRun->restartFrom.empty())
     {
-        string colname = string("&column name=") + string("averX_")     + to_string(j) + string(", units=m,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("averPx_")            + to_string(j) + string(", units=rad, type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("averY_")             + to_string(j) + string(", units=m,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("averPy_")            + to_string(j) + string(", units=rad, type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("averZ_")             + to_string(j) + string(", units=m,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("averPz_")            + to_string(j) + string(", units=rad, type=float,  &end");
-        fout<<colname<<endl;
-        
-        colname = string("&column name=") + string("rmsBunchZ_")     + to_string(j) + string(", units=m,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("rmsEnergySpread_") + to_string(j) + string(", units=rad, type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("rmsRx_")         + to_string(j) + string(", units=m,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("rmsRy_")         + to_string(j) + string(", units=m,   type=float,  &end");            
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("rmsEmitx_")      + to_string(j) + string(", units=m*rad,   type=float,  &end");
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("rmsEmity_")      + to_string(j) + string(", units=m*rad,   type=float,  &end");            
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("eigenEmitx_")    + to_string(j) + string(", units=m*rad,   type=float,  &end");            
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("eigenEmity_")    + to_string(j) + string(", units=m*rad,    type=float,  &end");            
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("transmission_")  + to_string(j) + string(",                type=float,  &end");            
-        fout<<colname<<endl;
-        colname = string("&column name=") + string("xyCouplingAlpha_")  + to_string(j) + string(", units=rad,  type=float,  &end");            
-        fout<<colname<<endl;
-       
+        startTurn = LoadCheckpoint(inputParameter,latticeInterActionPoint,cavityResonator,lRWakeFunction,firFeedBack);
     }
-    fout<<"&data mode=ascii, &end"<<endl;
-    fout<<inputParameter.ringParBasic->ringCurrent <<endl;
-    for(int i=0;i<5;i++) fout<<inputParameter.ringParBasic->radIntegral[i]<<endl;
-    for(int i=0;i<3;i++) fout<<inputParameter.ringParBasic->dampingPartJ[i]<<endl;
-    fout<<abs(latticeInterActionPoint.resDrivingTerms->f1001)<<endl;
-    fout<<abs(latticeInterActionPoint.resDrivingTerms->f1010)<<endl;
-    fout<<abs(latticeInterActionPoint.resDrivingTerms->f0110)<<endl;
-    fout<<abs(latticeInterActionPoint.resDrivingTerms->f0101)<<endl;
-    fout<<arg(latticeInterActionPoint.resDrivingTerms->f1001)<<endl;
-    fout<<arg(latticeInterActionPoint.resDrivingTerms->f1010)<<endl;
-    fout<<arg(latticeInterActionPoint.resDrivingTerms->f0110)<<endl;
-    fout<<arg(latticeInterActionPoint.resDrivingTerms->f0101)<<endl;
-    fout<<latticeInterActionPoint.resDrivingTerms->linearCouplingFactor<<endl;
-
-    fout<<"! page number "<<1<<endl;
-    fout<<nTurns<<endl;
+    int checkpointInterval = inputParameter.ringRun->checkpointInterval;
 
+    // the stages of one turn, chosen once from the flags
+    TrackingPipeline pipeline;
+    BuildPipeline(pipeline,inputParameter,latticeInterActionPoint,cavityResonator,ramping,firFeedBack,boardBandImp,
+                  lRWakeFunction,sRWakeFunction,picBeam3D,beamIon2DPIC);
+    
 
-    // run loop starts, for nTrns and each trun for k interaction-points
-    for(int n=0;n<nTurns;n++)
+    //-----------------------------------------------------------              
+    // turn by turn data-- average of bunches, from the synchronized bunch moments on rank 0
+    SDDSWriter fout;
+    const char *resultPara[18][2] = {{"beamCurr","mA"},{"I1","m"},{"I2","1/m"},{"I3","1/m^2"},{"I4","1/m"},{"I5","1/m"},
+                                     {"Jx",""},{"Jy",""},{"Jz",""},{"f1001Abs",""},{"f1010Abs",""},{"f0110Abs",""},{"f0101Abs",""},
+                                     {"f1001Arg","rad"},{"f1010Arg","rad"},{"f0110Arg","rad"},{"f0101Arg","rad"},{"LCFactor",""}};
+    for(int i=0;i<18;i++) fout.DefineParameter(resultPara[i][0],resultPara[i][1],SDDSWriter::FLOAT);
+
+    const char *resultCol[30][2] = {{"IonCharge","e"},{"maxAverX","m"},{"maxAverY","m"},
+                                    {"averAllBunchX","m"},{"averAllBunchY","m"},{"averAllBunchZ","m"},
+                                    {"averAllBunchPX","rad"},{"averAllBunchPY","rad"},{"averAllBunchPZ","rad"},
+                                    {"rmsAllBunchX","m"},{"rmsAllBunchY","m"},{"rmsAllBunchZ","m"},
+                                    {"rmsAllBunchPX","rad"},{"rmsAllBunchPY","rad"},{"rmsAllBunchPZ","rad"},
+                                    {"Nux",""},{"Nuy",""},{"deltaNu",""},{"f1001Abs",""},{"f1010Abs",""},{"f1001Arg","rad"},{"f1010Arg","rad"},
+                                    {"LCFactor",""},{"xyAlpha","rad"},{"traceA",""},{"traceB",""},{"traceMSubN",""},
+                                    {"gamma0",""},{"gamma1",""},{"detH",""}};
+    fout.DefineColumn("Turns","",SDDSWriter::LONG);
+    for(int i=0;i<30;i++) fout.DefineColumn(resultCol[i][0],resultCol[i][1],SDDSWriter::FLOAT);
+
+    const char *bunchCol[16][2] = {{"averX_","m"},{"averPx_","rad"},{"averY_","m"},{"averPy_","rad"},{"averZ_","m"},{"averPz_","rad"},
+                                   {"rmsBunchZ_","m"},{"rmsEnergySpread_","rad"},{"rmsRx_","m"},{"rmsRy_","m"},
+                                   {"rmsEmitx_","m*rad"},{"rmsEmity_","m*rad"},{"eigenEmitx_","m*rad"},{"eigenEmity_","m*rad"},
+                                   {"transmission_",""},{"xyCouplingAlpha_","rad"}};
+    for(int j=0;j<inputParameter.ringRun->TBTBunchPrintNum;j++)
     {
-        if(n%10==0) cout<<n<<"  turns, bunch_0 transmission: "<<beamVec[0].transmission <<endl;
-
-        currentTurnNum = n;
-        MPBeamRMSCal(latticeInterActionPoint, 0);
-        MPGetBeamInfo();
-     
-        /*  original setting, updated to be more general
-        if(beamIonFlag) 
-        {
-            for (int k=0;k<inputParameter.ringIonEffPara->numberofIonBeamInterPoint;k++)
-            {
-                MPBeamRMSCal(latticeInterActionPoint, k);
-                MPGetBeamInfo();
-                SSBeamIonEffectOneInteractionPoint(inputParameter,latticeInterActionPoint, n, k, beamIon2DPIC);                
-                BeamTransferPerInteractionPointDueToLatticeT(inputParameter,latticeInterActionPoint,k);             //transverse transfor per interaction point                
-                if(scFlag==2)
-                {
-                    BeamTransferDueToSpaceChargePIC(picBeam3D,latticeInterActionPoint,k);
-                }
-            }
-
-            MPBeamRMSCal(latticeInterActionPoint,0);
-             
-            if(ionInfoPrintInterval && (n%ionInfoPrintInterval==0))
-            {
-                MPBeamRMSCal(latticeInterActionPoint, 0);
-                SSIonDataPrint(inputParameter,latticeInterActionPoint, n);
-            }
-        }
-        else
-        {
-            // BeamTransferPerTurnDueToLatticeT(inputParameter,latticeInterActionPoint);
-            // BeamTransferPerTurnR66AndSynRadGPU(inputParameter,latticeInterActionPoint);
-            // BeamTransferPerTurnDueToLatticeTOneTurnR66(inputParameter,latticeInterActionPoint);
-            BeamTransferPerInteractionPointDueToLatticeT(inputParameter,latticeInterActionPoint,0); 
-            MPBeamRMSCal(latticeInterActionPoint, 0);
-            
-            // 2.5D space charge from PIC if defined. longitudinal sc is not included.
-            if(scFlag==2) BeamTransferDueToSpaceChargePIC(picBeam3D,latticeInterActionPoint,0);
-            // 2.5D basseti formular or linear approximation-- longitudinal sc is not included yet
-            if(scFlag==1||scFlag==3) BeamTransferDueToSpaceChargeAnalytical(latticeInterActionPoint,0,inputParameter);
-
-        }
-
-        */
-
-        // section-by-section tracking
-        for (int k=0;k<inputParameter.ringIonEffPara->numberofIonBeamInterPoint;k++)
-        {
-            MPBeamRMSCal(latticeInterActionPoint, k);
-            MPGetBeamInfo();
-            // both ion and space charge only update beam momentrum, transient bunch size does not change
-            if(beamIonFlag) SSBeamIonEffectOneInteractionPoint(inputParameter,latticeInterActionPoint, n, k, beamIon2DPIC);                
-            if(scFlag==2) BeamTransferDueToSpaceChargePIC(picBeam3D,latticeInterActionPoint,k);
-            if(scFlag==1||scFlag==3) BeamTransferDueToSpaceChargeAnalytical(latticeInterActionPoint,k,inputParameter);
-
-            BeamTransferPerInteractionPointDueToLatticeT(inputParameter,latticeInterActionPoint,k);             //transverse transfor per interaction point                
-            MPBeamRMSCal(latticeInterActionPoint,k);   
-        }
-        // print ion information
-        if(beamIonFlag && ionInfoPrintInterval && (n%ionInfoPrintInterval==0)) SSIonDataPrint(inputParameter,latticeInterActionPoint, n);
-        
-		// skeq quadrupole if defined
-		if(inputParameter.ringParBasic->skewQuadK!=0) 	BeamTransferDueToSkewQuad(inputParameter);
-        		
-        // BeamMomtumUpdateDueToRF(inputParameter,latticeInterActionPoint,cavityResonator);
-        BeamMomtumUpdateDueToRFTest(inputParameter,latticeInterActionPoint,cavityResonator);
-        BeamLongiPosTransferOneTurn(inputParameter);
-        BeamEnergyLossOneTurn(inputParameter);
-        if(synRadDampingFlag==1) BeamSynRadDamping(inputParameter,latticeInterActionPoint);
-        
-        // Subroutine in below only change the momentum 
-        if(bBImpFlag)  BBImpBeamInteraction(inputParameter,boardBandImp,latticeInterActionPoint);
-        if(lRWakeFlag) LRWakeBeamIntaction(inputParameter,lRWakeFunction,latticeInterActionPoint);
-        if(sRWakeFlag) SRWakeBeamIntaction(inputParameter,sRWakeFunction,latticeInterActionPoint,n);
-             
-        MPBeamRMSCal(latticeInterActionPoint, 0);
-        if(fIRBunchByBunchFeedbackFlag) FIRBunchByBunchFeedback(inputParameter,firFeedBack,n);
-        if(rampFlag) ramping.RampingPara(inputParameter,latticeInterActionPoint,n);
-
+        for(int i=0;i<16;i++) fout.DefineColumn(bunchCol[i][0] + to_string(j),bunchCol[i][1],SDDSWriter::FLOAT);
+    }
 
-        if((inputParameter.driveMode->driveModeOn!=0) && (inputParameter.driveMode->driveStart <n )  &&  (inputParameter.driveMode->driveEnd >n) )
-        {
-            BeamTransferDuetoDriveMode(inputParameter,n);
-        }
+    if(myRank==0) fout.Open("result.sdds",inputParameter.ringRun->sddsBinary);
 
+    vector<double> resultParaValue;
+    resultParaValue.push_back(inputParameter.ringParBasic->ringCurrent);
+    for(int i=0;i<5;i++) resultParaValue.push_back(inputParameter.ringParBasic->radIntegral[i]);
+    for(int i=0;i<3;i++) resultParaValue.push_back(inputParameter.ringParBasic->dampingPartJ[i]);
+    resultParaValue.push_back(abs(latticeInterActionPoint.resDrivingTerms->f1001));
+    resultParaValue.push_back(abs(latticeInterActionPoint.resDrivingTerms->f1010));
+    resultParaValue.push_back(abs(latticeInterActionPoint.resDrivingTerms->f0110));
+    resultParaValue.push_back(abs(latticeInterActionPoint.resDrivingTerms->f0101));
+    resultParaValue.push_back(arg(latticeInterActionPoint.resDrivingTerms->f1001));
+    resultParaValue.push_back(arg(latticeInterActionPoint.resDrivingTerms->f1010));
+    resultParaValue.push_back(arg(latticeInterActionPoint.resDrivingTerms->f0110));
+    resultParaValue.push_back(arg(latticeInterActionPoint.resDrivingTerms->f0101));
+    resultParaValue.push_back(latticeInterActionPoint.resDrivingTerms->linearCouplingFactor);
 
+    // one page, a row per turn
+    fout.StartPage(nTurns-startTurn,resultParaValue);
 
-        MarkParticleLostInBunch(inputParameter,latticeInterActionPoint);   
-        MPBeamRMSCal(latticeInterActionPoint, 0);
-        MPGetBeamInfo();
 
+    // turn-by-turn outputs and checkpoints close the turn
+    pipeline.Add("output",[&](int n)
+    {
         double nux = inputParameter.ringParBasic->workQx - floor(inputParameter.ringParBasic->workQx); 
         double nuy = inputParameter.ringParBasic->workQy - floor(inputParameter.ringParBasic->workQy);
-        fout<<setw(15)<<left<<n
-            <<setw(15)<<left<< latticeInterActionPoint.totIonCharge
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverXMax
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverYMax
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverX        // over all bunches, \sum_i beamVec[i].xAver / totBunchNumber
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverY        // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverZ        // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverPX       // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverPY       // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchAverPZ       // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizeX     // over all bunches \sum_i pow(beamVec[i].xAver,2)/totBunchNumber 
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizeY     // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizeZ     // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizePX    // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizePY    // over all bunches
-            <<setw(15)<<left<< strongStrongBunchInfo->bunchRmsSizePZ   // over all bunches
-            <<setw(15)<<left<< nux
-            <<setw(15)<<left<< nuy
-            <<setw(15)<<left<< nuy-nux
-            <<setw(15)<<left<< abs(latticeInterActionPoint.resDrivingTerms->f1001)
-            <<setw(15)<<left<< abs(latticeInterActionPoint.resDrivingTerms->f1010)
-            <<setw(15)<<left<< arg(latticeInterActionPoint.resDrivingTerms->f1001)
-            <<setw(15)<<left<< arg(latticeInterActionPoint.resDrivingTerms->f1010)
-            <<setw(15)<<left<< latticeInterActionPoint.resDrivingTerms->linearCouplingFactor
-            <<setw(15)<<left<< latticeInterActionPoint.resDrivingTerms->xyAlpha
-            <<setw(15)<<left<< latticeInterActionPoint.traceAB[0]
-            <<setw(15)<<left<< latticeInterActionPoint.traceAB[1]
-            <<setw(15)<<left<< latticeInterActionPoint.traceAB[2]
-            <<setw(15)<<left<< latticeInterActionPoint.gammaC[0]
-            <<setw(15)<<left<< latticeInterActionPoint.gammaC[1]
-            <<setw(15)<<left<< latticeInterActionPoint.detH;
+        fout.Put(n);
+        fout.Put(latticeInterActionPoint.totIonCharge);
+        fout.Put(strongStrongBunchInfo->bunchAverXMax);
+        fout.Put(strongStrongBunchInfo->bunchAverYMax);
+        fout.Put(strongStrongBunchInfo->bunchAverX);        // over all bunches, \sum_i beamVec[i].xAver / totBunchNumber
+        fout.Put(strongStrongBunchInfo->bunchAverY);
+        fout.Put(strongStrongBunchInfo->bunchAverZ);
+        fout.Put(strongStrongBunchInfo->bunchAverPX);
+        fout.Put(strongStrongBunchInfo->bunchAverPY);
+        fout.Put(strongStrongBunchInfo->bunchAverPZ);
+        fout.Put(strongStrongBunchInfo->bunchRmsSizeX);     // over all bunches \sum_i pow(beamVec[i].xAver,2)/totBunchNumber 
+        fout.Put(strongStrongBunchInfo->bunchRmsSizeY);
+        fout.Put(strongStrongBunchInfo->bunchRmsSizeZ);
+        fout.Put(strongStrongBunchInfo->bunchRmsSizePX);
+        fout.Put(strongStrongBunchInfo->bunchRmsSizePY);
+        fout.Put(strongStrongBunchInfo->bunchRmsSizePZ);
+        fout.Put(nux);
+        fout.Put(nuy);
+        fout.Put(nuy-nux);
+        fout.Put(abs(latticeInterActionPoint.resDrivingTerms->f1001));
+        fout.Put(abs(latticeInterActionPoint.resDrivingTerms->f1010));
+        fout.Put(arg(latticeInterActionPoint.resDrivingTerms->f1001));
+        fout.Put(arg(latticeInterActionPoint.resDrivingTerms->f1010));
+        fout.Put(latticeInterActionPoint.resDrivingTerms->linearCouplingFactor);
+        fout.Put(latticeInterActionPoint.resDrivingTerms->xyAlpha);
+        fout.Put(latticeInterActionPoint.traceAB[0]);
+        fout.Put(latticeInterActionPoint.traceAB[1]);
+        fout.Put(latticeInterActionPoint.traceAB[2]);
+        fout.Put(latticeInterActionPoint.gammaC[0]);
+        fout.Put(latticeInterActionPoint.gammaC[1]);
+        fout.Put(latticeInterActionPoint.detH);
 
         for(int i=0;i<inputParameter.ringRun->TBTBunchPrintNum;i++)
         {
             int index = inputParameter.ringRun->TBTBunchDisDataBunchIndex[i];
-            fout<<setw(15)<<left<<beamVec[index].xAver
-                <<setw(15)<<left<<beamVec[index].pxAver
-                <<setw(15)<<left<<beamVec[index].yAver
-                <<setw(15)<<left<<beamVec[index].pyAver
-                <<setw(15)<<left<<beamVec[index].zAver
-                <<setw(15)<<left<<beamVec[index].pzAver
-                <<setw(15)<<left<<beamVec[index].rmsBunchLength
-                <<setw(15)<<left<<beamVec[index].rmsEnergySpread
-                <<setw(15)<<left<<beamVec[index].rmsRx
-                <<setw(15)<<left<<beamVec[index].rmsRy
-                <<setw(15)<<left<<beamVec[index].emittanceX
-                <<setw(15)<<left<<beamVec[index].emittanceY
-                <<setw(15)<<left<<beamVec[index].eigenEmitX
-                <<setw(15)<<left<<beamVec[index].eigenEmitY
-                <<setw(15)<<left<<beamVec[index].transmission
-                <<setw(15)<<left<<beamVec[index].xyCouplingAlpha;
-
-        }
-        fout<<endl;        
-        
+            fout.Put(beamVec[index].xAver);
+            fout.Put(beamVec[index].pxAver);
+            fout.Put(beamVec[index].yAver);
+            fout.Put(beamVec[index].pyAver);
+            fout.Put(beamVec[index].zAver);
+            fout.Put(beamVec[index].pzAver);
+            fout.Put(beamVec[index].rmsBunchLength);
+            fout.Put(beamVec[index].rmsEnergySpread);
+            fout.Put(beamVec[index].rmsRx);
+            fout.Put(beamVec[index].rmsRy);
+            fout.Put(beamVec[index].emittanceX);
+            fout.Put(beamVec[index].emittanceY);
+            fout.Put(beamVec[index].eigenEmitX);
+            fout.Put(beamVec[index].eigenEmitY);
+            fout.Put(beamVec[index].transmission);
+            fout.Put(beamVec[index].xyCouplingAlpha);
+        }
+
         if(bunchInfoPrintInterval && (n%bunchInfoPrintInterval==0)  )
-        {             
+        {
             MPBeamDataPrintPerTurn(n,latticeInterActionPoint,inputParameter); 
-            if(inputParameter.driveMode->driveModeOn!=0)
+            if(inputParameter.driveMode->driveModeOn!=0 && myRank==0)
             {
                 GetDriveModeGrowthRate(n,inputParameter);
             }
-            if(!inputParameter.ringRun->runCBMGR.empty())
+            if(!inputParameter.ringRun->runCBMGR.empty() && myRank==0)
             {
                 GetCBMGR(n,latticeInterActionPoint,inputParameter);
             }          
-        }                                       
+        }
+    });
+    if(checkpointInterval)
+    {
+        pipeline.Add("checkpoint",[&](int n)
+        {
+            if(((n+1)%checkpointInterval==0) && (n+1<nTurns))
+            {
+                SaveCheckpoint(n+1,inputParameter,latticeInterActionPoint,cavityResonator,lRWakeFunction,firFeedBack);
+            }
+        });
     }
-    fout.close();
+    pipeline.Profile(inputParameter,nTurns-startTurn);
+    profileBunch = inputParameter.ringRun->profileFlag==2;
+
+    // run loop starts, for nTrns and each trun for k interaction-points
+    for(int n=startTurn;n<nTurns;n++)
+    {
+        if(n%10==0) cout<<n<<"  turns, bunch_0 transmission: "<<beamVec[0].transmission <<endl;
+        if(n%10==0 && myRank==0 && !inputParameter.ringRun->runCBMGR.empty())
+        {
+            GrowthRateEstimator::Report(cbmIdealGRX,cbmIdealGRY,cbmIdealGRZ,inputParameter.ringParBasic->t0);
+        }
+
+        currentTurnNum = n;
+        pipeline.Run(n);
+
+        // beam lost: the files are closed below with the rows up to this turn
+        if(BeamLost())
+        {
+            cout<<"more than 50% particles of a bunch are lost, tracking stops at turn "<<n<<endl;
+            break;
+        }
+    }
+    fout.Close();
+    tbtBunchAverOut->Close();
+    srWakePotenOut->Close();
+    for(int i=0;i<tbtBunchDisOut.size();i++) if(tbtBunchDisOut[i]!=NULL) tbtBunchDisOut[i]->Close();
+    for(int i=0;i<tbtBunchProOut.size();i++) if(tbtBunchProOut[i]!=NULL) tbtBunchProOut[i]->Close();
 
     cout<<"End of Tracking "<<nTurns<< "Turns"<<endl;
+    pipeline.TimingReport();
+    if(profileBunch) BunchTimingReport(inputParameter);
 
 
     // if( !inputParameter.ringRun->TBTBunchHaissinski.empty() &&  !cavityResonator.resonatorVec.empty())
@@ -1187,6 +1179,139 @@ void MPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
     // } 
 
 }
+void MPBeam::BuildPipeline(TrackingPipeline &pipeline, ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                           CavityResonator &cavityResonator, Ramping &ramping, FIRFeedBack &firFeedBack, BoardBandImp &boardBandImp,
+                           WakeFunction &lRWakeFunction, WakeFunction &sRWakeFunction, PIC3D &picBeam3D, BeamIon2DPIC &beamIon2DPIC)
+{
+    // the turn of MPBeam::Run, section-by-section tracking. Stages that are off are not added, the lattice map is
+    // the specialization for the chromaticity and ADTS terms of the input.
+    int synRadDampingFlag           = inputParameter.ringRun->synRadDampingFlag;
+    int fIRBunchByBunchFeedbackFlag = inputParameter.ringRun->fIRBunchByBunchFeedbackFlag;
+    int bBImpFlag                   = inputParameter.ringRun->bBImpFlag;
+    int beamIonFlag                 = inputParameter.ringRun->beamIonFlag;
+    int lRWakeFlag                  = inputParameter.ringRun->lRWakeFlag;
+    int sRWakeFlag                  = inputParameter.ringRun->sRWakeFlag;
+    int ionInfoPrintInterval        = inputParameter.ringIonEffPara->ionInfoPrintInterval;
+    int rampFlag                    = inputParameter.ringRun->rampFlag;
+    int scFlag                      = inputParameter.ringRun->spaceChargeFlag;
+    int interPointNum               = inputParameter.ringIonEffPara->numberofIonBeamInterPoint;
+
+    bool chrom, adts;
+    Bunch::LatticeMapOptions(inputParameter,chrom,adts);
+    void (MPBeam::*latticeMap)(const ReadInputSettings&, LatticeInterActionPoint&, int);
+    if(chrom && adts)   latticeMap = &MPBeam::BeamTransferPerInteractionPointDueToLatticeT<true, true >;
+    else if(chrom)      latticeMap = &MPBeam::BeamTransferPerInteractionPointDueToLatticeT<true, false>;
+    else if(adts)       latticeMap = &MPBeam::BeamTransferPerInteractionPointDueToLatticeT<false,true >;
+    else                latticeMap = &MPBeam::BeamTransferPerInteractionPointDueToLatticeT<false,false>;
+
+    ReadInputSettings       &in  = inputParameter;
+    LatticeInterActionPoint &lat = latticeInterActionPoint;
+
+    pipeline.Add("moments",[this,&lat](int n){MPBeamRMSCal(lat,0); MPGetBeamInfo();});
+
+    for(int k=0;k<interPointNum;k++)
+    {
+        pipeline.Add("moments",[this,&lat,k](int n){MPBeamRMSCal(lat,k); MPGetBeamInfo();});
+        // both ion and space charge only update beam momentrum, transient bunch size does not change
+        if(beamIonFlag)
+            pipeline.Add("beam-ion",[this,&in,&lat,&beamIon2DPIC,k](int n){SSBeamIonEffectOneInteractionPoint(in,lat,n,k,beamIon2DPIC);});
+        if(scFlag==2)
+            pipeline.Add("space charge PIC",[this,&lat,&picBeam3D,k](int n){BeamTransferDueToSpaceChargePIC(picBeam3D,lat,k);});
+        if(scFlag==1||scFlag==3)
+            pipeline.Add("space charge analytical",[this,&in,&lat,k](int n){BeamTransferDueToSpaceChargeAnalytical(lat,k,in);});
+        //transverse transfor per interaction point
+        pipeline.Add("lattice map",[this,&in,&lat,k,latticeMap](int n){(this->*latticeMap)(in,lat,k);});
+        pipeline.Add("moments",[this,&lat,k](int n){MPBeamRMSCal(lat,k);});
+    }
+
+    // print ion information
+    if(beamIonFlag && ionInfoPrintInterval)
+    {
+        pipeline.Add("ion output",[this,&in,&lat,ionInfoPrintInterval](int n){if(n%ionInfoPrintInterval==0) SSIonDataPrint(in,lat,n);});
+    }
+
+    // skeq quadrupole if defined, the strength can be ramped
+    if(inputParameter.ringParBasic->skewQuadK!=0 || (rampFlag && inputParameter.ramping->rampingSKQ!=0))
+    {
+        pipeline.Add("skew quadrupole",[this,&in](int n){if(in.ringParBasic->skewQuadK!=0) BeamTransferDueToSkewQuad(in);});
+    }
+
+    pipeline.Add("RF",[this,&in,&lat,&cavityResonator](int n){BeamMomtumUpdateDueToRFTest(in,lat,cavityResonator);});
+    pipeline.Add("longitudinal drift",[this,&in](int n){BeamLongiPosTransferOneTurn(in);});
+    pipeline.Add("energy loss",[this,&in](int n){BeamEnergyLossOneTurn(in);});
+    if(synRadDampingFlag==1)
+        pipeline.Add("synchrotron radiation",[this,&in,&lat](int n){BeamSynRadDamping(in,lat);});
+
+    // Subroutine in below only change the momentum
+    if(bBImpFlag)
+        pipeline.Add("broadband impedance",[this,&in,&lat,&boardBandImp](int n){BBImpBeamInteraction(in,boardBandImp,lat);});
+    if(lRWakeFlag)
+        pipeline.Add("long range wake",[this,&in,&lat,&lRWakeFunction](int n){LRWakeBeamIntaction(in,lRWakeFunction,lat);});
+    if(sRWakeFlag)
+        pipeline.Add("short range wake",[this,&in,&lat,&sRWakeFunction](int n){SRWakeBeamIntaction(in,sRWakeFunction,lat,n);});
+
+    // the feedback reads the centroids only
+    pipeline.Add("moments",[this,&lat](int n){MPBeamRMSCal(lat,0,MPBunch::MOMENTS_CENTROID);});
+    if(fIRBunchByBunchFeedbackFlag)
+        pipeline.Add("FIR feedback",[this,&in,&firFeedBack](int n){FIRBunchByBunchFeedback(in,firFeedBack,n);});
+    if(rampFlag)
+        pipeline.Add("ramping",[&in,&lat,&ramping](int n){ramping.RampingPara(in,lat,n);});
+
+    if(inputParameter.driveMode->driveModeOn!=0)
+    {
+        pipeline.Add("drive mode",[this,&in](int n){if((in.driveMode->driveStart <n) && (in.driveMode->driveEnd >n)) BeamTransferDuetoDriveMode(in,n);});
+    }
+
+    pipeline.Add("particle loss",[this,&in,&lat](int n){MarkParticleLostInBunch(in,lat);});
+    pipeline.Add("moments",[this,&lat](int n){MPBeamRMSCal(lat,0); MPGetBeamInfo();});
+}
+
+void MPBeam::BunchTimingReport(const ReadInputSettings &inputParameter)
+{
+    // per bunch seconds of the bunch kernels (runProfile = 2), every rank has its own bunches
+    int totBunchNum = beamVec.size();
+    vector<double> seconds(totBunchNum * Bunch::TIMER_NUM, 0.E0);
+    for(int j=bunchStart;j<bunchEnd;j++)
+    {
+        for(int t=0;t<Bunch::TIMER_NUM;t++) seconds[j * Bunch::TIMER_NUM + t] = beamVec[j].timer[t];
+    }
+#ifdef MPIMODE
+    MPI_Allreduce(MPI_IN_PLACE,seconds.data(),seconds.size(),MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif
+    if(myRank!=0) return;
+
+    const char *timerName[Bunch::TIMER_NUM] = {"Ion","SpaceCharge","Lattice"};
+
+    SDDSWriter fout;
+    fout.DefineColumn("BunchIndex","",SDDSWriter::LONG);
+    for(int t=0;t<Bunch::TIMER_NUM;t++) fout.DefineColumn(timerName[t],"s",SDDSWriter::DOUBLE);
+    fout.DefineColumn("Total","s",SDDSWriter::DOUBLE);
+    fout.Open(inputParameter.ringRun->profileFile + "_Bunch.sdds",inputParameter.ringRun->sddsBinary);
+    fout.StartPage(totBunchNum);
+
+    int slowest = 0;
+    double totalMax = 0.E0, totalSum = 0.E0;
+    for(int j=0;j<totBunchNum;j++)
+    {
+        double total = 0.E0;
+        fout.Put(j);
+        for(int t=0;t<Bunch::TIMER_NUM;t++)
+        {
+            fout.Put(seconds[j * Bunch::TIMER_NUM + t]);
+            total += seconds[j * Bunch::TIMER_NUM + t];
+        }
+        fout.Put(total);
+        totalSum += total;
+        if(total>totalMax)
+        {
+            totalMax = total;
+            slowest  = j;
+        }
+    }
+    fout.Close();
+
+    cout<<"bunch kernels: mean "<<totalSum / totBunchNum<<" s per bunch, slowest bunch "<<slowest<<" with "<<totalMax<<" s"<<endl;
+}
 
 void MPBeam::MPGetAccumuPhaseAdv(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter)
 {
@@ -1203,13 +1328,15 @@ void MPBeam::TuneRamping(ReadInputSettings &inputParameter, double turns)
 
 void MPBeam::BeamLongiPosTransferOneTurn(const ReadInputSettings &inputParameter)
 {
-    for(int i=0;i<beamVec.size();i++) 
+    #pragma omp parallel for schedule(static)
+    for(int i=bunchStart;i<bunchEnd;i++) 
         beamVec[i].BunchLongPosTransferOneTurn(inputParameter);
 }
 
 void MPBeam::BeamTransferDueToSkewQuad(const ReadInputSettings &inputParameter)
 {
-	for(int i=0;i<beamVec.size();i++)
+    #pragma omp parallel for schedule(static)
+	for(int i=bunchStart;i<bunchEnd;i++)
     {
     	beamVec[i].BunchTransferDuetoSkewQuad(inputParameter);
     }
@@ -1218,7 +1345,8 @@ void MPBeam::BeamTransferDueToSkewQuad(const ReadInputSettings &inputParameter)
 
 void MPBeam::BeamSynRadDamping(const ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint)
 {
-    for(int j=0;j<beamVec.size();j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
         beamVec[j].BunchSynRadDamping(inputParameter,latticeInterActionPoint);
     }
@@ -1285,6 +1413,8 @@ void MPBeam::CopyPartCordFromGPU(double *partCord)
     int indStart = 0;
     for(int i=0;i<beamVec.size();i++)
     {
+        beamVec[i].momentsDirty = true;
+        beamVec[i].longBinning.Invalidate();
         for(int j=0;j<beamVec[i].macroEleNumPerBunch;j++)
         {
             beamVec[i].ePositionX[j] = partCord[indStart + 6*j  ] ;
@@ -1331,25 +1461,33 @@ void MPBeam::BBImpBeamInteraction(const ReadInputSettings &inputParameter, const
     wakePoten[0] = quasiWakePoten->binPosZ;
 
 
-    for(int j=0;j<beamVec.size();j++)
+    if(inputParameter.ringBBImp->timeDomain==1)
     {
-        if(beamVec[j].macroEleCharge==0) continue;
-        if(inputParameter.ringBBImp->timeDomain==1)
+        #pragma omp parallel for schedule(static)
+        for(int j=bunchStart;j<bunchEnd;j++)
         {
+            if(beamVec[j].macroEleCharge==0) continue;
             beamVec[j].BBImpBunchInteractionTD(inputParameter,boardBandImp,latticeInterActionPoint,wakePoten);
         }
-        else if(inputParameter.ringBBImp->timeDomain==0)
+    }
+    else if(inputParameter.ringBBImp->timeDomain==0)
+    {
+        // plans come from FFTWPlanCache and each thread uses its own boardBandImp.fftwBuffer
+        #pragma omp parallel for schedule(static)
+        for(int j=bunchStart;j<bunchEnd;j++)
         {
+            if(beamVec[j].macroEleCharge==0) continue;
             beamVec[j].BBImpBunchInteraction(inputParameter,boardBandImp,latticeInterActionPoint);
         }
-        else cerr<<"wrong setting in BoardBandImpedance namelist"<<endl;    
     }
+    else cerr<<"wrong setting in BoardBandImpedance namelist"<<endl;
 
 }
 
 void MPBeam::BeamTransferDuetoDriveMode(const ReadInputSettings &inputParameter, const int n)
 {     
-    for(int j=0;j<beamVec.size();j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
         beamVec[j].BunchTransferDueToDriveMode(inputParameter,n);     
     }
@@ -1357,12 +1495,26 @@ void MPBeam::BeamTransferDuetoDriveMode(const ReadInputSettings &inputParameter,
 
 void MPBeam::MarkParticleLostInBunch(const ReadInputSettings &inputParameter, const LatticeInterActionPoint &latticeInterActionPoint)
 {
-    for(int i=0;i<beamVec.size();i++)
+    #pragma omp parallel for schedule(static)
+    for(int i=bunchStart;i<bunchEnd;i++)
     {
         beamVec[i].MarkLostParticle(inputParameter,latticeInterActionPoint);
     }
 }
 
+bool MPBeam::BeamLost() const
+{
+    int lost = 0;
+    for(int i=bunchStart;i<bunchEnd;i++)
+    {
+        if(beamVec[i].beamLost) lost = 1;
+    }
+#ifdef MPIMODE
+    MPI_Allreduce(MPI_IN_PLACE,&lost,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+#endif
+    return lost;
+}
+
 
 
 
@@ -1506,15 +1658,15 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
     double workQz = inputParameter.ringParBasic->workQz;
     int harmonics = inputParameter.ringParBasic->harmonics;
     double tRF    = inputParameter.ringParBasic->t0 / harmonics; 
+    int nBunch    = beamVec.size();
 
-    gsl_fft_complex_wavetable * wavetable;
-	gsl_fft_complex_workspace * workspace;
-	wavetable = gsl_fft_complex_wavetable_alloc (beamVec.size());
-	workspace = gsl_fft_complex_workspace_alloc (beamVec.size());
-
-    double tempXFFT[2*beamVec.size()];
-    double tempYFFT[2*beamVec.size()];
-    double tempZFFT[2*beamVec.size()];
+    // the three planes are transformed together, mode spectrum over the bunches and IQ spectrum over the buckets
+    fftw_complex *modeFFT = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 3 * nBunch);
+    fftw_complex *iqFFT   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 3 * harmonics);
+    fftw_plan     modePlan = FFTWPlanCache::GetPlanDFTMany(nBunch,3);
+    fftw_complex *tempXFFT = modeFFT;
+    fftw_complex *tempYFFT = modeFFT +   nBunch;
+    fftw_complex *tempZFFT = modeFFT + 2*nBunch;
 
     // (1) IPAC 2022 WEPOMS010 -- Diamond-II -- WangSiWei's IPAC paper. 
     for(int i=0;i<beamVec.size();i++)
@@ -1537,17 +1689,15 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
         complex<double> zy = ( y / sqrt(betay) - li * ( sqrt(betay) * py + alphay / sqrt(betay) * y ) ) * exp (li * phasey); 
         complex<double> zz = ( z / sqrt(betaz) + li * ( sqrt(betaz) * pz + alphaz / sqrt(betaz) * z ) ) * exp (li * phasez);  
 
-        tempXFFT[2*i]  = zx.real();
-        tempYFFT[2*i]  = zy.real();
-        tempZFFT[2*i]  = zz.real();
-        tempXFFT[2*i+1]= zx.imag();
-        tempYFFT[2*i+1]= zy.imag();
-        tempZFFT[2*i+1]= zz.imag();
+        tempXFFT[i][0] = zx.real();
+        tempYFFT[i][0] = zy.real();
+        tempZFFT[i][0] = zz.real();
+        tempXFFT[i][1] = zx.imag();
+        tempYFFT[i][1] = zy.imag();
+        tempZFFT[i][1] = zz.imag();
     }
 
-    gsl_fft_complex_forward (tempXFFT,1, beamVec.size(), wavetable, workspace);
-    gsl_fft_complex_forward (tempYFFT,1, beamVec.size(), wavetable, workspace);
-    gsl_fft_complex_forward (tempZFFT,1, beamVec.size(), wavetable, workspace);
+    fftw_execute_dft(modePlan, modeFFT, modeFFT);
     
 
     // store the data after fft turn by turn for fitting
@@ -1560,20 +1710,27 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
         
     for (int i=0;i<beamVec.size();i++)
     {
-        tempXFFTAmp[i] = sqrt( pow(tempXFFT[2*i],2) + pow(tempXFFT[2*i+1],2) );
-        tempYFFTAmp[i] = sqrt( pow(tempYFFT[2*i],2) + pow(tempYFFT[2*i+1],2) );
-        tempZFFTAmp[i] = sqrt( pow(tempZFFT[2*i],2) + pow(tempZFFT[2*i+1],2) );
-        tempXFFTArg[i] = atan2(tempXFFT[2*i], tempXFFT[2*i +1]);
-        tempYFFTArg[i] = atan2(tempYFFT[2*i], tempYFFT[2*i +1]);
-        tempZFFTArg[i] = atan2(tempZFFT[2*i], tempZFFT[2*i +1]);
+        tempXFFTAmp[i] = sqrt( pow(tempXFFT[i][0],2) + pow(tempXFFT[i][1],2) );
+        tempYFFTAmp[i] = sqrt( pow(tempYFFT[i][0],2) + pow(tempYFFT[i][1],2) );
+        tempZFFTAmp[i] = sqrt( pow(tempZFFT[i][0],2) + pow(tempZFFT[i][1],2) );
+        tempXFFTArg[i] = atan2(tempXFFT[i][0], tempXFFT[i][1]);
+        tempYFFTArg[i] = atan2(tempYFFT[i][0], tempYFFT[i][1]);
+        tempZFFTArg[i] = atan2(tempZFFT[i][0], tempZFFT[i][1]);
     }
 
-    coupledBunchModeAmpX.push_back(tempXFFTAmp);
-    coupledBunchModeAmpY.push_back(tempYFFTAmp);
-    coupledBunchModeAmpZ.push_back(tempZFFTAmp);
-    coupledBunchModeArgX.push_back(tempXFFTArg);
-    coupledBunchModeArgY.push_back(tempYFFTArg);
-    coupledBunchModeArgZ.push_back(tempZFFTArg);
+    bool cbmHistory = inputParameter.ringRun->cbmHistory;
+    cbmIdealGRX.Add(turns,tempXFFTAmp);
+    cbmIdealGRY.Add(turns,tempYFFTAmp);
+    cbmIdealGRZ.Add(turns,tempZFFTAmp);
+    if(cbmHistory)
+    {
+        coupledBunchModeAmpX.push_back(tempXFFTAmp);
+        coupledBunchModeAmpY.push_back(tempYFFTAmp);
+        coupledBunchModeAmpZ.push_back(tempZFFTAmp);
+        coupledBunchModeArgX.push_back(tempXFFTArg);
+        coupledBunchModeArgY.push_back(tempYFFTArg);
+        coupledBunchModeArgZ.push_back(tempZFFTArg);
+    }
 
     //(2) Store IQ decomposition without excitation-- only show the unstable mode   
     vector<double> xIQAmpOneTurn(beamVec.size());
@@ -1583,32 +1740,22 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
     vector<double> yIQArgOneTurn(beamVec.size());
     vector<double> zIQArgOneTurn(beamVec.size());
                 
-    for(int j=0;j<freXIQDecompScan.size();j++)
+    vector<double > xOneTurn(beamVec.size());
+    vector<double > yOneTurn(beamVec.size());
+    vector<double > zOneTurn(beamVec.size());
+    for(int i=0;i<beamVec.size();i++)
     {
-        vector<complex<double> > xIQ(beamVec.size());
-        vector<complex<double> > yIQ(beamVec.size());
-        vector<complex<double> > zIQ(beamVec.size());
-        complex<double> xIQAver,yIQAver,zIQAver;
-        
-        double time = 0.0;
-        double phaseX,phaseY,phaseZ;
-                
-        for(int i=0;i<beamVec.size();i++)
-        {
-            time =  beamVec[i].bunchHarmNum * tRF ;
-
-            phaseX = - 2.0 * PI * workQx * beamVec[i].bunchHarmNum / harmonics;
-            phaseY = - 2.0 * PI * workQy * beamVec[i].bunchHarmNum / harmonics;
-            phaseZ = - 2.0 * PI * workQz * beamVec[i].bunchHarmNum / harmonics;
-
-            xIQ[i] = beamVec[i].xAver  * exp( - li * 2.0 * PI * freXIQDecompScan[j] * time) ;
-            yIQ[i] = beamVec[i].yAver  * exp( - li * 2.0 * PI * freYIQDecompScan[j] * time) ;
-            zIQ[i] = beamVec[i].zAver  * exp( - li * 2.0 * PI * freZIQDecompScan[j] * time) ;            
-        }
+        xOneTurn[i] =  beamVec[i].xAver;
+        yOneTurn[i] =  beamVec[i].yAver;
+        zOneTurn[i] =  beamVec[i].zAver;
+    }
+    GetIQDecomp(xOneTurn,yOneTurn,zOneTurn,harmonics,iqFFT);
 
-        xIQAver =   accumulate(xIQ.begin(), xIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-        yIQAver =   accumulate(yIQ.begin(), yIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-        zIQAver =   accumulate(zIQ.begin(), zIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());       
+    for(int j=0;j<freXIQDecompScan.size();j++)
+    {
+        complex<double> xIQAver = complex<double>(iqFFT[j              ][0], iqFFT[j              ][1]) / double(beamVec.size());
+        complex<double> yIQAver = complex<double>(iqFFT[j +   harmonics][0], iqFFT[j +   harmonics][1]) / double(beamVec.size());
+        complex<double> zIQAver = complex<double>(iqFFT[j + 2*harmonics][0], iqFFT[j + 2*harmonics][1]) / double(beamVec.size());
 
         xIQAmpOneTurn[j] = abs(xIQAver);
         yIQAmpOneTurn[j] = abs(yIQAver);
@@ -1619,28 +1766,28 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
         zIQArgOneTurn[j] = arg(zIQAver);
     }
 
-    ampXIQ.push_back(xIQAmpOneTurn);
-    ampYIQ.push_back(yIQAmpOneTurn);
-    ampZIQ.push_back(zIQAmpOneTurn);
-    argXIQ.push_back(xIQArgOneTurn);
-    argYIQ.push_back(yIQArgOneTurn); 
-    argZIQ.push_back(zIQArgOneTurn);      
+    cbmIQGRX.Add(turns,xIQAmpOneTurn);
+    cbmIQGRY.Add(turns,yIQAmpOneTurn);
+    cbmIQGRZ.Add(turns,zIQAmpOneTurn);
+    if(cbmHistory)
+    {
+        ampXIQ.push_back(xIQAmpOneTurn);
+        ampYIQ.push_back(yIQAmpOneTurn);
+        ampZIQ.push_back(zIQAmpOneTurn);
+        argXIQ.push_back(xIQArgOneTurn);
+        argYIQ.push_back(yIQArgOneTurn); 
+        argZIQ.push_back(zIQArgOneTurn);      
+    }
     //IQ decomposition --------------------------------
 
 
     //(3)  store beam pos data for bunch-by-bunch Growth rate calculation
-    vector<double > xOneTurn(beamVec.size());
-    vector<double > yOneTurn(beamVec.size());
-    vector<double > zOneTurn(beamVec.size());
-    for(int i=0;i<beamVec.size();i++)
+    if(cbmHistory)
     {
-        xOneTurn[i] =  beamVec[i].xAver;
-        yOneTurn[i] =  beamVec[i].yAver;
-        zOneTurn[i] =  beamVec[i].zAver;
+        historyAverX.push_back(xOneTurn);
+        historyAverY.push_back(yOneTurn);
+        historyAverZ.push_back(zOneTurn);
     }
-    historyAverX.push_back(xOneTurn);
-    historyAverY.push_back(yOneTurn);
-    historyAverZ.push_back(zOneTurn);
 
     // Ideal method agrees with Analytical method. 
     // To get stable and unstbale coupled bunch mode grwoth-- have to rebuild the (x-px) along the ring.
@@ -1650,7 +1797,8 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
     // 
     if( (turns + inputParameter.ringRun->bunchInfoPrintInterval)  == inputParameter.ringRun->nTurns   )
     {               
-        GetAnalyticalWithFilter(inputParameter);
+        // without the histories only the ideal and IQ mode growth rates are written (rates fitted while tracking), no rows
+        if(cbmHistory) GetAnalyticalWithFilter(inputParameter);
     
         int indexStart =  int(inputParameter.ringRun->growthRateFittingStart / inputParameter.ringRun->bunchInfoPrintInterval);
         int indexEnd   =  int(inputParameter.ringRun->growthRateFittingEnd / inputParameter.ringRun->bunchInfoPrintInterval);  
@@ -1658,12 +1806,8 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
 
         double fitWeight[dim];
         double fitX[dim];
-        double fitFFTX[dim],    fitFFTY[dim],  fitFFTZ[dim];
-        double fitAmpIQX[dim], fitAmpIQY[dim], fitAmpIQZ[dim];
         double fitAbsAverXAna[dim],fitAbsAverYAna[dim],fitAbsAverZAna[dim];
         double fitHilbertCBMX[dim],fitHilbertCBMY[dim],fitHilbertCBMZ[dim];
-        vector<double> resFitFFTX(2,0.E0), resFitFFTY(2,0.E0), resFitFFTZ(2,0.E0);
-        vector<double> resFitIQX(2,0.E0),  resFitIQY(2,0.E0),  resFitIQZ(2,0.E0);
         vector<double> resFitAbsAverXAna(2,0.E0),  resFitAbsAverYAna(2,0.E0),  resFitAbsAverZAna(2,0.E0);
         vector<double> resfitHilbertCBMX(2,0.E0),  resfitHilbertCBMY(2,0.E0),  resfitHilbertCBMZ(2,0.E0);
         
@@ -1698,25 +1842,23 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
                 complex<double> zy = ( y / sqrt(betay) - li * ( sqrt(betay) * py + alphay / sqrt(betay) * y ) ) * exp (li * phasey); 
                 complex<double> zz = ( z / sqrt(betaz) + li * ( sqrt(betaz) * pz + alphaz / sqrt(betaz) * z ) ) * exp (li * phasez);
 
-                tempXFFT[2*i]  = zx.real();
-                tempYFFT[2*i]  = zy.real();
-                tempZFFT[2*i]  = zz.real();
-                tempXFFT[2*i+1]= zx.imag();
-                tempYFFT[2*i+1]= zy.imag();
-                tempZFFT[2*i+1]= zz.imag();
+                tempXFFT[i][0] = zx.real();
+                tempYFFT[i][0] = zy.real();
+                tempZFFT[i][0] = zz.real();
+                tempXFFT[i][1] = zx.imag();
+                tempYFFT[i][1] = zy.imag();
+                tempZFFT[i][1] = zz.imag();
             }
-            gsl_fft_complex_forward (tempXFFT,1, beamVec.size(), wavetable, workspace);
-            gsl_fft_complex_forward (tempYFFT,1, beamVec.size(), wavetable, workspace);
-            gsl_fft_complex_forward (tempZFFT,1, beamVec.size(), wavetable, workspace);
+            fftw_execute_dft(modePlan, modeFFT, modeFFT);
 
             for (int i=0;i<beamVec.size();i++)
             {
-                tempXFFTAmp[i] = sqrt( pow(tempXFFT[2*i],2) + pow(tempXFFT[2*i+1],2) );
-                tempYFFTAmp[i] = sqrt( pow(tempYFFT[2*i],2) + pow(tempYFFT[2*i+1],2) );
-                tempZFFTAmp[i] = sqrt( pow(tempZFFT[2*i],2) + pow(tempZFFT[2*i+1],2) );
-                tempXFFTArg[i] = atan2(tempXFFT[2*i], tempXFFT[2*i +1]);
-                tempYFFTArg[i] = atan2(tempYFFT[2*i], tempYFFT[2*i +1]);
-                tempZFFTArg[i] = atan2(tempZFFT[2*i], tempZFFT[2*i +1]);
+                tempXFFTAmp[i] = sqrt( pow(tempXFFT[i][0],2) + pow(tempXFFT[i][1],2) );
+                tempYFFTAmp[i] = sqrt( pow(tempYFFT[i][0],2) + pow(tempYFFT[i][1],2) );
+                tempZFFTAmp[i] = sqrt( pow(tempZFFT[i][0],2) + pow(tempZFFT[i][1],2) );
+                tempXFFTArg[i] = atan2(tempXFFT[i][0], tempXFFT[i][1]);
+                tempYFFTArg[i] = atan2(tempYFFT[i][0], tempYFFT[i][1]);
+                tempZFFTArg[i] = atan2(tempZFFT[i][0], tempZFFT[i][1]);
             }
 
             hilbertCoupledBunchModeAmpX.push_back(tempXFFTAmp);
@@ -1789,16 +1931,10 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
             
         for(int i=0; i<beamVec.size(); i++)
         {
-            for(int n=0;n<dim;n++)
+            for(int n=0;n<dim && cbmHistory;n++)
             {                
                 fitWeight[n]            = 1.E0;
                 fitX[n]                 = n * inputParameter.ringRun->bunchInfoPrintInterval;
-                fitFFTX[n]              = log(coupledBunchModeAmpX[n+indexStart][i]);
-                fitFFTY[n]              = log(coupledBunchModeAmpY[n+indexStart][i]);
-                fitFFTZ[n]              = log(coupledBunchModeAmpZ[n+indexStart][i]);
-                fitAmpIQX[n]            = log(              ampXIQ[n+indexStart][i]);
-                fitAmpIQY[n]            = log(              ampYIQ[n+indexStart][i]);
-                fitAmpIQZ[n]            = log(              ampZIQ[n+indexStart][i]);
                 fitHilbertCBMX[n]       = log(hilbertCoupledBunchModeAmpX[n+indexStart][i]);
                 fitHilbertCBMY[n]       = log(hilbertCoupledBunchModeAmpY[n+indexStart][i]);
                 fitHilbertCBMZ[n]       = log(hilbertCoupledBunchModeAmpZ[n+indexStart][i]);
@@ -1810,31 +1946,28 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
 
             }
                      
-            resFitFFTX        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTX,dim);
-            resFitFFTY        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTY,dim);   
-            resFitFFTZ        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTZ,dim); 
-            resFitIQX         = fittingGSL.FitALinear(fitX,fitWeight,fitAmpIQX,dim);
-            resFitIQY         = fittingGSL.FitALinear(fitX,fitWeight,fitAmpIQY,dim);
-            resFitIQZ         = fittingGSL.FitALinear(fitX,fitWeight,fitAmpIQZ,dim);
-
-            resfitHilbertCBMX = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMX,dim);
-            resfitHilbertCBMY = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMY,dim);
-            resfitHilbertCBMZ = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMZ,dim);
+            // the Hilbert and bunch growth rates need the whole history, the mode growth rates are fitted while tracking
+            if(cbmHistory)
+            {
+                resfitHilbertCBMX = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMX,dim);
+                resfitHilbertCBMY = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMY,dim);
+                resfitHilbertCBMZ = fittingGSL.FitALinear(fitX,fitWeight,fitHilbertCBMZ,dim);
 
-            resFitAbsAverXAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverXAna,dim);
-            resFitAbsAverYAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverYAna,dim);
-            resFitAbsAverZAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverZAna,dim);
+                resFitAbsAverXAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverXAna,dim);
+                resFitAbsAverYAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverYAna,dim);
+                resFitAbsAverZAna = fittingGSL.FitALinear(fitX,fitWeight,fitAbsAverZAna,dim);
+            }
 
 
             fout<<"! page number "<<i<<endl;
             fout<<setw(15)<<left<<dim<<endl;           
             fout<<setw(15)<<left<<i<<endl;
-            fout<<setw(15)<<left<<resFitFFTX[1] / inputParameter.ringParBasic->t0<<endl;
-            fout<<setw(15)<<left<<resFitFFTY[1] / inputParameter.ringParBasic->t0<<endl; 
-            fout<<setw(15)<<left<<resFitFFTZ[1] / inputParameter.ringParBasic->t0<<endl;
-            fout<<setw(15)<<left<<resFitIQX[1]  / inputParameter.ringParBasic->t0<<endl;
-            fout<<setw(15)<<left<<resFitIQY[1]  / inputParameter.ringParBasic->t0<<endl; 
-            fout<<setw(15)<<left<<resFitIQZ[1]  / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<cbmIdealGRX.GetRate(i) / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<cbmIdealGRY.GetRate(i) / inputParameter.ringParBasic->t0<<endl; 
+            fout<<setw(15)<<left<<cbmIdealGRZ.GetRate(i) / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<cbmIQGRX.GetRate(i)    / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<cbmIQGRY.GetRate(i)    / inputParameter.ringParBasic->t0<<endl; 
+            fout<<setw(15)<<left<<cbmIQGRZ.GetRate(i)    / inputParameter.ringParBasic->t0<<endl;
             fout<<setw(15)<<left<<resfitHilbertCBMX[1] / inputParameter.ringParBasic->t0<<endl;
             fout<<setw(15)<<left<<resfitHilbertCBMY[1] / inputParameter.ringParBasic->t0<<endl; 
             fout<<setw(15)<<left<<resfitHilbertCBMZ[1] / inputParameter.ringParBasic->t0<<endl; 
@@ -1885,10 +2018,32 @@ void MPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
         fout.close();
     }
 
-    gsl_fft_complex_workspace_free (workspace);
-    gsl_fft_complex_wavetable_free (wavetable);
+    fftw_free(modeFFT);
+    fftw_free(iqFFT);
+}
+
+void MPBeam::GetIQDecomp(const vector<double> &x, const vector<double> &y, const vector<double> &z, int harmonics, fftw_complex *iq)
+{
+    // IQ decomposition at all scan frequencies (j + Q) f0 at once. With t_i = h_i tRF, sum_i x_i exp(-li 2 PI (j + Q) h_i / H)
+    // is bin j of the length H DFT of x_i exp(-li 2 PI Q h_i / H) put into bucket h_i, empty buckets are zero.
+    // iq holds 3 * harmonics values (x y z), one batched FFT instead of the bunch x frequency scan.
+    int nBunch = beamVec.size();
+    const vector<double> *pos[3] = {&x, &y, &z};
 
+    memset(iq, 0, sizeof(fftw_complex) * 3 * harmonics);
+    for(int p=0;p<3;p++)
+    {
+        for(int i=0;i<nBunch;i++)
+        {
+            complex<double> v = (*pos[p])[i] * iqTwiddle[p*nBunch + i];
+            int h = p*harmonics + beamVec[i].bunchHarmNum;
+            iq[h][0] = v.real();
+            iq[h][1] = v.imag();
+        }
+    }
+    fftw_execute_dft(FFTWPlanCache::GetPlanDFTMany(harmonics,3), iq, iq);
 }
+
 void MPBeam::GetAnalyticalWithFilter(const ReadInputSettings &inputParameter)
 {
     int turns = historyAverX.size();
@@ -2116,21 +2271,298 @@ void MPBeam::GetAnalyticalLongitudinalPhaseSpace(ReadInputSettings &inputParamet
 
 void MPBeam::SRWakeBeamIntaction(const  ReadInputSettings &inputParameter, WakeFunction &sRWakeFunction, const  LatticeInterActionPoint &latticeInterActionPoint, int turns)
 {
-    for(int j=0;j<beamVec.size();j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
          beamVec[j].BunchTransferDueToSRWake(inputParameter,sRWakeFunction,latticeInterActionPoint,turns);
     }
+
+    // wake potentials are written after the bunch loop, keeps the bunch order in the file for any thread number.
+    // With MPI rank 0 writes the header and the ranks append their bunches one after the other.
+    int printInterval = inputParameter.ringRun->bunchInfoPrintInterval;
+    if(printInterval==0 || turns%printInterval!=0) return;
+
+    if(!srWakePotenOut->IsOpen())
+    {
+        const char *colName[5] = {"z","profile","wakePotenX","wakePotenY","wakePotenZ"};
+        for(int k=0;k<5;k++) srWakePotenOut->DefineColumn(colName[k],k==0?"m":"",SDDSWriter::FLOAT);
+        string fname = inputParameter.ringSRWake->SRWWakePotenWriteTo+".sdds";
+        if(myRank==0)
+        {
+            srWakePotenOut->Open(fname,inputParameter.ringRun->sddsBinary);
+            srWakePotenOut->Flush();
+        }
+#ifdef MPIMODE
+        MPI_Barrier(MPI_COMM_WORLD);
+#endif
+        if(myRank!=0) srWakePotenOut->Open(fname,inputParameter.ringRun->sddsBinary,false);
+    }
+
+    for(int r=0;r<numProcess;r++)
+    {
+        if(r==myRank)
+        {
+            for(int j=bunchStart;j<bunchEnd;j++)
+            {
+                beamVec[j].SRWakePotenPrint(*srWakePotenOut);
+            }
+            if(numProcess>1) srWakePotenOut->Flush();
+        }
+#ifdef MPIMODE
+        MPI_Barrier(MPI_COMM_WORLD);
+#endif
+    }
 }   
 
 
-void MPBeam::MPBeamRMSCal(LatticeInterActionPoint &latticeInterActionPoint, int k)
+void MPBeam::MPBeamRMSCal(LatticeInterActionPoint &latticeInterActionPoint, int k, int level)
 {
-    for(int j=0;j<beamVec.size();j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
-        beamVec[j].GetMPBunchRMS(latticeInterActionPoint,k);
+        beamVec[j].GetMPBunchRMS(latticeInterActionPoint,k,level);
     } 
+    MPISyncBunchMoments();
+}
+
+#ifdef MPIMODE
+// bunch moments read by the coupled-bunch stages and the outputs on every rank
+static void GetBunchMomentFields(MPBunch &bunch, vector<double*> &field)
+{
+    double *moment[] = {&bunch.xAver, &bunch.yAver, &bunch.zAver, &bunch.pxAver, &bunch.pyAver, &bunch.pzAver,
+                        &bunch.rmsRx, &bunch.rmsRy, &bunch.rmsBunchLength, &bunch.rmsEnergySpread,
+                        &bunch.emittanceX, &bunch.emittanceY, &bunch.emittanceZ, &bunch.eigenEmitX, &bunch.eigenEmitY,
+                        &bunch.xyCouplingAlpha, &bunch.rmsEffectiveRingEmitX, &bunch.rmsEffectiveRingEmitY,
+                        &bunch.rmsEffectiveRingEmitZ, &bunch.rmsEffectiveRx, &bunch.rmsEffectiveRy, &bunch.transmission,
+                        &bunch.zMinCurrentTurn, &bunch.zMaxCurrentTurn, &bunch.totIonCharge};
+    field.assign(moment, moment + sizeof(moment)/sizeof(moment[0]));
+
+    // complex<double> is laid out as double[2]
+    for(int i=0;i<bunch.bunchRFModeInfo->cavVolBunchCen.size();i++)
+    {
+        complex<double> *vol[3] = {&bunch.bunchRFModeInfo->cavVolBunchCen[i], &bunch.bunchRFModeInfo->genVolBunchAver[i],
+                                   &bunch.bunchRFModeInfo->induceVolBunchCen[i]};
+        for(int k=0;k<3;k++)
+        {
+            field.push_back(reinterpret_cast<double*>(vol[k])    );
+            field.push_back(reinterpret_cast<double*>(vol[k]) + 1);
+        }
+    }
+}
+
+static void GetBunchZMinMaxFields(MPBunch &bunch, vector<double*> &field)
+{
+    field.assign(1,&bunch.zMinCurrentTurn);
+    field.push_back(&bunch.zMaxCurrentTurn);
+}
+
+// every rank contributes the fields of beamVec[bunchStart,bunchEnd) and receives those of all the other bunches
+static void MPIAllgatherBunchFields(vector<MPBunch> &beamVec, int bunchStart, int bunchEnd, void (*getFields)(MPBunch &, vector<double*> &))
+{
+    int totBunchNum = beamVec.size();
+    vector<double*> field;
+    getFields(beamVec[0],field);
+    int nField = field.size();
+
+    vector<double> sendBuf(nField * (bunchEnd - bunchStart));
+    for(int j=bunchStart;j<bunchEnd;j++)
+    {
+        getFields(beamVec[j],field);
+        for(int k=0;k<nField;k++) sendBuf[(j-bunchStart)*nField + k] = *field[k];
+    }
+
+    vector<int> recvCount(numProcess), displs(numProcess);
+    for(int r=0;r<numProcess;r++)
+    {
+        int start = totBunchNum *  r      / numProcess;
+        int end   = totBunchNum * (r + 1) / numProcess;
+        recvCount[r] = nField * (end - start);
+        displs[r]    = nField * start;
+    }
+
+    vector<double> recvBuf(nField * totBunchNum);
+    MPI_Allgatherv(sendBuf.data(),sendBuf.size(),MPI_DOUBLE,recvBuf.data(),recvCount.data(),displs.data(),MPI_DOUBLE,MPI_COMM_WORLD);
+
+    for(int j=0;j<totBunchNum;j++)
+    {
+        if(j>=bunchStart && j<bunchEnd) continue;
+        getFields(beamVec[j],field);
+        for(int k=0;k<nField;k++) *field[k] = recvBuf[j*nField + k];
+    }
+}
+#endif
+
+void MPBeam::MPISyncBunchMoments()
+{
+#ifdef MPIMODE
+    if(numProcess>1) MPIAllgatherBunchFields(beamVec,bunchStart,bunchEnd,GetBunchMomentFields);
+#endif
+}
+
+void MPBeam::MPISyncBunchZMinMax()
+{
+#ifdef MPIMODE
+    if(numProcess>1) MPIAllgatherBunchFields(beamVec,bunchStart,bunchEnd,GetBunchZMinMaxFields);
+#endif
+}
+
+
+static string CheckpointFileName(const string &prefix)
+{
+    // one file per MPI rank, each rank keeps the particles of its own bunches
+    return numProcess>1 ? prefix + "." + to_string(myRank) : prefix;
+}
+
+void MPBeam::SaveCheckpoint(int nextTurn, const ReadInputSettings &inputParameter, const LatticeInterActionPoint &latticeInterActionPoint,
+                            const CavityResonator &cavityResonator, const WakeFunction &lRWakeFunction, const FIRFeedBack &firFeedBack)
+{
+    // state at the start of turn nextTurn: owned bunches, and the state every rank holds the same copy of
+    // (ramped parameters, cavity, long range wake and feedback histories, ions). Moments are recomputed by the next turn.
+    Checkpoint checkpoint;
+    checkpoint.Put(nextTurn);
+    checkpoint.Put(numProcess);
+    checkpoint.Put(int(beamVec.size()));
+    checkpoint.Put(bunchStart);
+    checkpoint.Put(bunchEnd);
+
+    checkpoint.Put(inputParameter.ringParBasic->workQx);
+    checkpoint.Put(inputParameter.ringParBasic->workQy);
+    checkpoint.Put(inputParameter.ringParBasic->skewQuadK);
+
+    vector<double> resState;
+    checkpoint.Put(int(cavityResonator.resonatorVec.size()));
+    for(int j=0;j<cavityResonator.resonatorVec.size();j++)
+    {
+        cavityResonator.resonatorVec[j].PackDynamicState(resState);
+        checkpoint.Put(resState);
+    }
+
+    lRWakeFunction.SaveLRWakeState(checkpoint);
+    firFeedBack.SaveState(checkpoint);
+    latticeInterActionPoint.SaveIonState(checkpoint);
+
+    for(int i=bunchStart;i<bunchEnd;i++)
+    {
+        beamVec[i].SaveState(checkpoint);
+    }
+
+    // coupled bunch mode histories of GetCBMGR and GetDriveModeGrowthRate (rank 0)
+    const vector<vector<double> > *history[15] = {&coupledBunchModeAmpX,&coupledBunchModeAmpY,&coupledBunchModeAmpZ,
+                                                  &coupledBunchModeArgX,&coupledBunchModeArgY,&coupledBunchModeArgZ,
+                                                  &ampXIQ,&ampYIQ,&ampZIQ,&argXIQ,&argYIQ,&argZIQ,
+                                                  &historyAverX,&historyAverY,&historyAverZ};
+    for(int h=0;h<15;h++) checkpoint.Put(*history[h]);
+    checkpoint.Put(ampIQ);
+    checkpoint.Put(phaseIQ);
+
+    // growth rate fits of GetCBMGR so far, continued after the restart
+    const GrowthRateEstimator *cbmGR[6] = {&cbmIdealGRX,&cbmIdealGRY,&cbmIdealGRZ,&cbmIQGRX,&cbmIQGRY,&cbmIQGRZ};
+    for(int h=0;h<6;h++) cbmGR[h]->SaveState(checkpoint);
+
+    string fileName = CheckpointFileName(inputParameter.ringRun->checkpointFile);
+    if(checkpoint.Commit(fileName))
+    {
+        cout<<"checkpoint "<<fileName<<" at turn "<<nextTurn<<endl;
+    }
 }
 
+int MPBeam::LoadCheckpoint(ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                           CavityResonator &cavityResonator, WakeFunction &lRWakeFunction, FIRFeedBack &firFeedBack)
+{
+    // reads back in the order of SaveCheckpoint, after Initial() and the set up of the Run objects
+    string fileName = CheckpointFileName(inputParameter.ringRun->restartFrom);
+    Checkpoint checkpoint;
+    if(!checkpoint.Load(fileName))
+    {
+        cerr<<"checkpoint "<<fileName<<" can not be read, or is not complete"<<endl;
+        exit(0);
+    }
+
+    int nextTurn, ranks, bunchNum, start, end;
+    checkpoint.Get(nextTurn);
+    checkpoint.Get(ranks);
+    checkpoint.Get(bunchNum);
+    checkpoint.Get(start);
+    checkpoint.Get(end);
+    if(ranks!=numProcess || bunchNum!=beamVec.size() || start!=bunchStart || end!=bunchEnd)
+    {
+        cerr<<"checkpoint "<<fileName<<" is from a run with "<<bunchNum<<" bunches on "<<ranks<<" MPI ranks"<<endl;
+        exit(0);
+    }
+
+    checkpoint.Get(inputParameter.ringParBasic->workQx);
+    checkpoint.Get(inputParameter.ringParBasic->workQy);
+    checkpoint.Get(inputParameter.ringParBasic->skewQuadK);
+
+    int resNum;
+    vector<double> resState, resStateNow;
+    checkpoint.Get(resNum);
+    if(resNum!=cavityResonator.resonatorVec.size())
+    {
+        cerr<<"checkpoint "<<fileName<<" has "<<resNum<<" cavity resonators"<<endl;
+        exit(0);
+    }
+    for(int j=0;j<resNum;j++)
+    {
+        checkpoint.Get(resState);
+        cavityResonator.resonatorVec[j].PackDynamicState(resStateNow);
+        if(resState.size()!=resStateNow.size())
+        {
+            cerr<<"checkpoint "<<fileName<<": sample number of resonator "<<j<<" differs from the input"<<endl;
+            exit(0);
+        }
+        cavityResonator.resonatorVec[j].UnpackDynamicState(resState);
+    }
+
+    lRWakeFunction.LoadLRWakeState(checkpoint);
+    firFeedBack.LoadState(checkpoint);
+    latticeInterActionPoint.LoadIonState(checkpoint);
+
+    for(int i=bunchStart;i<bunchEnd;i++)
+    {
+        beamVec[i].LoadState(checkpoint);
+    }
+
+    vector<vector<double> > *history[15] = {&coupledBunchModeAmpX,&coupledBunchModeAmpY,&coupledBunchModeAmpZ,
+                                            &coupledBunchModeArgX,&coupledBunchModeArgY,&coupledBunchModeArgZ,
+                                            &ampXIQ,&ampYIQ,&ampZIQ,&argXIQ,&argYIQ,&argZIQ,
+                                            &historyAverX,&historyAverY,&historyAverZ};
+    for(int h=0;h<15;h++) checkpoint.Get(*history[h]);
+    checkpoint.Get(ampIQ);
+    checkpoint.Get(phaseIQ);
+
+    GrowthRateEstimator *cbmGR[6] = {&cbmIdealGRX,&cbmIdealGRY,&cbmIdealGRZ,&cbmIQGRX,&cbmIQGRY,&cbmIQGRZ};
+    for(int h=0;h<6;h++) cbmGR[h]->LoadState(checkpoint);
+
+    if(!checkpoint.Good())
+    {
+        cerr<<"checkpoint "<<fileName<<" ends before the tracking state is complete"<<endl;
+        exit(0);
+    }
+
+    // lattice terms that follow the ramped tunes and skew quadrupole
+    if(inputParameter.ringRun->rampFlag)
+    {
+        latticeInterActionPoint.GetTransLinearCouplingCoef(inputParameter);
+        latticeInterActionPoint.SetLatticeBRHForSynRad(inputParameter);
+    }
+    currentTurnNum = nextTurn;
+
+#ifdef MPIMODE
+    // the ranks commit their files one by one, a crash in between leaves files of different turns
+    int turnMin, turnMax;
+    MPI_Allreduce(&nextTurn,&turnMin,1,MPI_INT,MPI_MIN,MPI_COMM_WORLD);
+    MPI_Allreduce(&nextTurn,&turnMax,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+    if(turnMin!=turnMax)
+    {
+        if(myRank==0) cerr<<"checkpoint files "<<inputParameter.ringRun->restartFrom<<".* are from turns "<<turnMin<<" to "<<turnMax<<endl;
+        MPI_Abort(MPI_COMM_WORLD,1);
+    }
+#endif
+
+    cout<<"restart from "<<fileName<<" at turn "<<nextTurn<<endl;
+    return nextTurn;
+}
 
 void MPBeam::MPGetBeamInfo()
 {
@@ -2318,265 +2750,169 @@ void MPBeam::MPGetBeamInfo()
 
 void MPBeam::MPBeamDataPrintPerTurn(int nTurns, LatticeInterActionPoint &latticeInterActionPoint,ReadInputSettings &inputParameter)
 {
+    // the files are opened at the first call (turn 0, or the restart turn) and get a page per call, written by SDDSWriter (runSDDSBinary)
+    int sddsBinary                        = inputParameter.ringRun->sddsBinary;
+    int resNum                            = inputParameter.ringParRf->resNum;
+    int TBTBunchPrintNum                  = inputParameter.ringRun->TBTBunchPrintNum;
+    vector<int> TBTBunchDisDataBunchIndex = inputParameter.ringRun->TBTBunchDisDataBunchIndex;
 
-    string filePrefix = inputParameter.ringRun->TBTBunchAverData;
-    string fname = filePrefix + ".sdds";
-    ofstream fout(fname,ios_base::app);
-   
-    if(!inputParameter.ringRun->TBTBunchAverData.empty())
+    if(!inputParameter.ringRun->TBTBunchAverData.empty() && myRank==0)
     {
-        string filePrefix = inputParameter.ringRun->TBTBunchAverData;
-        string fname = filePrefix + ".sdds";
-        ofstream fout(fname,ios_base::app);
-        
-        if(nTurns==0)
+        SDDSWriter &fout = *tbtBunchAverOut;
+
+        if(!tbtFilesOpened)
 	    {
-	        fout<<"SDDS1"<<endl;
-	        fout<<"&column name=Turns,                           type=long,  &end"<<endl;
-	        fout<<"&column name=HarmIndex,                       type=long,  &end"<<endl;
-            fout<<"&column name=BunchIndex,                       type=long,  &end"<<endl;
-            fout<<"&column name=TotIonCharge,       units=e,     type=float,  &end"<<endl;
-	        fout<<"&column name=AverX,              units=m,     type=float,  &end"<<endl;
-	        fout<<"&column name=AverY,              units=m,     type=float,  &end"<<endl;
-	        fout<<"&column name=AverZ,              units=m,     type=float,  &end"<<endl;
-	        fout<<"&column name=AverXP,             units=rad,   type=float,  &end"<<endl;
-	        fout<<"&column name=AverYP,             units=rad,   type=float,  &end"<<endl;
-	        fout<<"&column name=AverZP,             units=rad,   type=float,  &end"<<endl;
-	        fout<<"&column name=RmsEmitX,           units=m*rad, type=float,  &end"<<endl;
-	        fout<<"&column name=RmsEmitY,           units=m*rad, type=float,  &end"<<endl;
-	        fout<<"&column name=RmsEmitZ,           units=m*rad, type=float,  &end"<<endl;
-	        fout<<"&column name=RmsRX,              units=m*rad, type=float,  &end"<<endl;
-	        fout<<"&column name=RmsRY,              units=m*rad, type=float,  &end"<<endl;
-	        fout<<"&column name=RmsBunchLength,     units=m,     type=float,  &end"<<endl;
-     	    fout<<"&column name=RmsBunchEnergySpread, units=rad, type=float,  &end"<<endl;
-
-     	    for(int j=0; j<inputParameter.ringParRf->resNum;j++)
+            fout.DefineColumn("Turns",      "",SDDSWriter::LONG);
+            fout.DefineColumn("HarmIndex",  "",SDDSWriter::LONG);
+            fout.DefineColumn("BunchIndex", "",SDDSWriter::LONG);
+            const char *colName[14][2] = {{"TotIonCharge","e"},{"AverX","m"},{"AverY","m"},{"AverZ","m"},
+                                          {"AverXP","rad"},{"AverYP","rad"},{"AverZP","rad"},
+                                          {"RmsEmitX","m*rad"},{"RmsEmitY","m*rad"},{"RmsEmitZ","m*rad"},
+                                          {"RmsRX","m*rad"},{"RmsRY","m*rad"},{"RmsBunchLength","m"},{"RmsBunchEnergySpread","rad"}};
+            for(int k=0;k<14;k++) fout.DefineColumn(colName[k][0],colName[k][1],SDDSWriter::DOUBLE);
+
+     	    for(int j=0; j<resNum;j++)
             {
-    	        string colname = string("&column name=") + string("cavAmp_") + to_string(j) + string(", units=V,   type=float,  &end");
-                fout<<colname<<endl;
-                colname = string("&column name=") + string("cavPhase_") + to_string(j) + string(", units=rad,   type=float,  &end");
-                fout<<colname<<endl;
-                colname = string("&column name=") + string("cavReal_") + to_string(j) + string(", units=V,   type=float,  &end");
-                fout<<colname<<endl;
-
-                colname = string("&column name=") + string("genAmp_") + to_string(j) + string(", units=V,   type=float,  &end");
-                fout<<colname<<endl;
-                colname = string("&column name=") + string("genPhase_") + to_string(j) + string(", units=rad,   type=float,  &end");
-                fout<<colname<<endl;
-                colname = string("&column name=") + string("beamIndAmp_") + to_string(j) + string(", units=V,   type=float,  &end");
-                fout<<colname<<endl;
-                colname = string("&column name=") + string("beamIndPhase_") + to_string(j) + string(", units=rad,   type=float,  &end");
-                fout<<colname<<endl;
+                const char *cavName[7][2] = {{"cavAmp_","V"},{"cavPhase_","rad"},{"cavReal_","V"},{"genAmp_","V"},{"genPhase_","rad"},
+                                             {"beamIndAmp_","V"},{"beamIndPhase_","rad"}};
+                for(int k=0;k<7;k++) fout.DefineColumn(cavName[k][0] + to_string(j),cavName[k][1],SDDSWriter::DOUBLE);
  	        }
-	        fout<<"&data mode=ascii, &end"<<endl;
+            fout.Open(inputParameter.ringRun->TBTBunchAverData + ".sdds",sddsBinary);
 	    }
 
-        fout<<"! page number "<<nTurns + 1<<endl;
-        fout<<beamVec.size()<<endl;
-
+        fout.StartPage(beamVec.size());
         for(int i=0;i<beamVec.size();i++)
         {
-            fout<<setw(24)<<left<<setprecision(16)<<nTurns
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].bunchHarmNum
-                <<setw(24)<<left<<setprecision(16)<<i
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].totIonCharge
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].xAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].yAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].zAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].pxAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].pyAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].pzAver
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].emittanceX
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].emittanceY
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].emittanceZ
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].rmsRx
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].rmsRy
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].rmsBunchLength
-                <<setw(24)<<left<<setprecision(16)<<beamVec[i].rmsEnergySpread;
-
-            for(int j=0; j<inputParameter.ringParRf->resNum;j++)
+            fout.Put(nTurns);
+            fout.Put(beamVec[i].bunchHarmNum);
+            fout.Put(i);
+            fout.Put(beamVec[i].totIonCharge);
+            fout.Put(beamVec[i].xAver);
+            fout.Put(beamVec[i].yAver);
+            fout.Put(beamVec[i].zAver);
+            fout.Put(beamVec[i].pxAver);
+            fout.Put(beamVec[i].pyAver);
+            fout.Put(beamVec[i].pzAver);
+            fout.Put(beamVec[i].emittanceX);
+            fout.Put(beamVec[i].emittanceY);
+            fout.Put(beamVec[i].emittanceZ);
+            fout.Put(beamVec[i].rmsRx);
+            fout.Put(beamVec[i].rmsRy);
+            fout.Put(beamVec[i].rmsBunchLength);
+            fout.Put(beamVec[i].rmsEnergySpread);
+
+            for(int j=0; j<resNum;j++)
             {
-                fout<<setw(24)<<left<<setprecision(16)<<abs(beamVec[i].bunchRFModeInfo->cavVolBunchCen[j])
-                    <<setw(24)<<left<<setprecision(16)<<arg(beamVec[i].bunchRFModeInfo->cavVolBunchCen[j])
-                    <<setw(24)<<left<<setprecision(16)<<    beamVec[i].bunchRFModeInfo->cavVolBunchCen[j].real()
-                    <<setw(24)<<left<<setprecision(16)<<abs(beamVec[i].bunchRFModeInfo->genVolBunchAver[j])
-                    <<setw(24)<<left<<setprecision(16)<<arg(beamVec[i].bunchRFModeInfo->genVolBunchAver[j])
-                    <<setw(24)<<left<<setprecision(16)<<abs(beamVec[i].bunchRFModeInfo->induceVolBunchCen[j])
-                    <<setw(24)<<left<<setprecision(16)<<arg(beamVec[i].bunchRFModeInfo->induceVolBunchCen[j]);
+                fout.Put(abs(beamVec[i].bunchRFModeInfo->cavVolBunchCen[j]));
+                fout.Put(arg(beamVec[i].bunchRFModeInfo->cavVolBunchCen[j]));
+                fout.Put(    beamVec[i].bunchRFModeInfo->cavVolBunchCen[j].real());
+                fout.Put(abs(beamVec[i].bunchRFModeInfo->genVolBunchAver[j]));
+                fout.Put(arg(beamVec[i].bunchRFModeInfo->genVolBunchAver[j]));
+                fout.Put(abs(beamVec[i].bunchRFModeInfo->induceVolBunchCen[j]));
+                fout.Put(arg(beamVec[i].bunchRFModeInfo->induceVolBunchCen[j]));
             }
-            fout<<endl;
-
         }
-        fout.close();
     }
     
 
     // print out the specified bunch distribution....
-    int TBTBunchPrintNum                  = inputParameter.ringRun->TBTBunchPrintNum;
-    vector<int> TBTBunchDisDataBunchIndex = inputParameter.ringRun->TBTBunchDisDataBunchIndex;
-
     if(!inputParameter.ringRun->TBTBunchDisData.empty()  &&  (TBTBunchPrintNum !=0) )
     {
+        if(!tbtFilesOpened) tbtBunchDisOut.resize(TBTBunchPrintNum,NULL);
+
         for(int i=0;i<TBTBunchPrintNum;i++)
         {
-            string filePrefix = inputParameter.ringRun->TBTBunchDisData;
-            string fname = filePrefix +"_" +to_string(TBTBunchDisDataBunchIndex[i])+".sdds";
-            ofstream fout1(fname,ios_base::app);
+            // particles of the bunch are on its owner rank
+            int bunchIndex  = TBTBunchDisDataBunchIndex[i];
+            if(bunchIndex<bunchStart || bunchIndex>=bunchEnd) continue;
 
-            if(nTurns==0)
+            if(!tbtFilesOpened)
 	        {
-	            fout1<<"SDDS1"<<endl;
-	            fout1<<"&parameter name=BunchHarm,             type=float,  &end"<<endl;
-                fout1<<"&parameter name=partNum,               type=float,  &end"<<endl;
-	            fout1<<"&parameter name=AverX,    units=m,     type=float,  &end"<<endl;
-	            fout1<<"&parameter name=AverY,    units=m,     type=float,  &end"<<endl;
-	            fout1<<"&parameter name=AverZ,    units=m,     type=float,  &end"<<endl;
-
-	            fout1<<"&parameter name=rmsEmitX, units=m*rad, type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsEmitY, units=m*rad, type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsEmitZ, units=m*rad, type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsRx,    units=m,     type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsRy,    units=m,     type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsBunchLen,    units=m,     type=float,  &end"<<endl;
-	            fout1<<"&parameter name=rmsBunchEnergySpread,    units=rad,     type=float,  &end"<<endl;
-
-
-	            fout1<<"&column name=x,              units=m,     type=float,  &end"<<endl;
-	            fout1<<"&column name=y,              units=m,     type=float,  &end"<<endl;
-	            fout1<<"&column name=z,              units=m,     type=float,  &end"<<endl;
-	            fout1<<"&column name=xp,             units=rad,   type=float,  &end"<<endl;
-	            fout1<<"&column name=yp,             units=rad,   type=float,  &end"<<endl;
-	            fout1<<"&column name=zp,             units=rad,   type=float,  &end"<<endl;
-                fout1<<"&column name=nux,                         type=float,  &end"<<endl;
-	            fout1<<"&column name=nuy,                         type=float,  &end"<<endl;
-                fout1<<"&column name=nus,                         type=float,  &end"<<endl;
-	            fout1<<"&data mode=ascii, &end"<<endl;
+                tbtBunchDisOut[i] = new SDDSWriter;
+                SDDSWriter &fout1 = *tbtBunchDisOut[i];
+                const char *paraName[12][2] = {{"BunchHarm",""},{"partNum",""},{"AverX","m"},{"AverY","m"},{"AverZ","m"},
+                                               {"rmsEmitX","m*rad"},{"rmsEmitY","m*rad"},{"rmsEmitZ","m*rad"},
+                                               {"rmsRx","m"},{"rmsRy","m"},{"rmsBunchLen","m"},{"rmsBunchEnergySpread","rad"}};
+                for(int k=0;k<12;k++) fout1.DefineParameter(paraName[k][0],paraName[k][1],SDDSWriter::FLOAT);
+                const char *colName[9][2]  = {{"x","m"},{"y","m"},{"z","m"},{"xp","rad"},{"yp","rad"},{"zp","rad"},
+                                              {"nux",""},{"nuy",""},{"nus",""}};
+                for(int k=0;k<9;k++)  fout1.DefineColumn(colName[k][0],colName[k][1],SDDSWriter::FLOAT);
+                fout1.Open(inputParameter.ringRun->TBTBunchDisData + "_" + to_string(bunchIndex) + ".sdds",sddsBinary);
 	        }
+            SDDSWriter &fout1 = *tbtBunchDisOut[i];
 
-            int bunchIndex  = TBTBunchDisDataBunchIndex[i];
-
-            fout1<<"! page number "<<nTurns * TBTBunchPrintNum + i +1 <<endl;
-
-            fout1<<beamVec[bunchIndex].bunchHarmNum<<endl;
-            fout1<<beamVec[bunchIndex].electronNumPerBunch<<endl;
-            fout1<<beamVec[bunchIndex].xAver<<endl;
-            fout1<<beamVec[bunchIndex].yAver<<endl;
-            fout1<<beamVec[bunchIndex].zAver<<endl;
-            fout1<<beamVec[bunchIndex].emittanceX<<endl;
-            fout1<<beamVec[bunchIndex].emittanceY<<endl;
-            fout1<<beamVec[bunchIndex].emittanceZ<<endl;
-            fout1<<beamVec[bunchIndex].rmsRx<<endl;
-            fout1<<beamVec[bunchIndex].rmsRy<<endl;
-            fout1<<beamVec[bunchIndex].rmsBunchLength<<endl;
-            fout1<<beamVec[bunchIndex].rmsEnergySpread<<endl;
+            double para[12] = {double(beamVec[bunchIndex].bunchHarmNum),beamVec[bunchIndex].electronNumPerBunch,
+                               beamVec[bunchIndex].xAver,beamVec[bunchIndex].yAver,beamVec[bunchIndex].zAver,
+                               beamVec[bunchIndex].emittanceX,beamVec[bunchIndex].emittanceY,beamVec[bunchIndex].emittanceZ,
+                               beamVec[bunchIndex].rmsRx,beamVec[bunchIndex].rmsRy,
+                               beamVec[bunchIndex].rmsBunchLength,beamVec[bunchIndex].rmsEnergySpread};
+            fout1.StartPage(beamVec[bunchIndex].macroEleNumPerBunch,vector<double>(para,para+12));
 
-            fout1<<beamVec[bunchIndex].macroEleNumPerBunch<<endl;
-
-            for(int j=0; j<beamVec[i].macroEleNumPerBunch;j++)
+            for(int j=0; j<beamVec[bunchIndex].macroEleNumPerBunch;j++)
             {
-                fout1<<setw(20)<<left<<beamVec[bunchIndex].ePositionX[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].ePositionY[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].ePositionZ[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].eMomentumX[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].eMomentumY[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].eMomentumZ[j]
-                     <<setw(20)<<left<<beamVec[bunchIndex].accPhaseAdvX[j][2]  / (2 * PI) / (nTurns+1)
-                     <<setw(20)<<left<<beamVec[bunchIndex].accPhaseAdvY[j][2]  / (2 * PI) / (nTurns+1)
-                     <<setw(20)<<left<<1 - beamVec[bunchIndex].accPhaseAdvZ[j][2]  / (2 * PI) / (nTurns+1)
-                     <<endl;
+                fout1.Put(beamVec[bunchIndex].ePositionX[j]);
+                fout1.Put(beamVec[bunchIndex].ePositionY[j]);
+                fout1.Put(beamVec[bunchIndex].ePositionZ[j]);
+                fout1.Put(beamVec[bunchIndex].eMomentumX[j]);
+                fout1.Put(beamVec[bunchIndex].eMomentumY[j]);
+                fout1.Put(beamVec[bunchIndex].eMomentumZ[j]);
+                fout1.Put(beamVec[bunchIndex].accPhaseAdvX[j][2]  / (2 * PI) / (nTurns+1));
+                fout1.Put(beamVec[bunchIndex].accPhaseAdvY[j][2]  / (2 * PI) / (nTurns+1));
+                fout1.Put(1 - beamVec[bunchIndex].accPhaseAdvZ[j][2]  / (2 * PI) / (nTurns+1));
             }
-
-            fout1.close();
         }
-
     }
     
     // print out the rf voltage and phase along the specified bunch
     if(!inputParameter.ringRun->TBTBunchPro.empty()  &&  (TBTBunchPrintNum !=0) )
     {
+        if(!tbtFilesOpened) tbtBunchProOut.resize(TBTBunchPrintNum,NULL);
+
         for(int i=0;i<TBTBunchPrintNum;i++)
         {
-            string filePrefix = inputParameter.ringRun->TBTBunchPro;
-            string fname = filePrefix +"_" +to_string(i)+".sdds";
-            ofstream fout2(fname,ios_base::app);
+            // profile of the bunch is on its owner rank
+            int bunchIndex  = TBTBunchDisDataBunchIndex[i];
+            if(bunchIndex<bunchStart || bunchIndex>=bunchEnd) continue;
 
-            if(nTurns==0)
+            if(!tbtFilesOpened)
 	        {
-	            fout2<<"SDDS1"<<endl;
-	            fout2<<"&column name=z,              units=m,     type=float,  &end"<<endl;
-	            fout2<<"&column name=rho,            units=C/m,   type=float,  &end"<<endl;
-	            // fout2<<"&column name=potenWell,                   type=float,  &end"<<endl;
-	            // fout2<<"&column name=rhoAnalytical,               type=float,  &end"<<endl;
-
-    	        // for(int j=0; j<inputParameter.ringParRf->resNum;j++)
-	            // {
-
-                //     string colname = string("&column name=") + string("cavReal_") + to_string(j) + string(", units=V,   type=float,  &end");
-                //     fout2<<colname<<endl;
-                //     colname = string("&column name=") + string("cavImag_") + to_string(j) + string(", units=V,   type=float,  &end");
-                //     fout2<<colname<<endl;
-
-                //     colname = string("&column name=") + string("cavAbs_") + to_string(j) + string(", units=V,   type=float,  &end");
-                //     fout2<<colname<<endl;
-                //     colname = string("&column name=") + string("cavArg_") + to_string(j) + string(", units=rad,   type=float,  &end");
-                //     fout2<<colname<<endl;
-                //     colname = string("&column name=") + string("cavDpz_") + to_string(j) + string(", units=rad,   type=float,  &end");
-                //     fout2<<colname<<endl;
-	            // }
-	            // string colname = string("&column name=") + string("cavDpzTot")  + string(", units=rad,   type=float,  &end");
-	            // fout2<<colname<<endl;
-	            fout2<<"&data mode=ascii, &end"<<endl;
+                tbtBunchProOut[i] = new SDDSWriter;
+                tbtBunchProOut[i]->DefineColumn("z",  "m",  SDDSWriter::FLOAT);
+                tbtBunchProOut[i]->DefineColumn("rho","C/m",SDDSWriter::FLOAT);
+                tbtBunchProOut[i]->Open(inputParameter.ringRun->TBTBunchPro + "_" + to_string(i) + ".sdds",sddsBinary);
             }
+            SDDSWriter &fout2 = *tbtBunchProOut[i];
 
-            int bunchIndex  = TBTBunchDisDataBunchIndex[i];
-
-            fout2<<"! page number "<< nTurns + 1<<endl;
-            fout2<<inputParameter.ringParRf->rfBunchBinNum<<endl;
-            
+            fout2.StartPage(inputParameter.ringParRf->rfBunchBinNum);
             for(int k=0;k<inputParameter.ringParRf->rfBunchBinNum;k++)
             {
-                fout2<<setw(20)<<left<<-beamVec[bunchIndex].posZBins[k] + beamVec[bunchIndex].zMaxCurrentTurn
-                     <<setw(20)<<left<<beamVec[bunchIndex].densProfVsBin[k]<<endl;
-                    //  <<setw(20)<<left<<beamVec[bunchIndex].hamiltonPotenWell[k]
-                    //  <<setw(20)<<left<<beamVec[bunchIndex].densProfVsBinAnalytical[k];
-
-                // double dpzTemp=0;
-                // for(int j=0; j<inputParameter.ringParRf->resNum;j++)
-                // {
-                //     complex<double> temp = beamVec[bunchIndex].cavVolInfoVsLongBins[j][k];
-                //     double temp1 =  beamVec[bunchIndex].cavForceInfoVsLongBins[j][k];
-                //     fout2<<setw(20)<<left<<temp.real()
-                //          <<setw(20)<<left<<temp.imag()
-                //          <<setw(20)<<left<<abs(temp)
-                //          <<setw(20)<<left<<arg(temp)
-                //          <<setw(20)<<left<<temp1;
-
-                //     dpzTemp +=temp1;
-                // }
-                // fout2<<setw(20)<<left<<dpzTemp<<endl;
-
+                fout2.Put(-beamVec[bunchIndex].posZBins[k] + beamVec[bunchIndex].zMaxCurrentTurn);
+                fout2.Put( beamVec[bunchIndex].densProfVsBin[k]);
             }
-
-            fout2.close();
         }
     }
+
+    tbtFilesOpened = true;
 }
 
 void MPBeam::BeamTransferDueToSpaceChargePIC(PIC3D &picBeam3D,LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
-    int totBunchNum = beamVec.size();
-    for(int j=0;j<totBunchNum;j++)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
+        double t0 = profileBunch ? cpuSecond() : 0.E0;
         beamVec[j].BunchMomentumUpdateDueToSpaceChargePIC(picBeam3D,latticeInterActionPoint,k);
+        if(profileBunch) beamVec[j].timer[Bunch::TIMER_SPACECHARGE] += cpuSecond() - t0;
     }
 }
 
 void MPBeam::BeamTransferDueToSpaceChargeAnalytical(LatticeInterActionPoint &latticeInterActionPoint, int k, ReadInputSettings &inputParameter)
 {
-    int totBunchNum = beamVec.size();
-    for(int j=0;j<totBunchNum;j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
+        double t0 = profileBunch ? cpuSecond() : 0.E0;
         beamVec[j].BunchMomentumUpdateDueToSpaceChargeAnalytical(latticeInterActionPoint,k,inputParameter);
+        if(profileBunch) beamVec[j].timer[Bunch::TIMER_SPACECHARGE] += cpuSecond() - t0;
     }
 }
 
@@ -2589,6 +2925,7 @@ void MPBeam::SSBeamIonEffectOneInteractionPoint(ReadInputSettings &inputParamete
 
     for(int j=0;j<totBunchNum;j++)
     {
+        double t0 = profileBunch ? cpuSecond() : 0.E0;
         latticeInterActionPoint.GetIonNumberPerInterAction(beamVec[j].electronNumPerBunch, k);
         latticeInterActionPoint.IonGenerator(beamVec[j].rmsRx,beamVec[j].rmsRy,beamVec[j].xAver,beamVec[j].yAver,k);        
         latticeInterActionPoint.IonsUpdate(k);
@@ -2605,14 +2942,15 @@ void MPBeam::SSBeamIonEffectOneInteractionPoint(ReadInputSettings &inputParamete
         
         beamVec[j].BunchTransferDueToIon(latticeInterActionPoint,k);
         latticeInterActionPoint.IonTransferDueToBunch(beamVec[j].bunchGap,k,strongStrongBunchInfo->bunchSizeXMax,strongStrongBunchInfo->bunchSizeYMax);
-       
+        if(profileBunch) beamVec[j].timer[Bunch::TIMER_ION] += cpuSecond() - t0;
     }
 
 }
 
 void MPBeam::BeamTransferPerInteractionPointDueToLatticeT(const ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
-    for(int j=0;j<beamVec.size();j++)
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
         //beamVec[j].BunchTransferDueToLatticeT(inputParameter,latticeInterActionPoint,k);
     	beamVec[j].currentTurnNum = currentTurnNum;
@@ -2620,6 +2958,19 @@ void MPBeam::BeamTransferPerInteractionPointDueToLatticeT(const ReadInputSetting
     }
 }
 
+template<bool CHROM, bool ADTS>
+void MPBeam::BeamTransferPerInteractionPointDueToLatticeT(const ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint, int k)
+{
+    #pragma omp parallel for schedule(static)
+    for(int j=bunchStart;j<bunchEnd;j++)
+    {
+        double t0 = profileBunch ? cpuSecond() : 0.E0;
+    	beamVec[j].currentTurnNum = currentTurnNum;
+        beamVec[j].BunchTransferDueToLatticeTSymplectic<CHROM,ADTS>(inputParameter,latticeInterActionPoint,k);
+        if(profileBunch) beamVec[j].timer[Bunch::TIMER_LATTICE] += cpuSecond() - t0;
+    }
+}
+
 
 void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,LatticeInterActionPoint &latticeInterActionPoint,CavityResonator &cavityResonator)
 {
@@ -2643,14 +2994,25 @@ void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,Latti
         if (cavityResonator.resonatorVec[j].resRfMode ==0) // rfca element ideal cavity 
         {
            
-            for(int i=0;i<beamVec.size();i++)
+            for(int i=bunchStart;i<bunchEnd;i++)
             {
                 beamVec[i].BunchMomentumUpdateDueToRFCA(inputParameter,cavityResonator.resonatorVec[j],j);
             }
         }
         else  // rfmode element  -- beam loading in included in the tracking
         {
-            for (int i=0;i<beamVec.size();i++)
+#ifdef MPIMODE
+            // beam loading couples the bunches in passage order: the resonator state comes from the rank holding the
+            // bunches ahead, and goes on to the next rank after the own bunches have passed.
+            vector<double> resState;
+            cavityResonator.resonatorVec[j].PackDynamicState(resState);
+            if(myRank>0)
+            {
+                MPI_Recv(resState.data(),resState.size(),MPI_DOUBLE,myRank-1,j,MPI_COMM_WORLD,MPI_STATUS_IGNORE);
+                cavityResonator.resonatorVec[j].UnpackDynamicState(resState);
+            }
+#endif
+            for (int i=bunchStart;i<bunchEnd;i++)
             {
                 // particle momentum update
                 if(cavityResonator.resonatorVec[j].resExciteIntability==0)
@@ -2662,14 +3024,9 @@ void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,Latti
                     beamVec[i].BunchMomentumUpdateDueToRFMode(inputParameter,cavityResonator.resonatorVec[j],j);
                 }
 
-                // store the info sampled by the cavnty at n*tRF, stored the data for cavity feedbacks 
-                for (int k=0;k<beamVec[i].bunchGap;k++)
-                {
-                    int harmonicIndex = beamVec[i].bunchHarmNum + k;
-                    double dt = k * tRF  - beamVec[i].zMinCurrentTurn / CLight; 
-                    cavityResonator.resonatorVec[j].GetResonatorInfoAtNTrf(harmonicIndex,dt);
-                    cavityResonator.resonatorVec[j].ResonatorDynamics(tRF);  // cavity always is updated by tRf
-                }
+                // store the info sampled by the cavnty at n*tRF for cavity feedbacks, generator voltage over the gap to the next bunch
+                double dt = - beamVec[i].zMinCurrentTurn / CLight; 
+                cavityResonator.resonatorVec[j].AdvanceBuckets(beamVec[i].bunchHarmNum,beamVec[i].bunchGap,tRF,dt);
 
                 // resonator beamInduced voltage updated till next bunch -- also control condition for instability excitation
                 double timeTemp;
@@ -2685,7 +3042,14 @@ void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,Latti
                 }     
                 cavityResonator.resonatorVec[j].GetBeamInducedVol(timeTemp);
      
-            }           
+            }
+#ifdef MPIMODE
+            // after the last bunch of the turn every rank continues from the same cavity state
+            cavityResonator.resonatorVec[j].PackDynamicState(resState);
+            if(myRank<numProcess-1) MPI_Send(resState.data(),resState.size(),MPI_DOUBLE,myRank+1,j,MPI_COMM_WORLD);
+            MPI_Bcast(resState.data(),resState.size(),MPI_DOUBLE,numProcess-1,MPI_COMM_WORLD);
+            cavityResonator.resonatorVec[j].UnpackDynamicState(resState);
+#endif
         }    
     }
 
@@ -2695,7 +3059,7 @@ void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,Latti
     {
         if(cavityResonator.resonatorVec[j].resRfMode ==1 && cavityResonator.resonatorVec[j].resDirFB==1)
         {
-            for (int i=0;i<beamVec.size();i++)
+            for (int i=bunchStart;i<bunchEnd;i++)
             {
                 beamVec[i].GetLongiKickDueToCavFB(inputParameter,cavityResonator.resonatorVec[j]);
             }
@@ -2707,7 +3071,8 @@ void MPBeam::BeamMomtumUpdateDueToRFTest(ReadInputSettings &inputParameter,Latti
 
 void MPBeam::BeamEnergyLossOneTurn(const ReadInputSettings &inputParameter)
 {
-    for(int i=0;i<beamVec.size();i++)
+    #pragma omp parallel for schedule(static)
+    for(int i=bunchStart;i<bunchEnd;i++)
     {
         beamVec[i].BunchEnergyLossOneTurn(inputParameter);
     }
@@ -2724,7 +3089,9 @@ void MPBeam::GetTimeDisToNextBunch(const ReadInputSettings &inputParameter)
     double rBeta      = inputParameter.ringParBasic->rBeta;
     double tRF        = inputParameter.ringParBasic->t0 / ringHarmH; 
 
+    // z extent of the own bunches, then of all bunches on every rank
     GetBunchMinZMaxZ();
+    MPISyncBunchZMinMax();
 
     if(beamVec.size()==1)
     {        
@@ -2737,14 +3104,10 @@ void MPBeam::GetTimeDisToNextBunch(const ReadInputSettings &inputParameter)
         {
             if(i<beamVec.size()-1)
             {
-                beamVec[i].GetZMinMax();
-                beamVec[i+1].GetZMinMax();
                 beamVec[i].timeFromCurrnetBunchToNextBunch  = beamVec[i].bunchGap * tRF + (beamVec[i].zMinCurrentTurn - beamVec[i+1].zMaxCurrentTurn) / CLight / rBeta;
             }
             else
             {
-                beamVec[i].GetZMinMax();
-                beamVec[0].GetZMinMax();
                 beamVec[i].timeFromCurrnetBunchToNextBunch  = beamVec[i].bunchGap * tRF + (beamVec[i].zMinCurrentTurn - beamVec[0  ].zMaxCurrentTurn) / CLight / rBeta;
             }           
         }        
@@ -2902,7 +3265,8 @@ void MPBeam::BeamMomtumUpdateDueToRF(ReadInputSettings &inputParameter,LatticeIn
 
 void MPBeam::GetBunchMinZMaxZ()
 {
-    for(int i=0;i<beamVec.size();i++)
+    #pragma omp parallel for schedule(static)
+    for(int i=bunchStart;i<bunchEnd;i++)
     {
         beamVec[i].GetZMinMax();
     }
@@ -2927,7 +3291,7 @@ void MPBeam::SSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
             fout<<"SDDS1"<<endl;
             fout<<"&parameter name=totIonCharge, units=e, type=float,  &end"<<endl; 
             fout<<"&parameter name=tunrs,                 type=long,   &end"<<endl;              
-            for(int p=0;p<latticeInterActionPoint.ionAccumuPositionX[k].size();p++)
+            for(int p=0;p<latticeInterActionPoint.ionAccumu[k].size();p++)
             {
                 string col= string("parameter name=") + string("numOfMacroIon_") + to_string(p) + string(",  type=long,  &end");   
                 fout<<col<<endl;
@@ -2947,9 +3311,9 @@ void MPBeam::SSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
         fout<<"! page number "<<nTurns * numberOfInteraction + k + 1 <<endl;
         fout<<latticeInterActionPoint.totIonCharge<<endl;
         fout<<nTurns<<endl;
-        for(int p=0;p<latticeInterActionPoint.ionAccumuPositionX[k].size();p++)
+        for(int p=0;p<latticeInterActionPoint.ionAccumu[k].size();p++)
         {
-            fout<<latticeInterActionPoint.ionAccumuPositionX[k][p].size()<<endl;            
+            fout<<latticeInterActionPoint.ionAccumu[k][p].x.size()<<endl;            
         }
 
         fout<<latticeInterActionPoint.totMacroIonsAtInterPoint[k]<<endl;        
@@ -2959,12 +3323,12 @@ void MPBeam::SSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
             {
                 fout<<setw(15)<<left<<latticeInterActionPoint.ionMassNumber[p]
                     <<setw(15)<<left<<latticeInterActionPoint.macroIonCharge[k][p]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuPositionX[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuPositionY[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuVelocityX[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuVelocityY[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuFx[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuFy[k][p][i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].x[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].y[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].vx[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].vy[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].fx[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].fy[i]
                     <<endl;
             }
         }
@@ -2990,9 +3354,10 @@ void MPBeam::FIRBunchByBunchFeedback(const ReadInputSettings &inputParameter,FIR
     {
         if(fbflag==1)
         {
-            for(int i=0;i<beamVec.size();i++)
+            for(int i=bunchStart;i<bunchEnd;i++)
             {
-                for(int j=0;j<beamVec[i].macroEleNumPerBunch;j++)
+                beamVec[i].momentsDirty = true;
+                for(int j=0;j<beamVec[i].macroEleNumActive;j++)
                 {
                     beamVec[i].eMomentumX[j] -=  beamVec[i].pxAver; 
                     beamVec[i].eMomentumY[j] -=  beamVec[i].pyAver;
@@ -3076,9 +3441,10 @@ void MPBeam::FIRBunchByBunchFeedback(const ReadInputSettings &inputParameter,FIR
             }
 
 
-            for(int i=0;i<beamVec.size();i++)
+            for(int i=bunchStart;i<bunchEnd;i++)
             {
-                for(int j=0;j<beamVec[i].macroEleNumPerBunch;j++)
+                beamVec[i].momentsDirty = true;
+                for(int j=0;j<beamVec[i].macroEleNumActive;j++)
                 {
                     beamVec[i].eMomentumX[j] = beamVec[i].eMomentumX[j] + tranAngleKickx[i];
                     beamVec[i].eMomentumY[j] = beamVec[i].eMomentumY[j] + tranAngleKicky[i];
@@ -3236,112 +3602,100 @@ void MPBeam::LRWakeBeamIntaction(const  ReadInputSettings &inputParameter, WakeF
     int harmonics               = inputParameter.ringParBasic->harmonics;
     double electronBeamEnergy   = inputParameter.ringParBasic->electronBeamEnergy;
     double rBeta                = inputParameter.ringParBasic->rBeta;
-    double tRF                  = inputParameter.ringParBasic->t0 / double(harmonics);
+    double t0                   = inputParameter.ringParBasic->t0;
+    double tRF                  = t0 / double(harmonics);
 
-    // prepare bunch center position of the previous turns
-    vector<double> posxDataTemp(beamVec.size());
-    vector<double> posyDataTemp(beamVec.size());
-    vector<double> poszDataTemp(beamVec.size());
-    // current turn position
+    // current turn position goes to the head of the ring buffer, [LRWakeHistIndex(n)] stores pos[-n]
+    wakefunction.LRWakeHistPush();
+    int head = wakefunction.lrwHistHead;
     for(int i=0;i<beamVec.size();i++)
     {
-        posxDataTemp[i] = beamVec[i].xAver;
-        posyDataTemp[i] = beamVec[i].yAver;
-        poszDataTemp[i] = beamVec[i].zAver;
+        wakefunction.posxData[head][i] = beamVec[i].xAver;
+        wakefunction.posyData[head][i] = beamVec[i].yAver;
+        wakefunction.poszData[head][i] = beamVec[i].zAver;
     }
 
-    // [0,nTurnswakeTrunction] stores [pos[-nTurnswakeTrunction],pos[0]] 
-    wakefunction.posxData.erase(wakefunction.posxData.begin());
-    wakefunction.posyData.erase(wakefunction.posyData.begin());
-    wakefunction.poszData.erase(wakefunction.poszData.begin());
-
-    wakefunction.posxData.push_back(posxDataTemp);
-    wakefunction.posyData.push_back(posyDataTemp);
-    wakefunction.poszData.push_back(poszDataTemp);
-
-    vector<double> wakeForceTemp(3,0);
+    double wakeForceTemp[3];
 
     double tauij=0.e0;
     int nTauij=0;
     double deltaTij=0;
     double tauijStastic;
 
-    int tempIndex0,tempIndex1;
+    int tempIndex0,tempIndex1,hist;
 
     for (int j=0;j<beamVec.size();j++)
     {
 	    beamVec[j].lRWakeForceAver[0] =0.E0;      // x
 	    beamVec[j].lRWakeForceAver[1] =0.E0;      // y
 	    beamVec[j].lRWakeForceAver[2] =0.E0;      // z
-	
-        for(int n=0;n<nTurnswakeTrunction;n++)
-        {          
-            // self-interation of bunch in current turn is excluded if tempIndex1 = j - 1, when n=0.             
-            if(n==0)
-            {
-                tempIndex0   = 0;
-                tempIndex1   = j - 1 ;
-            }
-            else if (n==nTurnswakeTrunction-1)
-            {
-                tempIndex0   = j;
-                tempIndex1   = beamVec.size()-1;
-            }
-            else
-            {
-                tempIndex0   = 0;
-                tempIndex1   = beamVec.size()-1;
-            }
-            
-            for(int i=tempIndex0;i<=tempIndex1;i++)
-            {
-                nTauij   = beamVec[i].bunchHarmNum - beamVec[j].bunchHarmNum - n * harmonics;
-                tauijStastic = nTauij * tRF;
-
-                deltaTij = (beamVec[j].zAver -  wakefunction.poszData[nTurnswakeTrunction-1-n][i]) / CLight / rBeta;
-                tauij    = tauijStastic  + deltaTij;                     
-                // notification: 
-                // ensure the wakefucntion return the focusing strength in transverse and energy loss in longitudinal. 
-                // then: beamVec[j].lRWakeForceAver[?] -=  mins here.   
-
-                //if(!inputParameter.ringLRWake->pipeGeoInput.empty())
-                //{                                       
-                    //wakeForceTemp = wakefunction.GetRWLRWakeFun(tauij); 
-                    // beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                    // beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                    // beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;    //    [V/C]
-
-                    //lRWakeForce[0][ip] -= wakefunction.xlrwakefit(-tauij) * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];  
-                    //lRWakeForce[1][ip] -= wakefunction.ylrwakefit(-tauij) * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];
-                    //lRWakeForce[1][ip] -= wakefunction.xlrwakefit(-tauij) * beamVec[i].electronNumPerBunch ;
-                //}
-
-                //if(!inputParameter.ringLRWake->bbrInput.empty())
-                //{
-                    //wakeForceTemp = wakefunction.GetBBRWakeFun(tauij);                 
-                    // beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                    // beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                    // beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;                                                       //[V/C]         ->  [V/C]
-                    
-                    
-                    //lRWakeForce[0][ip] -= wakefunction.GetTotLRWakeLinearFit(-tauij) * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];  
-                    //lRWakeForce[1][ip] -= wakefunction.ylrwakefit(-tauij) * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];
-                    //lRWakeForce[1][ip] -= wakefunction.zlrwakefit(-tauij) * beamVec[i].electronNumPerBunch ;
+    }
+
+    // (1) BBR modes: phasors propagated from bunch to bunch in passage order (beamVec is sorted in bunchHarmNum), O(Nb * Nmodes).
+    if(wakefunction.lrwRecursion)
+    {
+        wakefunction.lrwTime -= t0;        // time origin moves to the start of this turn
+        for (int j=0;j<beamVec.size();j++)
+        {
+            double tj = beamVec[j].bunchHarmNum * tRF - beamVec[j].zAver / CLight / rBeta;
+            wakefunction.LRWakeRecursion(tj,beamVec[j].electronNumPerBunch,beamVec[j].xAver,beamVec[j].yAver,wakeForceTemp);
+            beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0];
+            beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1];
+            beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2];
+        }
+    }
+
+    // (2) tabulated wake summed over the truncated history, only the RW part when the BBR modes go through (1)
+    if(!wakefunction.lrwRecursion || !inputParameter.ringLRWake->pipeGeoInput.empty())
+    {
+        for (int j=0;j<beamVec.size();j++)
+        {
+            for(int n=0;n<nTurnswakeTrunction;n++)
+            {          
+                // self-interation of bunch in current turn is excluded if tempIndex1 = j - 1, when n=0.             
+                if(n==0)
+                {
+                    tempIndex0   = 0;
+                    tempIndex1   = j - 1 ;
+                }
+                else if (n==nTurnswakeTrunction-1)
+                {
+                    tempIndex0   = j;
+                    tempIndex1   = beamVec.size()-1;
+                }
+                else
+                {
+                    tempIndex0   = 0;
+                    tempIndex1   = beamVec.size()-1;
+                }
+
+                hist = wakefunction.LRWakeHistIndex(n);
                 
-                //}
-                    
-                wakeForceTemp = wakefunction.GetTotLRWakeLinearFit(tauij);
-                beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i] ;  
-                beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i] ;
-                beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;
-                    
-            }               
+                for(int i=tempIndex0;i<=tempIndex1;i++)
+                {
+                    nTauij   = beamVec[i].bunchHarmNum - beamVec[j].bunchHarmNum - n * harmonics;
+                    tauijStastic = nTauij * tRF;
+
+                    deltaTij = (beamVec[j].zAver -  wakefunction.poszData[hist][i]) / CLight / rBeta;
+                    tauij    = tauijStastic  + deltaTij;                     
+                    // notification: 
+                    // ensure the wakefucntion return the focusing strength in transverse and energy loss in longitudinal. 
+                    // then: beamVec[j].lRWakeForceAver[?] -=  mins here.   
+                        
+                    wakefunction.GetTotLRWakeLinearFit(tauij,wakeForceTemp);
+                    beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[hist][i] ;  
+                    beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[hist][i] ;
+                    beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;
+                }               
+            }
         }
-                                
+    }
+
+    for (int j=0;j<beamVec.size();j++)
+    {
         beamVec[j].lRWakeForceAver[0] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
         beamVec[j].lRWakeForceAver[1] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
         beamVec[j].lRWakeForceAver[2] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
-        
     }
 
     BeamTransferPerTurnDueWake(); 
@@ -3350,7 +3704,7 @@ void MPBeam::LRWakeBeamIntaction(const  ReadInputSettings &inputParameter, WakeF
 } 
 void MPBeam::BeamTransferPerTurnDueWake()
 {
-    for(int j=0;j<beamVec.size();j++)
+    for(int j=bunchStart;j<bunchEnd;j++)
     {
         beamVec[j].BunchTransferDueToWake();
     }
@@ -10,6 +10,7 @@
 #include "MPBunch.h"
 #include "Global.h"
 #include "Faddeeva.h"
+#include "BassettiErskineField.h"
 #include "WakeFunction.h"
 #include "Spline.h"
 #include <stdlib.h>
@@ -37,6 +38,8 @@
 #include <gsl/gsl_eigen.h>
 #include <memory.h>
 #include <fftw3.h>
+#include "FFTWPlanCache.h"
+#include <omp.h>
 #include <complex.h>
 
 using namespace std;
@@ -57,6 +60,18 @@ MPBunch::~MPBunch()
     delete wakePotenFromBBI;          
 }
 
+void MPBunch::SaveState(Checkpoint &checkpoint) const
+{
+    Bunch::SaveState(checkpoint);
+    checkpoint.Put(macroEleNumSurivePerBunch);
+}
+
+void MPBunch::LoadState(Checkpoint &checkpoint)
+{
+    Bunch::LoadState(checkpoint);
+    checkpoint.Get(macroEleNumSurivePerBunch);
+}
+
 
 void MPBunch::InitialMPBunch(const  ReadInputSettings &inputParameter)
 {    
@@ -97,13 +112,13 @@ void MPBunch::InitialMPBunch(const  ReadInputSettings &inputParameter)
 
 void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionPoint,const ReadInputSettings &inputParameter, int bunchIndex)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
 
 // longitudial bunch phase space generatetion --simple rms in both z and z' phase space.
     double rBeta      = inputParameter.ringParBasic->rBeta;
 
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    std::normal_distribution<> doffset{0,1};
+    rndGen.Seed(RandomStream::BUNCH, bunchIndex);
 
     double initialStaticOffSet[6];
     double initialDynamicOffSet[6];
@@ -115,16 +130,12 @@ void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
 
     }
 
-    srand(time(0) + bunchIndex);
-    double disDx = doffset(gen) * initialDynamicOffSet[0] + initialStaticOffSet[0];
-    double disDy = doffset(gen) * initialDynamicOffSet[1] + initialStaticOffSet[1];
-    double disDz = doffset(gen) * initialDynamicOffSet[2] + initialStaticOffSet[2];
-    double disMx = doffset(gen) * initialDynamicOffSet[3] + initialStaticOffSet[3];
-    double disMy = doffset(gen) * initialDynamicOffSet[4] + initialStaticOffSet[4];
-    double disMz = doffset(gen) * initialDynamicOffSet[5] + initialStaticOffSet[5];
-
-    std::normal_distribution<> dx{0,rmsBunchLength};
-    std::normal_distribution<> dy{0,rmsEnergySpread};
+    double disDx = rndGen.Normal() * initialDynamicOffSet[0] + initialStaticOffSet[0];
+    double disDy = rndGen.Normal() * initialDynamicOffSet[1] + initialStaticOffSet[1];
+    double disDz = rndGen.Normal() * initialDynamicOffSet[2] + initialStaticOffSet[2];
+    double disMx = rndGen.Normal() * initialDynamicOffSet[3] + initialStaticOffSet[3];
+    double disMy = rndGen.Normal() * initialDynamicOffSet[4] + initialStaticOffSet[4];
+    double disMz = rndGen.Normal() * initialDynamicOffSet[5] + initialStaticOffSet[5];
 
     double tempx;
     double tempy;
@@ -133,8 +144,8 @@ void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
     int i=0;
     while(i<macroEleNumPerBunch)
     {
-        tempx = dx(gen);
-        tempy = dy(gen);
+        tempx = rndGen.Normal() * rmsBunchLength;
+        tempy = rndGen.Normal() * rmsEnergySpread;
 
         temp =  pow(tempx/rmsBunchLength,2) + pow(tempy/rmsEnergySpread,2);
 
@@ -215,17 +226,17 @@ void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
         {
             case 1:
                 f0  = 4*emittanceX;
-                if0 = double(std::rand())/RAND_MAX;
+                if0 = rndGen.Uniform();
                 fi = f0;
                 break;
             case 2:
                 f0  = 6*emittanceX;
-                if0 = double(std::rand())/RAND_MAX;
+                if0 = rndGen.Uniform();
                 fi = f0 * sqrt(if0);
                 break;
             case 3:
                 f0  = 2*emittanceX;
-                if0 = double(std::rand())/RAND_MAX;
+                if0 = rndGen.Uniform();
                 fi  = GSSlover(if0);
                 fi  = fi * f0 ;
                 break;
@@ -234,7 +245,7 @@ void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
         }
 
 
-        ix   = double(rand())/RAND_MAX;
+        ix   = rndGen.Uniform();
 
         axax =  fi * ix;
         ayay = (fi - axax) * kappa;
@@ -242,8 +253,8 @@ void MPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
         ax  = sqrt(axax);
         ay  = sqrt(ayay);
 
-        phaseX = 2 * PI* double(rand())/RAND_MAX;
-        phaseY = 2 * PI* double(rand())/RAND_MAX;
+        phaseX = 2 * PI* rndGen.Uniform();
+        phaseY = 2 * PI* rndGen.Uniform();
 
         ePositionX[i] = ax *   sigmaX * cos( phaseX ) ;
         ePositionY[i] = ay *   sigmaY * cos( phaseY ) ;
@@ -339,89 +350,37 @@ double MPBunch::GSSlover(double if0)
 }
 
 
-void MPBunch::GetMPBunchRMS(const LatticeInterActionPoint &latticeInterActionPoint, int k)
+void MPBunch::GetMPBunchRMS(const LatticeInterActionPoint &latticeInterActionPoint, int k, int level)
 {
-    pxAver=0.E0;
-    pyAver=0.E0;
-    pzAver=0.E0;
-    xAver =0.E0;
-    yAver =0.E0;
-    zAver =0.E0;
-    macroEleNumSurivePerBunch = 0;
-
-    double etax   = latticeInterActionPoint.twissDispX[0];
-    double etaxp  = latticeInterActionPoint.twissDispPX[0];  // \frac{disP}{ds} 
-    double etay   = latticeInterActionPoint.twissDispY[0];
-    double etayp  = latticeInterActionPoint.twissDispPY[0];  // \frac{disP}{ds} 
-
-    // substracut the orbit shift due to the dispersion // Ref. Elegant ILMatrix Eq(56)
-    // for(int i=0;i<macroEleNumPerBunch;i++)
-    // {
-    //     ePositionX[i]  -=  etax  * eMomentumZ[i];   // [m] 
-    //     ePositionY[i]  -=  etay  * eMomentumZ[i];   // [m]
-    //     eMomentumX[i]  -=  etaxp * eMomentumZ[i];   // [rad]
-    //     eMomentumY[i]  -=  etayp * eMomentumZ[i];   // [rad]
-    // }
-
-    for(int i=0;i<macroEleNumPerBunch;i++)
-    {
-        if(eSurive[i]!=0) continue;
-
-        xAver   +=  ePositionX[i];
-        yAver   +=  ePositionY[i];
-        zAver   +=  ePositionZ[i];
-        pxAver  +=  eMomentumX[i];
-        pyAver  +=  eMomentumY[i];
-        pzAver  +=  eMomentumZ[i];
-        macroEleNumSurivePerBunch++;
-    }
-
-    xAver   /= macroEleNumSurivePerBunch;
-    yAver   /= macroEleNumSurivePerBunch;
-    zAver   /= macroEleNumSurivePerBunch;
-    pxAver  /= macroEleNumSurivePerBunch;
-    pyAver  /= macroEleNumSurivePerBunch;
-    pzAver  /= macroEleNumSurivePerBunch;
-
-    double x2Aver=0.E0;
-    double y2Aver=0.E0;
-    double z2Aver=0.E0;
-    double px2Aver=0.E0;
-    double py2Aver=0.E0;
-    double pz2Aver=0.E0;
-    double xpxAver=0.E0;
-    double ypyAver=0.E0;
-    double zpzAver=0.E0;
-
-// The below section is used to calculate the effective emittance
-
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    // moments from the cache unless the particles moved since (momentsDirty) or more is asked than was computed
+    macroEleNumSurivePerBunch = macroEleNumActive;
+    if(momentsDirty || momentsLevel<level)
     {
-        if(eSurive[i]!=0) continue;
-
-        x2Aver  +=  pow(ePositionX[i],2);
-        y2Aver  +=  pow(ePositionY[i],2);
-        z2Aver  +=  pow(ePositionZ[i],2);
-        px2Aver +=  pow(eMomentumX[i],2);
-        py2Aver +=  pow(eMomentumY[i],2);
-        pz2Aver +=  pow(eMomentumZ[i],2);
-
-        xpxAver +=  (ePositionX[i]) * (eMomentumX[i]);
-        ypyAver +=  (ePositionY[i]) * (eMomentumY[i]);
-        zpzAver +=  (ePositionZ[i]) * (eMomentumZ[i]);
-    }
-
-
-
-    x2Aver  /= macroEleNumSurivePerBunch;
-    y2Aver  /= macroEleNumSurivePerBunch;
-    z2Aver  /= macroEleNumSurivePerBunch;
-    px2Aver /= macroEleNumSurivePerBunch;
-    py2Aver /= macroEleNumSurivePerBunch;
-    pz2Aver /= macroEleNumSurivePerBunch;
-    xpxAver /= macroEleNumSurivePerBunch;
-    ypyAver /= macroEleNumSurivePerBunch;
-    zpzAver /= macroEleNumSurivePerBunch;
+        AccumulateMoments(level);
+        momentsDirty = false;
+        momentsLevel = level;
+        if(level==MOMENTS_FULL) GetEigenEmit(latticeInterActionPoint);
+    }
+
+    xAver   = momentMean[0];
+    pxAver  = momentMean[1];
+    yAver   = momentMean[2];
+    pyAver  = momentMean[3];
+    zAver   = momentMean[4];
+    pzAver  = momentMean[5];
+
+    if(momentsLevel<MOMENTS_FULL) return;
+
+    // effective emittance from the moments about the origin, rms emittance from the central moments
+    double x2Aver  = momentCov[0][0] + xAver  * xAver;
+    double px2Aver = momentCov[1][1] + pxAver * pxAver;
+    double xpxAver = momentCov[0][1] + xAver  * pxAver;
+    double y2Aver  = momentCov[2][2] + yAver  * yAver;
+    double py2Aver = momentCov[3][3] + pyAver * pyAver;
+    double ypyAver = momentCov[2][3] + yAver  * pyAver;
+    double z2Aver  = momentCov[4][4] + zAver  * zAver;
+    double pz2Aver = momentCov[5][5] + pzAver * pzAver;
+    double zpzAver = momentCov[4][5] + zAver  * pzAver;
 
     rmsEffectiveRingEmitX = sqrt(x2Aver * px2Aver - pow(xpxAver,2));
     rmsEffectiveRingEmitY = sqrt(y2Aver * py2Aver - pow(ypyAver,2));
@@ -430,71 +389,117 @@ void MPBunch::GetMPBunchRMS(const LatticeInterActionPoint &latticeInterActionPoi
     rmsEffectiveRx = sqrt(rmsEffectiveRingEmitX * latticeInterActionPoint.twissBetaX[k]);
     rmsEffectiveRy = sqrt(rmsEffectiveRingEmitY * latticeInterActionPoint.twissBetaY[k]);
 
+    // the obtained rms size is used to calculate the interaction between beam and ion
+    emittanceX = sqrt(momentCov[0][0] * momentCov[1][1] - pow(momentCov[0][1],2));
+    emittanceY = sqrt(momentCov[2][2] * momentCov[3][3] - pow(momentCov[2][3],2));
+    emittanceZ = sqrt(momentCov[4][4] * momentCov[5][5] - pow(momentCov[4][5],2));
 
-// The below section is used to calculate the  rms emittance
-// the obtained rms size is used to calculate the interaction between beam and ion
-
-    x2Aver=0.E0;
-    y2Aver=0.E0;
-    z2Aver=0.E0;
-    px2Aver=0.E0;
-    py2Aver=0.E0;
-    pz2Aver=0.E0;
-    xpxAver=0.E0;
-    ypyAver=0.E0;
-    zpzAver=0.E0;
+    rmsRx = sqrt(emittanceX * latticeInterActionPoint.twissBetaX[k]);
+    rmsRy = sqrt(emittanceY * latticeInterActionPoint.twissBetaY[k]);
 
+    rmsBunchLength  = sqrt(momentCov[4][4]);
+    rmsEnergySpread = sqrt(momentCov[5][5]);
+}
 
-    for(int i=0;i<macroEleNumPerBunch;i++)
+void MPBunch::AccumulateMoments(int level)
+{
+    // one pass over the particles. The coordinates are taken relative to the last means, which keeps the
+    // sum of squares free of cancellation for a bunch far off the origin (z, pz along the bucket).
+    // The sums are written out term by term so that the loop vectorizes.
+    const int n = macroEleNumActive;
+    if(n==0) return;
+
+    const double x0  = momentMean[0];
+    const double px0 = momentMean[1];
+    const double y0  = momentMean[2];
+    const double py0 = momentMean[3];
+    const double z0  = momentMean[4];
+    const double pz0 = momentMean[5];
+
+    // sum[0..5]: first moments, sum[6..26]: upper triangle of the second moments, row by row
+    double sum[27] = {0};
+
+    if(level<MOMENTS_FULL)
     {
-        if(eSurive[i]!=0) continue;
-
-        x2Aver  +=  pow(ePositionX[i]-xAver ,2);
-        y2Aver  +=  pow(ePositionY[i]-yAver ,2);
-        z2Aver  +=  pow(ePositionZ[i]-zAver ,2);
-
-        px2Aver +=  pow(eMomentumX[i]-pxAver,2);
-        py2Aver +=  pow(eMomentumY[i]-pyAver,2);
-        pz2Aver +=  pow(eMomentumZ[i]-pzAver,2);
-
-        xpxAver +=  (ePositionX[i]-xAver) * (eMomentumX[i]-pxAver);
-        ypyAver +=  (ePositionY[i]-yAver) * (eMomentumY[i]-pyAver);
-        zpzAver +=  (ePositionZ[i]-zAver) * (eMomentumZ[i]-pzAver);
+        #pragma omp simd reduction(+:sum[:6])
+        for(int i=0;i<n;i++)
+        {
+            sum[0] += ePositionX[i] - x0;
+            sum[1] += eMomentumX[i] - px0;
+            sum[2] += ePositionY[i] - y0;
+            sum[3] += eMomentumY[i] - py0;
+            sum[4] += ePositionZ[i] - z0;
+            sum[5] += eMomentumZ[i] - pz0;
+        }
+        for(int a=0;a<6;a++) momentMean[a] += sum[a] / n;
+        return;
     }
 
+    double zMin = ePositionZ[0];
+    double zMax = ePositionZ[0];
 
+    #pragma omp simd reduction(+:sum[:27]) reduction(min:zMin) reduction(max:zMax)
+    for(int i=0;i<n;i++)
+    {
+        double dx  = ePositionX[i] - x0;
+        double dpx = eMomentumX[i] - px0;
+        double dy  = ePositionY[i] - y0;
+        double dpy = eMomentumY[i] - py0;
+        double dz  = ePositionZ[i] - z0;
+        double dpz = eMomentumZ[i] - pz0;
+
+        sum[0]  += dx;
+        sum[1]  += dpx;
+        sum[2]  += dy;
+        sum[3]  += dpy;
+        sum[4]  += dz;
+        sum[5]  += dpz;
+
+        sum[6]  += dx  * dx;
+        sum[7]  += dx  * dpx;
+        sum[8]  += dx  * dy;
+        sum[9]  += dx  * dpy;
+        sum[10] += dx  * dz;
+        sum[11] += dx  * dpz;
+        sum[12] += dpx * dpx;
+        sum[13] += dpx * dy;
+        sum[14] += dpx * dpy;
+        sum[15] += dpx * dz;
+        sum[16] += dpx * dpz;
+        sum[17] += dy  * dy;
+        sum[18] += dy  * dpy;
+        sum[19] += dy  * dz;
+        sum[20] += dy  * dpz;
+        sum[21] += dpy * dpy;
+        sum[22] += dpy * dz;
+        sum[23] += dpy * dpz;
+        sum[24] += dz  * dz;
+        sum[25] += dz  * dpz;
+        sum[26] += dpz * dpz;
+
+        zMin = min(zMin, ePositionZ[i]);
+        zMax = max(zMax, ePositionZ[i]);
+    }
+
+    double mean[6];
+    for(int a=0;a<6;a++)
+    {
+        mean[a]        = sum[a] / n;
+        momentMean[a] += mean[a];
+    }
+    int m = 6;
+    for(int a=0;a<6;a++)
+    {
+        for(int b=a;b<6;b++)
+        {
+            momentCov[a][b] = sum[m++] / n - mean[a] * mean[b];
+            momentCov[b][a] = momentCov[a][b];
+        }
+    }
 
-    x2Aver  /= macroEleNumSurivePerBunch;
-    y2Aver  /= macroEleNumSurivePerBunch;
-    z2Aver  /= macroEleNumSurivePerBunch;
-    px2Aver /= macroEleNumSurivePerBunch;
-    py2Aver /= macroEleNumSurivePerBunch;
-    pz2Aver /= macroEleNumSurivePerBunch;
-    xpxAver /= macroEleNumSurivePerBunch;
-    ypyAver /= macroEleNumSurivePerBunch;
-    zpzAver /= macroEleNumSurivePerBunch;
-
-    emittanceX = sqrt(x2Aver * px2Aver - pow(xpxAver,2));
-    emittanceY = sqrt(y2Aver * py2Aver - pow(ypyAver,2));
-    emittanceZ = sqrt(z2Aver * pz2Aver - pow(zpzAver,2));
-
-    rmsRx = sqrt(emittanceX * latticeInterActionPoint.twissBetaX[k]);
-    rmsRy = sqrt(emittanceY * latticeInterActionPoint.twissBetaY[k]);
-
-    rmsBunchLength  = sqrt(z2Aver) ;
-    rmsEnergySpread = sqrt(pz2Aver);
-
-    // // add the orbit shift due to the dispersion // Ref. Elegant ILMatrix Eq(56)
-    // for(int i=0;i<macroEleNumPerBunch;i++)
-    // {
-    //     ePositionX[i]  +=  etax  * eMomentumZ[i];   // [m] 
-    //     ePositionY[i]  +=  etay  * eMomentumZ[i];   // [m]
-    //     eMomentumX[i]  +=  etaxp * eMomentumZ[i];   // [rad]
-    //     eMomentumY[i]  +=  etayp * eMomentumZ[i];   // [rad]
-    // }
-
-    GetZMinMax();
-    GetEigenEmit(latticeInterActionPoint);
+    // as GetZMinMax()
+    zMinCurrentTurn = zMin - 1.e-6;
+    zMaxCurrentTurn = zMax + 1.e-6;
 }
 
 void MPBunch::GetEigenEmit(const LatticeInterActionPoint &latticeInterActionPoint)
@@ -504,49 +509,20 @@ void MPBunch::GetEigenEmit(const LatticeInterActionPoint &latticeInterActionPoin
     double etay   = latticeInterActionPoint.twissDispY[0];
     double etayp  = latticeInterActionPoint.twissDispPY[0];  // \frac{disP}{ds} 
 
-    vector<double> x  = ePositionX;
-    vector<double> y  = ePositionY;
-    vector<double> xp = eMomentumX;
-    vector<double> yp = eMomentumY;
-    vector<double> zp = eMomentumZ;
-
     // substracut the orbit shift due to the dispersion // Ref. Elegant ILMatrix Eq(56)
-    for(int i=0;i<macroEleNumPerBunch;i++)
-    {
-        x[i]   -=  etax  * zp[i];   // [m] 
-        y[i]   -=  etay  * zp[i];   // [m]
-        xp[i]  -=  etaxp * zp[i];   // [rad]
-        yp[i]  -=  etayp * zp[i];   // [rad]
-    }
-
-    double averX  = std::accumulate(x.begin(),  x.end(),  0);
-    double averY  = std::accumulate(y.begin(),  y.end(),  0);
-    double averXP = std::accumulate(xp.begin(), xp.end(), 0);
-    double averYP = std::accumulate(yp.begin(), yp.end(), 0);
-
-    double aver2[10] = {0};  // x_x, x_xp, x_y,x_yp/ Ref. Lars, PRAB,16,044201 
-    
-
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    // u = (x - etax*pz, xp - etaxp*pz, y - etay*pz, yp - etayp*pz): <u_a u_b> from the cached 6x6 central moments
+    const double eta[4] = {etax, etaxp, etay, etayp};
+    double cov4[4][4];
+    for(int a=0;a<4;a++)
     {
-        x[i]   -=  averX;   
-        y[i]   -=  averY;   // [m]
-        xp[i]  -=  averXP;   // [rad]
-        yp[i]  -=  averYP;   // [rad]
-
-        aver2[0] +=  x[i] *   x[i];
-        aver2[1] +=  x[i] *  xp[i];
-        aver2[2] +=  x[i] *   y[i];
-        aver2[3] +=  x[i] *  yp[i];
-        aver2[4] += xp[i] *  xp[i];
-        aver2[5] += xp[i] *   y[i];
-        aver2[6] += xp[i] *  yp[i];
-        aver2[7] +=  y[i] *   y[i];
-        aver2[8] +=  y[i] *  yp[i];
-        aver2[9] += yp[i] *  yp[i]; 
+        for(int b=0;b<4;b++)
+        {
+            cov4[a][b] = momentCov[a][b] - eta[a] * momentCov[5][b] - eta[b] * momentCov[a][5] + eta[a] * eta[b] * momentCov[5][5];
+        }
     }
 
-    for(int i=0;i<10;i++) aver2[i] /= macroEleNumPerBunch;
+    double aver2[10] = {cov4[0][0], cov4[0][1], cov4[0][2], cov4[0][3], cov4[1][1],
+                        cov4[1][2], cov4[1][3], cov4[2][2], cov4[2][3], cov4[3][3]};  // x_x, x_xp, x_y,x_yp/ Ref. Lars, PRAB,16,044201 
     
     // aver2[0] = 8.57;
     // aver2[1] = -4.34;
@@ -660,9 +636,9 @@ void MPBunch::GetEigenEmit(const LatticeInterActionPoint &latticeInterActionPoin
 void MPBunch::SetSlicedBunchInfo(int const nz)
 {   
      //(1) set the slicedBuncDisInfo, 2.5D PIC model (-5 simgaz, 5*simgaz) 11 slices as default.   
-    slicedBunchDisInfo    = v3d(nz,v2d(6,v1d()));  
-    slicedBunchChargeInfo = v2d(nz,v1d());
-    slicedBunchPartiIndex = v2i(nz,v1i());
+    slicedBunchDisInfo.resize(nz,v2d(6,v1d()));
+    slicedBunchChargeInfo.resize(nz);
+    slicedBunchPartiIndex.resize(nz);
 
     GetZMinMax();  
     double zMin = zMinCurrentTurn;
@@ -672,22 +648,22 @@ void MPBunch::SetSlicedBunchInfo(int const nz)
     //int range = 10;
     //double dz = 2 * range * rmsBunchLength / (nz - 1);
     
-    int sliceIndex;
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    // slices are filled from the shared sort, the slice vectors keep their capacity from turn to turn
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMin,dz,nz);
+
+    const v1dAligned *coord[6] = {&ePositionX,&ePositionY,&ePositionZ,&eMomentumX,&eMomentumY,&eMomentumZ};
+    for(int s=0;s<nz;s++)
     {
-        //sliceIndex =  floor( (ePositionZ[i] -  (zAver - range * rmsBunchLength)) / dz);
-        sliceIndex =  floor( (ePositionZ[i] -  zMin) / dz);
-        sliceIndex = sliceIndex < 0    ? 0    :  sliceIndex;
-        sliceIndex = sliceIndex > nz-1 ? nz-1 :  sliceIndex; 
-			
-        slicedBunchDisInfo[sliceIndex][0].push_back(ePositionX[i]);
-        slicedBunchDisInfo[sliceIndex][1].push_back(ePositionY[i]);
-        slicedBunchDisInfo[sliceIndex][2].push_back(ePositionZ[i]);
-        slicedBunchDisInfo[sliceIndex][3].push_back(eMomentumX[i]);
-        slicedBunchDisInfo[sliceIndex][4].push_back(eMomentumY[i]);
-        slicedBunchDisInfo[sliceIndex][5].push_back(eMomentumZ[i]);
-        slicedBunchChargeInfo[sliceIndex].push_back(macroEleCharge * ElectronCharge / dz);  // [C/m]
-        slicedBunchPartiIndex[sliceIndex].push_back(i);
+        int        count = longBinning.Count(s);
+        const int *index = longBinning.Particles(s);
+
+        for(int c=0;c<6;c++)
+        {
+            slicedBunchDisInfo[s][c].resize(count);
+            for(int j=0;j<count;j++) slicedBunchDisInfo[s][c][j] = (*coord[c])[index[j]];
+        }
+        slicedBunchChargeInfo[s].assign(count,macroEleCharge * ElectronCharge / dz);  // [C/m]
+        slicedBunchPartiIndex[s].assign(index,index + count);
     }
 
 }
@@ -846,6 +822,7 @@ void MPBunch::UpdateTransverseMomentumLinear(vector<vector<double>>  &particles,
 
 void MPBunch::BunchMomentumUpdateDueToSpaceChargeAnalytical(LatticeInterActionPoint &latticeInterActionPoint, int k, const ReadInputSettings &inputParameter)
 {
+    momentsDirty = true;
     // 2.5D model for simulaiton with the ideal model
     int nz = inputParameter.ringRun->scMeshNum[2];
     int scFlag = inputParameter.ringRun->spaceChargeFlag;
@@ -886,6 +863,7 @@ void MPBunch::BunchMomentumUpdateDueToSpaceChargeAnalytical(LatticeInterActionPo
 
 void MPBunch::BunchMomentumUpdateDueToSpaceChargePIC(PIC3D &picSCBeam3D,LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
+    momentsDirty = true;
     // generate the mesh according to the rms beam size, and keep mesh size for in each slice. 
     double rmsXY[2]  = {rmsRx,rmsRy};
     // double rmsXY[2]  = {1.E-4,1.E-4};
@@ -897,34 +875,36 @@ void MPBunch::BunchMomentumUpdateDueToSpaceChargePIC(PIC3D &picSCBeam3D,LatticeI
     }
 
     // 2.5D model for simulaiton--since sigmaz~1.E-3, sigmax~1.E-5, sigmay~1.E-6, very un-symmetryic 
-    vector<vector<double> > particles(6,v1d());
-    vector<double> eCharge;
-    vector<int> partiIndexInSlice;
-    // mesh is generatote in XY accoding the rms beam size.
-    picSCBeam3D.slicedBunchPIC2D->Set2DMesh(rmsXY,averXY);
+    // mesh is generatote in XY accoding the rms beam size, the same in the solver of each thread.
+    picSCBeam3D.Set2DMesh(rmsXY,averXY);
     int nz = picSCBeam3D.numberOfGrid[2];
     SetSlicedBunchInfo(nz);  // sliced longitudianl bunch profile
 
     double ds = latticeInterActionPoint.interactionLength[k];
 
-    for (int slice = 0; slice<slicedBunchDisInfo.size(); ++slice )
+    // slices are independent: each thread solves its slices with its own PIC2D (picSCBeam3D.slicePIC2D), the
+    // particles of a slice are updated in place in slicedBunchDisInfo and written back to disjoint indices.
+    // Not nested in the OpenMP over bunches (MPBeam::BeamTransferDueToSpaceChargePIC runs the bunches serially).
+    int nSlice = slicedBunchDisInfo.size();
+    int nSolver = picSCBeam3D.slicePIC2D.size();
+    #pragma omp parallel for schedule(dynamic,1) num_threads(nSolver) if(!omp_in_parallel())
+    for (int slice = 0; slice<nSlice; ++slice )
     {
-        particles =  slicedBunchDisInfo[slice];
-        eCharge   =  slicedBunchChargeInfo[slice];
-        partiIndexInSlice = slicedBunchPartiIndex[slice];
+        vector<vector<double> > &particles = slicedBunchDisInfo[slice];
+        const vector<int> &partiIndexInSlice = slicedBunchPartiIndex[slice];
              
         if(particles[0].size()<2) continue;
-        picSCBeam3D.slicedBunchPIC2D->Set2DRho(particles,eCharge);
-        picSCBeam3D.slicedBunchPIC2D->Set2DPhi(); 
-        picSCBeam3D.slicedBunchPIC2D->Set2DEField();
-        picSCBeam3D.slicedBunchPIC2D->SetPartSCField();
-        picSCBeam3D.slicedBunchPIC2D->UpdateTransverseMomentum(particles, ds);
+        PIC2D *slicePIC2D = picSCBeam3D.slicePIC2D[omp_get_thread_num()];
+        slicePIC2D->Set2DRho(particles,slicedBunchChargeInfo[slice]);
+        slicePIC2D->Set2DPhi(); 
+        slicePIC2D->Set2DEField();
+        slicePIC2D->SetPartSCField();
+        slicePIC2D->UpdateTransverseMomentum(particles, ds);
 
         // update the particle momentum
-        int partIndex;
         for(int i=0; i<partiIndexInSlice.size(); ++i)
         {
-            partIndex = partiIndexInSlice[i];
+            int partIndex = partiIndexInSlice[i];
             eMomentumX[partIndex] = particles[3][i];
             eMomentumY[partIndex] = particles[4][i];
         } 
@@ -991,9 +971,8 @@ void MPBunch::SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC, LatticeInterA
     vector<vector<double> > particles(4,vector<double>()) ;  // [x,y,px,py]
     vector<double> eCharge;
 
-    for(int i=0;i<macroEleNumPerBunch;i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
-        if(eSurive[i]!=0) continue;  // only surive particles are set for PIC solver
         particles[0].push_back(ePositionX[i]);
         particles[1].push_back(ePositionY[i]);
         // particles[2].push_back(eMomentumX[i]); // px / p0
@@ -1045,8 +1024,8 @@ void MPBunch::SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC, LatticeInterA
     {
         for(int j=0;j<latticeInterActionPoint.ionAccumuNumber[k][p];j++)
         {
-            ions[0].push_back(latticeInterActionPoint.ionAccumuPositionX[k][p][j]);
-            ions[1].push_back(latticeInterActionPoint.ionAccumuPositionY[k][p][j]);
+            ions[0].push_back(latticeInterActionPoint.ionAccumu[k][p].x[j]);
+            ions[1].push_back(latticeInterActionPoint.ionAccumu[k][p].y[j]);
             // ions[2].push_back(latticeInterActionPoint.macroIonCharge[k][p] * ElectronCharge)
             // ions[3].push_back(latticeInterActionPoint.ionMassNumber[p]);
             ionCharge.push_back(latticeInterActionPoint.macroIonCharge[k][p] * ElectronCharge);   // [C] 
@@ -1061,16 +1040,10 @@ void MPBunch::SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC, LatticeInterA
     // to be updated...
     //(3) Get the momentum kick of electron due to ions 
     vector<vector<double> > eFieldPart = beamIon2DPIC.pic2DIon.GetPartSCField(particles);
-    int j;
-    for(int i=0;i<particles[0].size();i++)
+    for(int i=0;i<particles[0].size();i++)   // particles[] holds the active range [0,macroEleNumActive) in order
     {
-        if(eSurive[i]!=0)
-        {
-            j++;
-            continue;  // reset the momentum of the particiles.
-        } 
-        eFxDueToIon[i+j] = eFieldPart[0][i];
-        eFxDueToIon[i+j] = eFieldPart[1][i];
+        eFxDueToIon[i] = eFieldPart[0][i];
+        eFyDueToIon[i] = eFieldPart[1][i];
     }   
     
     //(4) Get the momentum kick of ions due to elecrons
@@ -1080,8 +1053,8 @@ void MPBunch::SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC, LatticeInterA
     {
         for(int j=0;j<latticeInterActionPoint.ionAccumuNumber[k][p];j++)
         {            
-            latticeInterActionPoint.ionAccumuFx[k][p][j]= eFieldIons[0][count];
-            latticeInterActionPoint.ionAccumuFy[k][p][j]= eFieldIons[1][count];
+            latticeInterActionPoint.ionAccumu[k][p].fx[j]= eFieldIons[0][count];
+            latticeInterActionPoint.ionAccumu[k][p].fy[j]= eFieldIons[1][count];
             count++;
         }
     }
@@ -1094,20 +1067,15 @@ void MPBunch::SSIonBunchInteractionPIC(BeamIon2DPIC &beamIon2DPIC, LatticeInterA
 void MPBunch::SSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionPoint, int k)
 {
     // (1) get the force of accumulated ions due to the bunch electron beam --- BassettiErskine model.
+    // The kicks of a species are evaluated in one BassettiErskineField::Field call (w(z) set by ionCalBEMethod).
 
     double nE0 = electronNumPerBunch;
     double nI0;
     double ionMassNumber;
-    double omegaE, omegaI;
     double coeffI, coeffE;
-    double tempFx=0.E0;
-    double tempFy=0.E0;
-    double posx=0.E0;
-    double posy=0.E0;
     double rmsRxTemp = rmsRx;
     double rmsRyTemp = rmsRy;
-    double eFxTemp;
-    double eFyTemp;
+    vector<double> posx, posy, tempFx, tempFy;
 
     for(int p=0;p<latticeInterActionPoint.gasSpec;p++)
     {
@@ -1115,93 +1083,67 @@ void MPBunch::SSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionP
         ionMassNumber = latticeInterActionPoint.ionMassNumber[p];
 
         coeffI = 2.0 * nE0*ElecClassicRadius * ElectronMassEV/IonMassEV/ionMassNumber * CLight;   // [m * m/s]
-        coeffE = 2.0 * ElecClassicRadius/rGamma;                                                  // [m]
 
-        for(int j=0;j<latticeInterActionPoint.ionAccumuNumber[k][p];j++)
-        {
-            latticeInterActionPoint.ionAccumuFx[k][p][j]=0.E0;
-            latticeInterActionPoint.ionAccumuFy[k][p][j]=0.E0;
-
-            posx    =  latticeInterActionPoint.ionAccumuPositionX[k][p][j] - xAver;
-            posy    =  latticeInterActionPoint.ionAccumuPositionY[k][p][j] - yAver;
+        LatticeInterActionPoint::IonStore &ion = latticeInterActionPoint.ionAccumu[k][p];
+        int ionNum = latticeInterActionPoint.ionAccumuNumber[k][p];
+        posx.resize(ionNum);
+        posy.resize(ionNum);
+        tempFx.resize(ionNum);
+        tempFy.resize(ionNum);
 
-            if(abs(posx/rmsRxTemp) + abs(posy/rmsRyTemp)<1.0E-5)
-            {
-                tempFx=0;
-                tempFy=0;
-            }
-            else
-            {
-                if( (rmsRxTemp - rmsRyTemp)/rmsRyTemp > 1.e-4 )
-                {
-                    BassettiErskine1(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);         // tempFx ->[1/m]; // assume electron rms as gaussion-- get force at ion position
-                }
-                else if ( (rmsRxTemp - rmsRyTemp)/rmsRyTemp < -1.e-4  )
-                {
-                    BassettiErskine1(posy,posx,rmsRyTemp,rmsRxTemp,tempFy,tempFx);
-                }
-                else
-                {
-                    GaussianField(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);
-                }
-            }
+        for(int j=0;j<ionNum;j++)
+        {
+            posx[j] = ion.x[j] - xAver;
+            posy[j] = ion.y[j] - yAver;
+        }
 
-            latticeInterActionPoint.ionAccumuFx[k][p][j]= coeffI*tempFx;                  //[1/m] * [m * m/s] - > [m/s]; -> (13) integrate along dt gives ion velovity change
-            latticeInterActionPoint.ionAccumuFy[k][p][j]= coeffI*tempFy;
+        // assume electron rms as gaussion-- get force at ion position, tempFx ->[1/m]
+        BassettiErskineField::Field(ionNum,posx.data(),posy.data(),rmsRxTemp,rmsRyTemp,tempFx.data(),tempFy.data());
 
-            eFxTemp = eFxTemp + tempFx;
-            eFyTemp = eFyTemp + tempFy;
+        for(int j=0;j<ionNum;j++)
+        {
+            ion.fx[j]= coeffI*tempFx[j];                  //[1/m] * [m * m/s] - > [m/s]; -> (13) integrate along dt gives ion velovity change
+            ion.fy[j]= coeffI*tempFy[j];
         }
-   
     } 
 
 
 
     // (2) get the force of certain bunched beam due to accumulated ions --- BassettiErskine model.
     // The process to get the force from accumulated ion beam is the similar to inverse "strong-weak" model.
-    
-    for(int i=0;i<macroEleNumPerBunch;i++)
-    {
-        if(eSurive[i] != 0) continue;
+    // Species outer, the sum over the species of each electron keeps its order.
 
+    for(int i=0;i<macroEleNumActive;i++)
+    {
         eFxDueToIon[i] =0.E0;
         eFyDueToIon[i] =0.E0;
+    }
 
-        for(int p=0;p<latticeInterActionPoint.gasSpec;p++)
-        {
-            nI0 = latticeInterActionPoint.macroIonCharge[k][p] * latticeInterActionPoint.ionAccumuNumber[k][p];
-            coeffE = 2.0*nI0*ElecClassicRadius/rGamma;
-            
-            rmsRxTemp = latticeInterActionPoint.ionAccumuRMSX[k][p];
-            rmsRyTemp = latticeInterActionPoint.ionAccumuRMSY[k][p];
+    posx.resize(macroEleNumActive);
+    posy.resize(macroEleNumActive);
+    tempFx.resize(macroEleNumActive);
+    tempFy.resize(macroEleNumActive);
 
-            posx    =  ePositionX[i] - latticeInterActionPoint.ionAccumuAverX[k][p];
-            posy    =  ePositionY[i] - latticeInterActionPoint.ionAccumuAverY[k][p];
+    for(int p=0;p<latticeInterActionPoint.gasSpec;p++)
+    {
+        nI0 = latticeInterActionPoint.macroIonCharge[k][p] * latticeInterActionPoint.ionAccumuNumber[k][p];
+        coeffE = 2.0*nI0*ElecClassicRadius/rGamma;
+        
+        rmsRxTemp = latticeInterActionPoint.ionAccumuRMSX[k][p];
+        rmsRyTemp = latticeInterActionPoint.ionAccumuRMSY[k][p];
 
-            if(abs(posx/rmsRxTemp) + abs(posy/rmsRyTemp)<1.0E-5)
-            {
-                tempFx=0;
-                tempFy=0;
-            }
-            else
-            {
-                if( (rmsRxTemp - rmsRyTemp)/rmsRyTemp > 1.e-4 )
-                {
-                    BassettiErskine1(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);         // tempFx ->[1/m]; // assume electron rms as gaussion-- get force at ion position
-                }
-                else if ( (rmsRxTemp - rmsRyTemp)/rmsRyTemp < -1.e-4  )
-                {
-                    BassettiErskine1(posy,posx,rmsRyTemp,rmsRxTemp,tempFy,tempFx);
-                }
-                else
-                {
-                    GaussianField(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);
-                }
-            }
+        for(int i=0;i<macroEleNumActive;i++)
+        {
+            posx[i] = ePositionX[i] - latticeInterActionPoint.ionAccumuAverX[k][p];
+            posy[i] = ePositionY[i] - latticeInterActionPoint.ionAccumuAverY[k][p];
+        }
 
-            eFxDueToIon[i] +=    coeffE * tempFx;
-            eFyDueToIon[i] +=    coeffE * tempFy;
+        BassettiErskineField::Field(macroEleNumActive,posx.data(),posy.data(),rmsRxTemp,rmsRyTemp,tempFx.data(),tempFy.data());
 
+        for(int i=0;i<macroEleNumActive;i++)
+        {
+            eFxDueToIon[i] +=    coeffE * tempFx[i];
+            eFyDueToIon[i] +=    coeffE * tempFy[i];
         }          
     }    
 
@@ -1213,6 +1155,7 @@ void MPBunch::SSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionP
 
 void MPBunch::BunchMomentumUpdateDuetoRFRigid(const ReadInputSettings &inputParameter,CavityResonator &cavityResonator)
 {
+    momentsDirty = true;
     // Ref. bunch.h that ePositionZ = - ePositionT * c. head pariticles: deltaT<0, ePositionZ[i]>0.
 
     int resNum        = inputParameter.ringParRf->resNum;
@@ -1234,14 +1177,8 @@ void MPBunch::BunchMomentumUpdateDuetoRFRigid(const ReadInputSettings &inputPara
         posZBins[i] = zMaxCurrentTurn - i * dzBin  - dzBin / 2.0;   
     }
 
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(bunchBinNumberZ);
-    for(int i=0;i<ePositionZ.size();i++)
-    {
-        if(eSurive[i]!=0) continue;
-        int index = floor((  zMaxCurrentTurn - ePositionZ[i] ) / dzBin); 
-        histoParIndex[index].push_back(i);    
-    }
+    // bin k from the head is bin bunchBinNumberZ-1-k of longBinning, which counts from zMin
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinCurrentTurn,dzBin,bunchBinNumberZ);
 
     for(int j=0;j<resNum;j++)
     {
@@ -1271,30 +1208,32 @@ void MPBunch::BunchMomentumUpdateDuetoRFRigid(const ReadInputSettings &inputPara
                             cavityResonator.resonatorVec[j].resQualityQ0,0.E0) * electronNumPerBunch * ElectronCharge;  // [Volt]
 
         // loop for bin-by-bin in one bunch from head to tail...
-        for(int k=0;k<histoParIndex.size();k++) 
+        for(int k=0;k<bunchBinNumberZ;k++)
         {
+            int        binPartNum = longBinning.Count(bunchBinNumberZ-1-k);
+            const int *binPart    = longBinning.Particles(bunchBinNumberZ-1-k);
             genVoltage = cavityResonator.resonatorVec[j].resGenVol * exp( - li * posZBins[k]  / CLight * 2. * PI * double(resHarm) * fRF );   
             cavVoltage = cavityResonator.resonatorVec[j].vbAccum   +  genVoltage;
                         
-            // loop for particle in each bin --- histoParIndex is ligned from head to tail [-t,t]          
-            for(int i=0;i<histoParIndex[k].size();i++)
+            // loop for particle in each bin --- bins are aligned from head to tail [-t,t]          
+            for(int i=0;i<binPartNum;i++)
             {
-                int index          = histoParIndex[k][i];
+                int index          = binPart[i];
                 eMomentumZ[index] += cavVoltage.real() / electronBeamEnergy / pow(rBeta,2);
                 eMomentumZ[index] += vb0.real()/2.0    / electronBeamEnergy / pow(rBeta,2);
                 if(j==0) eMomentumZ[index] -= u0       / electronBeamEnergy / pow(rBeta,2); 
             }
 
             // to get the weighing average of cavvity voltage, beam inuced voltage...
-            particleInBunch   += histoParIndex[k].size();
-            selfLossVolAccume += vb0/2.0    * double(histoParIndex[k].size());
-
-            cavVoltageReal    += cavVoltage.real() * double(histoParIndex[k].size());
-            cavVoltageImag    += cavVoltage.imag() * double(histoParIndex[k].size());
-            genVolReal        += genVoltage.real() * double(histoParIndex[k].size());
-            genVolImag        += genVoltage.imag() * double(histoParIndex[k].size());
-            induceVolReal     += (cavityResonator.resonatorVec[j].vbAccum + vb0).real() * double(histoParIndex[k].size()); 
-            induceVolImag     += (cavityResonator.resonatorVec[j].vbAccum + vb0).imag() * double(histoParIndex[k].size());         
+            particleInBunch   += binPartNum;
+            selfLossVolAccume += vb0/2.0    * double(binPartNum);
+
+            cavVoltageReal    += cavVoltage.real() * double(binPartNum);
+            cavVoltageImag    += cavVoltage.imag() * double(binPartNum);
+            genVolReal        += genVoltage.real() * double(binPartNum);
+            genVolImag        += genVoltage.imag() * double(binPartNum);
+            induceVolReal     += (cavityResonator.resonatorVec[j].vbAccum + vb0).real() * double(binPartNum); 
+            induceVolImag     += (cavityResonator.resonatorVec[j].vbAccum + vb0).imag() * double(binPartNum);         
         }
         
         cavVoltageReal /= double(particleInBunch);
@@ -1322,6 +1261,7 @@ void MPBunch::BunchMomentumUpdateDuetoRFRigid(const ReadInputSettings &inputPara
 
 void MPBunch::BunchMomentumUpdateDueToRFModeStable(const ReadInputSettings &inputParameter,Resonator &resonator, int resIndex)
 {
+    momentsDirty = true;
 
     int ringHarmH     = inputParameter.ringParRf->ringHarm;
     double f0         = inputParameter.ringParBasic->f0;
@@ -1342,17 +1282,11 @@ void MPBunch::BunchMomentumUpdateDueToRFModeStable(const ReadInputSettings &inpu
         posZBins[i] = zMaxCurrentTurn - i * dzBin  - dzBin / 2.0;  
     }
     
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(bunchBinNumberZ);
-    for(int i=0;i<ePositionZ.size();i++)
-    {
-        if(eSurive[i]!=0) continue;
-        int index = floor((  zMaxCurrentTurn - ePositionZ[i] ) / dzBin);         
-        histoParIndex[index].push_back(i);  
-    }
+    // the resonators after the first one find the bunch already sorted on this grid
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinCurrentTurn,dzBin,bunchBinNumberZ);
     for(int i=0;i<bunchBinNumberZ;i++)
     {
-        densProfVsBin[i] = histoParIndex[i].size() / double(macroEleNumPerBunch) /  dzBin;
+        densProfVsBin[i] = longBinning.Count(bunchBinNumberZ-1-i) / double(macroEleNumPerBunch) /  dzBin;
     }
     
 
@@ -1374,24 +1308,26 @@ void MPBunch::BunchMomentumUpdateDueToRFModeStable(const ReadInputSettings &inpu
     genVoltage = resonator.resGenVol;     
     cavVoltage = resonator.vbAccum + genVoltage;
 
-    for(int k=0;k<histoParIndex.size();k++) 
-    {                    
+    for(int k=0;k<bunchBinNumberZ;k++)
+    {
+        int        binPartNum = longBinning.Count(bunchBinNumberZ-1-k);
+        const int *binPart    = longBinning.Particles(bunchBinNumberZ-1-k);
         // loop for particle in each bin          
-        for(int i=0;i<histoParIndex[k].size();i++)
+        for(int i=0;i<binPartNum;i++)
         {
-            int index          = histoParIndex[k][i];
+            int index          = binPart[i];
             eMomentumZ[index] += (cavVoltage * exp( - li * posZBins[k]  / CLight / rBeta * 2. * PI * double(resHarm) * fRF)).real() / electronBeamEnergy / pow(rBeta,2);
             eMomentumZ[index] += vb0.real()/2.0  / electronBeamEnergy / pow(rBeta,2);
         }
 
-        particleInBunch   += histoParIndex[k].size();
-        selfLossVolAccume += vb0/2.0           * double(histoParIndex[k].size());
-        cavVoltageReal    += cavVoltage.real() * double(histoParIndex[k].size());
-        cavVoltageImag    += cavVoltage.imag() * double(histoParIndex[k].size());
-        genVolReal        += genVoltage.real() * double(histoParIndex[k].size());
-        genVolImag        += genVoltage.imag() * double(histoParIndex[k].size());
-        induceVolReal     += (resonator.vbAccum + vb0).real() * double(histoParIndex[k].size()); 
-        induceVolImag     += (resonator.vbAccum + vb0).imag() * double(histoParIndex[k].size());
+        particleInBunch   += binPartNum;
+        selfLossVolAccume += vb0/2.0           * double(binPartNum);
+        cavVoltageReal    += cavVoltage.real() * double(binPartNum);
+        cavVoltageImag    += cavVoltage.imag() * double(binPartNum);
+        genVolReal        += genVoltage.real() * double(binPartNum);
+        genVolImag        += genVoltage.imag() * double(binPartNum);
+        induceVolReal     += (resonator.vbAccum + vb0).real() * double(binPartNum); 
+        induceVolImag     += (resonator.vbAccum + vb0).imag() * double(binPartNum);
 
         // beam induced voltage retotate and decay bin-by-bin            
         // tB     = dtBin;
@@ -1418,6 +1354,7 @@ void MPBunch::BunchMomentumUpdateDueToRFModeStable(const ReadInputSettings &inpu
 
 void MPBunch::BunchMomentumUpdateDueToRFMode(const ReadInputSettings &inputParameter,Resonator &resonator, int resIndex)
 {
+    momentsDirty = true;
     int ringHarmH     = inputParameter.ringParRf->ringHarm;
     double f0         = inputParameter.ringParBasic->f0;
     double rBeta      = inputParameter.ringParBasic->rBeta;
@@ -1437,17 +1374,11 @@ void MPBunch::BunchMomentumUpdateDueToRFMode(const ReadInputSettings &inputParam
         posZBins[i] = zMaxCurrentTurn - i * dzBin  - dzBin / 2.0;  
     }
     
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(bunchBinNumberZ);
-    for(int i=0;i<ePositionZ.size();i++)
-    {
-        if(eSurive[i]!=0) continue;
-        int index = floor((  zMaxCurrentTurn - ePositionZ[i] ) / dzBin);         
-        histoParIndex[index].push_back(i);  
-    }
+    // the resonators after the first one find the bunch already sorted on this grid
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinCurrentTurn,dzBin,bunchBinNumberZ);
     for(int i=0;i<bunchBinNumberZ;i++)
     {
-        densProfVsBin[i] = histoParIndex[i].size() / double(macroEleNumPerBunch) / dzBin;
+        densProfVsBin[i] = longBinning.Count(bunchBinNumberZ-1-i) / double(macroEleNumPerBunch) / dzBin;
     }
    
     double cavVoltageReal = 0.E0;
@@ -1464,29 +1395,31 @@ void MPBunch::BunchMomentumUpdateDueToRFMode(const ReadInputSettings &inputParam
 
     // loop for bin-by-bin in one bunch, bins is alined from head to tail and each bin excite beam induced voltage itself
 
-    for(int k=0;k<histoParIndex.size();k++) 
-    {            
+    for(int k=0;k<bunchBinNumberZ;k++)
+    {
+        int        binPartNum = longBinning.Count(bunchBinNumberZ-1-k);
+        const int *binPart    = longBinning.Particles(bunchBinNumberZ-1-k);
         genVoltage = resonator.resGenVol * exp( - li * posZBins[k]  / CLight / rBeta * 2. * PI * double(resHarm) * fRF); 
         cavVoltage = resonator.vbAccum   +  genVoltage;
         
-        vb0  = complex<double>(-1 * 2 * PI * resFre * resonator.resShuntImpRs / resonator.resQualityQ0, 0.E0) * macroEleCharge*double(histoParIndex[k].size()) * ElectronCharge;  // [Volt]
+        vb0  = complex<double>(-1 * 2 * PI * resFre * resonator.resShuntImpRs / resonator.resQualityQ0, 0.E0) * macroEleCharge*double(binPartNum) * ElectronCharge;  // [Volt]
 
         // loop for particle in each bin          
-        for(int i=0;i<histoParIndex[k].size();i++)
+        for(int i=0;i<binPartNum;i++)
         {
-            int index          = histoParIndex[k][i];
+            int index          = binPart[i];
             eMomentumZ[index] += cavVoltage.real() / electronBeamEnergy / pow(rBeta,2);
             eMomentumZ[index] += vb0.real()/2.0    / electronBeamEnergy / pow(rBeta,2);
         }
 
-        particleInBunch   += histoParIndex[k].size();
-        selfLossVolAccume += vb0/2.0           * double(histoParIndex[k].size());
-        cavVoltageReal    += cavVoltage.real() * double(histoParIndex[k].size());
-        cavVoltageImag    += cavVoltage.imag() * double(histoParIndex[k].size());
-        genVolReal        += genVoltage.real() * double(histoParIndex[k].size());
-        genVolImag        += genVoltage.imag() * double(histoParIndex[k].size());
-        induceVolReal     += (resonator.vbAccum + vb0).real() * double(histoParIndex[k].size()); 
-        induceVolImag     += (resonator.vbAccum + vb0).imag() * double(histoParIndex[k].size());
+        particleInBunch   += binPartNum;
+        selfLossVolAccume += vb0/2.0           * double(binPartNum);
+        cavVoltageReal    += cavVoltage.real() * double(binPartNum);
+        cavVoltageImag    += cavVoltage.imag() * double(binPartNum);
+        genVolReal        += genVoltage.real() * double(binPartNum);
+        genVolImag        += genVoltage.imag() * double(binPartNum);
+        induceVolReal     += (resonator.vbAccum + vb0).real() * double(binPartNum); 
+        induceVolImag     += (resonator.vbAccum + vb0).imag() * double(binPartNum);
 
         // beam induced voltage retotate and decay bin-by-bin            
         tB     = dtBin;
@@ -1515,6 +1448,7 @@ void MPBunch::BunchMomentumUpdateDueToRFMode(const ReadInputSettings &inputParam
 
 void MPBunch::BunchMomentumUpdateDuetoRFBinByBin(const ReadInputSettings &inputParameter,CavityResonator &cavityResonator)
 {
+    momentsDirty = true;
     // Ref. bunch.h that ePositionZ = - ePositionT * c. head pariticles: deltaT<0, ePositionZ[i]>0.
     
     int resNum        = inputParameter.ringParRf->resNum;
@@ -1537,14 +1471,7 @@ void MPBunch::BunchMomentumUpdateDuetoRFBinByBin(const ReadInputSettings &inputP
         posZBins[i] = zMaxCurrentTurn - i * dzBin  - dzBin / 2.0;   
     }
 
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(bunchBinNumberZ);
-    for(int i=0;i<ePositionZ.size();i++)
-    {
-        if(eSurive[i]!=0) continue;
-        int index = floor((  zMaxCurrentTurn - ePositionZ[i] ) / dzBin);         
-        histoParIndex[index].push_back(i);    
-    }
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinCurrentTurn,dzBin,bunchBinNumberZ);
 
 
     for(int j=0;j<resNum;j++)
@@ -1573,34 +1500,36 @@ void MPBunch::BunchMomentumUpdateDuetoRFBinByBin(const ReadInputSettings &inputP
 
         // loop for bin-by-bin in one bunch, bins is alined from head to tail
         // each bin excite beam induced voltage itself
-        for(int k=0;k<histoParIndex.size();k++) 
+        for(int k=0;k<bunchBinNumberZ;k++)
         {
+            int        binPartNum = longBinning.Count(bunchBinNumberZ-1-k);
+            const int *binPart    = longBinning.Particles(bunchBinNumberZ-1-k);
             // change in the real time frame for generator voltage calculation...            
             genVoltage = cavityResonator.resonatorVec[j].resGenVol * exp(  - li * posZBins[k]  / CLight * 2. * PI * double(resHarm) * fRF); 
             cavVoltage = cavityResonator.resonatorVec[j].vbAccum   +  genVoltage;
             
             vb0  = complex<double>(-1 * 2 * PI * resFre * cavityResonator.resonatorVec[j].resShuntImpRs /
-                    cavityResonator.resonatorVec[j].resQualityQ0,0.E0) * macroEleCharge * double(histoParIndex[k].size()) * ElectronCharge;  // [Volt]
+                    cavityResonator.resonatorVec[j].resQualityQ0,0.E0) * macroEleCharge * double(binPartNum) * ElectronCharge;  // [Volt]
 
             // loop for particle in each bin          
-            for(int i=0;i<histoParIndex[k].size();i++)
+            for(int i=0;i<binPartNum;i++)
             {
-                int index          = histoParIndex[k][i];
+                int index          = binPart[i];
                 eMomentumZ[index] += cavVoltage.real() / electronBeamEnergy / pow(rBeta,2);
                 eMomentumZ[index] += vb0.real()/2.0    / electronBeamEnergy / pow(rBeta,2);
                 if(j==0) eMomentumZ[index] -= u0       / electronBeamEnergy / pow(rBeta,2); 
             }
   
             // to get the weighing average of cavvity voltage, beam inuced voltage...
-            particleInBunch   += histoParIndex[k].size();
-            selfLossVolAccume += vb0/2.0 * double(histoParIndex[k].size());
+            particleInBunch   += binPartNum;
+            selfLossVolAccume += vb0/2.0 * double(binPartNum);
            
-            cavVoltageReal    += cavVoltage.real() * double(histoParIndex[k].size());
-            cavVoltageImag    += cavVoltage.imag() * double(histoParIndex[k].size());
-            genVolReal        += genVoltage.real() * double(histoParIndex[k].size());
-            genVolImag        += genVoltage.imag() * double(histoParIndex[k].size());
-            induceVolReal     += (cavityResonator.resonatorVec[j].vbAccum + vb0).real() * double(histoParIndex[k].size()); 
-            induceVolImag     += (cavityResonator.resonatorVec[j].vbAccum + vb0).imag() * double(histoParIndex[k].size());
+            cavVoltageReal    += cavVoltage.real() * double(binPartNum);
+            cavVoltageImag    += cavVoltage.imag() * double(binPartNum);
+            genVolReal        += genVoltage.real() * double(binPartNum);
+            genVolImag        += genVoltage.imag() * double(binPartNum);
+            induceVolReal     += (cavityResonator.resonatorVec[j].vbAccum + vb0).real() * double(binPartNum); 
+            induceVolImag     += (cavityResonator.resonatorVec[j].vbAccum + vb0).imag() * double(binPartNum);
 
             // beam induced voltage retotate and decay bin-by-bin            
             tB     = dtBin;
@@ -1640,19 +1569,13 @@ void MPBunch::BunchMomentumUpdateDuetoRFBinByBin(const ReadInputSettings &inputP
 
 void MPBunch::BunchTransferDueToLatticeLNoInstability(const ReadInputSettings &inputParameter,CavityResonator &cavityResonator)
 {
+    momentsDirty = true;
+    longBinning.Invalidate();
     // Ref. bunch.h that ePositionZ = - ePositionT * c. head pariticles: deltaT<0, ePositionZ[i]>0.
     // During the tracking, from head to tail means ePositionZMin from [+,-];   
 
     double *synchRadDampTime = inputParameter.ringParBasic->synchRadDampTime;
 
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    double rmsEnergySpreadTemp = inputParameter.ringBunchPara-> rmsEnergySpread; // quantum excitation  natural beam energy spread.
-    //rmsEnergySpreadTemp = rmsEnergySpread;                  
-
-
-    std::normal_distribution<> qEpsilon{0,2*rmsEnergySpreadTemp/sqrt(synchRadDampTime[2])};
-
     int resNum        = inputParameter.ringParRf->resNum;
     int ringHarmH     = inputParameter.ringParRf->ringHarm;
     double t0         = inputParameter.ringParBasic->t0;
@@ -1712,7 +1635,7 @@ void MPBunch::BunchTransferDueToLatticeLNoInstability(const ReadInputSettings &i
 
     int counter;
 
-    for(int i=0;i<ePositionZ.size();i++)
+    for(int i=0;i<macroEleNumActive;i++)
     {
         int index = int( (ePositionZ[i] -poszMin  ) / dzBin );  // head particle index stores in histoParIndex[i]. Smaller i represents head particle.  
         histoParIndex[index].push_back(i);
@@ -1866,9 +1789,8 @@ void MPBunch::GetZMinMax()
     // zMax = *max_element(ePositionZ.begin(),ePositionZ.end());
  
 
-    for (int i=0;i<ePositionZ.size();i++)
-    {        
-        if(eSurive[i]!=0) continue;      //  eSurive[i]=0 when partilce is not lost 
+    for(int i=0;i<macroEleNumActive;i++)
+    {
     
         if(zMin>ePositionZ[i])
         {
@@ -1886,15 +1808,13 @@ void MPBunch::GetZMinMax()
 
 void MPBunch::BunchTransferDueToSRWake(const  ReadInputSettings &inputParameter, WakeFunction &sRWakeFunction, const LatticeInterActionPoint &latticeInterActionPoint,int turns)
 {
+    momentsDirty = true;
     // Ref. bunch.h that ePositionZ = - ePositionT * c. head pariticles: deltaT<0, ePositionZ[i]>0.
     // During the tracking, from head to tail means ePositionZMin from [+,-];   
+    // The bin-to-bin sum of the pseudo-Green function is done as FFT convolution with a table cached in sRWakeFunction (Ref. WakeFunction::GetSRWakeGreenTable).
      
     int bunchBinNumberZ = inputParameter.ringSRWake->SRWBunchBinNum;
 
-    for(int i=0;i<3;i++)
-    {
-        srWakePoten[i].resize(bunchBinNumberZ,0.e0);
-    }
     double zMin,zMax; 
 
     GetZMinMax();
@@ -1904,124 +1824,85 @@ void MPBunch::BunchTransferDueToSRWake(const  ReadInputSettings &inputParameter,
     double poszMin = zMin  - 2 * rmsBunchLength;
     double poszMax = zMax  + 2 * rmsBunchLength;
 
-    double dzBin = (poszMax - poszMin) / bunchBinNumberZ;
-    double dtBin = dzBin / CLight;
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(bunchBinNumberZ);
-    
-    vector<double> averXAlongBunch(bunchBinNumberZ,0);
-    vector<double> averYAlongBunch(bunchBinNumberZ,0);
-
-    for(int i=0;i<ePositionZ.size();i++)
+    // the table fixes the bin length (rounded up), the grid is re-centred on the bunch.
+    double dtBin = (poszMax - poszMin) / bunchBinNumberZ / CLight;
+    const WakeFunction::SRWakeGreenTable *greenTable = sRWakeFunction.GetSRWakeGreenTable(bunchBinNumberZ,dtBin);
+    dtBin = greenTable->dtBin;
+    double dzBin = dtBin * CLight;
+    poszMin = (poszMin + poszMax) / 2.0 - bunchBinNumberZ * dzBin / 2.0;
+
+    vector<double> partNumInBin(bunchBinNumberZ,0);
+    vector<double> dipoleXAlongBunch(bunchBinNumberZ,0);      // N * <x> per bin
+    vector<double> dipoleYAlongBunch(bunchBinNumberZ,0);      // N * <y> per bin
+
+    // head particle in the large bin index. runBinningCIC = 1 shares each particle between the two nearest bin centres
+    int binningCIC = inputParameter.ringRun->binningCIC;
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,poszMin,dzBin,bunchBinNumberZ);
+    if(binningCIC)
     {
-        int index = int( (ePositionZ[i] -poszMin ) / dzBin );          // head particle index stores in histoParIndex[i]. Smaller i represents head particle.  
-        histoParIndex[index].push_back(i);
+        longBinning.DepositCIC(ePositionZ.data(),nullptr,          1.E0,partNumInBin.data());
+        longBinning.DepositCIC(ePositionZ.data(),ePositionX.data(),1.E0,dipoleXAlongBunch.data());
+        longBinning.DepositCIC(ePositionZ.data(),ePositionY.data(),1.E0,dipoleYAlongBunch.data());
     }
-     
-    int partID;
-    
-    for(int i=0;i<bunchBinNumberZ;i++)
-    {
-        for(int j=0;j<histoParIndex[i].size();j++)
-        {
-            partID = histoParIndex[i][j];
-            if(eSurive[partID]!=0) continue;
-           
-            averXAlongBunch[i] += ePositionX[partID]; 
-            averYAlongBunch[i] += ePositionY[partID]; 
-        }
-
-        if (histoParIndex[i].size()==0)
-        {
-            averXAlongBunch[i]=0;
-            averYAlongBunch[i]=0;    
-        }
-        else
-        {
-            averXAlongBunch[i] /= histoParIndex[i].size();
-            averYAlongBunch[i] /= histoParIndex[i].size();
-        }
-    }
-    
-    vector<double> wakeFunji;
-    double tauji;   
-    int partNumInBin;
-
-    ofstream fout(inputParameter.ringSRWake->SRWWakePotenWriteTo+".sdds",ios_base::app);
-    if(turns==0) 
+    else
     {
-        fout<<"SDDS1"<<endl;
-        fout<<"&column name=z,              units=m,              type=float,  &end" <<endl;
-        fout<<"&column name=profile,                              type=float,  &end" <<endl;
-        fout<<"&column name=wakePotenX,                        type=float,  &end" <<endl;
-        fout<<"&column name=wakePotenY,                        type=float,  &end" <<endl;
-        fout<<"&column name=wakePotenZ,                        type=float,  &end" <<endl;
-        fout<<"&data mode=ascii, &end"                                               <<endl;
+        longBinning.DepositNGP(nullptr,          1.E0,partNumInBin.data());
+        longBinning.DepositNGP(ePositionX.data(),1.E0,dipoleXAlongBunch.data());
+        longBinning.DepositNGP(ePositionY.data(),1.E0,dipoleYAlongBunch.data());
     }
 
-    if(turns% (inputParameter.ringRun->bunchInfoPrintInterval)==0)
-    {
-        fout<<"! page number " << int(turns/100)+1 <<endl;
-        fout<<bunchBinNumberZ<<endl;
-    }
+    sRWakeFunction.SRWakeConvolution(greenTable,partNumInBin,dipoleXAlongBunch,dipoleYAlongBunch,srWakePoten);
+    
     for(int i=0;i<bunchBinNumberZ;i++)
     {
-        // RW puesdo wake function -- integration range have to modified
-        if(!inputParameter.ringSRWake->pipeGeoInput.empty())
-        {
-             for(int j=0;j<bunchBinNumberZ;j++)                         //integration range have to modified
-             {
-                tauji = (i-j) * dtBin;                                        // [s]  must .LE. 0             
-                partNumInBin = histoParIndex[j].size();
-                wakeFunji = sRWakeFunction.GetRWSRWakeFun(tauji);                                                             
-                srWakePoten[0][i] += wakeFunji[0] * partNumInBin * averXAlongBunch[j];  // [V/C m] [m] ->[V/C] X
-                srWakePoten[1][i] += wakeFunji[1] * partNumInBin * averXAlongBunch[j];  // [V/C m] [m] ->[V/C] Y
-                srWakePoten[2][i] += wakeFunji[2] * partNumInBin;        
-             }            
-        }
-
-        if(!inputParameter.ringSRWake->bbrInput.empty())
-        {
-            for(int j=0;j<bunchBinNumberZ;j++)
-             {
-                tauji = (i-j) * dtBin;                                        // [s]  must .LE. 0             
-                partNumInBin = histoParIndex[j].size();
-                wakeFunji = sRWakeFunction.GetBBRWakeFun1(tauji);                                                             
-                srWakePoten[0][i] += wakeFunji[0] * partNumInBin * averXAlongBunch[j];  // [V/C m] [m] ->[V/C] X
-                srWakePoten[1][i] += wakeFunji[1] * partNumInBin * averXAlongBunch[j];  // [V/C m] [m] ->[V/C] Y
-                srWakePoten[2][i] += wakeFunji[2] * partNumInBin;                        
-             }         
-        }
-
         srWakePoten[0][i] *= (-1)  * ElectronCharge * macroEleCharge / electronEnergy;              // [V/V] [rad]  Eq. (3.7) -- multiplty -1; 
         srWakePoten[1][i] *= (-1)  * ElectronCharge * macroEleCharge / electronEnergy;              // [V/V] [rad]  Eq. (3.7) -- multiplty -1;  
         srWakePoten[2][i] *= (-1)  * ElectronCharge * macroEleCharge / electronEnergy;              // [V/V] [rad]  Eq. (3.7) -- multiplty -1;   
-
-        if(turns% (inputParameter.ringRun->bunchInfoPrintInterval)==0) 
-        {
-            fout<<setw(15)<<left<< i*dtBin*CLight + poszMin
-                <<setw(15)<<left<<histoParIndex[i].size()
-                <<setw(15)<<left<<srWakePoten[0][i]
-                <<setw(15)<<left<<srWakePoten[1][i]
-                <<setw(15)<<left<<srWakePoten[2][i]
-                <<endl;
-        }
     }
-    fout.close();
-    
+
+    // keep the bin grid and profile for SRWakePotenPrint, which is called out of the bunch-parallel loop
+    srWakeBinZMin = poszMin;
+    srWakeBinDz   = dzBin;
+    srWakeBinPartNum.resize(bunchBinNumberZ);
+    for(int i=0;i<bunchBinNumberZ;i++) srWakeBinPartNum[i] = int(round(partNumInBin[i]));
 
     // can be updated to include the quadrupole wakes. -- left for future. 
     
-    for(int i=0;i<bunchBinNumberZ;i++)
+    if(binningCIC)
     {
-        for(int j=0;j<histoParIndex[i].size();j++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            partID = histoParIndex[i][j];
-            if(eSurive[partID]!=0) continue;
-            //eMomentumX[partID] += srWakePoten[0][i];            //rad
-            //eMomentumY[partID] += srWakePoten[1][i];            //rad    
-            eMomentumZ[partID] += srWakePoten[2][i];            //rad
+            eMomentumX[i] += longBinning.GatherCIC(srWakePoten[0].data(),ePositionZ[i]);            //rad
+            eMomentumY[i] += longBinning.GatherCIC(srWakePoten[1].data(),ePositionZ[i]);            //rad
+            eMomentumZ[i] += longBinning.GatherCIC(srWakePoten[2].data(),ePositionZ[i]);            //rad
         }
+        return;
+    }
+
+    const int *partBinIndex = longBinning.GetBinIndex();
+    for(int i=0;i<macroEleNumActive;i++)
+    {
+        int index = partBinIndex[i];
+        eMomentumX[i] += srWakePoten[0][index];            //rad
+        eMomentumY[i] += srWakePoten[1][index];            //rad    
+        eMomentumZ[i] += srWakePoten[2][index];            //rad
+    }
+}
+
+
+void MPBunch::SRWakePotenPrint(SDDSWriter &fout)
+{
+    // one page per bunch: bin position, particles per bin and the x, y, z wake kicks
+    int bunchBinNumberZ = srWakeBinPartNum.size();
+
+    fout.StartPage(bunchBinNumberZ);
+    for(int i=0;i<bunchBinNumberZ;i++)
+    {
+        fout.Put(i*srWakeBinDz + srWakeBinZMin);
+        fout.Put(srWakeBinPartNum[i]);
+        fout.Put(srWakePoten[0][i]);
+        fout.Put(srWakePoten[1][i]);
+        fout.Put(srWakePoten[2][i]);
     }
 }
 
@@ -2029,6 +1910,7 @@ void MPBunch::BunchTransferDueToSRWake(const  ReadInputSettings &inputParameter,
 void MPBunch::BBImpBunchInteractionTD(const ReadInputSettings &inputParameter, const BoardBandImp &boardBandImp,const LatticeInterActionPoint &latticeInterActionPoint,
                                       vector<vector<double>> wakePoten)
 {
+    momentsDirty = true;
     double rBeta              = inputParameter.ringParBasic->rBeta;
     double electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
     int ringHarmH             = inputParameter.ringParRf->ringHarm;
@@ -2045,40 +1927,20 @@ void MPBunch::BBImpBunchInteractionTD(const ReadInputSettings &inputParameter, c
     double densityProfile[nBinBunchDen];
     for(int i=0;i<nBinBunchDen;i++)densityProfile[i]=0;
     
-    vector<vector<int>> histoParIndex;
-    histoParIndex.resize(nBinBunchDen);
-    for(int i=0;i<ePositionZ.size();i++)
-    {
-        int index = int( (ePositionZ[i] - zMinBin ) / dzBin );          // head particle index stores in histoParIndex[i]. Smaller i represents head particle.  
-        histoParIndex[index].push_back(i);
-        densityProfile[index] +=  macroEleCharge * ElectronCharge ;  // [C]
-    } 
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinBin,dzBin,nBinBunchDen);
+    longBinning.DepositNGP(nullptr,macroEleCharge * ElectronCharge,densityProfile);      // [C]
     GetSmoothedBunchProfileGassionFilter(densityProfile,nBinBunchDen);
 
     vector<double> averXAlongBunch(nBinBunchDen,0);
     vector<double> averYAlongBunch(nBinBunchDen,0);
+    longBinning.DepositNGP(ePositionX.data(),1.E0,averXAlongBunch.data());
+    longBinning.DepositNGP(ePositionY.data(),1.E0,averYAlongBunch.data());
     
     for(int i=0;i<nBinBunchDen;i++)
     {
-        for(int j=0;j<histoParIndex[i].size();j++)
-        {
-            int partID = histoParIndex[i][j];
-            if(eSurive[partID]!=0) continue;
-           
-            averXAlongBunch[i] += ePositionX[partID]; 
-            averYAlongBunch[i] += ePositionY[partID]; 
-        }
-
-        if (histoParIndex[i].size()==0)
-        {
-            averXAlongBunch[i]=0;
-            averYAlongBunch[i]=0;    
-        }
-        else
-        {
-            averXAlongBunch[i] /= histoParIndex[i].size();
-            averYAlongBunch[i] /= histoParIndex[i].size();
-        }
+        if (longBinning.Count(i)==0) continue;
+        averXAlongBunch[i] /= longBinning.Count(i);
+        averYAlongBunch[i] /= longBinning.Count(i);
     }
 
     // ofstream fout("wakePotenTimeDomain_fromGreenFun.dat");
@@ -2110,9 +1972,10 @@ void MPBunch::BBImpBunchInteractionTD(const ReadInputSettings &inputParameter, c
             if(inputParameter.ringBBImp->impedSimFlag[4]==1) temp[4] -= wakePoten[5][tij] * densityProfile[j] ;
         }
 
-        for(int k=0;k<histoParIndex[i].size();k++) // Eq3.7 and Eq3.49 
+        const int *binPart = longBinning.Particles(i);
+        for(int k=0;k<longBinning.Count(i);k++) // Eq3.7 and Eq3.49 
         {                    
-            partID = histoParIndex[i][k];
+            partID = binPart[k];
             if(inputParameter.ringBBImp->impedSimFlag[0]==1) eMomentumZ[partID] += temp[0] / electronBeamEnergy / pow(rBeta,2);
             if(inputParameter.ringBBImp->impedSimFlag[1]==1) eMomentumX[partID] += temp[1] / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaX[0];
             if(inputParameter.ringBBImp->impedSimFlag[2]==1) eMomentumY[partID] += temp[2] / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaY[0];
@@ -2142,6 +2005,7 @@ void MPBunch::BBImpBunchInteractionTD(const ReadInputSettings &inputParameter, c
 
 void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, const BoardBandImp &boardBandImp,const LatticeInterActionPoint &latticeInterActionPoint)
 {
+    momentsDirty = true;
     double rBeta      = inputParameter.ringParBasic->rBeta;
     double electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
     double zMinBin = -boardBandImp.zMax;
@@ -2156,25 +2020,32 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
     if(doTracking==0) return;
     
 
-    fftw_complex *r2cout  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nBins /2 +1) );  // the same size as boardBandImp.zZImp.size() // bunch specturm
-    fftw_complex *c2rin   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nBins /2 +1) );  // the same size as boardBandImp.zZImp.size()
-
-    double temp[nBins];
-    int    partBinIndex[macroEleNumPerBunch];
+    // buffers and plans are owned by boardBandImp and FFTWPlanCache, nothing is planned or allocated per bunch and turn
+    int thread = 0;
+#ifdef _OPENMP
+    thread = omp_get_thread_num();
+#endif
+    const BoardBandImp::FFTWBuffer &buffer = boardBandImp.fftwBuffer[thread];
+    fftw_complex *r2cout  = buffer.r2cout;          // the same size as boardBandImp.zZImp.size() // bunch specturm
+    fftw_complex *c2rin   = buffer.c2rin;           // the same size as boardBandImp.zZImp.size()
+    double       *temp    = buffer.r2cin;
+    fftw_plan planR2C     = FFTWPlanCache::GetPlanR2C(nBins);
+    fftw_plan planC2R     = FFTWPlanCache::GetPlanC2R(nBins);
+
+    // bin i is centred at zMinBin + i * dzBin; one sort for the three profiles below
+    int binningCIC = inputParameter.ringRun->binningCIC;
+    longBinning.Bin(ePositionZ.data(),macroEleNumActive,zMinBin - dzBin / 2,dzBin,nBins);
+    const int *partBinIndex = longBinning.GetBinIndex();
+    double profileScale = macroEleCharge * ElectronCharge / dzBin *  CLight;      // [C/s]
 
     // get the smoothed longi-BunchCharge-profile 
     fill(profileForBunchBBImp.begin(),profileForBunchBBImp.end(),0); // array[ 2* nBins -1 ] to store the profile
-    for(int i=0;i<macroEleNumPerBunch;i++)
-    {
-        partBinIndex[i]  =  (ePositionZ[i] - zMinBin + dzBin / 2 ) / dzBin; 
-        int index = partBinIndex[i];
-        profileForBunchBBImp[index] +=  macroEleCharge * ElectronCharge / dzBin *  CLight;  // [C/s]  
-    }
+    if(binningCIC) longBinning.DepositCIC(ePositionZ.data(),nullptr,profileScale,profileForBunchBBImp.data());
+    else           longBinning.DepositNGP(nullptr,profileScale,profileForBunchBBImp.data());
     GetSmoothedBunchProfileGassionFilter(inputParameter, boardBandImp);
     for(int i=0;i<nBins;i++) temp[i] = profileForBunchBBImp[i];
 
-    fftw_plan p = fftw_plan_dft_r2c_1d(nBins, temp, r2cout, FFTW_ESTIMATE);    // ffw, according to g++/nvcc complile flag is FFTW_MEASURE/FFTW_ESTIMATE
-    fftw_execute(p);
+    fftw_execute_dft_r2c(planR2C, temp, r2cout);
 
     
     // (0) in zz  directoin --------------------------------------------------- Eq3.10 
@@ -2186,14 +2057,13 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
             c2rin[i][0] = indVF.real();
             c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
         }
-        p = fftw_plan_dft_c2r_1d(nBins, c2rin, temp, FFTW_ESTIMATE);
-        fftw_execute(p);   
+        fftw_execute_dft_c2r(planC2R, c2rin, temp);
         for(int i=0;i<nBins;i++)  wakePotenFromBBI->wakePotenZ[i] = - temp[i] / nBins;
         
-        for(int i=0;i<macroEleNumPerBunch;i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            int index  = partBinIndex[i] ; 
-            eMomentumZ[i] += wakePotenFromBBI->wakePotenZ[index] / electronBeamEnergy / pow(rBeta,2);
+            double wake    = binningCIC ? longBinning.GatherCIC(wakePotenFromBBI->wakePotenZ.data(),ePositionZ[i]) : wakePotenFromBBI->wakePotenZ[partBinIndex[i]];
+            eMomentumZ[i] += wake / electronBeamEnergy / pow(rBeta,2);
         }
     }
 
@@ -2206,14 +2076,13 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
             c2rin[i][0] = indVF.real();
             c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
         }
-        p = fftw_plan_dft_c2r_1d(nBins, c2rin, temp, FFTW_ESTIMATE);
-        fftw_execute(p);   
+        fftw_execute_dft_c2r(planC2R, c2rin, temp);
         for(int i=0;i<nBins;i++)  wakePotenFromBBI->wakePotenQx[i] = temp[i] / nBins;
         
-        for(int i=0;i<macroEleNumPerBunch;i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            int index  = partBinIndex[i] ; 
-            eMomentumX[i] += wakePotenFromBBI->wakePotenQx[index] / electronBeamEnergy / pow(rBeta,2) *  ePositionX[i] / latticeInterActionPoint.twissBetaX[0];
+            double wake    = binningCIC ? longBinning.GatherCIC(wakePotenFromBBI->wakePotenQx.data(),ePositionZ[i]) : wakePotenFromBBI->wakePotenQx[partBinIndex[i]];
+            eMomentumX[i] += wake / electronBeamEnergy / pow(rBeta,2) *  ePositionX[i] / latticeInterActionPoint.twissBetaX[0];
         }
     }
 
@@ -2227,14 +2096,13 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
             c2rin[i][0] = indVF.real();
             c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
         }
-        p = fftw_plan_dft_c2r_1d(nBins, c2rin, temp, FFTW_ESTIMATE);
-        fftw_execute(p);   
+        fftw_execute_dft_c2r(planC2R, c2rin, temp);
         for(int i=0;i<nBins;i++)  wakePotenFromBBI->wakePotenQy[i] = temp[i] / nBins;
         
-        for(int i=0;i<macroEleNumPerBunch;i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            int index  = partBinIndex[i] ; 
-            eMomentumY[i] += wakePotenFromBBI->wakePotenQy[index] / electronBeamEnergy / pow(rBeta,2) *  ePositionY[i] / latticeInterActionPoint.twissBetaY[0];
+            double wake    = binningCIC ? longBinning.GatherCIC(wakePotenFromBBI->wakePotenQy.data(),ePositionZ[i]) : wakePotenFromBBI->wakePotenQy[partBinIndex[i]];
+            eMomentumY[i] += wake / electronBeamEnergy / pow(rBeta,2) *  ePositionY[i] / latticeInterActionPoint.twissBetaY[0];
         }
     }
 
@@ -2245,31 +2113,25 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
     {
         fill(profileForBunchBBImp.begin(),profileForBunchBBImp.end(),0); // array[ 2* nBins -1 ] to store the profile
 
-        for(int i=0;i<macroEleNumPerBunch;i++)
-        {
-            partBinIndex[i]  =  (ePositionZ[i] - zMinBin + dzBin / 2 ) / dzBin; 
-            int index        = partBinIndex[i];
-            profileForBunchBBImp[index] +=  macroEleCharge * ElectronCharge / dzBin *  CLight * ePositionX[i];  // [C/s]  
-        }
+        if(binningCIC) longBinning.DepositCIC(ePositionZ.data(),ePositionX.data(),profileScale,profileForBunchBBImp.data());   // [C/s m]
+        else           longBinning.DepositNGP(ePositionX.data(),profileScale,profileForBunchBBImp.data());
         GetSmoothedBunchProfileGassionFilter(inputParameter, boardBandImp);
         for(int i=0;i<nBins;i++) temp[i] = profileForBunchBBImp[i];
 
-        p = fftw_plan_dft_r2c_1d(nBins, temp, r2cout, FFTW_ESTIMATE);    // ffw, according to g++/nvcc complile flag is FFTW_MEASURE/FFTW_ESTIMATE
-        fftw_execute(p);
+        fftw_execute_dft_r2c(planR2C, temp, r2cout);
         for(int i=0;i<boardBandImp.zZImp.size();i++)
         {
             complex<double> indVF = complex<double> (r2cout[i][0], r2cout[i][1] ) * boardBandImp.zDxImp[i] * li;
             c2rin[i][0] = indVF.real();
             c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
         }
-        p = fftw_plan_dft_c2r_1d(nBins, c2rin, temp, FFTW_ESTIMATE);
-        fftw_execute(p);   
+        fftw_execute_dft_c2r(planC2R, c2rin, temp);
         for(int i=0;i<nBins;i++)  wakePotenFromBBI->wakePotenDx[i] = temp[i] / nBins;           
             
-        for(int i=0;i<macroEleNumPerBunch;i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            int index      = partBinIndex[i] ; 
-            eMomentumX[i] += wakePotenFromBBI->wakePotenDx[index] / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaX[0];
+            double wake    = binningCIC ? longBinning.GatherCIC(wakePotenFromBBI->wakePotenDx.data(),ePositionZ[i]) : wakePotenFromBBI->wakePotenDx[partBinIndex[i]];
+            eMomentumX[i] += wake / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaX[0];
         }
     }
      
@@ -2279,40 +2141,30 @@ void MPBunch::BBImpBunchInteraction(const ReadInputSettings &inputParameter, con
     {
         fill(profileForBunchBBImp.begin(),profileForBunchBBImp.end(),0); // array[ 2* nBins -1 ] to store the profile
 
-        for(int i=0;i<macroEleNumPerBunch;i++)
-        {
-            partBinIndex[i]  =  (ePositionZ[i] - zMinBin + dzBin / 2 ) / dzBin; 
-            int index        = partBinIndex[i];
-            profileForBunchBBImp[index] +=  macroEleCharge * ElectronCharge / dzBin *  CLight * ePositionY[i];  // [C/s]  
-        }
+        if(binningCIC) longBinning.DepositCIC(ePositionZ.data(),ePositionY.data(),profileScale,profileForBunchBBImp.data());   // [C/s m]
+        else           longBinning.DepositNGP(ePositionY.data(),profileScale,profileForBunchBBImp.data());
         GetSmoothedBunchProfileGassionFilter(inputParameter, boardBandImp);
         for(int i=0;i<nBins;i++) temp[i] = profileForBunchBBImp[i];
 
-        p = fftw_plan_dft_r2c_1d(nBins, temp, r2cout, FFTW_ESTIMATE);    // ffw, according to g++/nvcc complile flag is FFTW_MEASURE/FFTW_ESTIMATE
-        fftw_execute(p);
+        fftw_execute_dft_r2c(planR2C, temp, r2cout);
         for(int i=0;i<boardBandImp.zZImp.size();i++)
         {
             complex<double> indVF = complex<double> (r2cout[i][0], r2cout[i][1] ) * boardBandImp.zDyImp[i] * li;
             c2rin[i][0] = indVF.real();
             c2rin[i][1] = indVF.imag();                              // [C/s] * [Ohm] = [V]   
         }
-        p = fftw_plan_dft_c2r_1d(nBins, c2rin, temp, FFTW_ESTIMATE);
-        fftw_execute(p);   
+        fftw_execute_dft_c2r(planC2R, c2rin, temp);
         for(int i=0;i<nBins;i++)  wakePotenFromBBI->wakePotenDy[i] = temp[i] / nBins;
             
-        for(int i=0;i<macroEleNumPerBunch;i++)
+        for(int i=0;i<macroEleNumActive;i++)
         {
-            int index      = partBinIndex[i] ; 
-            eMomentumY[i] += wakePotenFromBBI->wakePotenDy[index] / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaY[0];
+            double wake    = binningCIC ? longBinning.GatherCIC(wakePotenFromBBI->wakePotenDy.data(),ePositionZ[i]) : wakePotenFromBBI->wakePotenDy[partBinIndex[i]];
+            eMomentumY[i] += wake / electronBeamEnergy / pow(rBeta,2) / latticeInterActionPoint.twissBetaY[0];
         }
     }
 
     
 
-    fftw_free(r2cout);
-    fftw_free(c2rin);
-    fftw_destroy_plan(p);
-
 
     // test the wakefield her. 
     // ofstream fout("wakePotenFreqDomain_23mm.dat");
@@ -2361,10 +2213,10 @@ void MPBunch::GetSmoothedBunchProfileGassionFilter(const ReadInputSettings &inpu
     int N = indexEnd - indexStart;
   
 
-    double tempProfile[N];
+    vector<double> tempProfile(N);
     for(int i=0;i<N;i++) tempProfile[i] = profileForBunchBBImp[i+indexStart];  
 
-    GetSmoothedBunchProfileGassionFilter(tempProfile,N);
+    GetSmoothedBunchProfileGassionFilter(tempProfile.data(),N);
 
     for(int i=0;i<N;i++) profileForBunchBBImp[i+indexStart] = tempProfile[i];
 
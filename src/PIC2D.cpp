@@ -24,6 +24,7 @@
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_histogram.h>
 #include <fftw3.h>
+#include <omp.h>
 
 using namespace std;
 using std::vector;
@@ -41,15 +42,19 @@ PIC2D::PIC2D()
 
 PIC2D::~PIC2D()
 {
-    fftw_free(in_xy);
-    fftw_free(out_xy);
     fftw_destroy_plan(rho_X_Y_To_Rho_Kx_Ky);
     fftw_destroy_plan(phi_Kx_Ky_To_Phi_X_Y);
 
+    fftw_free(rhoIGF);
+    fftw_free(rhoIGFk);
+    fftw_free(greenIGFk);
+    fftw_destroy_plan(rhoIGF_X_Y_To_Kx_Ky);
+    fftw_destroy_plan(phiIGF_Kx_Ky_To_X_Y);
 }
 
-void PIC2D::InitialPIC2D(vector<int> meshNum)
+void PIC2D::InitialPIC2D(vector<int> meshNum, int solver)
 {
+    poissonSolver = solver;
     numberOfGrid = meshNum;
     int nx = numberOfGrid[0];
     int ny = numberOfGrid[1];
@@ -57,13 +62,10 @@ void PIC2D::InitialPIC2D(vector<int> meshNum)
     meshx = v1d(nx);
     meshy = v1d(ny);
 
-    rho = v2d(nx, v1d(ny) );
-    phi = v2d(nx, v1d(ny) );
-    ex  = v2d(nx, v1d(ny) );
-    ey  = v2d(nx, v1d(ny) );
-
-    in_xy  = (double*)             fftw_malloc(sizeof(double)      * nx * ny );
-    out_xy = (double*)             fftw_malloc(sizeof(double)      * nx * ny );
+    rho.Resize(nx, ny);
+    phi.Resize(nx, ny);
+    ex.Resize (nx, ny);
+    ey.Resize (nx, ny);
 
     int numofgridx = nx;
     int numofgridy = ny;
@@ -72,19 +74,33 @@ void PIC2D::InitialPIC2D(vector<int> meshNum)
     // 1
     int n_xy[]={numofgridx,numofgridy};
     rho_X_Y_To_Rho_Kx_Ky = fftw_plan_many_r2r(2, n_xy, numofgridz,
-    in_xy  ,n_xy,
+    rho.Data(), n_xy,
     numofgridz, 1,
-    out_xy ,n_xy,
+    phi.Data(), n_xy,
     numofgridz, 1,
     kind_xy_forward, FFTW_MEASURE);
     //2
-    // fftw_plan_with_nthreads(omp_get_max_threads());
     phi_Kx_Ky_To_Phi_X_Y = fftw_plan_many_r2r(2, n_xy, numofgridz,
-    out_xy,n_xy,
+    phi.Data(), n_xy,
     numofgridz, 1,
-    in_xy,n_xy ,
+    phi.Data(), n_xy,
     numofgridz, 1,
     kind_xy_backward, FFTW_MEASURE);
+
+    if(poissonSolver==1)
+    {
+        // Hockney: the charge on the (2nx)*(2ny) grid, zero outside the mesh, is convolved with the Green function
+        rhoIGF    = (double*)       fftw_malloc(sizeof(double)       * 4 * nx * ny );
+        rhoIGFk   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 2 * nx * (ny + 1) );
+        greenIGFk = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 2 * nx * (ny + 1) );
+        rhoIGF_X_Y_To_Kx_Ky = fftw_plan_dft_r2c_2d(2 * nx, 2 * ny, rhoIGF, rhoIGFk, FFTW_MEASURE);
+        phiIGF_Kx_Ky_To_X_Y = fftw_plan_dft_c2r_2d(2 * nx, 2 * ny, rhoIGFk, rhoIGF, FFTW_MEASURE);
+        greenAspect = 0.E0;
+    }
+
+    // FFTW_MEASURE planning overwrites the arrays
+    rho.Zero();
+    phi.Zero();
 }
 
 void PIC2D::Set2DMesh(double rmsXY[2], double beamCen[2])
@@ -101,11 +117,13 @@ void PIC2D::Set2DMesh(double rmsXY[2], double beamCen[2])
     }
 
     double meshLengthMax = (meshLength[0] > meshLength[1]) ?  meshLength[0] : meshLength[1];
+    bool squareMesh = poissonSolver==0 || meshLength[0]==0 || meshLength[1]==0;
+    if(squareMesh) meshLength.assign(dims,meshLengthMax);
+    SetMeshAspect(meshLength,squareMesh);
     
     dv = 1.E0;
     for (int plane=0; plane<dims;plane++)
     {  
-        meshLength[plane] = meshLengthMax;
         meshWidth[plane]  = meshLength[plane] / (numberOfGrid[plane] - 1);
         meshStart[plane]  = beamCen[plane] - meshLength[plane] / 2; 
 
@@ -152,11 +170,14 @@ void PIC2D::Set2DMesh(vector<vector<double>>  &particles)
     }
 
 
+    // the open boundary solver keeps the mesh length of each plane
     double meshLengthMax = (meshLength[0] > meshLength[1]) ?  meshLength[0] : meshLength[1]; 
+    bool squareMesh = poissonSolver==0 || meshLength[0]==0 || meshLength[1]==0;
+    if(squareMesh) meshLength.assign(dims,meshLengthMax);
+    SetMeshAspect(meshLength,squareMesh);
     
     for (int plane=0; plane<dims;plane++)
     {  
-        meshLength[plane] = meshLengthMax;
         meshWidth[plane]  = meshLength[plane] / (numberOfGrid[plane] - 1);
         meshStart[plane]  = beamCen[plane] - meshLength[plane] / 2; 
 
@@ -171,39 +192,56 @@ void PIC2D::Set2DMesh(vector<vector<double>>  &particles)
     }
 }
 
-void PIC2D::Set2DRho (vector<vector<double>>  &particles, vector<double> charge)
+// The open boundary solver reuses its Green function while the cell aspect ratio hy/hx stays the same (Set2DPhiIGF).
+// On a flat mesh the ratio is rounded up onto the ladder 2^(k/igfAspectLadder) by lengthening the mesh in y,
+// at most 2^(1/16)-1 ~ 4.4%, so a beam changing its size from turn to turn keeps one table.
+static const int igfAspectLadder = 16;
+
+void PIC2D::SetMeshAspect(vector<double> &meshLength, bool squareMesh)
+{
+    double cellRatio = double(numberOfGrid[0] - 1) / (numberOfGrid[1] - 1);
+    if(squareMesh || poissonSolver==0)
+    {
+        meshAspect = cellRatio;
+        return;
+    }
+
+    int k = int( ceil( log2(meshLength[1] / meshLength[0] * cellRatio) * igfAspectLadder ) );
+    meshAspect    = pow(2.0, double(k) / igfAspectLadder);
+    meshLength[1] = meshLength[0] * meshAspect / cellRatio;
+}
+
+void PIC2D::Set2DRho (vector<vector<double>>  &particles, const vector<double> &charge)
 {
     // initialize vecotor size accroding to the input parameters
     partNum =  particles[0].size();
     
-    partMeshIndX = v1i(partNum);
-    partMeshIndY = v1i(partNum); 
-    isPartOutMesh = v1i(partNum,0); 
-    weigh = v2d(partNum,v1d(4,0.E0));
-    partExEyField = v2d(2,v1d(partNum,0.E0));          //(Ex(v1d),Ey(v1d))
+    // resize() within the capacity reached before does not allocate
+    partMeshIndX.resize(partNum);
+    partMeshIndY.resize(partNum); 
+    isPartOutMesh.resize(partNum); 
+    weigh.resize(4 * partNum);
+    partExEyField.resize(2);                           //(Ex(v1d),Ey(v1d))
+    partExEyField[0].resize(partNum);
+    partExEyField[1].resize(partNum);
     
     // charge represents the line density  [C/m]
 
-    for(int i=0;i<partNum;i++)
-    {
-        partMeshIndX[i] = floor( (particles[0][i] - meshx[0] ) / meshWidth[0] ) ;
-        partMeshIndY[i] = floor( (particles[1][i] - meshy[0] ) / meshWidth[1] ) ;
-    }
-    
     // get the linear weighting factor from particle to mesh. 
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
     for (int i=0;i<partNum;i++)
     {
+        partMeshIndX[i] = floor( (particles[0][i] - meshx[0] ) / meshWidth[0] ) ;
+        partMeshIndY[i] = floor( (particles[1][i] - meshy[0] ) / meshWidth[1] ) ;
+
         bool outMeshFlagX, outMeshFlagY, outMeshFlagZ, outMeshFlag; 
 
         outMeshFlagX = partMeshIndX[i] >= numberOfGrid[0] - 1 || partMeshIndX[i] < 0;  
         outMeshFlagY = partMeshIndY[i] >= numberOfGrid[1] - 1 || partMeshIndY[i] < 0;
         outMeshFlag  = outMeshFlagX || outMeshFlagY ;
 
-        if(outMeshFlag) 
-        {
-            isPartOutMesh[i] = 1;
-            continue;
-        }
+        isPartOutMesh[i] = outMeshFlag ? 1 : 0;
+        if(outMeshFlag) continue;
 
         double sum = 0;
         for(int j=0;j<4; j++)
@@ -212,11 +250,11 @@ void PIC2D::Set2DRho (vector<vector<double>>  &particles, vector<double> charge)
             idx = (j%2==0) ? 1 : 0;
             idy = (j%4< 2) ? 1 : 0;
 
-            weigh[i][j] =   
+            weigh[4*i+j] =   
             abs( particles[0][i] - meshx[ partMeshIndX[i] + idx ]) *
             abs( particles[1][i] - meshy[ partMeshIndY[i] + idy ])  / dv;
 
-            sum += weigh[i][j];
+            sum += weigh[4*i+j];
         }
         if(abs(sum-1)>1.E-9)  
         {
@@ -225,24 +263,44 @@ void PIC2D::Set2DRho (vector<vector<double>>  &particles, vector<double> charge)
         }
     }
     
-    // get the charge density on mesh
-    for(int x=0;x<numberOfGrid[0];x++)
+    // get the charge density on mesh: each thread deposits its particles on its own grid, the grids are summed
+    // in thread order afterwards. One thread deposits on rho directly.
+    int nx = numberOfGrid[0];
+    int ny = numberOfGrid[1];
+    int nThreads = (partNum>=parallelMinSize && !omp_in_parallel()) ? omp_get_max_threads() : 1;
+    if(nThreads>1) rhoThread.resize(nThreads * nx * ny);
+
+    #pragma omp parallel num_threads(nThreads)
     {
-        for(int y=0;y<numberOfGrid[1];y++)
+        int nTeam = omp_get_num_threads();
+        double *rhoT = nTeam==1 ? rho.Data() : &rhoThread[omp_get_thread_num() * nx * ny];
+        for(int j=0;j<nx*ny;j++) rhoT[j] = 0.E0;
+
+        #pragma omp for schedule(static)
+        for (int i=0;i<partNum;i++)
         {
-            rho[x][y] =0.E0;
+            if(isPartOutMesh[i]==1) continue; 
+            int idx  =  partMeshIndX[i];
+            int idy  =  partMeshIndY[i];
+            rhoT[ idx    * ny + idy  ] += weigh[4*i+0] * charge[i] / dv;    
+            rhoT[(idx+1) * ny + idy  ] += weigh[4*i+1] * charge[i] / dv;
+            rhoT[ idx    * ny + idy+1] += weigh[4*i+2] * charge[i] / dv;
+            rhoT[(idx+1) * ny + idy+1] += weigh[4*i+3] * charge[i] / dv; //   C/m^3
+        }
+
+        if(nTeam>1)
+        {
+            #pragma omp for schedule(static)
+            for(int x=0;x<nx;x++)
+            {
+                for(int y=0;y<ny;y++)
+                {
+                    double sum = 0.E0;
+                    for(int t=0;t<nTeam;t++) sum += rhoThread[(t * nx + x) * ny + y];
+                    rho(x,y) = sum;
+                }
+            }
         }
-    }   
-        
-    for (int i=0;i<partNum;i++)
-    {
-        if(isPartOutMesh[i]==1) continue; 
-        int idx  =  partMeshIndX[i];
-        int idy  =  partMeshIndY[i];
-        rho[idx  ][idy  ] += weigh[i][0] * charge[i] / dv;    
-        rho[idx+1][idy  ] += weigh[i][1] * charge[i] / dv;
-        rho[idx  ][idy+1] += weigh[i][2] * charge[i] / dv;
-        rho[idx+1][idy+1] += weigh[i][3] * charge[i] / dv; //   C/m^3
     }
    
 
@@ -264,11 +322,11 @@ void PIC2D::Set2DRho (vector<vector<double>>  &particles, vector<double> charge)
     //         y = meshy[0] + j * meshWidth[1];
     //         if ( pow(x,2) / pow(a,2)  + pow(y,2) / pow(b,2) < 1 ) 
     //         {   
-    //             rho[i][j] = 3.33564E-12 / PI / a / b ;
+    //             rho(i,j) = 3.33564E-12 / PI / a / b ;
     //         }
     //         else 
     //         {
-    //             rho[i][j] = 0.E0;
+    //             rho(i,j) = 0.E0;
     //         }
             
     //     }
@@ -278,26 +336,28 @@ void PIC2D::Set2DRho (vector<vector<double>>  &particles, vector<double> charge)
 
 void PIC2D::Set2DPhi()
 {
+    if(poissonSolver==1)
+    {
+        Set2DPhiIGF();
+        return;
+    }
+
     int nx = numberOfGrid[0];
     int ny = numberOfGrid[1];
 
-    // (x,y) real space to (kx,ky)
-    for(int i=0; i<nx; i++)
-    {
-        for(int j=0; j<ny;j++)
-        {
-            phi[i][j] =0.E0;
-            in_xy[i * ny  + j ] = rho[i][j] ;                       //   C/m^3
-        }
-    }   
+    bool parallel = nx * ny >= parallelMinSize;
 
-    fftw_execute(rho_X_Y_To_Rho_Kx_Ky);                             //  in_xy->out_xy
+    // (x,y) real space to (kx,ky), rho -> phi
+    fftw_execute(rho_X_Y_To_Rho_Kx_Ky);
 
-    double K_rho2phi=0, knx=0, kny=0;
-    int coun445;
+    // the normalization of the two RODFT00 transforms, 4 (nx+1) (ny+1), is applied in k space
+    double norm = 4.E0 * (nx + 1) * (ny + 1);
+    double *phiK = phi.Data();
 
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0; i<nx; ++i)
     {
+        double K_rho2phi=0, knx=0, kny=0;
         for(int j=0; j<ny; ++j)
         {  
             knx=PI / 2 * (i+1) / (nx + 1);
@@ -307,22 +367,99 @@ void PIC2D::Set2DPhi()
             K_rho2phi = pow(2*sin(knx) / meshWidth[0], 2)
                       + pow(2*sin(kny) / meshWidth[1], 2);            // unit is 1/m^2   
 
-            coun445 = i * ny  + j ;
-            out_xy[coun445] = out_xy[coun445] / K_rho2phi /Epsilon;   // unit is  (C/m^3) / (1/m^2) /(C/m*V) = V             
+            phiK[i * ny + j] /= K_rho2phi * Epsilon * norm;            // unit is  (C/m^3) / (1/m^2) /(C/m*V) = V             
+        }
+    }
+
+    fftw_execute(phi_Kx_Ky_To_Phi_X_Y);                              //  phi -> phi [V], in place
+
+}
+
+
+// integral of ln(x^2+y^2) over [0,x]*[0,y], the 2D integrated Green function is its difference over a cell
+static double IGFPrimitive(double x, double y)
+{
+    double r2 = x * x + y * y;
+    if(r2==0) return 0.E0;
+    double f = - 3 * x * y;
+    if(x!=0 && y!=0) f += x * y * log(r2) + x * x * atan(y / x) + y * y * atan(x / y);
+    return f;
+}
+
+void PIC2D::SetIGFGreen()
+{
+    // G(x,y) = -ln(x^2+y^2) / (4 PI) integrated over the cell around the mesh offset (ix*hx, iy*hy), for the unit cell
+    // hx = 1, hy = meshAspect; offsets of the doubled grid wrap around: index i >= nx is the offset i-2nx
+    int nx = numberOfGrid[0];
+    int ny = numberOfGrid[1];
+    double hx = 1.E0;
+    double hy = meshAspect;
+
+    #pragma omp parallel for schedule(static) if(nx * ny >= parallelMinSize)
+    for(int i=0; i<2*nx; i++)
+    {
+        double x = (i<=nx ? i : i - 2 * nx) * hx;
+        for(int j=0; j<2*ny; j++)
+        {
+            double y = (j<=ny ? j : j - 2 * ny) * hy;
+            double green = IGFPrimitive(x + hx / 2, y + hy / 2) - IGFPrimitive(x - hx / 2, y + hy / 2)
+                         - IGFPrimitive(x + hx / 2, y - hy / 2) + IGFPrimitive(x - hx / 2, y - hy / 2);
+            rhoIGF[i * 2 * ny + j] = - green / (4 * PI);
+        }
+    }
+
+    fftw_execute_dft_r2c(rhoIGF_X_Y_To_Kx_Ky, rhoIGF, greenIGFk);
+
+    greenAspect = meshAspect;
+}
+
+void PIC2D::Set2DPhiIGF()
+{
+    int nx = numberOfGrid[0];
+    int ny = numberOfGrid[1];
+    int nk = 2 * nx * (ny + 1);
+
+    bool parallel = nx * ny >= parallelMinSize;
+
+    if(meshAspect!=greenAspect) SetIGFGreen();
+
+    // the cell scaled by s = hx: G_s = s^2 G_1 - s^2 hy_1 ln(s^2) / (4 PI) in every cell, the constant is the k = 0 term
+    // (2nx*2ny points, unnormalized transform). It shifts phi by a constant only.
+    double scale = meshWidth[0] * meshWidth[0];
+    double shift = - scale * meshAspect * log(scale) / (4 * PI) * 4 * nx * ny;
+
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(int i=0; i<2*nx; i++)
+    {
+        for(int j=0; j<2*ny; j++)
+        {
+            rhoIGF[i * 2 * ny + j] = (i<nx && j<ny) ? rho(i,j) : 0.E0;      //   C/m^3
         }
     }
 
-    fftw_execute(phi_Kx_Ky_To_Phi_X_Y);                              //  out_xy -> in_xy
+    fftw_execute(rhoIGF_X_Y_To_Kx_Ky);                               //  rhoIGF -> rhoIGFk
+
+    #pragma omp parallel for schedule(static) if(parallel)
+    for(int k=0; k<nk; k++)
+    {
+        double gr = scale * greenIGFk[k][0] + (k==0 ? shift : 0.E0);
+        double gi = scale * greenIGFk[k][1];
+        double re = rhoIGFk[k][0] * gr - rhoIGFk[k][1] * gi;
+        double im = rhoIGFk[k][0] * gi + rhoIGFk[k][1] * gr;
+        rhoIGFk[k][0] = re;
+        rhoIGFk[k][1] = im;
+    }
+
+    fftw_execute(phiIGF_Kx_Ky_To_X_Y);                               //  rhoIGFk -> rhoIGF
 
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0; i<nx; ++i)
     {
         for(int j=0; j<ny; ++j)
         {
-            coun445 = i * ny  + j ;
-            phi[i][j] = in_xy[coun445] / (4 * (nx + 1) * (ny + 1)) ;        // [V]
+            phi(i,j) = rhoIGF[i * 2 * ny + j] / (4 * nx * ny) / Epsilon;     // (C/m^3) * m^2 / (C/m*V) = V
         }
     }
-
 }
 
 
@@ -330,21 +467,32 @@ void PIC2D::Set2DEField()
 {
     int nx = numberOfGrid[0];
     int ny = numberOfGrid[1];
-    double phix1 = 0.E0, phix2 = 0.E0;
-    double phiy1 = 0.E0, phiy2 = 0.E0;
 
+    #pragma omp parallel for schedule(static) if(nx * ny >= parallelMinSize)
     for(int i=0;i<nx;++i)
     {
+        double phix1 = 0.E0, phix2 = 0.E0;
+        double phiy1 = 0.E0, phiy2 = 0.E0;
         for(int j=0;j<ny;++j)
         {                
-            phix1 = (i==0   ) ? 0 :  phi[i-1][j  ];
-            phix2 = (i==nx-1) ? 0 :  phi[i+1][j  ];
+            if(poissonSolver==1)
+            {
+                // phi is known on the mesh only: one-sided difference on the edges
+                int i1 = (i==0) ? 0 : i-1,  i2 = (i==nx-1) ? i : i+1;
+                int j1 = (j==0) ? 0 : j-1,  j2 = (j==ny-1) ? j : j+1;
+                ex(i,j) =  -(phi(i2,j) - phi(i1,j))  / ((i2 - i1) * meshWidth[0]);      // [V/m]
+                ey(i,j) =  -(phi(i,j2) - phi(i,j1))  / ((j2 - j1) * meshWidth[1]);      // [V/m]
+                continue;
+            }
+
+            phix1 = (i==0   ) ? 0 :  phi(i-1,j  );
+            phix2 = (i==nx-1) ? 0 :  phi(i+1,j  );
             
-            phiy1 = (j==0   ) ? 0 :  phi[i  ][j-1];
-            phiy2 = (j==ny-1) ? 0 :  phi[i  ][j+1];
+            phiy1 = (j==0   ) ? 0 :  phi(i  ,j-1);
+            phiy2 = (j==ny-1) ? 0 :  phi(i  ,j+1);
             
-            ex[i][j] =  -(phix2 - phix1)  / (2 * meshWidth[0]);      // [V/m]
-            ey[i][j] =  -(phiy2 - phiy1)  / (2 * meshWidth[1]);      // [V/m]            
+            ex(i,j) =  -(phix2 - phix1)  / (2 * meshWidth[0]);      // [V/m]
+            ey(i,j) =  -(phiy2 - phiy1)  / (2 * meshWidth[1]);      // [V/m]            
         }
     }
 
@@ -372,10 +520,10 @@ void PIC2D::Set2DEField()
 
 //             fout<<setw(15)<< x 
 //                 <<setw(15)<< y
-//                 <<setw(15)<< rho[i][j]
-//                 <<setw(15)<< phi[i][j]
-//                 <<setw(15)<< ex[i][j]
-//                 <<setw(15)<< ey[i][j]
+//                 <<setw(15)<< rho(i,j)
+//                 <<setw(15)<< phi(i,j)
+//                 <<setw(15)<< ex(i,j)
+//                 <<setw(15)<< ey(i,j)
 //                 <<setw(15)<< tempx   
 //                 <<setw(15)<< tempy   
 //                 <<endl;
@@ -388,9 +536,10 @@ void PIC2D::Set2DEField()
 
 void PIC2D::SetPartSCField()
 {
-    int idx, idy;
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
     for(int i=0;i<partNum;++i)
     {
+        int idx, idy;
         if(isPartOutMesh[i]==1)
         {
             partExEyField[0][i] = 0.E0 ;
@@ -401,15 +550,15 @@ void PIC2D::SetPartSCField()
             idx  =  partMeshIndX[i];
             idy  =  partMeshIndY[i];
         
-            partExEyField[0][i] = ex[idx  ][idy  ]     * weigh[i][0]
-                                + ex[idx+1][idy  ]     * weigh[i][1]
-                                + ex[idx  ][idy+1]     * weigh[i][2]
-                                + ex[idx+1][idy+1]     * weigh[i][3];
+            partExEyField[0][i] = ex(idx  ,idy  )     * weigh[4*i+0]
+                                + ex(idx+1,idy  )     * weigh[4*i+1]
+                                + ex(idx  ,idy+1)     * weigh[4*i+2]
+                                + ex(idx+1,idy+1)     * weigh[4*i+3];
                     
-             partExEyField[1][i]= ey[idx  ][idy  ]     * weigh[i][0]
-                                + ey[idx+1][idy  ]     * weigh[i][1]
-                                + ey[idx  ][idy+1]     * weigh[i][2]
-                                + ey[idx+1][idy+1]     * weigh[i][3];            
+             partExEyField[1][i]= ey(idx  ,idy  )     * weigh[4*i+0]
+                                + ey(idx+1,idy  )     * weigh[4*i+1]
+                                + ey(idx  ,idy+1)     * weigh[4*i+2]
+                                + ey(idx+1,idy+1)     * weigh[4*i+3];            
         }
     }
 }
@@ -419,13 +568,15 @@ void PIC2D::UpdateTransverseMomentum(vector<vector<double>>  &particles, const d
     double gamma0 = electronBeamEnergy / ElectronMassEV; 
     double beta0  = sqrt(1 - 1 / pow(gamma0, 2));
     double p0     = beta0 * gamma0;
-    double px, py, pz, p, gamma, beta, factorT, factorL; 
-    double deltaPx,deltaPy,deltaPz; 
     
     // ofstream fout("test.sdds");
 
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
     for(int i=0;i<partNum;++i)
     {
+        double px, py, pz, p, gamma, beta; 
+        double deltaPx,deltaPy; 
+
         pz = (1 + particles[5][i]) * p0;
         px = pz * particles[1][i];
         py = pz * particles[3][i];
@@ -464,7 +615,7 @@ vector<vector<double> > PIC2D::GetPartSCField(vector<vector<double>> &particles)
     vector<int> partMeshIndX =  vector<int> (np, 0); 
     vector<int> partMeshIndY =  vector<int> (np, 0);
     vector<int> isPartOutMesh = vector<int> (np, 0);
-    v2d weigh = v2d(np,v1d(4,0.E0));
+    v1d weigh = v1d(4 * np,0.E0);
 
     for(int i=0;i<np;i++)
     {
@@ -494,11 +645,11 @@ vector<vector<double> > PIC2D::GetPartSCField(vector<vector<double>> &particles)
             idx = (j%2==0) ? 1 : 0;
             idy = (j%4< 2) ? 1 : 0;
 
-            weigh[i][j] =   
+            weigh[4*i+j] =   
             abs( particles[0][i] - meshx[ partMeshIndX[i] + idx ]) *
             abs( particles[1][i] - meshy[ partMeshIndY[i] + idy ])  /dv;
 
-            sum += weigh[i][j];
+            sum += weigh[4*i+j];
         }
         if(abs(sum-1)>1.E-9)  
         {
@@ -521,15 +672,15 @@ vector<vector<double> > PIC2D::GetPartSCField(vector<vector<double>> &particles)
             idx  =  partMeshIndX[i];
             idy  =  partMeshIndY[i];
         
-            partEField[0][i]    = ex[idx  ][idy  ]     * weigh[i][0]
-                                + ex[idx+1][idy  ]     * weigh[i][1]
-                                + ex[idx  ][idy+1]     * weigh[i][2]
-                                + ex[idx+1][idy+1]     * weigh[i][3];
+            partEField[0][i]    = ex(idx  ,idy  )     * weigh[4*i+0]
+                                + ex(idx+1,idy  )     * weigh[4*i+1]
+                                + ex(idx  ,idy+1)     * weigh[4*i+2]
+                                + ex(idx+1,idy+1)     * weigh[4*i+3];
                     
-             partEField[1][i]   = ey[idx  ][idy  ]     * weigh[i][0]
-                                + ey[idx+1][idy  ]     * weigh[i][1]
-                                + ey[idx  ][idy+1]     * weigh[i][2]
-                                + ey[idx+1][idy+1]     * weigh[i][3];
+             partEField[1][i]   = ey(idx  ,idy  )     * weigh[4*i+0]
+                                + ey(idx+1,idy  )     * weigh[4*i+1]
+                                + ey(idx  ,idy+1)     * weigh[4*i+2]
+                                + ey(idx+1,idy+1)     * weigh[4*i+3];
             
         }
     }    
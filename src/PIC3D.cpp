@@ -24,6 +24,7 @@
 #include <gsl/gsl_matrix.h>
 #include <gsl/gsl_histogram.h>
 #include <fftw3.h>
+#include <omp.h>
 
 using namespace std;
 using std::vector;
@@ -41,18 +42,11 @@ PIC3D::PIC3D()
 PIC3D::~PIC3D()
 {
 
-    fftw_free(in_xy);
     fftw_free(out_xy);
-    fftw_free(in);
-    fftw_free(out);
-    fftw_free(outf);
     fftw_free(in_z);
     fftw_free(out_z);
     fftw_free(outf_z);
 
-    fftw_free(in_xyz);
-    fftw_free(out_xyz);
-
     fftw_destroy_plan(rho_X_Y_Z_To_Rho_KX_KY_Z);
     fftw_destroy_plan(phi_KX_KY_Z_To_Phi_X_Y_Z);
     fftw_destroy_plan(rho_KX_KY_Z_To_Rho_KX_KY_KZ);
@@ -61,7 +55,7 @@ PIC3D::~PIC3D()
     fftw_destroy_plan(rho_X_Y_Z_To_Rho_KX_KY_KZ);
     fftw_destroy_plan(phi_KX_KY_KZ_To_Phi_X_Y_Z);
 
-    delete slicedBunchPIC2D;
+    for(int i=0;i<slicePIC2D.size();i++) delete slicePIC2D[i];
 
 }
 
@@ -81,40 +75,37 @@ void PIC3D::InitialSC3D(const ReadInputSettings &inputParameter)
     meshy = v1d(ny);
     meshz = v1d(nz);
 
-    rho = v3d(nx, v2d(ny, v1d(nz) ) );
-    phi = v3d(nx, v2d(ny, v1d(nz) ) );
-    ex  = v3d(nx, v2d(ny, v1d(nz) ) );
-    ey  = v3d(nx, v2d(ny, v1d(nz) ) );
-    ez  = v3d(nx, v2d(ny, v1d(nz) ) );
+    rho.Resize(nx, ny, nz);
+    phi.Resize(nx, ny, nz);
+    ex.Resize (nx, ny, nz);
+    ey.Resize (nx, ny, nz);
+    ez.Resize (nx, ny, nz);
 
 
-    in     = (double*)             fftw_malloc(sizeof(double)      * nx * ny * nz);
-    out    = (double*)             fftw_malloc(sizeof(double)      * nx * ny * nz);
-    outf   = (double*)             fftw_malloc(sizeof(double)      * nx * ny * nz);
-    in_xy  = (double*)             fftw_malloc(sizeof(double)      * nx * ny * nz);
     out_xy = (double*)             fftw_malloc(sizeof(double)      * nx * ny * nz);
     in_z   = (fftw_complex*)       fftw_malloc(sizeof(fftw_complex)* nx * ny * nz);
     out_z  = (fftw_complex*)       fftw_malloc(sizeof(fftw_complex)* nx * ny * nz);
     outf_z = (fftw_complex*)       fftw_malloc(sizeof(fftw_complex)* nx * ny * nz);
 
-    in_xyz     = (double*)          fftw_malloc(sizeof(double)      * nx * ny * nz);
-    out_xyz    = (double*)          fftw_malloc(sizeof(double)      * nx * ny * nz);
-
 
     int numofgridx = nx;
     int numofgridy = ny;
     int numofgridz = nz; 
 
+#ifdef FFTW_THREADS
+    static int threadsInitial = fftw_init_threads();
+    if(threadsInitial) fftw_plan_with_nthreads(nx * ny * nz >= fftThreadMinGrid ? omp_get_max_threads() : 1);
+#endif
+
     // 1
     int n_xy[]={numofgridx,numofgridy};
     rho_X_Y_Z_To_Rho_KX_KY_Z = fftw_plan_many_r2r(2, n_xy, numofgridz,
-    in_xy  ,n_xy,
+    rho.Data(), n_xy,
     numofgridz, 1,
     out_xy ,n_xy,
     numofgridz, 1,
     kind_xy_forward, FFTW_MEASURE);
     //2
-    // fftw_plan_with_nthreads(omp_get_max_threads());
     int n_z[]={numofgridz};
     rho_KX_KY_Z_To_Rho_KX_KY_KZ = fftw_plan_many_dft(1, n_z, numofgridx*numofgridy,
     in_z , n_z ,
@@ -123,7 +114,6 @@ void PIC3D::InitialSC3D(const ReadInputSettings &inputParameter)
     1,numofgridz,
     FFTW_FORWARD, FFTW_MEASURE);
     //3
-    // fftw_plan_with_nthreads(omp_get_max_threads());
     phi_KX_KY_KZ_To_Phi_KX_KY_Z = fftw_plan_many_dft(1, n_z, numofgridx*numofgridy,
     out_z  , n_z ,
     1,numofgridz,
@@ -131,25 +121,47 @@ void PIC3D::InitialSC3D(const ReadInputSettings &inputParameter)
     1,numofgridz,
     FFTW_BACKWARD, FFTW_MEASURE);
     //4
-    // fftw_plan_with_nthreads(omp_get_max_threads());
     phi_KX_KY_Z_To_Phi_X_Y_Z = fftw_plan_many_r2r(2, n_xy, numofgridz,
     out_xy,n_xy,
     numofgridz, 1,
-    in_xy,n_xy ,
+    phi.Data(), n_xy,
     numofgridz, 1,
     kind_xy_backward, FFTW_MEASURE);
 
 
     //test 3d sine fft  
     int n_xyz[]={numofgridx,numofgridy,numofgridz};
-    rho_X_Y_Z_To_Rho_KX_KY_KZ = fftw_plan_r2r(3, n_xyz,  in_xyz, out_xyz, kind_xyz_forward,  FFTW_MEASURE);
-    phi_KX_KY_KZ_To_Phi_X_Y_Z = fftw_plan_r2r(3, n_xyz, out_xyz,  in_xyz, kind_xyz_backward, FFTW_MEASURE);
-
+    rho_X_Y_Z_To_Rho_KX_KY_KZ = fftw_plan_r2r(3, n_xyz, rho.Data(), phi.Data(), kind_xyz_forward,  FFTW_MEASURE);
+    phi_KX_KY_KZ_To_Phi_X_Y_Z = fftw_plan_r2r(3, n_xyz, phi.Data(), phi.Data(), kind_xyz_backward, FFTW_MEASURE);
+    // FFTW_MEASURE planning overwrites the arrays
+    rho.Zero();
+    phi.Zero();
+
+    // the 2D solvers run one slice per thread, their plans are single threaded. Plans are made here, serially,
+    // fftw_execute of the own plan on the own buffers is thread safe.
+#ifdef FFTW_THREADS
+    if(threadsInitial) fftw_plan_with_nthreads(1);
+#endif
     vector<int> meshNum = vector<int>{numofgridx,numofgridy};
-    slicedBunchPIC2D =  new PIC2D();
-    slicedBunchPIC2D->InitialPIC2D(meshNum);
-    slicedBunchPIC2D->electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
-    slicedBunchPIC2D->range = range;
+    slicePIC2D.resize(omp_get_max_threads());
+    for(int i=0;i<slicePIC2D.size();i++)
+    {
+        slicePIC2D[i] = new PIC2D();
+        slicePIC2D[i]->InitialPIC2D(meshNum,inputParameter.ringRun->scPICSolver);
+        slicePIC2D[i]->electronBeamEnergy = inputParameter.ringParBasic->electronBeamEnergy;
+        slicePIC2D[i]->range = range;
+    }
+    slicedBunchPIC2D = slicePIC2D[0];
+
+#ifdef FFTW_THREADS
+    // back to the setting of FFTWPlanCache::Initial for the plans made later
+    if(threadsInitial) fftw_plan_with_nthreads(omp_get_max_threads());
+#endif
+}
+
+void PIC3D::Set2DMesh(double rmsXY[2], double averXY[2])
+{
+    for(int i=0;i<slicePIC2D.size();i++) slicePIC2D[i]->Set2DMesh(rmsXY,averXY);
 }
 
 
@@ -204,30 +216,29 @@ void PIC3D::Set3DMesh(vector<vector<double>> &particles)
         } 
     }
 
+    // resize() within the capacity reached before does not allocate
     partNum =  particles[0].size();
-    partMeshIndX = v1i(partNum);
-    partMeshIndY = v1i(partNum); 
-    partMeshIndZ = v1i(partNum);
-    isPartOutMesh = v1i(partNum,0); 
-    weigh = v2d(partNum,v1d(8,0.E0));
-    partEField = v2d(3,v1d(partNum,0.E0));
+    partMeshIndX.resize(partNum);
+    partMeshIndY.resize(partNum); 
+    partMeshIndZ.resize(partNum);
+    isPartOutMesh.resize(partNum); 
+    weigh.resize(8 * partNum);
+    partEField.resize(3);
+    for(int i=0;i<3;i++) partEField[i].resize(partNum);
     
 }
 
 void PIC3D::Set3DRho(vector<vector<double>> &particles, double macroCharge)
 {
     // macroCharge is charge per macro-partilce has with a unit [C]
-    for(int i=0;i<partNum;i++)
+    // get the linear weighting factor from particle to mesh. 
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
+    for (int i=0;i<partNum;i++)
     {
         partMeshIndX[i] = floor( (particles[0][i] - meshx[0] ) / meshWidth[0] ) ;
         partMeshIndY[i] = floor( (particles[1][i] - meshy[0] ) / meshWidth[1] ) ;
         partMeshIndZ[i] = floor( (particles[2][i] - meshz[0] ) / meshWidth[2] ) ;
-    }
 
-   
-    // get the linear weighting factor from particle to mesh. 
-    for (int i=0;i<partNum;i++)
-    {
         bool outMeshFlagX, outMeshFlagY, outMeshFlagZ, outMeshFlag; 
 
         outMeshFlagX = (partMeshIndX[i] >= numberOfGrid[0] - 1) || (partMeshIndX[i] < 0);  
@@ -235,11 +246,8 @@ void PIC3D::Set3DRho(vector<vector<double>> &particles, double macroCharge)
         outMeshFlagZ = (partMeshIndZ[i] >= numberOfGrid[2] - 1) || (partMeshIndZ[i] < 0);  
         outMeshFlag  = outMeshFlagX || outMeshFlagY || outMeshFlagZ ;
 
-        if(outMeshFlag) 
-        {
-            isPartOutMesh[i] = 1;
-            continue;
-        }
+        isPartOutMesh[i] = outMeshFlag ? 1 : 0;
+        if(outMeshFlag) continue;
 
         double sum = 0;
         for(int j=0;j<8; j++)
@@ -249,12 +257,12 @@ void PIC3D::Set3DRho(vector<vector<double>> &particles, double macroCharge)
             idy = (j%4< 2) ? 1 : 0;
             idz = (j <= 3) ? 1 : 0;
 
-            weigh[i][j] =   
+            weigh[8*i+j] =   
             abs( particles[0][i] - meshx[ partMeshIndX[i] + idx ]) *
             abs( particles[1][i] - meshy[ partMeshIndY[i] + idy ]) *
             abs( particles[2][i] - meshz[ partMeshIndZ[i] + idz ]) / dv;   
             
-            sum += weigh[i][j];
+            sum += weigh[8*i+j];
         }
 
         if(abs(sum-1)>1.E-9)  
@@ -265,34 +273,55 @@ void PIC3D::Set3DRho(vector<vector<double>> &particles, double macroCharge)
     }
 
     
-    // get the charge density on mesh
-    for(int x=0;x<numberOfGrid[0];x++)
+    // get the charge density on mesh: private grid per thread, summed in thread order (see PIC2D::Set2DRho)
+    int nx = numberOfGrid[0];
+    int ny = numberOfGrid[1];
+    int nz = numberOfGrid[2];
+    int nxyz = nx * ny * nz;
+    int nThreads = (partNum>=parallelMinSize && !omp_in_parallel()) ? omp_get_max_threads() : 1;
+    if(nThreads>1) rhoThread.resize(nThreads * nxyz);
+
+    #pragma omp parallel num_threads(nThreads)
     {
-        for(int y=0;y<numberOfGrid[1];y++)
+        int nTeam = omp_get_num_threads();
+        double *rhoT = nTeam==1 ? rho.Data() : &rhoThread[omp_get_thread_num() * nxyz];
+        for(int j=0;j<nxyz;j++) rhoT[j] = 0.E0;
+
+        #pragma omp for schedule(static)
+        for (int i=0;i<partNum;i++)
         {
-            for(int z=0;z<numberOfGrid[2];z++)
+            if(isPartOutMesh[i]==1) continue;
+            int idx  =  partMeshIndX[i];
+            int idy  =  partMeshIndY[i];
+            int idz  =  partMeshIndZ[i];
+            
+            rhoT[( idx    * ny + idy  ) * nz + idz  ] += weigh[8*i+0] * macroCharge / dv;    
+            rhoT[((idx+1) * ny + idy  ) * nz + idz  ] += weigh[8*i+1] * macroCharge / dv;
+            rhoT[( idx    * ny + idy+1) * nz + idz  ] += weigh[8*i+2] * macroCharge / dv;
+            rhoT[((idx+1) * ny + idy+1) * nz + idz  ] += weigh[8*i+3] * macroCharge / dv;
+            rhoT[( idx    * ny + idy  ) * nz + idz+1] += weigh[8*i+4] * macroCharge / dv;
+            rhoT[((idx+1) * ny + idy  ) * nz + idz+1] += weigh[8*i+5] * macroCharge / dv;
+            rhoT[( idx    * ny + idy+1) * nz + idz+1] += weigh[8*i+6] * macroCharge / dv;
+            rhoT[((idx+1) * ny + idy+1) * nz + idz+1] += weigh[8*i+7] * macroCharge / dv;   //   [C/m^3]
+        }
+
+        if(nTeam>1)
+        {
+            #pragma omp for schedule(static)
+            for(int x=0;x<nx;x++)
             {
-                 rho[x][y][z] = 0.E0;
+                for(int y=0;y<ny;y++)
+                {
+                    for(int z=0;z<nz;z++)
+                    {
+                        double sum = 0.E0;
+                        int coun = (x * ny + y) * nz + z;
+                        for(int t=0;t<nTeam;t++) sum += rhoThread[t * nxyz + coun];
+                        rho(x,y,z) = sum;
+                    }
+                }
             }
         }
-    }    
-    
-   
-    for (int i=0;i<partNum;i++)
-    {
-        int idx  =  partMeshIndX[i];
-        int idy  =  partMeshIndY[i];
-        int idz  =  partMeshIndZ[i];
-        
-        rho[idx  ][idy  ][idz  ] += weigh[i][0] * macroCharge / dv;    
-        rho[idx+1][idy  ][idz  ] += weigh[i][1] * macroCharge / dv;
-        rho[idx  ][idy+1][idz  ] += weigh[i][2] * macroCharge / dv;
-        rho[idx+1][idy+1][idz  ] += weigh[i][3] * macroCharge / dv;
-        rho[idx  ][idy  ][idz+1] += weigh[i][4] * macroCharge / dv;
-        rho[idx+1][idy  ][idz+1] += weigh[i][5] * macroCharge / dv;
-        rho[idx  ][idy+1][idz+1] += weigh[i][6] * macroCharge / dv;
-        rho[idx+1][idy+1][idz+1] += weigh[i][7] * macroCharge / dv;   //   [C/m^3]
-
     }
     
     // benechmark -- with a unifrom beam distribution
@@ -321,11 +350,11 @@ void PIC3D::Set3DRho(vector<vector<double>> &particles, double macroCharge)
 
     //             if ( pow(x,2) / pow(a,2)  + pow(y,2) / pow(b,2) + pow(z,2) / pow(c,2) < 1 ) 
     //             {   
-    //                 rho[i][j][k] = 1. / (4 / 3. * PI * a * b * c);
+    //                 rho(i,j,k) = 1. / (4 / 3. * PI * a * b * c);
     //             }
     //             else 
     //             {
-    //                 rho[i][j][k] = 0.E0;
+    //                 rho(i,j,k) = 0.E0;
     //             }
 
     //         }
@@ -339,29 +368,19 @@ void PIC3D::Set3DPhi()
     int ny = numberOfGrid[1];
     int nz = numberOfGrid[2];
 
-    // (x,y) real space to (kx,ky)
-    for(int i=0; i<nx; i++)
-    {
-        for(int j=0; j<ny;j++)
-        {
-            for(int k=0; k<nz; k++)
-            {
-                phi[i][j][k] = 0.E0;
-                in_xy[i * ny * nz + j * nz + k] = rho[i][j][k] ;   //   C/m^3
-            }
-        }
-    }    
+    bool parallel = nx * ny * nz >= parallelMinSize;
 
-    fftw_execute(rho_X_Y_Z_To_Rho_KX_KY_Z);                         //  in_xy->out_xy
+    // (x,y) real space to (kx,ky)
+    fftw_execute(rho_X_Y_Z_To_Rho_KX_KY_Z);                         //  rho->out_xy
 
-    int coun365;
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0;i<nx;i++)
     {
         for(int j=0;j<ny;j++)
         {
             for(int k=0;k<nz;k++)
             {
-                coun365 = i * ny * nz + j * nz + k;
+                int coun365 = i * ny * nz + j * nz + k;
                 in_z[coun365][0]=out_xy[coun365];                  //   out_xy-> in_z 
                 in_z[coun365][1]=0;
             }
@@ -370,15 +389,17 @@ void PIC3D::Set3DPhi()
 
     fftw_execute(rho_KX_KY_Z_To_Rho_KX_KY_KZ);                   //   in_z-> out_z
 
-    double K_rho2phi=0, knx=0, kny=0, knz=0;
-    int coun445;
+    // normalization of the transforms, 4 (nx+1) (ny+1) nz, applied in k space
+    double norm = 4.E0 * (nx + 1) * (ny + 1) * nz;
 
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0; i<nx; ++i)
     {
         for(int j=0; j<ny; ++j)
         {
             for(int k=0; k<nz; ++k)
             {
+                double K_rho2phi=0, knx=0, kny=0, knz=0;
                 knx=PI / 2 * (i+1) / (nx + 1);
                 kny=PI / 2 * (j+1) / (ny + 1);
                 knz=PI     * (k)   / (nz);              // check the formular used in FFTW mannul,  
@@ -388,9 +409,9 @@ void PIC3D::Set3DPhi()
                             +pow(2*sin(kny) / meshWidth[1], 2)
                             +pow(2*sin(knz) / meshWidth[2], 2);   // unit is 1/m^2
 
-                coun445 = i * ny * nz + j * nz + k;
-                out_z[coun445][0] = out_z[coun445][0] /K_rho2phi /Epsilon;   // unit is  (C/m^3) / (1/m^2) /(C/m*V)=V                
-                out_z[coun445][1] = out_z[coun445][1] /K_rho2phi /Epsilon;
+                int coun445 = i * ny * nz + j * nz + k;
+                out_z[coun445][0] /= K_rho2phi * Epsilon * norm;   // unit is  (C/m^3) / (1/m^2) /(C/m*V)=V                
+                out_z[coun445][1] /= K_rho2phi * Epsilon * norm;
             }
         }
     }
@@ -399,31 +420,20 @@ void PIC3D::Set3DPhi()
 
     fftw_execute(phi_KX_KY_KZ_To_Phi_KX_KY_Z);                           // out_z  -> outf_z
 
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0; i<nx; ++i)
     {
         for(int j=0; j<ny; ++j)
         {
             for(int k=0; k<nz; ++k)
             {
-                coun365 = i * ny * nz + j * nz + k;
+                int coun365 = i * ny * nz + j * nz + k;
                 out_xy[coun365] = outf_z[coun365][0];                     // outf_z -> out_xy
             }
         }
     }
 
-    fftw_execute(phi_KX_KY_Z_To_Phi_X_Y_Z);                              //  out_xy -> in_xy
-
-    for(int i=0; i<nx; ++i)
-    {
-        for(int j=0; j<ny; ++j)
-        {
-            for(int k=0; k<nz; ++k)
-            {
-                coun365 = i * ny * nz + j * nz + k;
-                phi[i][j][k] = in_xy[coun365] / (4 * (nx + 1) * (ny + 1) * nz ) ;        // [V]
-            }
-        }
-    }
+    fftw_execute(phi_KX_KY_Z_To_Phi_X_Y_Z);                              //  out_xy -> phi [V]
 }
 
 
@@ -433,30 +443,23 @@ void PIC3D::Set3DPhi1()
     int ny = numberOfGrid[1];
     int nz = numberOfGrid[2];
 
-    // (x,y，z) real space to (kx,ky,kz)
-    for(int i=0; i<nx; i++)
-    {
-        for(int j=0; j<ny;j++)
-        {
-            for(int k=0; k<nz; k++)
-            {
-                phi[i][j][k] = 0.E0;
-                in_xyz[i * ny * nz + j * nz + k] = rho[i][j][k] ;   //   C/m^3
-            }
-        }
-    }    
+    bool parallel = nx * ny * nz >= parallelMinSize;
 
-    fftw_execute(rho_X_Y_Z_To_Rho_KX_KY_KZ);                       //  in_xyz->out_xyz
+    // (x,y，z) real space to (kx,ky,kz)
+    fftw_execute(rho_X_Y_Z_To_Rho_KX_KY_KZ);                       //  rho->phi
 
-    double K_rho2phi=0, knx=0, kny=0, knz=0;
-    int coun445;
+    // normalization of the two RODFT00 transforms, 8 (nx+1) (ny+1) (nz+1), applied in k space
+    double norm = 8.E0 * (nx + 1) * (ny + 1) * (nz + 1);
+    double *phiK = phi.Data();
 
+    #pragma omp parallel for schedule(static) if(parallel)
     for(int i=0; i<nx; ++i)
     {
         for(int j=0; j<ny; ++j)
         {
             for(int k=0; k<nz; ++k)
             {
+                double K_rho2phi=0, knx=0, kny=0, knz=0;
                 knx=PI / 2 * (i+1) / (nx + 1);
                 kny=PI / 2 * (j+1) / (ny + 1);
                 knz=PI / 2 * (k+1) / (nz + 1);               // chech the formular used in FFTW mannul in function FFT,  
@@ -466,25 +469,13 @@ void PIC3D::Set3DPhi1()
                             +pow(2*sin(kny) / meshWidth[1], 2)
                             +pow(2*sin(knz) / meshWidth[2], 2);   // unit is 1/m^2
 
-                coun445 = i * ny * nz + j * nz + k;
-                out_xyz[coun445] = out_xyz[coun445] /K_rho2phi / Epsilon;   // unit is  (C/m^3) / (1/m^2) /(C/m*V)=V                
+                int coun445 = i * ny * nz + j * nz + k;
+                phiK[coun445] /= K_rho2phi * Epsilon * norm;   // unit is  (C/m^3) / (1/m^2) /(C/m*V)=V                
             }
         }
     }
 
-    fftw_execute(phi_KX_KY_KZ_To_Phi_X_Y_Z);                              //  out_xyz -> in_xyz
-    int coun365;
-    for(int i=0; i<nx; ++i)
-    {
-        for(int j=0; j<ny; ++j)
-        {
-            for(int k=0; k<nz; ++k)
-            {
-                coun365 = i * ny * nz + j * nz + k;
-                phi[i][j][k] = in_xyz[coun365] / (8 * (nx + 1) * (ny + 1) * (nz + 1) ) ;        // [V]
-            }
-        }
-    }
+    fftw_execute(phi_KX_KY_KZ_To_Phi_X_Y_Z);                              //  phi -> phi [V], in place
 
 }
 
@@ -506,27 +497,27 @@ void PIC3D::Set3DEField()
             for(int k=0;k<nz;++k)
             {
                 
-                phix1 = (i==0   ) ? 0 :  phi[i-1][j  ][k  ];
-                phix2 = (i==nx-1) ? 0 :  phi[i+1][j  ][k  ];
+                phix1 = (i==0   ) ? 0 :  phi(i-1,j  ,k  );
+                phix2 = (i==nx-1) ? 0 :  phi(i+1,j  ,k  );
                 
-                phiy1 = (j==0   ) ? 0 :  phi[i  ][j-1][k  ];
-                phiy2 = (j==ny-1) ? 0 :  phi[i  ][j+1][k  ];
+                phiy1 = (j==0   ) ? 0 :  phi(i  ,j-1,k  );
+                phiy2 = (j==ny-1) ? 0 :  phi(i  ,j+1,k  );
 
-                phiz1 = (k==0   ) ? 0 :  phi[i  ][j  ][k-1];
-                phiz2 = (k==nz-1) ? 0 :  phi[i  ][j  ][k+1];
+                phiz1 = (k==0   ) ? 0 :  phi(i  ,j  ,k-1);
+                phiz2 = (k==nz-1) ? 0 :  phi(i  ,j  ,k+1);
                 
-                ex[i][j][k] =  -(phix2 - phix1)  / (2 * meshWidth[0]);  //* beamRms[2] * 2 / 2304;      // [V/m]
-                ey[i][j][k] =  -(phiy2 - phiy1)  / (2 * meshWidth[1]);  //* beamRms[2] * 2 / 2304;      // [V/m]
-                ez[i][j][k] =  -(phiz2 - phiz1)  / (2 * meshWidth[2]);  // * beamRms[2] * 2 / 2304;      // [V/m]
+                ex(i,j,k) =  -(phix2 - phix1)  / (2 * meshWidth[0]);  //* beamRms[2] * 2 / 2304;      // [V/m]
+                ey(i,j,k) =  -(phiy2 - phiy1)  / (2 * meshWidth[1]);  //* beamRms[2] * 2 / 2304;      // [V/m]
+                ez(i,j,k) =  -(phiz2 - phiz1)  / (2 * meshWidth[2]);  // * beamRms[2] * 2 / 2304;      // [V/m]
 
                 fout<<setw(15)<< meshx[i] 
                     <<setw(15)<< meshy[j]
                     <<setw(15)<< meshz[k]
-                    <<setw(15)<< ex[i][j][k]
-                    <<setw(15)<< ey[i][j][k]
-                    <<setw(15)<< ez[i][j][k]
-                    <<setw(15)<< phi[i][j][k]
-                    <<setw(15)<< rho[i][j][k]
+                    <<setw(15)<< ex(i,j,k)
+                    <<setw(15)<< ey(i,j,k)
+                    <<setw(15)<< ez(i,j,k)
+                    <<setw(15)<< phi(i,j,k)
+                    <<setw(15)<< rho(i,j,k)
                     <<endl; 
 
             }
@@ -540,11 +531,10 @@ void PIC3D::Set3DEField()
 
 void PIC3D::SetPartSCField(vector<vector<double>>  &particles)
 {
-    double e1=0,e2=0,e3=0,b1=0,b2=0,b3=0;
-    int idx, idy, idz;
-
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
     for(int i=0;i<partNum;++i)
     {
+        int idx, idy, idz;
         if(isPartOutMesh[i]==1)
         {
             partEField[0][i] = 0.E0 ;
@@ -558,32 +548,32 @@ void PIC3D::SetPartSCField(vector<vector<double>>  &particles)
             idy  =  partMeshIndY[i];
             idz  =  partMeshIndZ[i];
         
-            partEField[0][i]    = ex[idx  ][idy  ][idz  ]     * weigh[i][0]
-                                + ex[idx+1][idy  ][idz  ]     * weigh[i][1]
-                                + ex[idx  ][idy+1][idz  ]     * weigh[i][2]
-                                + ex[idx+1][idy+1][idz  ]     * weigh[i][3]
-                                + ex[idx  ][idy  ][idz+1]     * weigh[i][4]
-                                + ex[idx+1][idy  ][idz+1]     * weigh[i][5]
-                                + ex[idx  ][idy+1][idz+1]     * weigh[i][6]
-                                + ex[idx+1][idy+1][idz+1]     * weigh[i][7];
+            partEField[0][i]    = ex(idx  ,idy  ,idz  )     * weigh[8*i+0]
+                                + ex(idx+1,idy  ,idz  )     * weigh[8*i+1]
+                                + ex(idx  ,idy+1,idz  )     * weigh[8*i+2]
+                                + ex(idx+1,idy+1,idz  )     * weigh[8*i+3]
+                                + ex(idx  ,idy  ,idz+1)     * weigh[8*i+4]
+                                + ex(idx+1,idy  ,idz+1)     * weigh[8*i+5]
+                                + ex(idx  ,idy+1,idz+1)     * weigh[8*i+6]
+                                + ex(idx+1,idy+1,idz+1)     * weigh[8*i+7];
                     
-             partEField[1][i]   = ey[idx  ][idy  ][idz  ]     * weigh[i][0]
-                                + ey[idx+1][idy  ][idz  ]     * weigh[i][1]
-                                + ey[idx  ][idy+1][idz  ]     * weigh[i][2]
-                                + ey[idx+1][idy+1][idz  ]     * weigh[i][3]
-                                + ey[idx  ][idy  ][idz+1]     * weigh[i][4]
-                                + ey[idx+1][idy  ][idz+1]     * weigh[i][5]
-                                + ey[idx  ][idy+1][idz+1]     * weigh[i][6]
-                                + ey[idx+1][idy+1][idz+1]     * weigh[i][7];
+             partEField[1][i]   = ey(idx  ,idy  ,idz  )     * weigh[8*i+0]
+                                + ey(idx+1,idy  ,idz  )     * weigh[8*i+1]
+                                + ey(idx  ,idy+1,idz  )     * weigh[8*i+2]
+                                + ey(idx+1,idy+1,idz  )     * weigh[8*i+3]
+                                + ey(idx  ,idy  ,idz+1)     * weigh[8*i+4]
+                                + ey(idx+1,idy  ,idz+1)     * weigh[8*i+5]
+                                + ey(idx  ,idy+1,idz+1)     * weigh[8*i+6]
+                                + ey(idx+1,idy+1,idz+1)     * weigh[8*i+7];
             
-             partEField[2][i]   = ez[idx  ][idy  ][idz  ]     * weigh[i][0]
-                                + ez[idx+1][idy  ][idz  ]     * weigh[i][1]
-                                + ez[idx]  [idy+1][idz  ]     * weigh[i][2]
-                                + ez[idx+1][idy+1][idz  ]     * weigh[i][3]
-                                + ez[idx  ][idy  ][idz+1]     * weigh[i][4]
-                                + ez[idx+1][idy  ][idz+1]     * weigh[i][5]
-                                + ez[idx  ][idy+1][idz+1]     * weigh[i][6]
-                                + ez[idx+1][idy+1][idz+1]     * weigh[i][7];   // [V/m]
+             partEField[2][i]   = ez(idx  ,idy  ,idz  )     * weigh[8*i+0]
+                                + ez(idx+1,idy  ,idz  )     * weigh[8*i+1]
+                                + ez(idx,idy+1,idz  )     * weigh[8*i+2]
+                                + ez(idx+1,idy+1,idz  )     * weigh[8*i+3]
+                                + ez(idx  ,idy  ,idz+1)     * weigh[8*i+4]
+                                + ez(idx+1,idy  ,idz+1)     * weigh[8*i+5]
+                                + ez(idx  ,idy+1,idz+1)     * weigh[8*i+6]
+                                + ez(idx+1,idy+1,idz+1)     * weigh[8*i+7];   // [V/m]
         }
     }
 }
@@ -594,13 +584,15 @@ void PIC3D::UpdatMomentum(vector<vector<double>> &particles, const double ds)
     double gamma0 = electronBeamEnergy / ElectronMassEV; 
     double beta0  = sqrt(1 - 1 / pow(gamma0, 2));
     double p0     = beta0 * gamma0;
-    double px, py, pz, p, gamma, beta, factorT, factorL; 
-    double deltaPx,deltaPy,deltaPz; 
     
     // ofstream fout("test.sdds");
 
+    #pragma omp parallel for schedule(static) if(partNum>=parallelMinSize)
     for(int i=0;i<partNum;++i)
     {
+        double px, py, pz, p, gamma, beta, factorT, factorL; 
+        double deltaPx,deltaPy; 
+
         pz = (1 + particles[5][i]) * p0;
         px = pz * particles[1][i];
         py = pz * particles[3][i];
@@ -0,0 +1,37 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "PICMesh.h"
+#include <algorithm>
+#include <fftw3.h>
+
+using namespace std;
+
+PICMesh::~PICMesh()
+{
+    fftw_free(data);
+}
+
+void PICMesh::Resize(int nx, int ny, int nz)
+{
+    if(nx * ny * nz != size)
+    {
+        fftw_free(data);
+        size = nx * ny * nz;
+        data = (double*) fftw_malloc(sizeof(double) * size);
+    }
+    this->nx = nx;
+    this->ny = ny;
+    this->nz = nz;
+    Zero();
+}
+
+void PICMesh::Zero()
+{
+    fill(data, data + size, 0.E0);
+}
@@ -0,0 +1,145 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "RandomStream.h"
+#include "Global.h"
+#include <cmath>
+#include <random>
+#include <iostream>
+#ifdef MPIMODE
+#include <mpi.h>
+#endif
+
+using namespace std;
+
+uint64_t RandomStream::seed = 0;
+
+
+// one Philox4x32-10 block: ctr = (position, stream), key = seed. The 32x32->64 bit products keep the loops vectorizable.
+static inline void Philox4x32(uint64_t position, uint64_t stream, uint64_t key, uint32_t out[4])
+{
+    uint32_t c0 = uint32_t(position), c1 = uint32_t(position >> 32);
+    uint32_t c2 = uint32_t(stream),   c3 = uint32_t(stream >> 32);
+    uint32_t k0 = uint32_t(key),      k1 = uint32_t(key >> 32);
+
+    for(int r=0;r<10;r++)
+    {
+        uint64_t p0 = uint64_t(0xD2511F53u) * c0;
+        uint64_t p1 = uint64_t(0xCD9E8D57u) * c2;
+        uint32_t n0 = uint32_t(p1 >> 32) ^ c1 ^ k0;
+        uint32_t n2 = uint32_t(p0 >> 32) ^ c3 ^ k1;
+        c0 = n0;
+        c1 = uint32_t(p1);
+        c2 = n2;
+        c3 = uint32_t(p0);
+        k0 += 0x9E3779B9u;
+        k1 += 0xBB67AE85u;
+    }
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+// 53 random bits -> (0,1), never 0 so that log() in Box-Muller is finite
+static inline double ToUniform(uint32_t lo, uint32_t hi)
+{
+    uint64_t bits = ((uint64_t(hi) << 32) | lo) >> 11;
+    return (bits + 0.5) * (1.0 / 9007199254740992.0);
+}
+
+
+void RandomStream::Initial(const ReadInputSettings &inputParameter)
+{
+    seed = inputParameter.ringRun->randomSeed;
+    if(seed==0)
+    {
+        random_device rd;
+        seed = (uint64_t(rd()) << 32) | rd();
+    }
+#ifdef MPIMODE
+    // all ranks use the seed of rank 0, the bunch streams are told apart by the bunch index
+    unsigned long long seedAll = seed;
+    MPI_Bcast(&seedAll,1,MPI_UNSIGNED_LONG_LONG,0,MPI_COMM_WORLD);
+    seed = seedAll;
+#endif
+    cout<<"random seed: "<<seed<<endl;
+}
+
+void RandomStream::Seed(int type, int index)
+{
+    key      = seed;
+    stream   = (uint64_t(type) << 32) | uint32_t(index);
+    position = 0;
+    spare    = 0;
+    hasSpare = 0;
+}
+
+double RandomStream::Uniform()
+{
+    uint32_t out[4];
+    Philox4x32(position, stream, key, out);
+    position++;
+    return ToUniform(out[0], out[1]);
+}
+
+double RandomStream::Normal()
+{
+    if(hasSpare)
+    {
+        hasSpare = 0;
+        return spare;
+    }
+    double pair[2];
+    NormalPairs(1, pair);
+    spare    = pair[1];
+    hasSpare = 1;
+    return pair[0];
+}
+
+void RandomStream::Normal(int n, double *out)
+{
+    int i = 0;
+    if(n>0 && hasSpare)
+    {
+        out[i++] = spare;
+        hasSpare = 0;
+    }
+
+    int nPair = (n - i) / 2;
+    NormalPairs(nPair, out + i);
+    i += 2 * nPair;
+
+    if(i<n) out[i] = Normal();
+}
+
+void RandomStream::NormalPairs(int nPair, double *out)
+{
+    // the Philox blocks first (integer only), then Box-Muller on the whole array
+    const uint64_t pos0 = position;
+    const uint64_t str  = stream;
+    const uint64_t k    = key;
+
+    #pragma omp simd
+    for(int i=0;i<nPair;i++)
+    {
+        uint32_t r[4];
+        Philox4x32(pos0 + i, str, k, r);
+        out[2*i]   = ToUniform(r[0], r[1]);
+        out[2*i+1] = ToUniform(r[2], r[3]);
+    }
+    position += nPair;
+
+    for(int i=0;i<nPair;i++)
+    {
+        double radius = sqrt(-2.0 * log(out[2*i]));
+        double theta  = 2.0 * PI * out[2*i+1];
+        out[2*i]   = radius * cos(theta);
+        out[2*i+1] = radius * sin(theta);
+    }
+}
@@ -354,6 +354,10 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
             ringParRf->methodForVb = strVec[1];
             ringParRf->methodForVb = "soft";
         }    
+        if (strVec[0]=="rfresinittransient") 
+        {
+            ringParRf->resInitTransient = stoi(strVec[1]);
+        }
                  
         if (strVec[0]=="rfrescold") 
         {
@@ -548,6 +552,14 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
         {
             ringIonEffPara->ionCalSCMethod = stoi(strVec[1]);
         } 
+        if(strVec[0]=="ioncalbemethod")
+        {
+            ringIonEffPara->ionCalBEMethod = stoi(strVec[1]);
+        } 
+        if(strVec[0]=="ioncalpicsolver")
+        {
+            ringIonEffPara->ionCalPICSolver = stoi(strVec[1]);
+        } 
         //----------------------------------------------------------------------  
 
             
@@ -703,6 +715,10 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
         {
           ringLRWake->nTurnswakeTrunction = stoi(strVec[1]) + 1;
         }
+        if(strVec[0]=="lrwrecursion")
+        {
+          ringLRWake->recursion = stoi(strVec[1]);
+        }
         
         // 7.1)  initial short range wake 
         if(strVec[0]=="srwpipegeoinput")
@@ -866,6 +882,11 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
         {                       
           ringRun->runCBMGR = strVec[1];
         }
+
+        if(strVec[0]=="runcbmhistory")
+        {                       
+          ringRun->cbmHistory = stoi(strVec[1]);
+        }
             
         if(strVec[0]=="runtbtbunchdisdatabunchindex")
         {                                 
@@ -883,12 +904,77 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
           ringRun->scMeshNum[2] = stoi(strVec[4]); 
         }
 
+        if(strVec[0]=="runscpicsolver")
+        {
+          ringRun->scPICSolver = stoi(strVec[1]);
+        }
+
 
         if(strVec[0]=="runramping")
         {
           ringRun->rampFlag = stoi(strVec[1]);
         }
 
+        if(strVec[0]=="runthreads")
+        {
+          ringRun->threads = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runsymplecticmapgsl")
+        {
+          ringRun->symplecticMapGSL = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runfftwplanner")
+        {
+          ringRun->fftwPlanner = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runfftwwisdom")
+        {
+          ringRun->fftwWisdom = strVec[1];
+        }
+
+        if(strVec[0]=="runsddsbinary")
+        {
+          ringRun->sddsBinary = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runrandomseed")
+        {
+          ringRun->randomSeed = stoull(strVec[1]);
+        }
+
+        if(strVec[0]=="runcheckpointinterval")
+        {
+          ringRun->checkpointInterval = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runcheckpointfile")
+        {
+          ringRun->checkpointFile = strVec[1];
+        }
+
+        if(strVec[0]=="runrestartfrom")
+        {
+          ringRun->restartFrom = strVec[1];
+        }
+
+        if(strVec[0]=="runprofile")
+        {
+          ringRun->profileFlag = stoi(strVec[1]);
+        }
+
+        if(strVec[0]=="runprofilefile")
+        {
+          ringRun->profileFile = strVec[1];
+        }
+
+        if(strVec[0]=="runbinningcic")
+        {
+          ringRun->binningCIC = stoi(strVec[1]);
+        }
+
         // 11) ramping
         if(strVec[0]=="rampingnu")
         {
@@ -953,7 +1039,67 @@ int ReadInputSettings::ParamRead(int argc, char *argv[])
   {
     cerr<<"wrong settings: nTurns small than growthRateFittingEnd"<<endl;
     exit(0);
-  } 
+  }
+
+  if(ringRun->threads < 0)
+  {
+    cerr<<"wrong settings: runThreads has to be >= 0 (0: OpenMP default)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->fftwPlanner < 0 || ringRun->fftwPlanner > 2)
+  {
+    cerr<<"wrong settings: runFFTWPlanner has to be 0 (ESTIMATE), 1 (MEASURE) or 2 (PATIENT)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->sddsBinary != 0 && ringRun->sddsBinary != 1)
+  {
+    cerr<<"wrong settings: runSDDSBinary has to be 0 (ascii) or 1 (binary)"<<endl;
+    exit(0);
+  }
+
+  if(ringIonEffPara->ionCalBEMethod < 0 || ringIonEffPara->ionCalBEMethod > 3)
+  {
+    cerr<<"wrong settings: ionCalBEMethod has to be 0 (Faddeeva), 1 (Humlicek), 2 (Weideman) or 3 (table)"<<endl;
+    exit(0);
+  }
+
+  if(ringIonEffPara->ionCalPICSolver < 0 || ringIonEffPara->ionCalPICSolver > 1 || ringRun->scPICSolver < 0 || ringRun->scPICSolver > 1)
+  {
+    cerr<<"wrong settings: ionCalPICSolver and runSCPICSolver have to be 0 (sine transform) or 1 (open boundary IGF)"<<endl;
+    exit(0);
+  }
+
+  if(ringParRf->resInitTransient < 0 || ringParRf->resInitTransient > 1)
+  {
+    cerr<<"wrong settings: rfResInitTransient has to be 0 (closed form steady state) or 1 (turn by turn tracking)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->checkpointInterval < 0)
+  {
+    cerr<<"wrong settings: runCheckpointInterval has to be >= 0 (0: no checkpoint)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->profileFlag < 0 || ringRun->profileFlag > 2)
+  {
+    cerr<<"wrong settings: runProfile has to be 0 (off), 1 (per stage) or 2 (per stage and bunch)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->binningCIC < 0 || ringRun->binningCIC > 1)
+  {
+    cerr<<"wrong settings: runBinningCIC has to be 0 (nearest bin) or 1 (cloud-in-cell)"<<endl;
+    exit(0);
+  }
+
+  if(ringRun->cbmHistory < 0 || ringRun->cbmHistory > 1)
+  {
+    cerr<<"wrong settings: runCBMHistory has to be 0 (streaming growth rates only) or 1 (full histories)"<<endl;
+    exit(0);
+  }
 
     // debug -- print all bunch data
     // ringRun->TBTBunchPrintNum = ringFillPatt->totBunchNumber;
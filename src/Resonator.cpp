@@ -17,6 +17,7 @@
 	
 #include <numeric>
 #include <cmath>
+#include <algorithm>
 
 using namespace std;
 using std::vector;
@@ -238,6 +239,13 @@ void Resonator::ResonatorDynamics(double time)
     // Notice: factor of k in Eq.4  is the accelerator definition R_a/Q. 
     //cavity voltage is only solved at t=m*tRF, m=0,1,2,3.., that the golable TrackingTime=m*tRF
     
+    complex<double> decay, drive;
+    GetGenPropagator(time,decay,drive);
+    resGenVol = resGenVol * decay + drive;
+}
+
+void Resonator::GetGenPropagator(double time, complex<double> &decay, complex<double> &drive) const
+{
     double tB = time;
     double sigma =  2.0 * PI * resFre / (2.0 * resQualityQL);
     double deltaOmega = 2.0 * PI * resDetuneFre;
@@ -245,7 +253,7 @@ void Resonator::ResonatorDynamics(double time)
     complex<double> genIg =  resGenIg;   
 
     // the same as matirx multiplying by matrix A of Eq.(3) in PAC 2015-MOPMA006
-    resGenVol *= exp( - sigma * tB ) * exp (li * deltaOmega * tB);
+    decay = exp( - sigma * tB ) * exp (li * deltaOmega * tB);
 
     double alpha = deltaOmega * exp(- sigma * tB ) * sin(deltaOmega * tB) -  sigma      * exp(- sigma * tB ) * cos(deltaOmega * tB) + sigma;
     double beta  = sigma      * exp(- sigma * tB ) * sin(deltaOmega * tB) +  deltaOmega * exp(- sigma * tB ) * cos(deltaOmega * tB) - deltaOmega;
@@ -255,10 +263,79 @@ void Resonator::ResonatorDynamics(double time)
     double resGenVolReal = coefB * ( alpha * genIg.real() + beta  * genIg.imag());
     double resGenVolImag = coefB * (- beta * genIg.real() + alpha * genIg.imag());
 
-    resGenVol += complex<double>(resGenVolReal, resGenVolImag); 
+    drive = complex<double>(resGenVolReal, resGenVolImag); 
+}
+
+void Resonator::AdvanceBuckets(int harmonicNum, int nBuckets, double tRF, double dt)
+{
+    // the empty buckets of the gap are not sampled, nobody reads them
+    if(sampleAtNTrf) GetResonatorInfoAtNTrf(harmonicNum,dt);
+
+    // the generator equation is linear with a constant current, so the gap is one exact step of nBuckets * tRF
+    double key[6] = {tRF, resFre, resQualityQL, resDetuneFre, resShuntImpRs, resQualityQ0};
+    if(!equal(key,key+6,propagatorKey) || propagatorIg!=resGenIg)
+    {
+        genPropagator.clear();
+        copy(key,key+6,propagatorKey);
+        propagatorIg = resGenIg;
+    }
+
+    auto it = genPropagator.find(nBuckets);
+    if(it==genPropagator.end())
+    {
+        complex<double> decay, drive;
+        GetGenPropagator(nBuckets * tRF,decay,drive);
+        it = genPropagator.insert(make_pair(nBuckets,make_pair(decay,drive))).first;
+    }
+    resGenVol = resGenVol * it->second.first + it->second.second;
+}
 
+
+// exp(z) - 1 without the cancellation at small |z| (decay per bucket tRF/tF can be 1.E-8)
+static complex<double> ExpM1(complex<double> z)
+{
+    double s = sin(z.imag() / 2);
+    return expm1(z.real()) * exp(li * z.imag()) + complex<double>(-2 * s * s, sin(z.imag()));
 }
 
+complex<double> Resonator::GetPeriodicTurnStartVol(const vector<complex<double> > &vb0, const vector<complex<double> > &stepExp,
+                                                   const vector<int> &stepNum, int nTurn)
+{
+    // the voltage one turn of kicks leaves at the end of the turn, and the exponent of one whole turn
+    complex<double> turnExp = (0.E0,0.E0);
+    complex<double> vTurn   = (0.E0,0.E0);
+    for(int k=vb0.size()-1;k>=0;k--)
+    {
+        turnExp += double(stepNum[k]) * stepExp[k];
+        vTurn   += vb0[k] * exp(turnExp);
+    }
+
+    // vTurn * (1 + Q + ... + Q^(nTurn-1)), Q = exp(turnExp)
+    if(nTurn<1) return complex<double>(0.E0,0.E0);
+    return vTurn * ExpM1(double(nTurn) * turnExp) / ExpM1(turnExp);
+}
+
+complex<double> Resonator::GetPeriodicBeamInducedVol(const vector<complex<double> > &vb0, const vector<complex<double> > &stepExp,
+                                                     const vector<int> &stepNum, int nTurns)
+{
+    int n = vb0.size();
+    complex<double> vb = GetPeriodicTurnStartVol(vb0,stepExp,stepNum,nTurns-1);
+
+    // last turn: sum of vb q^s, s = 1..stepNum, over the steps of each gap
+    complex<double> vbSum = (0.E0,0.E0);
+    int stepSum = 0;
+    for(int k=0;k<n;k++)
+    {
+        vb += vb0[k];
+        if(stepNum[k]==0) continue;
+        complex<double> q = exp(stepExp[k]);
+        vbSum   += vb * q * ExpM1(double(stepNum[k]) * stepExp[k]) / ExpM1(stepExp[k]);
+        vb      *= exp(double(stepNum[k]) * stepExp[k]);
+        stepSum += stepNum[k];
+    }
+
+    return stepSum==0 ? vbSum : vbSum / double(stepSum);
+}
 
 void Resonator::GetResonatorInfoAtNTrf(int harmonicNum,double dt)
 {
@@ -281,6 +358,45 @@ void Resonator::GetResonatorInfoAtNTrf(int harmonicNum,double dt)
     
 
 
+void Resonator::PackDynamicState(vector<double> &buf) const
+{
+    const complex<double> scalar[6] = {vbAccum, vbAccum0, vbAccumRFFrame, resGenVolFB, vBSampleTemp, resGenVol};
+    const vector<complex<double> > *sample[5] = {&vBSample, &vCavSample, &deltaVCavSample, &vGenSample, &vCavDueToDirFB};
 
+    buf.clear();
+    for(int i=0;i<6;i++)
+    {
+        buf.push_back(scalar[i].real());
+        buf.push_back(scalar[i].imag());
+    }
+    // the samples only when they are taken, 10 * harmonics doubles per resonator otherwise
+    for(int i=0;i<5 && sampleAtNTrf;i++)
+    {
+        for(int k=0;k<sample[i]->size();k++)
+        {
+            buf.push_back((*sample[i])[k].real());
+            buf.push_back((*sample[i])[k].imag());
+        }
+    }
+}
 
+void Resonator::UnpackDynamicState(const vector<double> &buf)
+{
+    complex<double> *scalar[6] = {&vbAccum, &vbAccum0, &vbAccumRFFrame, &resGenVolFB, &vBSampleTemp, &resGenVol};
+    vector<complex<double> > *sample[5] = {&vBSample, &vCavSample, &deltaVCavSample, &vGenSample, &vCavDueToDirFB};
 
+    int index=0;
+    for(int i=0;i<6;i++)
+    {
+        *scalar[i] = complex<double>(buf[index],buf[index+1]);
+        index += 2;
+    }
+    for(int i=0;i<5 && sampleAtNTrf;i++)
+    {
+        for(int k=0;k<sample[i]->size();k++)
+        {
+            (*sample[i])[k] = complex<double>(buf[index],buf[index+1]);
+            index += 2;
+        }
+    }
+}
@@ -0,0 +1,272 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "SDDSWriter.h"
+#include <iostream>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+set<SDDSWriter*> SDDSWriter::openWriters;
+mutex SDDSWriter::openMtx;
+
+
+SDDSWriter::SDDSWriter()
+{
+
+}
+
+SDDSWriter::~SDDSWriter()
+{
+    Close();
+}
+
+void SDDSWriter::DefineParameter(const string &name, const string &units, DataType type)
+{
+    Field field = {name, units, type};
+    parameterDef.push_back(field);
+}
+
+void SDDSWriter::DefineColumn(const string &name, const string &units, DataType type)
+{
+    Field field = {name, units, type};
+    columnDef.push_back(field);
+}
+
+void SDDSWriter::Open(const string &fileName, int binaryMode, bool writeHeader)
+{
+    Close();
+    file = fopen(fileName.c_str(), writeHeader ? "wb" : "ab");
+    if(file==NULL)
+    {
+        cerr<<"SDDS file "<<fileName<<" can not be opened"<<endl;
+        exit(0);
+    }
+
+    binary      = binaryMode;
+    columnIndex = 0;
+    append      = !writeHeader;
+    fileBytes   = 0;
+    pageRowsPos = -1;
+    stop        = false;
+    buffer.reserve(bufferSize);
+    writeBuffer.reserve(bufferSize);
+    writer = thread(&SDDSWriter::WriterLoop, this);
+
+    {
+        lock_guard<mutex> lock(openMtx);
+        static bool registered = false;
+        if(!registered) atexit(CloseAll);
+        registered = true;
+        openWriters.insert(this);
+    }
+
+    if(writeHeader) WriteHeader();
+}
+
+void SDDSWriter::CloseAll()
+{
+    vector<SDDSWriter*> writers;
+    {
+        lock_guard<mutex> lock(openMtx);
+        writers.assign(openWriters.begin(), openWriters.end());
+    }
+    for(size_t i=0;i<writers.size();i++) writers[i]->Close();
+}
+
+void SDDSWriter::WriteHeader()
+{
+    static const char *typeName[3] = {"long", "float", "double"};
+
+    string header = "SDDS1\n";
+    if(binary)
+    {
+        const uint16_t one = 1;
+        header += *(const char*)&one ? "!# little-endian\n" : "!# big-endian\n";
+    }
+    for(size_t i=0;i<parameterDef.size();i++)
+    {
+        header += "&parameter name=" + parameterDef[i].name;
+        if(!parameterDef[i].units.empty()) header += ", units=" + parameterDef[i].units;
+        header += string(", type=") + typeName[parameterDef[i].type] + ", &end\n";
+    }
+    for(size_t i=0;i<columnDef.size();i++)
+    {
+        header += "&column name=" + columnDef[i].name;
+        if(!columnDef[i].units.empty()) header += ", units=" + columnDef[i].units;
+        header += string(", type=") + typeName[columnDef[i].type] + ", &end\n";
+    }
+    header += binary ? "&data mode=binary, &end\n" : "&data mode=ascii, &end\n";
+
+    Append(header.data(), header.size());
+}
+
+void SDDSWriter::StartPage(int rowNum, const vector<double> &parameter)
+{
+    if(file==NULL) return;
+
+    if(parameter.size()!=parameterDef.size())
+    {
+        cerr<<"SDDS page: "<<parameter.size()<<" parameter values for "<<parameterDef.size()<<" parameters"<<endl;
+        exit(0);
+    }
+
+    // binary page: row count, then the parameters. ascii page: parameters one per line, then the row count.
+    if(binary)
+    {
+        pageRowsPos = fileBytes;
+        PutRowCount(rowNum);
+        for(size_t i=0;i<parameter.size();i++) PutValue(parameter[i], parameterDef[i].type, '\n');
+    }
+    else
+    {
+        for(size_t i=0;i<parameter.size();i++) PutValue(parameter[i], parameterDef[i].type, '\n');
+        pageRowsPos = fileBytes;
+        PutRowCount(rowNum);
+    }
+    pageRows    = rowNum;
+    pageRowsPut = 0;
+    columnIndex = 0;
+}
+
+void SDDSWriter::PutRowCount(int rowNum)
+{
+    // fixed width in ascii as well, Close() overwrites it in place
+    if(binary)
+    {
+        int32_t rows = rowNum;
+        Append(&rows, sizeof(rows));
+    }
+    else
+    {
+        char line[32];
+        int n = snprintf(line, sizeof(line), "%-10d\n", rowNum);
+        Append(line, n);
+    }
+}
+
+void SDDSWriter::Put(double value)
+{
+    if(file==NULL) return;
+
+    char sep = (columnIndex==int(columnDef.size())-1) ? '\n' : ' ';
+    PutValue(value, columnDef[columnIndex].type, sep);
+    columnIndex = (columnIndex + 1) % columnDef.size();
+    if(columnIndex==0) pageRowsPut++;
+}
+
+void SDDSWriter::PutValue(double value, DataType type, char sep)
+{
+    if(binary)
+    {
+        if(type==LONG)
+        {
+            int32_t v = int32_t(value);
+            Append(&v, sizeof(v));
+        }
+        else if(type==FLOAT)
+        {
+            float v = float(value);
+            Append(&v, sizeof(v));
+        }
+        else
+        {
+            Append(&value, sizeof(value));
+        }
+    }
+    else
+    {
+        char text[40];
+        int n;
+        if     (type==LONG)  n = snprintf(text, sizeof(text), "%d%c",    int(value), sep);
+        else if(type==FLOAT) n = snprintf(text, sizeof(text), "%.8g%c",  value, sep);
+        else                 n = snprintf(text, sizeof(text), "%.16g%c", value, sep);
+        Append(text, n);
+    }
+}
+
+void SDDSWriter::Append(const void *data, size_t n)
+{
+    const char *p = (const char*)data;
+    buffer.insert(buffer.end(), p, p + n);
+    fileBytes += n;
+    if(buffer.size()>=bufferSize) HandOver();
+}
+
+void SDDSWriter::HandOver()
+{
+    // the writer thread owns writeBuffer until it clears writePending
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [this]{return !writePending;});
+    buffer.swap(writeBuffer);
+    writePending = true;
+    cv.notify_all();
+}
+
+void SDDSWriter::WriterLoop()
+{
+    unique_lock<mutex> lock(mtx);
+    while(true)
+    {
+        cv.wait(lock, [this]{return writePending || stop;});
+        if(writePending)
+        {
+            lock.unlock();
+            fwrite(writeBuffer.data(), 1, writeBuffer.size(), file);
+            lock.lock();
+            writeBuffer.clear();
+            writePending = false;
+            cv.notify_all();
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+void SDDSWriter::Flush()
+{
+    if(file==NULL) return;
+
+    if(!buffer.empty()) HandOver();
+    unique_lock<mutex> lock(mtx);
+    cv.wait(lock, [this]{return !writePending;});
+    fflush(file);
+}
+
+void SDDSWriter::Close()
+{
+    if(file==NULL) return;
+
+    Flush();
+    {
+        lock_guard<mutex> lock(mtx);
+        stop = true;
+    }
+    cv.notify_all();
+    writer.join();
+
+    // short last page: the declared row count is replaced by the rows in the file. Not possible on a file opened
+    // for appending, the writes go to its end whatever the position.
+    if(pageRowsPos>=0 && pageRowsPut<pageRows && !append)
+    {
+        fseek(file, pageRowsPos, SEEK_SET);
+        buffer.clear();
+        PutRowCount(pageRowsPut);
+        fwrite(buffer.data(), 1, buffer.size(), file);
+        buffer.clear();
+    }
+    fclose(file);
+    file = NULL;
+
+    lock_guard<mutex> lock(openMtx);
+    openWriters.erase(this);
+}
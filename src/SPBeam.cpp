@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <iostream>
 #include <fftw3.h>
+#include "FFTWPlanCache.h"
 #include <time.h>
 #include <string>
 #include <cmath>
@@ -119,12 +120,28 @@ void SPBeam::Initial(Train &train, LatticeInterActionPoint &latticeInterActionPo
     // workQy = workQy - floor(workQy);
     // workQz = workQz - floor(workQz);
 
-    // only works for unifrom filling patterns setings.
+    // scan frequency j is evaluated as bin j of a bucket FFT (GetIQDecomp), which also holds for non-uniform filling patterns.
+    iqTwiddle.resize(3*totBunchNum);
     for(int i=0;i<totBunchNum;i++)
     {
         freXIQDecompScan[i] = (i + workQx) * f0;
         freYIQDecompScan[i] = (i + workQy) * f0;
         freZIQDecompScan[i] = (i + workQz) * f0;
+
+        iqTwiddle[i                ] = exp(- li * 2.0 * PI * workQx * double(beamVec[i].bunchHarmNum) / double(harmonics));
+        iqTwiddle[i +   totBunchNum] = exp(- li * 2.0 * PI * workQy * double(beamVec[i].bunchHarmNum) / double(harmonics));
+        iqTwiddle[i + 2*totBunchNum] = exp(- li * 2.0 * PI * workQz * double(beamVec[i].bunchHarmNum) / double(harmonics));
+    }
+
+    // GetCBMGR1 growth rate window, the samples the fit on the histories takes
+    int printInterval = inputParameter.ringRun->bunchInfoPrintInterval;
+    if(printInterval)
+    {
+        int fitStart = inputParameter.ringRun->growthRateFittingStart / printInterval * printInterval;
+        int fitEnd   = inputParameter.ringRun->growthRateFittingEnd   / printInterval * printInterval;
+        CBMIdealGRX.Initial(totBunchNum,fitStart,fitEnd);
+        CBMIdealGRY.Initial(totBunchNum,fitStart,fitEnd);
+        CBMIdealGRZ.Initial(totBunchNum,fitStart,fitEnd);
     }
     
     RMOutPutFiles();   
@@ -197,6 +214,7 @@ void SPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
 {
     // According the beam filling pattern, tracking from transient to get steady state Vb. Ref. Bill Chapter 7.4.2
     // The notatoion of Bill's book is the same in P.B.Wilson's Section 3. Slac Pub 6062  except li -> - li, the phase rotation oppsiste.
+    // rfResInitTransient=0: the same steady state in closed form, Resonator::GetPeriodicBeamInducedVol, O(bunches) per cavity.
 
     int resNum      = inputParameter.ringParRf->resNum;
     int ringHarmH   = inputParameter.ringParBasic->harmonics;
@@ -227,6 +245,7 @@ void SPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
 
     for(int i=0; i<resNum;i++)
     {
+        cavityResonator.resonatorVec[i].sampleAtNTrf = 1;         // SPBeamDataPrintPerTurn writes the samples of the bunch buckets
         // if(cavityResonator.resonatorVec[i].resRfMode==0) continue;
 
         tF     = cavityResonator.resonatorVec[i].tF  ;      // [s]
@@ -239,8 +258,24 @@ void SPBeam::InitialcavityResonator(ReadInputSettings &inputParameter,CavityReso
         vbKickAccum  =   complex<double>(0,0);              // get the accumme of  vb0/2
         vbKickAver[i] =  complex<double>(0,0);
         
+        if(!inputParameter.ringParRf->resInitTransient)
+        {
+            // one step per bunch, decay and rotate over its bunchGap
+            vector<complex<double> > stepVb0(beamVec.size()), stepExp(beamVec.size());
+            vector<int> stepNum(beamVec.size(),1);
+            for(int k=0;k<beamVec.size(); k++)
+            {
+                stepVb0[k] = complex<double>(-1 * cavityResonator.resonatorVec[i].resFre * 2 * PI * cavityResonator.resonatorVec[i].resShuntImpRs
+                                                /  cavityResonator.resonatorVec[i].resQualityQ0, 0.E0)
+                                                *  beamVec[k].electronNumPerBunch * ElectronCharge;
+                tB = beamVec[k].bunchGap * t0 / ringHarmH ;
+                stepExp[k] = complex<double>(-tB / tF, 2 * PI * cavityResonator.resonatorVec[i].resFre * tB);
+                vbKickAccum += stepVb0[k]/2.0 ;
+            }
+            vbAccumAver2 = Resonator::GetPeriodicBeamInducedVol(stepVb0,stepExp,stepNum,nTurns) * double(beamVec.size());   // sum over the bunches
+        }
 
-        for(int n=0;n<nTurns;n++)
+        for(int n=0;n<nTurns && inputParameter.ringParRf->resInitTransient;n++)
         {
             for(int k=0;k<beamVec.size(); k++)
             {
@@ -588,10 +623,11 @@ void SPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
 
     
     
-    // run loop starts, for nTrns and each trun for k interaction-points
-    for(int n=0;n<nTurns;n++)
-    {  
-      	double nux = inputParameter.ringParBasic->workQx - floor(inputParameter.ringParBasic->workQx); 
+    // the stages of one turn, chosen once from the flags. The turn-by-turn row opens the turn.
+    TrackingPipeline pipeline;
+    pipeline.Add("output",[&](int n)
+    {
+        double nux = inputParameter.ringParBasic->workQx - floor(inputParameter.ringParBasic->workQx); 
         double nuy = inputParameter.ringParBasic->workQy - floor(inputParameter.ringParBasic->workQy);
         fout<<n<<"  "
             <<setw(15)<<left<< latticeInterActionPoint.totIonCharge;
@@ -645,70 +681,16 @@ void SPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
                 <<setw(15)<<left<<beamVec[index].actionJy;
         
         }
-        fout<<endl; 
-        
-        
-        
-        // tracing started form here.
-        if(n%100==0) 
+        fout<<endl;
+        if(n%100==0) cout<<n<<"  turns"<<endl;
+        if(n%100==0 && !inputParameter.ringRun->runCBMGR.empty())
         {
-            cout<<n<<"  turns"<<endl;
+            GrowthRateEstimator::Report(CBMIdealGRX,CBMIdealGRY,CBMIdealGRZ,inputParameter.ringParBasic->t0);
         }
-        
-        if(beamIonFlag) 
-        {
-            
-            for (int k=0;k<inputParameter.ringIonEffPara->numberofIonBeamInterPoint;k++)
-            {
-                SPBeamRMSCal(latticeInterActionPoint, k);
-                WSBeamIonEffectOneInteractionPoint(inputParameter,latticeInterActionPoint, n, k);
-                BeamTransferPerInteractionPointDueToLatticeT(inputParameter,latticeInterActionPoint,k);  //transverse transfor per interaction point
-            }
-
-            if(ionInfoPrintInterval && (n%ionInfoPrintInterval==0))
-            {                
-                SPBeamRMSCal(latticeInterActionPoint, 0);
-                WSIonDataPrint(inputParameter,latticeInterActionPoint, n);
-            } 
-        }
-        else
-        {
-            SPBeamRMSCal(latticeInterActionPoint, 0);    
-            // BeamTransferPerTurnDueToLatticeT(latticeInterActionPoint);       // here use the one turn matrix with elegant apprpach     
-            // BeamTransferPerTurnDueToLatticeTOneTurnR66(inputParameter,latticeInterActionPoint);
-        	BeamTransferPerInteractionPointDueToLatticeT(inputParameter,latticeInterActionPoint,0);
-        }
-        
-        if(inputParameter.ringParBasic->skewQuadK!=0)
-        {
-        	BeamTransferDueToSkewQuad(inputParameter);
-        }
-   
-        SPBeamRMSCal(latticeInterActionPoint, 0);
-        // here tracking partilce in longitudinal due to the RF filed from cavity
-        // BeamMomentumUpdateDueToRF(inputParameter,latticeInterActionPoint,cavityResonator,n); 
-        BeamMomentumUpdateDueToRFTest(inputParameter,latticeInterActionPoint,cavityResonator,n);
-        BeamEnergyLossOneTurn(inputParameter); 
-        BeamLongiPosTransferOneTurn(inputParameter); 
-
-
-        // Subroutine in below only change the momentum 
-        if(lRWakeFlag) LRWakeBeamIntaction(inputParameter,lRWakeFunction,latticeInterActionPoint,n); 
-        
-        if((inputParameter.driveMode->driveModeOn!=0) && (inputParameter.driveMode->driveStart <n )  &&  (inputParameter.driveMode->driveEnd >n) )
-        {
-            BeamTransferDuetoDriveMode(inputParameter,n);
-        }   
-
-        if(synRadDampingFlag==1) BeamSynRadDamping(inputParameter,latticeInterActionPoint);
-       
-        if(rampFlag) ramping.RampingPara(inputParameter,latticeInterActionPoint,n);
-
-        SPBeamRMSCal(latticeInterActionPoint, 0);
-        if(fIRBunchByBunchFeedbackFlag)  FIRBunchByBunchFeedback(inputParameter,firFeedBack,n);
-        SPBeamRMSCal(latticeInterActionPoint, 0);
-        SPGetBeamInfo();
-                    
+    });
+    BuildPipeline(pipeline,inputParameter,latticeInterActionPoint,cavityResonator,ramping,firFeedBack,lRWakeFunction);
+    pipeline.Add("output",[&](int n)
+    {
         if(bunchInfoPrintInterval && (n%bunchInfoPrintInterval==0) )
         {      
             SPBeamDataPrintPerTurn(n,latticeInterActionPoint,inputParameter,cavityResonator);           
@@ -722,13 +704,24 @@ void SPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
                 GetCBMGR1(n,latticeInterActionPoint,inputParameter);  // only with ideal method to generate the coupled bunch mode growth rate.
             }
         }
+    });
+    pipeline.Add("particle loss",[&](int n){MarkParticleLostInBunch(inputParameter,latticeInterActionPoint);});
+    pipeline.Profile(inputParameter,nTurns);
 
-        MarkParticleLostInBunch(inputParameter,latticeInterActionPoint);
-  
-        // getchar();
+    // run loop starts, for nTrns and each trun for k interaction-points
+    for(int n=0;n<nTurns;n++)
+    {
+        pipeline.Run(n);
+
+        if(BeamLost())
+        {
+            cout<<"more than 50% particles of a bunch are lost, tracking stops at turn "<<n<<endl;
+            break;
+        }
     }
     fout.close();
     cout<<"End of Tracking "<<nTurns<< " Turns"<<endl;
+    pipeline.TimingReport();
        
     // after single particle tracking- with the RF data to get the Haissinski solution -- not a self-consistent process, since
     // the bunch centor shift due to the poten-well distortation from short wakes also affect the cavity voltage and phase.  
@@ -746,6 +739,75 @@ void SPBeam::Run(Train &train, LatticeInterActionPoint &latticeInterActionPoint,
 }
 
 
+void SPBeam::BuildPipeline(TrackingPipeline &pipeline, ReadInputSettings &inputParameter, LatticeInterActionPoint &latticeInterActionPoint,
+                           CavityResonator &cavityResonator, Ramping &ramping, FIRFeedBack &firFeedBack, WakeFunction &lRWakeFunction)
+{
+    // the turn of SPBeam::Run, stages that are off are not added
+    int synRadDampingFlag           = inputParameter.ringRun->synRadDampingFlag;
+    int fIRBunchByBunchFeedbackFlag = inputParameter.ringRun->fIRBunchByBunchFeedbackFlag;
+    int beamIonFlag                 = inputParameter.ringRun->beamIonFlag;
+    int lRWakeFlag                  = inputParameter.ringRun->lRWakeFlag;
+    int ionInfoPrintInterval        = inputParameter.ringIonEffPara->ionInfoPrintInterval;
+    int rampFlag                    = inputParameter.ringRun->rampFlag;
+
+    ReadInputSettings       &in  = inputParameter;
+    LatticeInterActionPoint &lat = latticeInterActionPoint;
+
+    if(beamIonFlag)
+    {
+        for(int k=0;k<inputParameter.ringIonEffPara->numberofIonBeamInterPoint;k++)
+        {
+            pipeline.Add("moments",[this,&lat,k](int n){SPBeamRMSCal(lat,k);});
+            pipeline.Add("beam-ion",[this,&in,&lat,k](int n){WSBeamIonEffectOneInteractionPoint(in,lat,n,k);});
+            //transverse transfor per interaction point
+            pipeline.Add("lattice map",[this,&in,&lat,k](int n){BeamTransferPerInteractionPointDueToLatticeT(in,lat,k);});
+        }
+        if(ionInfoPrintInterval)
+        {
+            pipeline.Add("ion output",[this,&in,&lat,ionInfoPrintInterval](int n)
+            {
+                if(n%ionInfoPrintInterval!=0) return;
+                SPBeamRMSCal(lat,0);
+                WSIonDataPrint(in,lat,n);
+            });
+        }
+    }
+    else
+    {
+        pipeline.Add("moments",[this,&lat](int n){SPBeamRMSCal(lat,0);});
+        pipeline.Add("lattice map",[this,&in,&lat](int n){BeamTransferPerInteractionPointDueToLatticeT(in,lat,0);});
+    }
+
+    if(inputParameter.ringParBasic->skewQuadK!=0 || (rampFlag && inputParameter.ramping->rampingSKQ!=0))
+    {
+        pipeline.Add("skew quadrupole",[this,&in](int n){if(in.ringParBasic->skewQuadK!=0) BeamTransferDueToSkewQuad(in);});
+    }
+
+    pipeline.Add("moments",[this,&lat](int n){SPBeamRMSCal(lat,0);});
+    // here tracking partilce in longitudinal due to the RF filed from cavity
+    pipeline.Add("RF",[this,&in,&lat,&cavityResonator](int n){BeamMomentumUpdateDueToRFTest(in,lat,cavityResonator,n);});
+    pipeline.Add("energy loss",[this,&in](int n){BeamEnergyLossOneTurn(in);});
+    pipeline.Add("longitudinal drift",[this,&in](int n){BeamLongiPosTransferOneTurn(in);});
+
+    // Subroutine in below only change the momentum
+    if(lRWakeFlag)
+        pipeline.Add("long range wake",[this,&in,&lat,&lRWakeFunction](int n){LRWakeBeamIntaction(in,lRWakeFunction,lat,n);});
+    if(inputParameter.driveMode->driveModeOn!=0)
+    {
+        pipeline.Add("drive mode",[this,&in](int n){if((in.driveMode->driveStart <n) && (in.driveMode->driveEnd >n)) BeamTransferDuetoDriveMode(in,n);});
+    }
+    if(synRadDampingFlag==1)
+        pipeline.Add("synchrotron radiation",[this,&in,&lat](int n){BeamSynRadDamping(in,lat);});
+    if(rampFlag)
+        pipeline.Add("ramping",[&in,&lat,&ramping](int n){ramping.RampingPara(in,lat,n);});
+
+    pipeline.Add("moments",[this,&lat](int n){SPBeamRMSCal(lat,0);});
+    if(fIRBunchByBunchFeedbackFlag)
+        pipeline.Add("FIR feedback",[this,&in,&firFeedBack](int n){FIRBunchByBunchFeedback(in,firFeedBack,n);});
+    pipeline.Add("moments",[this,&lat](int n){SPBeamRMSCal(lat,0); SPGetBeamInfo();});
+}
+
+
 
 void SPBeam::TuneRamping(ReadInputSettings &inputParameter,double n)
 {
@@ -816,6 +878,15 @@ void SPBeam::MarkParticleLostInBunch(const ReadInputSettings &inputParameter, co
     }
 }
 
+bool SPBeam::BeamLost() const
+{
+    for(int i=0;i<beamVec.size();i++)
+    {
+        if(beamVec[i].beamLost) return true;
+    }
+    return false;
+}
+
 
 void SPBeam::BeamTransferDuetoDriveMode(const ReadInputSettings &inputParameter, const int n)
 {     
@@ -1419,32 +1490,23 @@ void SPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
     vector<double> yIQArgOneTurn(beamVec.size());
     vector<double> zIQArgOneTurn(beamVec.size());
                 
-    for(int j=0;j<beamVec.size();j++)   // loop of mode index
+    vector<double > xOneTurn(beamVec.size());
+    vector<double > yOneTurn(beamVec.size());
+    vector<double > zOneTurn(beamVec.size());
+    for(int i=0;i<beamVec.size();i++)
     {
-        vector<complex<double> > xIQ(beamVec.size());
-        vector<complex<double> > yIQ(beamVec.size());
-        vector<complex<double> > zIQ(beamVec.size());
-        complex<double> xIQAver,yIQAver,zIQAver;
-        
-        double time = 0.0;
-        double phaseX,phaseY,phaseZ;
-                
-        for(int i=0;i<beamVec.size();i++)  // each mode, collect one turn data to get the mode amplitude
-        {
-            time =  beamVec[i].bunchHarmNum * tRF ;
-
-            phaseX = - 2.0 * PI * workQx * beamVec[i].bunchHarmNum / harmonics;
-            phaseY = - 2.0 * PI * workQy * beamVec[i].bunchHarmNum / harmonics;
-            phaseZ = - 2.0 * PI * workQz * beamVec[i].bunchHarmNum / harmonics;
-
-            xIQ[i] = beamVec[i].xAver  * exp( - li * 2.0 * PI * freXIQDecompScan[j] * time) ;
-            yIQ[i] = beamVec[i].yAver  * exp( - li * 2.0 * PI * freYIQDecompScan[j] * time) ;
-            zIQ[i] = beamVec[i].zAver  * exp( - li * 2.0 * PI * freZIQDecompScan[j] * time) ;            
-        }
+        xOneTurn[i] =  beamVec[i].xAver;
+        yOneTurn[i] =  beamVec[i].yAver;
+        zOneTurn[i] =  beamVec[i].zAver;
+    }
+    fftw_complex *iqFFT = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 3 * harmonics);
+    GetIQDecomp(xOneTurn,yOneTurn,zOneTurn,harmonics,iqFFT);
 
-        xIQAver =   accumulate(xIQ.begin(), xIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-        yIQAver =   accumulate(yIQ.begin(), yIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-        zIQAver =   accumulate(zIQ.begin(), zIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());       
+    for(int j=0;j<beamVec.size();j++)   // loop of mode index
+    {
+        complex<double> xIQAver = complex<double>(iqFFT[j              ][0], iqFFT[j              ][1]) / double(beamVec.size());
+        complex<double> yIQAver = complex<double>(iqFFT[j +   harmonics][0], iqFFT[j +   harmonics][1]) / double(beamVec.size());
+        complex<double> zIQAver = complex<double>(iqFFT[j + 2*harmonics][0], iqFFT[j + 2*harmonics][1]) / double(beamVec.size());
 
         xIQAmpOneTurn[j] = abs(xIQAver);
         yIQAmpOneTurn[j] = abs(yIQAver);
@@ -1454,6 +1516,7 @@ void SPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
         yIQArgOneTurn[j] = arg(yIQAver);
         zIQArgOneTurn[j] = arg(zIQAver);
     }
+    fftw_free(iqFFT);
 
     ampXIQ.push_back(xIQAmpOneTurn);
     ampYIQ.push_back(yIQAmpOneTurn);
@@ -1465,15 +1528,6 @@ void SPBeam::GetCBMGR(const int turns, const LatticeInterActionPoint &latticeInt
 
 
     //(3)  store beam position data for bunch-by-bunch Growth rate calculation,
-    vector<double > xOneTurn(beamVec.size());
-    vector<double > yOneTurn(beamVec.size());
-    vector<double > zOneTurn(beamVec.size());
-    for(int i=0;i<beamVec.size();i++)
-    {
-        xOneTurn[i] =  beamVec[i].xAver;
-        yOneTurn[i] =  beamVec[i].yAver;
-        zOneTurn[i] =  beamVec[i].zAver;
-    }
     historyAverX.push_back(xOneTurn);
     historyAverY.push_back(yOneTurn);
     historyAverZ.push_back(zOneTurn);
@@ -1683,12 +1737,18 @@ void SPBeam::GetCBMGR1(const int turns, const LatticeInterActionPoint &latticeIn
         pyOneTurn[i] =  beamVec[i].pyAver;
         pzOneTurn[i] =  beamVec[i].pzAver;
     }
-    historyAverX.push_back(xOneTurn);
-    historyAverY.push_back(yOneTurn);
-    historyAverZ.push_back(zOneTurn);
-    historyAverPX.push_back(pxOneTurn);
-    historyAverPY.push_back(pyOneTurn);
-    historyAverPZ.push_back(pzOneTurn);
+    if(inputParameter.ringRun->cbmHistory)
+    {
+        historyAverX.push_back(xOneTurn);
+        historyAverY.push_back(yOneTurn);
+        historyAverZ.push_back(zOneTurn);
+        historyAverPX.push_back(pxOneTurn);
+        historyAverPY.push_back(pyOneTurn);
+        historyAverPZ.push_back(pzOneTurn);
+    }
+
+    // ideal coupled bunch mode spectrum of this turn, its growth rates are fitted while tracking
+    SetIdealCoupledBunchModeData(turns,latticeInterActionPoint,inputParameter);
 
 
     if( (turns + inputParameter.ringRun->bunchInfoPrintInterval)  == inputParameter.ringRun->nTurns   )
@@ -1738,7 +1798,6 @@ void SPBeam::GetCBMGR1(const int turns, const LatticeInterActionPoint &latticeIn
         fout<<"&data mode=ascii &end"<<endl;          
 
    
-        SetIdealCoupledBunchModeData(latticeInterActionPoint,inputParameter);
         // SetHilbertCoupledBunchModeData(latticeInterActionPoint,inputParameter);  // can only produce the unstable coupled bunch mode 
         // SetIQCoupledBunchModeData(latticeInterActionPoint,inputParameter);       // can only produce the unstable coupled bunch mode
         
@@ -1752,15 +1811,15 @@ void SPBeam::GetCBMGR1(const int turns, const LatticeInterActionPoint &latticeIn
             fout<<setw(15)<<left<<dim<<endl;           
             fout<<setw(15)<<left<<i<<endl;
             fout<<setw(15)<<left<<beamVec[i].bunchHarmNum<<endl;
-            fout<<setw(15)<<left<<CBMIdealGRX[i] / inputParameter.ringParBasic->t0<<endl;
-            fout<<setw(15)<<left<<CBMIdealGRY[i] / inputParameter.ringParBasic->t0<<endl; 
-            fout<<setw(15)<<left<<CBMIdealGRZ[i] / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<CBMIdealGRX.GetRate(i) / inputParameter.ringParBasic->t0<<endl;
+            fout<<setw(15)<<left<<CBMIdealGRY.GetRate(i) / inputParameter.ringParBasic->t0<<endl; 
+            fout<<setw(15)<<left<<CBMIdealGRZ.GetRate(i) / inputParameter.ringParBasic->t0<<endl;
             // fout<<setw(15)<<left<<CBMHTGRX[i]    / inputParameter.ringParBasic->t0<<endl;
             // fout<<setw(15)<<left<<CBMHTGRY[i]    / inputParameter.ringParBasic->t0<<endl; 
             // fout<<setw(15)<<left<<CBMHTGRZ[i]    / inputParameter.ringParBasic->t0<<endl; 
-            fout<<dim<<endl;
+            fout<<coupledBunchModeAmpX.size()<<endl;           // dim, 0 without runCBMHistory
 
-            for(int n=0;n<dim; n++)   
+            for(int n=0;n<coupledBunchModeAmpX.size(); n++)   
             {
                 fout<<setw(15)<<left<<n * inputParameter.ringRun->bunchInfoPrintInterval
                     <<setw(15)<<left<<coupledBunchModeAmpX[n][i]
@@ -1821,36 +1880,17 @@ void SPBeam:: SetIQCoupledBunchModeData(const LatticeInterActionPoint &latticeIn
     vector<double> zIQArgOneTurn(beamVec.size());
 
 
+    fftw_complex *iqFFT = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 3 * harmonics);
+
     for(int n=0;n<dim;n++)
     {
+        GetIQDecomp(historyAverX[n+indexStart],historyAverY[n+indexStart],historyAverZ[n+indexStart],harmonics,iqFFT);
+
         for(int i=0;i<beamVec.size();i++)   //loop of mode
         {
-            vector<complex<double> > xIQ(beamVec.size());
-            vector<complex<double> > yIQ(beamVec.size());
-            vector<complex<double> > zIQ(beamVec.size());
-            complex<double> xIQAver,yIQAver,zIQAver;
-            
-            for(int j=0;j<beamVec.size();j++) // nth turn ith mode
-            {
-                double time = beamVec[j].bunchHarmNum * tRF;
-                double x  =  historyAverX[n+indexStart][j];
-                double y  =  historyAverY[n+indexStart][j];
-                double z  =  historyAverZ[n+indexStart][j];
-                
-                double phasex = 2.0 * PI * freXIQDecompScan[i] * time;
-                double phasey = 2.0 * PI * freYIQDecompScan[i] * time;
-                double phasez = 2.0 * PI * freZIQDecompScan[i] * time;
-
-                xIQ[j] = x * exp( - li * phasex);
-                yIQ[j] = y * exp( - li * phasey);
-                zIQ[j] = z * exp( - li * phasez);         
-
-            }
-            
-            
-            xIQAver =   accumulate(xIQ.begin(), xIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-            yIQAver =   accumulate(yIQ.begin(), yIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());
-            zIQAver =   accumulate(zIQ.begin(), zIQ.end(), complex<double>(0.0,0.0) ) / double(beamVec.size());  
+            complex<double> xIQAver = complex<double>(iqFFT[i              ][0], iqFFT[i              ][1]) / double(beamVec.size());
+            complex<double> yIQAver = complex<double>(iqFFT[i +   harmonics][0], iqFFT[i +   harmonics][1]) / double(beamVec.size());
+            complex<double> zIQAver = complex<double>(iqFFT[i + 2*harmonics][0], iqFFT[i + 2*harmonics][1]) / double(beamVec.size());
 
             xIQAmpOneTurn[i] = abs(xIQAver);
             yIQAmpOneTurn[i] = abs(yIQAver);
@@ -1859,13 +1899,13 @@ void SPBeam:: SetIQCoupledBunchModeData(const LatticeInterActionPoint &latticeIn
             xIQArgOneTurn[i] = arg(xIQAver);
             yIQArgOneTurn[i] = arg(yIQAver);
             zIQArgOneTurn[i] = arg(zIQAver);
-
         }
 
         ampXIQ.push_back(xIQAmpOneTurn);
         ampYIQ.push_back(yIQAmpOneTurn);
         ampZIQ.push_back(zIQAmpOneTurn);
     }
+    fftw_free(iqFFT);
 
     //IQ decomposition --------------------------------
 
@@ -1898,7 +1938,28 @@ void SPBeam:: SetIQCoupledBunchModeData(const LatticeInterActionPoint &latticeIn
 }
 
 
-void SPBeam::SetIdealCoupledBunchModeData(const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter)
+void SPBeam::GetIQDecomp(const vector<double> &x, const vector<double> &y, const vector<double> &z, int harmonics, fftw_complex *iq)
+{
+    // IQ decomposition at all scan frequencies (j + Q) f0 at once, see MPBeam::GetIQDecomp.
+    // iq holds 3 * harmonics values (x y z), bin j of each plane is scan frequency j.
+    int nBunch = beamVec.size();
+    const vector<double> *pos[3] = {&x, &y, &z};
+
+    memset(iq, 0, sizeof(fftw_complex) * 3 * harmonics);
+    for(int p=0;p<3;p++)
+    {
+        for(int i=0;i<nBunch;i++)
+        {
+            complex<double> v = (*pos[p])[i] * iqTwiddle[p*nBunch + i];
+            int h = p*harmonics + beamVec[i].bunchHarmNum;
+            iq[h][0] = v.real();
+            iq[h][1] = v.imag();
+        }
+    }
+    fftw_execute_dft(FFTWPlanCache::GetPlanDFTMany(harmonics,3), iq, iq);
+}
+
+void SPBeam::SetIdealCoupledBunchModeData(const int turns, const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter)
 {
     double alphax = latticeInterActionPoint.twissAlphaX[0];
     double betax  = latticeInterActionPoint.twissBetaX [0];
@@ -1910,71 +1971,74 @@ void SPBeam::SetIdealCoupledBunchModeData(const LatticeInterActionPoint &lattice
     double workQy = inputParameter.ringParBasic->workQy;
     double workQz = inputParameter.ringParBasic->workQz;
     int harmonics = inputParameter.ringParBasic->harmonics;
-    double tRF    = inputParameter.ringParBasic->t0 / harmonics; 
     int nBins = beamVec.size();
 
-    int indexStart =  int(inputParameter.ringRun->growthRateFittingStart / inputParameter.ringRun->bunchInfoPrintInterval);
-    int indexEnd   =  int(inputParameter.ringRun->growthRateFittingEnd   / inputParameter.ringRun->bunchInfoPrintInterval);  
-    int dim        =  indexEnd - indexStart ;
+    int printInterval = inputParameter.ringRun->bunchInfoPrintInterval;
+    int indexStart =  int(inputParameter.ringRun->growthRateFittingStart / printInterval);
+    int indexEnd   =  int(inputParameter.ringRun->growthRateFittingEnd   / printInterval);  
         
-    fftw_complex *c2cxin   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins ); 
-    fftw_complex *c2cyin   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins );
-    fftw_complex *c2czin   = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins );    
-	fftw_complex *c2cxout  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins );    
-	fftw_complex *c2cyout  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins );      
-	fftw_complex *c2czout  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * nBins );   
-    fftw_plan p;
+    // x y z transformed in place by one cached batched plan
+    fftw_complex *modeFFT  = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * 3 * nBins );
+    fftw_complex *c2cxout  = modeFFT;
+    fftw_complex *c2cyout  = modeFFT +   nBins;
+    fftw_complex *c2czout  = modeFFT + 2*nBins;
+    fftw_plan p = FFTWPlanCache::GetPlanDFTMany(nBins,3);
 
     // (1) IPAC 2022 WEPOMS010 -- Diamond-II -- WangSiWei's IPAC paper. Turn-by-turn mode 
-    
-    for(int n=0;n<dim;n++)
+    for (int i=0;i<beamVec.size();i++)
     {
-        for (int i=0;i<beamVec.size();i++)
-        {
-            double x  =  historyAverX[n+indexStart][i];
-            double y  =  historyAverY[n+indexStart][i];
-            double z  =  historyAverZ[n+indexStart][i]; 
-            
-            double px =  historyAverPX[n+indexStart][i];
-            double py =  historyAverPY[n+indexStart][i];
-            double pz =  historyAverPZ[n+indexStart][i];
-
-            // transverse is clockwise rotation from ith bunch to  bpm position
-            // re-distribution bunch position along the ring in one turn
-            double phasex = - 2.0 * PI * workQx * beamVec[i].bunchHarmNum / harmonics;
-            double phasey = - 2.0 * PI * workQy * beamVec[i].bunchHarmNum / harmonics;
-            double phasez = - 2.0 * PI * workQz * beamVec[i].bunchHarmNum / harmonics;
-            
-            complex<double> zx = ( x / sqrt(betax) - li * ( sqrt(betax) * px + alphax / sqrt(betax) * x ) ) * exp (li * phasex);
-            complex<double> zy = ( y / sqrt(betay) - li * ( sqrt(betay) * py + alphay / sqrt(betay) * y ) ) * exp (li * phasey); 
-            complex<double> zz = ( z / sqrt(betaz) + li * ( sqrt(betaz) * pz + alphaz / sqrt(betaz) * z ) ) * exp (li * phasez);  
-            
-            c2cxin[i][0] = zx.real(); c2cxin[i][1] = zx.imag();
-            c2cyin[i][0] = zy.real(); c2cyin[i][1] = zy.imag();
-            c2czin[i][0] = zz.real(); c2czin[i][1] = zz.imag();
-        }
+        double x  =  beamVec[i].xAver;
+        double y  =  beamVec[i].yAver;
+        double z  =  beamVec[i].zAver; 
         
-        p = fftw_plan_dft_1d(nBins, c2cxin, c2cxout, FFTW_FORWARD, FFTW_ESTIMATE);     fftw_execute(p);
-        p = fftw_plan_dft_1d(nBins, c2cyin, c2cyout, FFTW_FORWARD, FFTW_ESTIMATE);     fftw_execute(p);
-        p = fftw_plan_dft_1d(nBins, c2czin, c2czout, FFTW_FORWARD, FFTW_ESTIMATE);     fftw_execute(p);
+        double px =  beamVec[i].pxAver;
+        double py =  beamVec[i].pyAver;
+        double pz =  beamVec[i].pzAver;
+
+        // transverse is clockwise rotation from ith bunch to  bpm position
+        // re-distribution bunch position along the ring in one turn
+        double phasex = - 2.0 * PI * workQx * beamVec[i].bunchHarmNum / harmonics;
+        double phasey = - 2.0 * PI * workQy * beamVec[i].bunchHarmNum / harmonics;
+        double phasez = - 2.0 * PI * workQz * beamVec[i].bunchHarmNum / harmonics;
+        
+        complex<double> zx = ( x / sqrt(betax) - li * ( sqrt(betax) * px + alphax / sqrt(betax) * x ) ) * exp (li * phasex);
+        complex<double> zy = ( y / sqrt(betay) - li * ( sqrt(betay) * py + alphay / sqrt(betay) * y ) ) * exp (li * phasey); 
+        complex<double> zz = ( z / sqrt(betaz) + li * ( sqrt(betaz) * pz + alphaz / sqrt(betaz) * z ) ) * exp (li * phasez);  
+        
+        c2cxout[i][0] = zx.real(); c2cxout[i][1] = zx.imag();
+        c2cyout[i][0] = zy.real(); c2cyout[i][1] = zy.imag();
+        c2czout[i][0] = zz.real(); c2czout[i][1] = zz.imag();
+    }
+    
+    fftw_execute_dft(p, modeFFT, modeFFT);
 
-        vector<double> tempXFFTAmp(beamVec.size());
-        vector<double> tempYFFTAmp(beamVec.size());
-        vector<double> tempZFFTAmp(beamVec.size());
-        vector<double> tempXFFTArg(beamVec.size());
-        vector<double> tempYFFTArg(beamVec.size());
-        vector<double> tempZFFTArg(beamVec.size());
+    vector<double> tempXFFTAmp(beamVec.size());
+    vector<double> tempYFFTAmp(beamVec.size());
+    vector<double> tempZFFTAmp(beamVec.size());
+    vector<double> tempXFFTArg(beamVec.size());
+    vector<double> tempYFFTArg(beamVec.size());
+    vector<double> tempZFFTArg(beamVec.size());
 
-        for (int i=0;i<beamVec.size();i++)
-        {
-            tempXFFTAmp[i] = sqrt( pow(c2cxout[i][0],2) + pow(c2cxout[i][1],2) );
-            tempYFFTAmp[i] = sqrt( pow(c2cyout[i][0],2) + pow(c2cyout[i][1],2) );
-            tempZFFTAmp[i] = sqrt( pow(c2czout[i][0],2) + pow(c2czout[i][1],2) );
-            tempXFFTArg[i] = atan2(c2cxout[i][1], c2cxout[i][0]);
-            tempYFFTArg[i] = atan2(c2cyout[i][1], c2cyout[i][0]);
-            tempZFFTArg[i] = atan2(c2czout[i][1], c2czout[i][0]);
-        }
+    for (int i=0;i<beamVec.size();i++)
+    {
+        tempXFFTAmp[i] = sqrt( pow(c2cxout[i][0],2) + pow(c2cxout[i][1],2) );
+        tempYFFTAmp[i] = sqrt( pow(c2cyout[i][0],2) + pow(c2cyout[i][1],2) );
+        tempZFFTAmp[i] = sqrt( pow(c2czout[i][0],2) + pow(c2czout[i][1],2) );
+        tempXFFTArg[i] = atan2(c2cxout[i][1], c2cxout[i][0]);
+        tempYFFTArg[i] = atan2(c2cyout[i][1], c2cyout[i][0]);
+        tempZFFTArg[i] = atan2(c2czout[i][1], c2czout[i][0]);
+    }
+    fftw_free(modeFFT);
 
+    // growth rates: log(amp) fitted sample by sample over the runGrowthRateFitting window
+    CBMIdealGRX.Add(turns,tempXFFTAmp);
+    CBMIdealGRY.Add(turns,tempYFFTAmp);
+    CBMIdealGRZ.Add(turns,tempZFFTAmp);
+
+    // the window samples are written as rows of runCBMGR
+    int index = turns / printInterval;
+    if(inputParameter.ringRun->cbmHistory && index >= indexStart && index < indexEnd)
+    {
         coupledBunchModeAmpX.push_back(tempXFFTAmp);
         coupledBunchModeAmpY.push_back(tempYFFTAmp);
         coupledBunchModeAmpZ.push_back(tempZFFTAmp);
@@ -1982,46 +2046,8 @@ void SPBeam::SetIdealCoupledBunchModeData(const LatticeInterActionPoint &lattice
         coupledBunchModeArgY.push_back(tempYFFTArg);
         coupledBunchModeArgZ.push_back(tempZFFTArg);
     }
-   
-    fftw_free(c2cxout);     fftw_free(c2cxin);   
-    fftw_free(c2cyout);     fftw_free(c2cyin);
-    fftw_free(c2czout);     fftw_free(c2czin);
-    fftw_destroy_plan(p);
-
-
-
-    double fitWeight[dim];
-    double fitX[dim];
-    double fitFFTX[dim],  fitFFTY[dim],  fitFFTZ[dim];
-    vector<double> resFitFFTX(2,0.E0), resFitFFTY(2,0.E0), resFitFFTZ(2,0.E0);
-    FittingGSL fittingGSL; 
-
-    for(int i=0; i<beamVec.size(); i++)    // loop for mode index
-    {
-        for(int n=0;n<dim;n++)
-        {                
-            fitWeight[n]            = 1.E0;
-            fitX[n]                 = n * inputParameter.ringRun->bunchInfoPrintInterval;
-            fitFFTX[n]              = log(coupledBunchModeAmpX[n][i]);
-            fitFFTY[n]              = log(coupledBunchModeAmpY[n][i]);
-            fitFFTZ[n]              = log(coupledBunchModeAmpZ[n][i]);
-        }
-
-        // fitting only with certain turns specified by users
-
-        resFitFFTX        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTX,dim);
-        resFitFFTY        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTY,dim);   
-        resFitFFTZ        = fittingGSL.FitALinear(fitX,fitWeight,fitFFTZ,dim);    
-
-        CBMIdealGRX.push_back(resFitFFTX[1]);
-        CBMIdealGRY.push_back(resFitFFTY[1]);
-        CBMIdealGRZ.push_back(resFitFFTZ[1]);
-    }
 }
 
-
-
-
 void SPBeam::SetHilbertCoupledBunchModeData(const LatticeInterActionPoint &latticeInterActionPoint, const ReadInputSettings &inputParameter)
 {
     double alphax = latticeInterActionPoint.twissAlphaX[0];
@@ -2643,14 +2669,9 @@ void SPBeam::BeamMomentumUpdateDueToRFTest(ReadInputSettings &inputParameter,Lat
                 // particle momentum update
                 beamVec[i].BunchMomentumUpdateDueToRFMode(inputParameter,cavityResonator.resonatorVec[j],j);
                 
-                // cavity dynamics, it also store the cavity voltage sampled by beam at n*Trf, when n=0,1,2,...,harmonics, prepare for cavity feedbackes
-                for (int k=0;k<beamVec[i].bunchGap;k++)
-                {
-                    int harmonicIndex = beamVec[i].bunchHarmNum + k;
-                    double dt = k * tRF - (- beamVec[i].zAver / CLight );
-                    cavityResonator.resonatorVec[j].GetResonatorInfoAtNTrf(harmonicIndex,dt);
-                    cavityResonator.resonatorVec[j].ResonatorDynamics(tRF);   // cavity is updated by tRF
-                }
+                // cavity dynamics, it also store the cavity voltage sampled by beam at the bunch bucket, prepare for cavity feedbackes
+                double dt = - (- beamVec[i].zAver / CLight );
+                cavityResonator.resonatorVec[j].AdvanceBuckets(beamVec[i].bunchHarmNum,beamVec[i].bunchGap,tRF,dt);
                
                 // resonator beamInduced voltage updated till next bunch -- also control condition for instability excitation
                 if(cavityResonator.resonatorVec[j].resExciteIntability!=0)
@@ -2756,7 +2777,7 @@ void SPBeam::WSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
             fout<<"SDDS1"<<endl;
             fout<<"&parameter name=totIonCharge, units=e, type=float,  &end"<<endl;
             fout<<"&parameter name=turns,                 type=long,   &end"<<endl;             
-            for(int p=0;p<latticeInterActionPoint.ionAccumuPositionX[k].size();p++)
+            for(int p=0;p<latticeInterActionPoint.ionAccumu[k].size();p++)
             {
                 string col= string("&parameter name=") + string("numOfMacroIon_") + to_string(p) + string(",  type=long,  &end");   
                 fout<<col<<endl;
@@ -2777,9 +2798,9 @@ void SPBeam::WSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
         fout<<"! page number "<<nTurns * numberOfInteraction + k + 1 <<endl;
         fout<<latticeInterActionPoint.totIonCharge<<endl;
         fout<<nTurns<<endl;
-        for(int p=0;p<latticeInterActionPoint.ionAccumuPositionX[k].size();p++)
+        for(int p=0;p<latticeInterActionPoint.ionAccumu[k].size();p++)
         {
-            fout<<latticeInterActionPoint.ionAccumuPositionX[k][p].size()<<endl;            
+            fout<<latticeInterActionPoint.ionAccumu[k][p].x.size()<<endl;            
         }
 
         fout<<latticeInterActionPoint.totMacroIonsAtInterPoint[k]<<endl;        
@@ -2789,12 +2810,12 @@ void SPBeam::WSIonDataPrint(ReadInputSettings &inputParameter,LatticeInterAction
             {
                 fout<<setw(15)<<left<<latticeInterActionPoint.ionMassNumber[p]
                     <<setw(15)<<left<<latticeInterActionPoint.macroIonCharge[k][p]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuPositionX[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuPositionY[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuVelocityX[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuVelocityY[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuFx[k][p][i]
-                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumuFy[k][p][i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].x[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].y[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].vx[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].vy[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].fx[i]
+                    <<setw(15)<<left<<latticeInterActionPoint.ionAccumu[k][p].fy[i]
                     <<endl;
             }
         }
@@ -3058,120 +3079,102 @@ void SPBeam::LRWakeBeamIntaction(const  ReadInputSettings &inputParameter, WakeF
     int harmonics               = inputParameter.ringParBasic->harmonics;
     double electronBeamEnergy   = inputParameter.ringParBasic->electronBeamEnergy;
     double rBeta                = inputParameter.ringParBasic->rBeta;
-
-    int ringHarmH     = inputParameter.ringParRf->ringHarm;
-    double circRing   = inputParameter.ringParBasic->circRing;
+    double t0                   = inputParameter.ringParBasic->t0;
 
 
-    // prepare bunch center position of the previous turns
-    vector<double> posxDataTemp(beamVec.size());
-    vector<double> posyDataTemp(beamVec.size());
-    vector<double> poszDataTemp(beamVec.size());
-    // current turn position
+    // current turn position goes to the head of the ring buffer, [LRWakeHistIndex(n)] stores pos[-n]
+    wakefunction.LRWakeHistPush();
+    int head = wakefunction.lrwHistHead;
     for(int i=0;i<beamVec.size();i++)
     {
-        posxDataTemp[i] = beamVec[i].xAver;
-        posyDataTemp[i] = beamVec[i].yAver;
-        poszDataTemp[i] = beamVec[i].zAver;
+        wakefunction.posxData[head][i] = beamVec[i].xAver;
+        wakefunction.posyData[head][i] = beamVec[i].yAver;
+        wakefunction.poszData[head][i] = beamVec[i].zAver;
     }
 
-    // [0,nTurnswakeTrunction] stores [pos[-nTurnswakeTrunction],pos[0]] 
-    wakefunction.posxData.erase(wakefunction.posxData.begin());
-    wakefunction.posyData.erase(wakefunction.posyData.begin());
-    wakefunction.poszData.erase(wakefunction.poszData.begin());
-
-    wakefunction.posxData.push_back(posxDataTemp);
-    wakefunction.posyData.push_back(posyDataTemp);
-    wakefunction.poszData.push_back(poszDataTemp);
-
-    vector<double> wakeForceTemp(3,0);
-    vector<double> wakeStasticForceTemp(3,0);
+    double wakeForceTemp[3];
 
     double tauij=0.e0;
     double tauijStastic=0.e0;
     int nTauij=0;
-    double deltaZij=0;
     double deltaTij=0;
-    double tRF   = inputParameter.ringParBasic->t0 / double(harmonics);
-    double rfLen = circRing  / ringHarmH;
+    double tRF   = t0 / double(harmonics);
 
-    int tempIndex0,tempIndex1;
+    int tempIndex0,tempIndex1,hist;
 
-    // bunch j in the wittness particle during the simulation
     for (int j=0;j<beamVec.size();j++)
     {
         beamVec[j].lRWakeForceAver[0] =0.E0;      // x rad
         beamVec[j].lRWakeForceAver[1] =0.E0;      // y rad
         beamVec[j].lRWakeForceAver[2] =0.E0;      // z rad
-        
-        for(int n=0;n<nTurnswakeTrunction;n++)
+    }
+
+    // (1) BBR modes: phasors propagated from bunch to bunch in passage order (beamVec is sorted in bunchHarmNum), O(Nb * Nmodes).
+    if(wakefunction.lrwRecursion)
+    {
+        wakefunction.lrwTime -= t0;        // time origin moves to the start of this turn
+        for (int j=0;j<beamVec.size();j++)
         {
-            // self-interation of bunch in current turn is excluded if tempIndex1 = j - 1, when n=0.             
-            if(n==0)
-            {
-                tempIndex0   = 0;
-                tempIndex1   = j - 1;
-            }
-            else if (n==nTurnswakeTrunction-1)
-            {
-                tempIndex0   = j;
-                tempIndex1   = beamVec.size()-1;
-            }
-            else
-            {
-                tempIndex0   = 0;
-                tempIndex1   = beamVec.size()-1;
-            }
-            // bunch i in the leadng particle in previous turn during the simulation --Alex eq.4.3
-            //  Tij =  nij * Trf + (deltaT_j - deltaT_i)
-            //      =  nij * Trf - (deltaZ_j - deltaZ_i) / c 
-            //      =  nij * Trf - (deltaZ_j - deltaZ_i) / c
-            
-            // finnally  -Tij  is applied in the wake-force subroutine.
-            // -Tij =  - nij * Trf + (deltaZ_j - deltaZ_i) / c
+            double tj = beamVec[j].bunchHarmNum * tRF - beamVec[j].zAver / CLight / rBeta;
+            wakefunction.LRWakeRecursion(tj,beamVec[j].electronNumPerBunch,beamVec[j].xAver,beamVec[j].yAver,wakeForceTemp);
+            beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0];
+            beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1];
+            beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2];
+        }
+    }
 
-            for(int i=tempIndex0;i<=tempIndex1;i++)
-            {                 
-                nTauij   = beamVec[i].bunchHarmNum - beamVec[j].bunchHarmNum - n * harmonics;
-                tauijStastic = nTauij * tRF;
-                
-                deltaTij = (beamVec[j].zAver -  wakefunction.poszData[nTurnswakeTrunction-1-n][i]) / CLight / rBeta;
-                tauij    = tauijStastic  + deltaTij;   
+    // (2) tabulated wake summed over the truncated history, only the RW part when the BBR modes go through (1)
+    // bunch j in the wittness particle during the simulation
+    if(!wakefunction.lrwRecursion || !inputParameter.ringLRWake->pipeGeoInput.empty())
+    {
+        for (int j=0;j<beamVec.size();j++)
+        {
+            for(int n=0;n<nTurnswakeTrunction;n++)
+            {
+                // self-interation of bunch in current turn is excluded if tempIndex1 = j - 1, when n=0.             
+                if(n==0)
+                {
+                    tempIndex0   = 0;
+                    tempIndex1   = j - 1;
+                }
+                else if (n==nTurnswakeTrunction-1)
+                {
+                    tempIndex0   = j;
+                    tempIndex1   = beamVec.size()-1;
+                }
+                else
+                {
+                    tempIndex0   = 0;
+                    tempIndex1   = beamVec.size()-1;
+                }
+                // bunch i in the leadng particle in previous turn during the simulation --Alex eq.4.3
+                //  Tij =  nij * Trf + (deltaT_j - deltaT_i)
+                //      =  nij * Trf - (deltaZ_j - deltaZ_i) / c 
                 
-                wakeForceTemp = wakefunction.GetTotLRWakeLinearFit(tauij);
-                beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i] ;  
-                beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i] ;
-                beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;            
-
-
-                // notification: 
-                // ensure the wakefucntion return the focusing strength in transverse and energy loss in longitudinal. 
-                // then: beamVec[j].lRWakeForceAver[?] -=  mins here.   
-
-                // if(!inputParameter.ringLRWake->pipeGeoInput.empty())
-                // {                                       
-                //     wakeForceTemp = wakefunction.GetRWLRWakeFun(tauij); 
-                //     beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                //     beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                //     beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch;                                                       //[V/C]         ->  [V/C]                    
-                // }
-
-                // if(!inputParameter.ringLRWake->bbrInput.empty())
-                // {
-                //     wakeForceTemp = wakefunction.GetBBRWakeFun(tauij);                                       
-                //     beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]
-                //     beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[nTurnswakeTrunction-1-n][i];    //[V/C/m] * [m] ->  [V/C]                   
-                //     beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch; 
-                //     // to subsctract the "stastic term -- only when coupled bunch modes"
-                //     // wakeStasticForceTemp = wakefunction.GetBBRWakeFun(tauijStastic);
-                //     // beamVec[j].lRWakeForceAver[2] -= (wakeForceTemp[2] - wakeStasticForceTemp[2]) * beamVec[i].electronNumPerBunch;                                                        //[V/C]         ->  [V/C]                
-                // }
+                // finnally  -Tij  is applied in the wake-force subroutine.
+                // -Tij =  - nij * Trf + (deltaZ_j - deltaZ_i) / c
 
-            
-            }   
+                hist = wakefunction.LRWakeHistIndex(n);
+
+                for(int i=tempIndex0;i<=tempIndex1;i++)
+                {                 
+                    nTauij   = beamVec[i].bunchHarmNum - beamVec[j].bunchHarmNum - n * harmonics;
+                    tauijStastic = nTauij * tRF;
+                    
+                    deltaTij = (beamVec[j].zAver -  wakefunction.poszData[hist][i]) / CLight / rBeta;
+                    tauij    = tauijStastic  + deltaTij;   
+                    
+                    wakefunction.GetTotLRWakeLinearFit(tauij,wakeForceTemp);
+                    beamVec[j].lRWakeForceAver[0] -= wakeForceTemp[0] * beamVec[i].electronNumPerBunch * wakefunction.posxData[hist][i] ;  
+                    beamVec[j].lRWakeForceAver[1] -= wakeForceTemp[1] * beamVec[i].electronNumPerBunch * wakefunction.posyData[hist][i] ;
+                    beamVec[j].lRWakeForceAver[2] -= wakeForceTemp[2] * beamVec[i].electronNumPerBunch ;            
+                }   
+            }
         }
-        
+    }
 
+    for (int j=0;j<beamVec.size();j++)
+    {
         beamVec[j].lRWakeForceAver[0] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
         beamVec[j].lRWakeForceAver[1] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
         beamVec[j].lRWakeForceAver[2] *=  ElectronCharge / electronBeamEnergy / pow(rBeta,2);   // [V/C] * [C] * [1e] / [eV] ->rad
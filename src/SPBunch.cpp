@@ -10,6 +10,7 @@
 #include "SPBunch.h"
 #include "Global.h"
 #include "Faddeeva.h"
+#include "BassettiErskineField.h"
 #include "WakeFunction.h"
 #include "Spline.h"
 #include <stdlib.h>
@@ -49,9 +50,7 @@ void SPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
 {
     // single particle always located at (0,0,0,0,0,0), Dis errors are defined by input
  
-    std::random_device rd{};
-    std::mt19937 gen{rd()};
-    std::normal_distribution<> doffset{0,1};
+    rndGen.Seed(RandomStream::BUNCH, bunchIndex);
 
     double initialStaticOffSet[6];
     double initialDynamicOffSet[6];
@@ -62,38 +61,37 @@ void SPBunch::DistriGenerator(const LatticeInterActionPoint &latticeInterActionP
        initialDynamicOffSet[i]  = inputParameter.ringBunchPara->initialDynamicOffSet[i];       
     }
 
-    srand(time(0)+bunchIndex);
     
     double temp;
     double disDx,disDy,disDz,disMx,disMy,disMz;
     
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disDx = temp * initialDynamicOffSet[0] + initialStaticOffSet[0];
     }while(temp>3); 
     
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disDy = temp * initialDynamicOffSet[1] + initialStaticOffSet[1];
     }while(temp>3); 
 
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disDz = temp * initialDynamicOffSet[2] + initialStaticOffSet[2];
     }while(temp>3);         
     
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disMx = temp * initialDynamicOffSet[3] + initialStaticOffSet[3];
     }while(temp>3);
     
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disMy = temp * initialDynamicOffSet[4] + initialStaticOffSet[4];
     }while(temp>3);
     
     do{
-        temp  = doffset(gen);            
+        temp  = rndGen.Normal();            
         disMz = temp * initialDynamicOffSet[5] + initialStaticOffSet[5];
     }while(temp>3);
     
@@ -161,16 +159,12 @@ void SPBunch::WSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionP
     double nE0 = electronNumPerBunch;
     double nI0;
     double ionMassNumber;
-    double omegaE, omegaI;
     double coeffI, coeffE;
-    double tempFx=0.E0;
-    double tempFy=0.E0;
-    double posx=0.E0;
-    double posy=0.E0;
     double rmsRxTemp = rmsRx;
     double rmsRyTemp = rmsRy;
     double eFxTemp;
     double eFyTemp;
+    vector<double> posx, posy, tempFx, tempFy;
 
     eFxDueToIon[0] =0.E0;
     eFyDueToIon[0] =0.E0;
@@ -186,40 +180,29 @@ void SPBunch::WSIonBunchInteraction(LatticeInterActionPoint &latticeInterActionP
         coeffI = 2.0*nE0*ElecClassicRadius*ElectronMassEV/IonMassEV/ionMassNumber * CLight;   // [m * m/s]
         coeffE = 2.0*ElecClassicRadius/rGamma;                                                // [m]
 
-        for(int j=0;j<latticeInterActionPoint.ionAccumuNumber[k][p];j++)
+        LatticeInterActionPoint::IonStore &ion = latticeInterActionPoint.ionAccumu[k][p];
+        int ionNum = latticeInterActionPoint.ionAccumuNumber[k][p];
+        posx.resize(ionNum);
+        posy.resize(ionNum);
+        tempFx.resize(ionNum);
+        tempFy.resize(ionNum);
+
+        for(int j=0;j<ionNum;j++)
+        {
+            posx[j] = ion.x[j] - xAver;
+            posy[j] = ion.y[j] - yAver;
+        }
+
+        // assume electron rms as gaussion-- get force at ion position, tempFx ->[1/m]
+        BassettiErskineField::Field(ionNum,posx.data(),posy.data(),rmsRxTemp,rmsRyTemp,tempFx.data(),tempFy.data());
+
+        for(int j=0;j<ionNum;j++)
         {
-            latticeInterActionPoint.ionAccumuFx[k][p][j]=0.E0;
-            latticeInterActionPoint.ionAccumuFy[k][p][j]=0.E0;
-
-            posx    =  latticeInterActionPoint.ionAccumuPositionX[k][p][j] - xAver;
-            posy    =  latticeInterActionPoint.ionAccumuPositionY[k][p][j] - yAver;
-
-            if(abs(posx/rmsRxTemp) + abs(posy/rmsRyTemp)<1.0E-5)
-            {
-                tempFx=0;
-                tempFy=0;
-            }
-            else
-            {
-                if( (rmsRxTemp - rmsRyTemp)/rmsRyTemp > 1.e-4 )
-                {
-                    BassettiErskine1(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);         // tempFx ->[1/m]; // assume electron rms as gaussion-- get force at ion position
-                }
-                else if ( (rmsRxTemp - rmsRyTemp)/rmsRyTemp < -1.e-4  )
-                {
-                    BassettiErskine1(posy,posx,rmsRyTemp,rmsRxTemp,tempFy,tempFx);
-                }
-                else
-                {
-                    GaussianField(posx,posy,rmsRxTemp,rmsRyTemp,tempFx,tempFy);
-                }
-            }
-
-            latticeInterActionPoint.ionAccumuFx[k][p][j]= coeffI*tempFx;                  //[1/m] * [m * m/s] - > [m/s]; -> (13) integrate along dt gives ion velovity change
-            latticeInterActionPoint.ionAccumuFy[k][p][j]= coeffI*tempFy;
-
-            eFxTemp +=  tempFx;
-            eFyTemp +=  tempFy;
+            ion.fx[j]= coeffI*tempFx[j];                  //[1/m] * [m * m/s] - > [m/s]; -> (13) integrate along dt gives ion velovity change
+            ion.fy[j]= coeffI*tempFy[j];
+
+            eFxTemp +=  tempFx[j];
+            eFyTemp +=  tempFy[j];
         }
 
         eFxDueToIon[0] += -1*eFxTemp * coeffE * nI0;                                      // since the e and ion with opposite charge state  [1/m * m ]-> [rad]  integrage (12) along ds -- beam dpx change.
@@ -0,0 +1,140 @@
+//*************************************************************************
+//Copyright (c) 2020 IHEP                                                  
+//Copyright (c) 2021 DESY                                                  
+//This program is free software; you can redistribute it and/or modify     
+//it under the terms of the GNU General Public License                     
+//Author: chao li, li.chao@desy.de                                         
+//*************************************************************************
+
+#include "TrackingPipeline.h"
+#include "Global.h"
+#include <chrono>
+#include <iostream>
+#include <iomanip>
+#include <sys/resource.h>
+#ifdef MPIMODE
+#include <mpi.h>
+#endif
+
+using namespace std;
+
+
+void TrackingPipeline::Add(const string &name, StageFunc func)
+{
+    int column = 0;
+    while(column<int(names.size()) && names[column]!=name) column++;
+    if(column==int(names.size())) names.push_back(name);
+
+    Stage stage = {name, func, 0.E0, column};
+    stages.push_back(stage);
+}
+
+void TrackingPipeline::Profile(const ReadInputSettings &inputParameter, int turnNum)
+{
+    level = inputParameter.ringRun->profileFlag;
+    if(level==0) return;
+
+    turnSeconds.assign(names.size(),0.E0);
+
+    // stage names as SDDS column names: blanks and dashes to '_'
+    fout.DefineColumn("Turns","",SDDSWriter::LONG);
+    for(size_t i=0;i<names.size();i++)
+    {
+        string column = names[i];
+        for(size_t j=0;j<column.size();j++) if(column[j]==' ' || column[j]=='-') column[j] = '_';
+        fout.DefineColumn(column,"ms",SDDSWriter::DOUBLE);
+    }
+    fout.DefineColumn("TurnTime","ms",SDDSWriter::DOUBLE);
+    fout.DefineColumn("PeakMemory","MB",SDDSWriter::DOUBLE);
+
+    if(myRank==0)
+    {
+        fout.Open(inputParameter.ringRun->profileFile + ".sdds",inputParameter.ringRun->sddsBinary);
+        fout.StartPage(turnNum);
+    }
+}
+
+void TrackingPipeline::Run(int turn)
+{
+    if(level==0)
+    {
+        for(size_t i=0;i<stages.size();i++) stages[i].func(turn);
+        turns++;
+        return;
+    }
+
+    for(size_t i=0;i<turnSeconds.size();i++) turnSeconds[i] = 0.E0;
+    for(size_t i=0;i<stages.size();i++)
+    {
+        auto start = chrono::steady_clock::now();
+        stages[i].func(turn);
+        double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stages[i].seconds               += seconds;
+        turnSeconds[stages[i].column]   += seconds;
+    }
+    turns++;
+
+    if(!fout.IsOpen()) return;
+    double turnTime = 0.E0;
+    fout.Put(turn);
+    for(size_t i=0;i<turnSeconds.size();i++)
+    {
+        fout.Put(turnSeconds[i] * 1.E3);
+        turnTime += turnSeconds[i];
+    }
+    fout.Put(turnTime * 1.E3);
+    fout.Put(PeakMemory());
+}
+
+double TrackingPipeline::GetStageTime(const string &name) const
+{
+    double seconds = 0.E0;
+    for(size_t i=0;i<stages.size();i++)
+    {
+        if(stages[i].name==name) seconds += stages[i].seconds;
+    }
+    return seconds;
+}
+
+double TrackingPipeline::PeakMemory()
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF,&usage);
+    return usage.ru_maxrss / 1024.E0;          // ru_maxrss in kB on linux
+}
+
+void TrackingPipeline::TimingReport()
+{
+    if(level==0) return;
+    fout.Close();
+
+    vector<double> seconds(names.size());
+    for(size_t j=0;j<names.size();j++) seconds[j] = GetStageTime(names[j]);
+    double memory    = PeakMemory();
+    double memoryAll = memory;
+
+#ifdef MPIMODE
+    // the slowest rank per stage, the memory of all ranks
+    MPI_Allreduce(MPI_IN_PLACE,seconds.data(),seconds.size(),MPI_DOUBLE,MPI_MAX,MPI_COMM_WORLD);
+    MPI_Allreduce(&memory,&memoryAll,1,MPI_DOUBLE,MPI_SUM,MPI_COMM_WORLD);
+#endif
+
+    double total = 0.E0;
+    for(size_t j=0;j<names.size();j++) total += seconds[j];
+
+    cout<<"tracking stages, "<<turns<<" turns"<<endl;
+    cout<<setw(28)<<left<<"stage"<<setw(16)<<left<<"time [s]"<<setw(16)<<left<<"ms/turn"<<setw(10)<<left<<"share [%]"<<endl;
+    for(size_t j=0;j<names.size();j++)
+    {
+        cout<<setw(28)<<left<<names[j]
+            <<setw(16)<<left<<seconds[j]
+            <<setw(16)<<left<<(turns ? seconds[j] / turns * 1.E3 : 0.E0)
+            <<setw(10)<<left<<(total>0 ? seconds[j] / total * 100 : 0.E0)<<endl;
+    }
+    cout<<setw(28)<<left<<"total"
+        <<setw(16)<<left<<total
+        <<setw(16)<<left<<(turns ? total / turns * 1.E3 : 0.E0)<<endl;
+    cout<<"peak memory: "<<memory<<" MB";
+    if(numProcess>1) cout<<", all ranks "<<memoryAll<<" MB";
+    cout<<endl;
+}
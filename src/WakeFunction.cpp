@@ -16,6 +16,7 @@
 #include <cmath>
 #include <stdio.h>
 #include "WakeFunction.h"
+#include "FFTWPlanCache.h"
 #include <gsl/gsl_matrix.h> 
 #include <gsl/gsl_sf_gamma.h>
 #include <gsl/gsl_sf_hyperg.h>
@@ -44,6 +45,7 @@ WakeFunction::WakeFunction()
 
 WakeFunction::~WakeFunction()
 {   
+    for(auto &it : srWakeGreenTable) delete it.second;
 }
 
 void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint)
@@ -79,6 +81,8 @@ void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const L
         }
     }
 
+    lrwHistHead = nTurnswakeTrunction - 1;
+
     if(!inputParameter.ringLRWake->pipeGeoInput.empty())
     {    
         RWWakeParaReadIn(inputParameter.ringLRWake->pipeGeoInput);
@@ -87,6 +91,9 @@ void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const L
     {    
         BBRWakeParaReadIn(inputParameter.ringLRWake->bbrInput);    
     }
+
+    lrwRecursion = inputParameter.ringLRWake->recursion;
+    if(lrwRecursion) InitialLRWakeRecursion();
     
     double trf = inputParameter.ringParBasic->t0 / inputParameter.ringParBasic->harmonics;
     int turns = inputParameter.ringLRWake->nTurnswakeTrunction;
@@ -100,7 +107,8 @@ void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const L
     v1d lwakeTemp = v1d(3, 0.E0); 
 	
 	string output = inputParameter.ringLRWake->lrwOutput;
-    ofstream fout(output);
+    ofstream fout;
+    if(myRank==0) fout.open(output);        // same table on every MPI rank, written once
     fout<<"SDDS1"<<endl;
     fout<<"&column name=time,                    units=s,      type=float,  &end"<<endl;
 
@@ -140,9 +148,10 @@ void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const L
             }
         }
 		
+		// with the phasor recursion the table only carries the resistive wall part (ring buffer sum)
 		for(int j=0;j<3;++j)
 		{
-			lwakesTot[j][i] = lwakesBBR[i][j] + lwakesRW[i][j];
+			lwakesTot[j][i] = lrwRecursion ? lwakesRW[i][j] : lwakesBBR[i][j] + lwakesRW[i][j];
 		}
 
     
@@ -202,6 +211,13 @@ void WakeFunction::InitialLRWake(const ReadInputSettings &inputParameter,const L
    
 }
 vector<double> WakeFunction::GetTotLRWakeLinearFit(double tau)
+{
+	vector<double> lwake(3,0.E0);
+	GetTotLRWakeLinearFit(tau,lwake.data());
+	return lwake;
+}
+
+void WakeFunction::GetTotLRWakeLinearFit(double tau, double *lwake)
 {
 	if(tau>0)
     {
@@ -214,20 +230,93 @@ vector<double> WakeFunction::GetTotLRWakeLinearFit(double tau)
 	v1 = -tau / dt - index;
 	v0 = 1 - v1;
 	
-	//cout<<v0<<"	"<<v1<<endl;
-	vector<double> lwake(3,0.E0);
 	for(int i=0;i<3;++i)
 	{
 		lwake[i] = lwakesTot[i][index] * v0 +  lwakesTot[i][index + 1] * v1;
 	}
-	
-	
-	//getchar();
-	return lwake;
-	
-	
 }
 
+void WakeFunction::LRWakeHistPush()
+{
+    lrwHistHead = (lrwHistHead + 1) % posxData.size();
+}
+
+void WakeFunction::InitialLRWakeRecursion()
+{
+    // same mode parameters and signs as GetBBRWakeFun (Alex Chao Eq. 2.84 and 2.88)
+    //   x,y: c Rs omega / Q / omegab / beta * exp(alpha tau) sin(omegab tau) = Re( -i K exp(rate tau) )
+    //   z  : 2 alpha Rs exp(alpha tau) (cos(omegab tau) + alpha/omegab sin(omegab tau)) = Re( 2 alpha Rs (1 - i alpha/omegab) exp(rate tau) )
+    double alpha,omegab;
+    for(int p=0;p<3;p++)
+    {
+        lrwRate[p].clear();
+        lrwCoeff[p].clear();
+    }
+
+    for(int i=0;i<txRs.size();i++)
+    {
+        alpha  =  txOmega[i] / 2.0 / txQ[i];
+        omegab =  sqrt( pow(txOmega[i],2) - pow(alpha,2) );
+        lrwRate[0] .push_back(complex<double>(alpha,omegab));
+        lrwCoeff[0].push_back(-li * CLight * txRs[i] * txOmega[i] / txQ[i] / omegab / betaFunIntPoint[0]);
+
+        alpha  =  tyOmega[i] / 2.0 / tyQ[i];
+        omegab =  sqrt( pow(tyOmega[i],2) - pow(alpha,2) );
+        lrwRate[1] .push_back(complex<double>(alpha,omegab));
+        lrwCoeff[1].push_back(-li * CLight * tyRs[i] * tyOmega[i] / tyQ[i] / omegab / betaFunIntPoint[1]);
+    }
+
+    for(int i=0;i<lRs.size();i++)
+    {
+        alpha  =  lOmega[i] / 2.0 / lQ[i];
+        omegab =  sqrt( pow(lOmega[i],2) - pow(alpha,2) );
+        lrwRate[2] .push_back(complex<double>(alpha,omegab));
+        lrwCoeff[2].push_back(2 * alpha * lRs[i] * (1.0 - li * alpha / omegab));
+    }
+
+    for(int p=0;p<3;p++) lrwPhasor[p].assign(lrwRate[p].size(),complex<double>(0.E0,0.E0));
+    lrwTime = 0.E0;
+}
+
+void WakeFunction::LRWakeRecursion(double t, double electronNum, double posx, double posy, double *wakeSum)
+{
+    // bunch passage at time t [s] (relative to the current turn start, non-decreasing between calls):
+    // wakeSum[p] = sum_k W_p(t_k - t) N_k d_k over all earlier passages, the same sum the table approach does up to its truncation.
+    // The own passage is added after the kick, so the self wake of the current turn is excluded as in LRWakeBeamIntaction.
+    double d[3] = {posx, posy, 1.E0};
+
+    for(int p=0;p<3;p++)
+    {
+        wakeSum[p] = 0.E0;
+        for(int m=0;m<lrwRate[p].size();m++)
+        {
+            lrwPhasor[p][m] *= exp( - lrwRate[p][m] * (t - lrwTime) );
+            wakeSum[p]      += ( lrwCoeff[p][m] * lrwPhasor[p][m] ).real();
+            lrwPhasor[p][m] += electronNum * d[p];
+        }
+    }
+    lrwTime = t;
+}
+
+void WakeFunction::SaveLRWakeState(Checkpoint &checkpoint) const
+{
+    checkpoint.Put(posxData);
+    checkpoint.Put(posyData);
+    checkpoint.Put(poszData);
+    checkpoint.Put(lrwHistHead);
+    checkpoint.Put(lrwTime);
+    for(int p=0;p<3;p++) checkpoint.Put(lrwPhasor[p]);
+}
+
+void WakeFunction::LoadLRWakeState(Checkpoint &checkpoint)
+{
+    checkpoint.Get(posxData);
+    checkpoint.Get(posyData);
+    checkpoint.Get(poszData);
+    checkpoint.Get(lrwHistHead);
+    checkpoint.Get(lrwTime);
+    for(int p=0;p<3;p++) checkpoint.Get(lrwPhasor[p]);
+}
 
 void WakeFunction::InitialSRWake(const ReadInputSettings &inputParameter,const LatticeInterActionPoint &latticeInterActionPoint)
 {
@@ -652,6 +741,105 @@ vector<double> WakeFunction::GetBBRWakeFun1(double tau)
 }
 
 
+// The bin length is rounded up onto a geometric ladder dtRef * 2^(k/srWakeBinLadder), so that bunches with slightly different
+// lengths (and the same bunch over many turns) share one table. The coarsening is below 2^(1/16)-1 ~ 4.4%.
+static const double srWakeBinRef    = 1.E-15;     // [s]
+static const int    srWakeBinLadder = 16;
+
+const WakeFunction::SRWakeGreenTable *WakeFunction::GetSRWakeGreenTable(int nBin, double dtBin)
+{
+    int k = int( ceil( log2(dtBin / srWakeBinRef) * srWakeBinLadder ) );
+    SRWakeGreenTable *table;
+
+    // bunches call this from the OpenMP loop in MPBeam::SRWakeBeamIntaction
+    #pragma omp critical(srWakeGreenTable)
+    {
+        auto it = srWakeGreenTable.find(make_pair(nBin,k));
+        if(it != srWakeGreenTable.end())
+        {
+            table = it->second;
+        }
+        else
+        {
+            table = new SRWakeGreenTable;
+            table->nBin  = nBin;
+            table->dtBin = srWakeBinRef * pow(2.0, double(k) / srWakeBinLadder);
+            table->nFFT  = 1;
+            while(table->nFFT < 2 * nBin) table->nFFT *= 2;
+
+            int nFFT = table->nFFT;
+            double       *r2cin  = (double*)       fftw_malloc(sizeof(double)       * nFFT);
+            fftw_complex *r2cout = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nFFT/2+1));
+            fftw_plan planR2C    = FFTWPlanCache::GetPlanR2C(nFFT);
+            FFTWPlanCache::GetPlanC2R(nFFT);
+
+            // G(tau) on lags m = -(nBin-1)...(nBin-1); negative lags wrap to the end of the padded grid. 
+            // RW and BBR parameters are only filled when the corresponding input file is given, otherwise they contribute zero.
+            vector<vector<double> > green(3,vector<double>(nFFT,0.E0));
+            vector<double> wakeFun;
+            for(int m=-(nBin-1);m<nBin;m++)
+            {
+                double tau = m * table->dtBin;
+                int index  = m >= 0 ? m : m + nFFT;
+                wakeFun = GetRWSRWakeFun(tau);
+                for(int p=0;p<3;p++) green[p][index] += wakeFun[p];
+                wakeFun = GetBBRWakeFun1(tau);
+                for(int p=0;p<3;p++) green[p][index] += wakeFun[p];
+            }
+
+            for(int p=0;p<3;p++)
+            {
+                for(int i=0;i<nFFT;i++) r2cin[i] = green[p][i];
+                fftw_execute_dft_r2c(planR2C, r2cin, r2cout);
+                table->kernelFFT[p].resize(nFFT/2+1);
+                for(int i=0;i<nFFT/2+1;i++) table->kernelFFT[p][i] = complex<double>(r2cout[i][0],r2cout[i][1]) / double(nFFT);
+            }
+
+            fftw_free(r2cin);
+            fftw_free(r2cout);
+            srWakeGreenTable[make_pair(nBin,k)] = table;
+        }
+    }
+
+    return table;
+}
+
+void WakeFunction::SRWakeConvolution(const SRWakeGreenTable *table, const vector<double> &lineDensity, const vector<double> &dipoleX, const vector<double> &dipoleY, vector<vector<double> > &wakePoten)
+{
+    // wakePoten[p][i] = sum_j G_p((i-j)*dtBin) * source_p[j], source = (N*<x>, N*<y>, N) per bin. 
+    // Only new-array execute is used on the plans of FFTWPlanCache, which is thread safe.
+    int nBin = table->nBin;
+    int nFFT = table->nFFT;
+    const vector<double> *source[3] = {&dipoleX, &dipoleY, &lineDensity};
+
+    double       *r2cin  = (double*)       fftw_malloc(sizeof(double)       * nFFT);
+    fftw_complex *r2cout = (fftw_complex*) fftw_malloc(sizeof(fftw_complex) * (nFFT/2+1));
+    fftw_plan planR2C    = FFTWPlanCache::GetPlanR2C(nFFT);
+    fftw_plan planC2R    = FFTWPlanCache::GetPlanC2R(nFFT);
+
+    for(int p=0;p<3;p++)
+    {
+        for(int i=0;i<nBin;i++)    r2cin[i] = (*source[p])[i];
+        for(int i=nBin;i<nFFT;i++) r2cin[i] = 0.E0;
+        fftw_execute_dft_r2c(planR2C, r2cin, r2cout);
+
+        for(int i=0;i<nFFT/2+1;i++)
+        {
+            complex<double> temp = complex<double>(r2cout[i][0],r2cout[i][1]) * table->kernelFFT[p][i];
+            r2cout[i][0] = temp.real();
+            r2cout[i][1] = temp.imag();
+        }
+        fftw_execute_dft_c2r(planC2R, r2cout, r2cin);
+
+        wakePoten[p].resize(nBin);
+        for(int i=0;i<nBin;i++) wakePoten[p][i] = r2cin[i];
+    }
+
+    fftw_free(r2cin);
+    fftw_free(r2cout);
+}
+
+
 vector<double> WakeFunction::GetBBRWakeFun(double tau)     // requires tau < 0;
 {
     // longitudinal wake funciton, Refer to Alex 2.82 and 2.84 and 2.87 and 2.88    
@@ -8,7 +8,9 @@
 #pragma once                                                             
 #include <stdio.h>
 #include <string.h>
-//#include "mpi.h"
+#ifdef MPIMODE
+#include <mpi.h>
+#endif
 #include <iomanip>
 #include <fstream>
 #include <stdlib.h>
@@ -25,6 +27,9 @@
 #include "CavityResonator.h"
 #include "SPBeam.h"
 #include "MPBeam.h"
+#include "FFTWPlanCache.h"
+#include "BassettiErskineField.h"
+#include "RandomStream.h"
 
 
 using namespace std;
@@ -34,11 +39,13 @@ using std::complex;
 int main(int argc,char *argv[])
 {
 
-//    MPI_Init(&argc,&argv);
-//    MPI_Status status;
-
-//    MPI_Comm_size(MPI_COMM_WORLD,&numProcess);
-//    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+#ifdef MPIMODE
+    // bunches of MPBeam are distributed over the ranks, see MPBeam::Initial
+    MPI_Init(&argc,&argv);
+    MPI_Comm_size(MPI_COMM_WORLD,&numProcess);
+    MPI_Comm_rank(MPI_COMM_WORLD,&myRank);
+    if(myRank!=0) cout.setstate(ios_base::failbit);     // screen output from rank 0 only
+#endif
 
     /*
     int num=omp_get_max_threads();
@@ -56,6 +63,19 @@ int main(int argc,char *argv[])
     ReadInputSettings inputParameter;
     inputParameter.ParamRead(argc, argv);
 
+#ifdef _OPENMP
+    // threads used by the bunch-parallel stages in MPBeam::Run, runThreads = 0 keeps the OpenMP default (OMP_NUM_THREADS)
+    if(inputParameter.ringRun->threads > 0) omp_set_num_threads(inputParameter.ringRun->threads);
+    cout<<"OpenMP threads: "<<omp_get_max_threads()<<endl;
+#endif
+#ifdef MPIMODE
+    cout<<"MPI ranks: "<<numProcess<<endl;
+#endif
+
+    FFTWPlanCache::Initial(inputParameter);
+    BassettiErskineField::Initial(inputParameter);
+    RandomStream::Initial(inputParameter);
+
     LatticeInterActionPoint latticeInterActionPoint;
     latticeInterActionPoint.Initial(inputParameter);
     latticeInterActionPoint.SetLatticeParaForOneTurnMap(inputParameter);
@@ -70,6 +90,11 @@ int main(int argc,char *argv[])
 
     if(inputParameter.ringRun->calSetting==1 && inputParameter.ringBunchPara->macroEleNumPerBunch==1)   // bunch is rigid represneted by only single particle...
     {        
+        if(numProcess>1)
+        {
+            cerr<<"SP tracking (calSetting=1) runs on a single MPI rank"<<endl;
+            exit(0);
+        }
         SPBeam spbeam;
         
         spbeam.Initial(train,latticeInterActionPoint,inputParameter);
@@ -91,6 +116,8 @@ int main(int argc,char *argv[])
         exit(0);
     }
     
+    if(myRank==0) FFTWPlanCache::ExportWisdom();
+    FFTWPlanCache::Clear();
 
     struct timeval t1;
     gettimeofday(&t1, NULL); 
@@ -98,7 +125,8 @@ int main(int argc,char *argv[])
     long int ms = (t1.tv_sec - t0.tv_sec) * 1000 + (t1.tv_usec -t0.tv_usec) / 1000;
     cout<<ms/1000.00<<" seconds"<<endl;
 
-
-//    MPI_Finalize();
+#ifdef MPIMODE
+    MPI_Finalize();
+#endif
     return 0;
 }